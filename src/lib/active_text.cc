@@ -22,49 +22,99 @@
 #include "text_content.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <vector>
 
 using std::list;
 using std::pair;
 using std::make_pair;
+using std::vector;
 using boost::weak_ptr;
 using boost::shared_ptr;
 using boost::optional;
 
+ActiveText::ActiveText ()
+	: _next_sequence (0)
+{
+
+}
+
 /** Get the open captions that should be burnt into a given period.
  *  @param period Period of interest.
  *  @param always_burn_captions Always burn captions even if their content is not set to burn.
+ *  @return Captions from each piece of content in turn, each in the order that they were added.
  */
 list<PlayerText>
 ActiveText::get_burnt (DCPTimePeriod period, bool always_burn_captions) const
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	list<PlayerText> ps;
-
-	for (Map::const_iterator i = _data.begin(); i != _data.end(); ++i) {
+	vector<Periods::const_iterator> found;
 
-		shared_ptr<const TextContent> caption = i->first.lock ();
-		if (!caption) {
-			continue;
+	/* Anything starting at or after the end of the period can't overlap it, and nothing
+	   with a to time which starts more than the longest such period before it can reach it.
+	*/
+	DCPTime const longest = _lengths.empty() ? DCPTime() : *_lengths.rbegin();
+	Periods::const_iterator const end = _periods.lower_bound (period.to);
+	for (Periods::const_iterator i = _periods.lower_bound (period.from - longest); i != end; ++i) {
+		if (i->second.to && burnt (i, period, always_burn_captions)) {
+			found.push_back (i);
 		}
+	}
 
-		if (!caption->use() || (!always_burn_captions && !caption->burn())) {
-			/* Not burning this content */
-			continue;
+	/* Periods without a to time could have started any time before */
+	BOOST_FOREACH (Periods::iterator i, _open) {
+		if (i->first < period.to && burnt (i, period, always_burn_captions)) {
+			found.push_back (i);
 		}
+	}
 
-		BOOST_FOREACH (Period j, i->second) {
-			DCPTimePeriod test (j.from, j.to.get_value_or(DCPTime::max()));
-			optional<DCPTimePeriod> overlap = period.overlap (test);
-			if (overlap && overlap->duration() > DCPTime(period.duration().get() / 2)) {
-				ps.push_back (j.subs);
-			}
-		}
+	/* Captions are stacked in the order that we give them, so keep that the same as it has always been */
+	sort (found.begin(), found.end(), &ActiveText::burn_order);
+
+	list<PlayerText> ps;
+	BOOST_FOREACH (Periods::const_iterator i, found) {
+		ps.push_back (i->second.subs);
 	}
 
 	return ps;
 }
 
+/** @return true if the subtitles in a period of ours should be burnt into a given period */
+bool
+ActiveText::burnt (Periods::const_iterator i, DCPTimePeriod period, bool always_burn_captions) const
+{
+	shared_ptr<const TextContent> caption = i->second.content.lock ();
+	if (!caption) {
+		return false;
+	}
+
+	if (!caption->use() || (!always_burn_captions && !caption->burn())) {
+		/* Not burning this content */
+		return false;
+	}
+
+	DCPTimePeriod test (i->first, i->second.to.get_value_or(DCPTime::max()));
+	optional<DCPTimePeriod> overlap = period.overlap (test);
+	return overlap && overlap->duration() > DCPTime(period.duration().get() / 2);
+}
+
+/** @return true if a should be burnt before b; i.e. a's content comes first in _data, or they
+ *  are from the same content and a was added first.
+ */
+bool
+ActiveText::burn_order (Periods::const_iterator a, Periods::const_iterator b)
+{
+	if (a->second.content < b->second.content) {
+		return true;
+	} else if (b->second.content < a->second.content) {
+		return false;
+	}
+
+	return a->second.sequence < b->second.sequence;
+}
+
 /** Remove subtitles that finish before a given time from our list.
  *  @param time Time to remove before.
  */
@@ -73,19 +123,20 @@ ActiveText::clear_before (DCPTime time)
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	Map updated;
-	for (Map::const_iterator i = _data.begin(); i != _data.end(); ++i) {
-		list<Period> as;
-		BOOST_FOREACH (Period j, i->second) {
-			if (!j.to || j.to.get() >= time) {
-				as.push_back (j);
-			}
-		}
-		if (!as.empty ()) {
-			updated[i->first] = as;
+	while (!_ends.empty() && _ends.begin()->first < time) {
+		Periods::iterator i = _ends.begin()->second;
+		_ends.erase (_ends.begin());
+		_lengths.erase (_lengths.find (*i->second.to - i->first));
+
+		Map::iterator j = _data.find (i->second.content);
+		DCPOMATIC_ASSERT (j != _data.end());
+		j->second.remove (i);
+		if (j->second.empty()) {
+			_data.erase (j);
 		}
+
+		_periods.erase (i);
 	}
-	_data = updated;
 }
 
 /** Add a new subtitle with a from time.
@@ -98,10 +149,9 @@ ActiveText::add_from (weak_ptr<const TextContent> content, PlayerText ps, DCPTim
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	if (_data.find(content) == _data.end()) {
-		_data[content] = list<Period>();
-	}
-	_data[content].push_back (Period (ps, from));
+	Periods::iterator i = _periods.insert (make_pair(from, Period(content, ps, _next_sequence++)));
+	_data[content].push_back (i);
+	_open.push_back (i);
 }
 
 /** Add the to time for the last subtitle added from a piece of content.
@@ -114,15 +164,39 @@ ActiveText::add_to (weak_ptr<const TextContent> content, DCPTime to)
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	DCPOMATIC_ASSERT (_data.find(content) != _data.end());
+	Map::iterator i = _data.find (content);
+	DCPOMATIC_ASSERT (i != _data.end() && !i->second.empty());
+
+	Periods::iterator last = i->second.back();
+	remove_end (last);
+	_open.remove (last);
+	last->second.to = to;
+	_ends.insert (make_pair(to, last));
+	_lengths.insert (to - last->first);
+
+	BOOST_FOREACH (StringText& j, last->second.subs.string) {
+		j.set_out (dcp::Time(to.seconds(), 1000));
+	}
 
-	_data[content].back().to = to;
+	return make_pair (last->second.subs, last->first);
+}
 
-	BOOST_FOREACH (StringText& i, _data[content].back().subs.string) {
-		i.set_out (dcp::Time(to.seconds(), 1000));
+/** Remove any entry for a period from _ends */
+void
+ActiveText::remove_end (Periods::iterator period)
+{
+	if (!period->second.to) {
+		return;
 	}
 
-	return make_pair (_data[content].back().subs, _data[content].back().from);
+	pair<Ends::iterator, Ends::iterator> range = _ends.equal_range (*period->second.to);
+	for (Ends::iterator i = range.first; i != range.second; ++i) {
+		if (i->second == period) {
+			_ends.erase (i);
+			_lengths.erase (_lengths.find (*period->second.to - period->first));
+			return;
+		}
+	}
 }
 
 /** @param content Some content.
@@ -146,4 +220,8 @@ ActiveText::clear ()
 {
 	boost::mutex::scoped_lock lm (_mutex);
 	_data.clear ();
+	_ends.clear ();
+	_open.clear ();
+	_periods.clear ();
+	_lengths.clear ();
 }
@@ -26,8 +26,10 @@
 #include "player_text.h"
 #include <boost/noncopyable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <stdint.h>
 #include <list>
 #include <map>
+#include <set>
 
 class TextContent;
 
@@ -37,6 +39,8 @@ class TextContent;
 class ActiveText : public boost::noncopyable
 {
 public:
+	ActiveText ();
+
 	std::list<PlayerText> get_burnt (DCPTimePeriod period, bool always_burn_captions) const;
 	void clear_before (DCPTime time);
 	void clear ();
@@ -50,18 +54,39 @@ private:
 	public:
 		Period () {}
 
-		Period (PlayerText s, DCPTime f)
-			: subs (s)
-			, from (f)
+		Period (boost::weak_ptr<const TextContent> c, PlayerText s, uint64_t q)
+			: content (c)
+			, subs (s)
+			, sequence (q)
 		{}
 
+		boost::weak_ptr<const TextContent> content;
 		PlayerText subs;
-		DCPTime from;
 		boost::optional<DCPTime> to;
+		/** number which increases with each period that is added */
+		uint64_t sequence;
 	};
 
-	typedef std::map<boost::weak_ptr<const TextContent>, std::list<Period> > Map;
+	/** All our periods, keyed by their from time */
+	typedef std::multimap<DCPTime, Period> Periods;
+
+	void remove_end (Periods::iterator period);
+	bool burnt (Periods::const_iterator i, DCPTimePeriod period, bool always_burn_captions) const;
+	static bool burn_order (Periods::const_iterator a, Periods::const_iterator b);
 
 	mutable boost::mutex _mutex;
+	Periods _periods;
+	/** Periods which have a to time, keyed by that time */
+	typedef std::multimap<DCPTime, Periods::iterator> Ends;
+	Ends _ends;
+	/** Periods which do not yet have a to time */
+	std::list<Periods::iterator> _open;
+	/** lengths of the periods in _ends, so that we know how far back to look for periods
+	 *  which might still be active.
+	 */
+	std::multiset<DCPTime> _lengths;
+	uint64_t _next_sequence;
+	/** Periods from each piece of content, in the order that they were added */
+	typedef std::map<boost::weak_ptr<const TextContent>, std::list<Periods::iterator> > Map;
 	Map _data;
 };
@@ -0,0 +1,124 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "binary_metadata.h"
+#include "exceptions.h"
+#include <cstring>
+
+#include "i18n.h"
+
+void
+BinaryWriter::write_uint8 (uint8_t v)
+{
+	_data.push_back (v);
+}
+
+void
+BinaryWriter::write_uint32 (uint32_t v)
+{
+	for (int i = 0; i < 4; ++i) {
+		_data.push_back (v & 0xff);
+		v >>= 8;
+	}
+}
+
+void
+BinaryWriter::write_int32 (int32_t v)
+{
+	write_uint32 (static_cast<uint32_t> (v));
+}
+
+void
+BinaryWriter::write_double (double v)
+{
+	uint64_t bits;
+	memcpy (&bits, &v, sizeof (bits));
+	for (int i = 0; i < 8; ++i) {
+		_data.push_back (bits & 0xff);
+		bits >>= 8;
+	}
+}
+
+void
+BinaryWriter::write_bool (bool v)
+{
+	write_uint8 (v ? 1 : 0);
+}
+
+BinaryReader::BinaryReader (uint8_t const * data, int size)
+	: _data (data)
+	, _size (size)
+	, _position (0)
+{
+
+}
+
+void
+BinaryReader::check (int n) const
+{
+	if ((_position + n) > _size) {
+		throw NetworkError (_("Badly-formed binary metadata"));
+	}
+}
+
+uint8_t
+BinaryReader::read_uint8 ()
+{
+	check (1);
+	return _data[_position++];
+}
+
+uint32_t
+BinaryReader::read_uint32 ()
+{
+	check (4);
+	uint32_t v = 0;
+	for (int i = 3; i >= 0; --i) {
+		v = (v << 8) | _data[_position + i];
+	}
+	_position += 4;
+	return v;
+}
+
+int32_t
+BinaryReader::read_int32 ()
+{
+	return static_cast<int32_t> (read_uint32 ());
+}
+
+double
+BinaryReader::read_double ()
+{
+	check (8);
+	uint64_t bits = 0;
+	for (int i = 7; i >= 0; --i) {
+		bits = (bits << 8) | _data[_position + i];
+	}
+	_position += 8;
+	double v;
+	memcpy (&v, &bits, sizeof (v));
+	return v;
+}
+
+bool
+BinaryReader::read_bool ()
+{
+	return read_uint8 () != 0;
+}
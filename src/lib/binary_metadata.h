@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_BINARY_METADATA_H
+#define DCPOMATIC_BINARY_METADATA_H
+
+/** @file  src/lib/binary_metadata.h
+ *  @brief BinaryWriter and BinaryReader classes.
+ */
+
+#include <boost/noncopyable.hpp>
+#include <vector>
+#include <stdint.h>
+
+/** @class BinaryWriter
+ *  @brief Builder for compact binary metadata, as an alternative to XML where
+ *  parsing and serialising would cost too much.
+ *
+ *  Everything is written little-endian; doubles are written as their IEEE-754 bits.
+ */
+class BinaryWriter : public boost::noncopyable
+{
+public:
+	void write_uint8 (uint8_t v);
+	void write_uint32 (uint32_t v);
+	void write_int32 (int32_t v);
+	void write_double (double v);
+	void write_bool (bool v);
+
+	uint8_t const * data () const {
+		return _data.empty() ? 0 : &_data[0];
+	}
+
+	int size () const {
+		return _data.size ();
+	}
+
+private:
+	std::vector<uint8_t> _data;
+};
+
+/** @class BinaryReader
+ *  @brief Reader for metadata written by a BinaryWriter.
+ *
+ *  The read methods throw NetworkError if there is not enough data left.
+ */
+class BinaryReader : public boost::noncopyable
+{
+public:
+	BinaryReader (uint8_t const * data, int size);
+
+	uint8_t read_uint8 ();
+	uint32_t read_uint32 ();
+	int32_t read_int32 ();
+	double read_double ();
+	bool read_bool ();
+
+private:
+	void check (int n) const;
+
+	uint8_t const * _data;
+	int _size;
+	int _position;
+};
+
+#endif
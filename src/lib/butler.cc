@@ -26,6 +26,8 @@
 #include "cross.h"
 #include "compose.hpp"
 #include "exceptions.h"
+#include "image_pool.h"
+#include "seek_cache.h"
 #include <boost/weak_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -33,6 +35,7 @@ using std::cout;
 using std::pair;
 using std::make_pair;
 using std::string;
+using std::list;
 using boost::weak_ptr;
 using boost::shared_ptr;
 using boost::bind;
@@ -269,12 +272,38 @@ Butler::seek_unlocked (DCPTime position, bool accurate)
 	_finished = false;
 	_pending_seek_position = position;
 	_pending_seek_accurate = accurate;
+	_prefetch_to = optional<DCPTime> ();
+	_cached_to = optional<DCPTime> ();
 
 	{
 		boost::mutex::scoped_lock lm (_buffers_mutex);
 		_video.clear ();
 		_audio.clear ();
 		_closed_caption.clear ();
+
+		if (_seek_cache && accurate) {
+			/* Give out what we already have for this position straight away; the player will
+			   still be seeked so that it carries on from there.
+			*/
+			list<pair<shared_ptr<PlayerVideo>, DCPTime> > cached = _seek_cache->get (position);
+			for (list<pair<shared_ptr<PlayerVideo>, DCPTime> >::const_iterator i = cached.begin(); i != cached.end(); ++i) {
+				_video.put (i->first, i->second);
+				_cached_to = i->second;
+			}
+
+			/* Start the player a little early so that the frames just before `position' end up in the
+			   cache, ready for a scrub back.
+			*/
+			DCPTime const from = _seek_cache->prefetch_from (position);
+			if (from < position) {
+				_pending_seek_position = from;
+				_prefetch_to = position;
+			}
+		}
+	}
+
+	if (_cached_to) {
+		_arrived.notify_all ();
 	}
 
 	_summon.notify_all ();
@@ -311,6 +340,15 @@ Butler::video (shared_ptr<PlayerVideo> video, DCPTime time)
 
 	_prepare_service.post (bind (&Butler::prepare, this, weak_ptr<PlayerVideo>(video)));
 
+	if (_seek_cache) {
+		_seek_cache->put (video, time);
+	}
+
+	if ((_prefetch_to && time < *_prefetch_to) || (_cached_to && time <= *_cached_to)) {
+		/* We only wanted this for the cache, or we already took it from there */
+		return;
+	}
+
 	boost::mutex::scoped_lock lm2 (_buffers_mutex);
 	_video.put (video, time);
 }
@@ -318,16 +356,34 @@ Butler::video (shared_ptr<PlayerVideo> video, DCPTime time)
 void
 Butler::audio (shared_ptr<AudioBuffers> audio, DCPTime time, int frame_rate)
 {
+	optional<DCPTime> prefetch_to;
+
 	{
 		boost::mutex::scoped_lock lm (_mutex);
 		if (_pending_seek_position || _disable_audio) {
 			/* Don't store any audio in these cases */
 			return;
 		}
+		prefetch_to = _prefetch_to;
+	}
+
+	Frame discard = 0;
+	if (prefetch_to && time < *prefetch_to) {
+		/* The player was started early to fill the seek cache; drop the audio from before where we were asked to seek to */
+		discard = (*prefetch_to - time).frames_round (frame_rate);
+		if (discard >= audio->frames()) {
+			return;
+		}
+	}
+
+	shared_ptr<AudioBuffers> mapped = remap (audio, _audio_channels, _audio_mapping);
+	if (discard) {
+		mapped->trim_start (discard);
+		time += DCPTime::from_frames (discard, frame_rate);
 	}
 
 	boost::mutex::scoped_lock lm2 (_buffers_mutex);
-	_audio.put (remap (audio, _audio_channels, _audio_mapping), time, frame_rate);
+	_audio.put (mapped, time, frame_rate);
 }
 
 /** Try to get `frames' frames of audio and copy it into `out'.  Silence
@@ -349,11 +405,33 @@ Butler::disable_audio ()
 	_disable_audio = true;
 }
 
+/** Give all our video to a cache, and use the cache to answer accurate seeks where possible */
+void
+Butler::set_seek_cache (shared_ptr<SeekCache> cache)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_seek_cache = cache;
+}
+
+/** @return Memory used by our video buffers, and a description which includes
+ *  the state of the ImagePool.
+ */
 pair<size_t, string>
 Butler::memory_used () const
 {
 	/* XXX: should also look at _audio.memory_used() */
-	return _video.memory_used();
+	pair<size_t, string> video = _video.memory_used();
+	ImagePool::Statistics const pool = ImagePool::instance()->statistics ();
+	return make_pair (
+		video.first,
+		String::compose (
+			"%1; image pool %2MB in use, %3MB idle, %4%% hit rate",
+			video.second,
+			pool.in_use / 1048576,
+			pool.idle / 1048576,
+			int (pool.hit_rate() * 100)
+			)
+		);
 }
 
 void
@@ -363,6 +441,10 @@ Butler::player_change (ChangeType type, bool frequent)
 
 	if (type == CHANGE_TYPE_PENDING) {
 		++_suspended;
+		if (_seek_cache) {
+			/* Frames from now on may not match what the cache has until it gets a new identifier */
+			_seek_cache->invalidate ();
+		}
 	} else if (type == CHANGE_TYPE_DONE) {
 		--_suspended;
 		if (_died || _pending_seek_position || frequent) {
@@ -32,6 +32,7 @@
 
 class Player;
 class PlayerVideo;
+class SeekCache;
 
 class Butler : public ExceptionStore, public boost::noncopyable
 {
@@ -60,6 +61,7 @@ public:
 	boost::optional<TextRingBuffers::Data> get_closed_caption ();
 
 	void disable_audio ();
+	void set_seek_cache (boost::shared_ptr<SeekCache> cache);
 
 	std::pair<size_t, std::string> memory_used () const;
 
@@ -115,6 +117,15 @@ private:
 	*/
 	boost::optional<DCPTime> _awaiting;
 
+	/** Cache to give our video to and to serve seeks from, if any */
+	boost::shared_ptr<SeekCache> _seek_cache;
+	/** If set, video before this time has been asked for only so that it goes into _seek_cache,
+	    and audio before it should be discarded.
+	*/
+	boost::optional<DCPTime> _prefetch_to;
+	/** If set, video up to and including this time has already been taken from _seek_cache */
+	boost::optional<DCPTime> _cached_to;
+
 	boost::signals2::scoped_connection _player_video_connection;
 	boost::signals2::scoped_connection _player_audio_connection;
 	boost::signals2::scoped_connection _player_text_connection;
@@ -22,6 +22,7 @@
 #include "colour_conversion.h"
 #include "util.h"
 #include "digester.h"
+#include "binary_metadata.h"
 #include <dcp/raw_convert.h>
 #include <dcp/chromaticity.h>
 #include <dcp/gamma_transfer_function.h>
@@ -133,6 +134,103 @@ ColourConversion::ColourConversion (cxml::NodePtr node, int version)
 	}
 }
 
+/** Type codes for transfer functions in binary metadata */
+enum BinaryTransferFunction
+{
+	BINARY_TRANSFER_FUNCTION_NONE,
+	BINARY_TRANSFER_FUNCTION_IDENTITY,
+	BINARY_TRANSFER_FUNCTION_GAMMA,
+	BINARY_TRANSFER_FUNCTION_MODIFIED_GAMMA,
+	BINARY_TRANSFER_FUNCTION_SGAMUT3
+};
+
+static void
+write_transfer_function (BinaryWriter& writer, shared_ptr<const dcp::TransferFunction> tf)
+{
+	if (dynamic_pointer_cast<const dcp::GammaTransferFunction> (tf)) {
+		writer.write_uint8 (BINARY_TRANSFER_FUNCTION_GAMMA);
+		writer.write_double (dynamic_pointer_cast<const dcp::GammaTransferFunction>(tf)->gamma());
+	} else if (dynamic_pointer_cast<const dcp::ModifiedGammaTransferFunction> (tf)) {
+		shared_ptr<const dcp::ModifiedGammaTransferFunction> mg = dynamic_pointer_cast<const dcp::ModifiedGammaTransferFunction> (tf);
+		writer.write_uint8 (BINARY_TRANSFER_FUNCTION_MODIFIED_GAMMA);
+		writer.write_double (mg->power ());
+		writer.write_double (mg->threshold ());
+		writer.write_double (mg->A ());
+		writer.write_double (mg->B ());
+	} else if (dynamic_pointer_cast<const dcp::SGamut3TransferFunction> (tf)) {
+		writer.write_uint8 (BINARY_TRANSFER_FUNCTION_SGAMUT3);
+	} else if (dynamic_pointer_cast<const dcp::IdentityTransferFunction> (tf)) {
+		writer.write_uint8 (BINARY_TRANSFER_FUNCTION_IDENTITY);
+	} else {
+		writer.write_uint8 (BINARY_TRANSFER_FUNCTION_NONE);
+	}
+}
+
+static shared_ptr<dcp::TransferFunction>
+read_transfer_function (BinaryReader& reader)
+{
+	switch (reader.read_uint8 ()) {
+	case BINARY_TRANSFER_FUNCTION_IDENTITY:
+		return shared_ptr<dcp::TransferFunction> (new dcp::IdentityTransferFunction ());
+	case BINARY_TRANSFER_FUNCTION_GAMMA:
+		return shared_ptr<dcp::TransferFunction> (new dcp::GammaTransferFunction (reader.read_double ()));
+	case BINARY_TRANSFER_FUNCTION_MODIFIED_GAMMA:
+	{
+		double const power = reader.read_double ();
+		double const threshold = reader.read_double ();
+		double const A = reader.read_double ();
+		double const B = reader.read_double ();
+		return shared_ptr<dcp::TransferFunction> (new dcp::ModifiedGammaTransferFunction (power, threshold, A, B));
+	}
+	case BINARY_TRANSFER_FUNCTION_SGAMUT3:
+		return shared_ptr<dcp::TransferFunction> (new dcp::SGamut3TransferFunction ());
+	default:
+		return shared_ptr<dcp::TransferFunction> ();
+	}
+}
+
+/** Read a ColourConversion written by as_binary() */
+ColourConversion::ColourConversion (BinaryReader& reader)
+{
+	_in = read_transfer_function (reader);
+	_yuv_to_rgb = static_cast<dcp::YUVToRGB> (reader.read_uint8 ());
+	_red.x = reader.read_double ();
+	_red.y = reader.read_double ();
+	_green.x = reader.read_double ();
+	_green.y = reader.read_double ();
+	_blue.x = reader.read_double ();
+	_blue.y = reader.read_double ();
+	_white.x = reader.read_double ();
+	_white.y = reader.read_double ();
+	if (reader.read_bool ()) {
+		double const x = reader.read_double ();
+		double const y = reader.read_double ();
+		_adjusted_white = dcp::Chromaticity (x, y);
+	}
+	_out = read_transfer_function (reader);
+}
+
+void
+ColourConversion::as_binary (BinaryWriter& writer) const
+{
+	write_transfer_function (writer, _in);
+	writer.write_uint8 (static_cast<uint8_t> (_yuv_to_rgb));
+	writer.write_double (_red.x);
+	writer.write_double (_red.y);
+	writer.write_double (_green.x);
+	writer.write_double (_green.y);
+	writer.write_double (_blue.x);
+	writer.write_double (_blue.y);
+	writer.write_double (_white.x);
+	writer.write_double (_white.y);
+	writer.write_bool (static_cast<bool> (_adjusted_white));
+	if (_adjusted_white) {
+		writer.write_double (_adjusted_white->x);
+		writer.write_double (_adjusted_white->y);
+	}
+	write_transfer_function (writer, _out);
+}
+
 boost::optional<ColourConversion>
 ColourConversion::from_xml (cxml::NodePtr node, int version)
 {
@@ -33,15 +33,20 @@ namespace xmlpp {
 	class Node;
 }
 
+class BinaryWriter;
+class BinaryReader;
+
 class ColourConversion : public dcp::ColourConversion
 {
 public:
 	ColourConversion ();
 	explicit ColourConversion (dcp::ColourConversion);
 	ColourConversion (cxml::NodePtr, int version);
+	explicit ColourConversion (BinaryReader& reader);
 	virtual ~ColourConversion () {}
 
 	virtual void as_xml (xmlpp::Node *) const;
+	void as_binary (BinaryWriter& writer) const;
 	std::string identifier () const;
 
 	boost::optional<size_t> preset () const;
@@ -96,6 +96,7 @@ Config::set_defaults ()
 	_cinema_sound_processor = CinemaSoundProcessor::from_id (N_("dolby_cp750"));
 	_allow_any_dcp_frame_rate = false;
 	_allow_any_container = false;
+	_fused_video_pipeline = true;
 	_language = optional<string> ();
 	_default_still_length = 10;
 	_default_container = Ratio::from_id ("185");
@@ -153,6 +154,9 @@ Config::set_defaults ()
 	   use about 240Mb with 72 encoding threads.
 	*/
 	_frames_in_memory_multiplier = 3;
+	_writer_memory_limit = optional<int64_t>();
+	_write_behind = false;
+	_decode_ahead = false;
 	_decode_reduction = optional<int>();
 	_default_notify = false;
 	for (int i = 0; i < NOTIFICATION_COUNT; ++i) {
@@ -395,6 +399,7 @@ try
 	_maximum_j2k_bandwidth = f.optional_number_child<int> ("MaximumJ2KBandwidth").get_value_or (250000000);
 	_allow_any_dcp_frame_rate = f.optional_bool_child ("AllowAnyDCPFrameRate").get_value_or (false);
 	_allow_any_container = f.optional_bool_child ("AllowAnyContainer").get_value_or (false);
+	_fused_video_pipeline = f.optional_bool_child ("FusedVideoPipeline").get_value_or (true);
 
 	_log_types = f.optional_number_child<int> ("LogTypes").get_value_or (LogEntry::TYPE_GENERAL | LogEntry::TYPE_WARNING | LogEntry::TYPE_ERROR);
 	_analyse_ebur128 = f.optional_bool_child("AnalyseEBUR128").get_value_or (true);
@@ -534,6 +539,9 @@ try
 		}
 	}
 	_frames_in_memory_multiplier = f.optional_number_child<int>("FramesInMemoryMultiplier").get_value_or(3);
+	_writer_memory_limit = f.optional_number_child<int64_t>("WriterMemoryLimit");
+	_write_behind = f.optional_bool_child("WriteBehind").get_value_or(false);
+	_decode_ahead = f.optional_bool_child("DecodeAhead").get_value_or(false);
 	_decode_reduction = f.optional_number_child<int>("DecodeReduction");
 	_default_notify = f.optional_bool_child("DefaultNotify").get_value_or(false);
 
@@ -794,6 +802,10 @@ Config::write_config () const
 	root->add_child("AllowAnyDCPFrameRate")->add_child_text (_allow_any_dcp_frame_rate ? "1" : "0");
 	/* [XML] AllowAnyContainer 1 to allow users to user any container ratio for their DCP, 0 to limit the GUI to standard containers. */
 	root->add_child("AllowAnyContainer")->add_child_text (_allow_any_container ? "1" : "0");
+	/* [XML] FusedVideoPipeline 1 to crop, scale, blend subtitles, fade and convert to XYZ in a single pass when encoding,
+	   0 to do each of these steps separately over the whole frame.
+	*/
+	root->add_child("FusedVideoPipeline")->add_child_text (_fused_video_pipeline ? "1" : "0");
 	/* [XML] LogTypes Types of logging to write; a bitfield where 1 is general notes, 2 warnings, 4 errors, 8 debug information related
 	   to encoding, 16 debug information related to encoding, 32 debug information for timing purposes, 64 debug information related
 	   to sending email.
@@ -927,6 +939,21 @@ Config::write_config () const
 	*/
 	root->add_child("FramesInMemoryMultiplier")->add_child_text(raw_convert<string>(_frames_in_memory_multiplier));
 
+	/* [XML] WriterMemoryLimit maximum number of bytes of encoded frames to hold in memory while they are waiting to
+	   be written; if this is given it is used instead of FramesInMemoryMultiplier.
+	*/
+	if (_writer_memory_limit) {
+		root->add_child("WriterMemoryLimit")->add_child_text(raw_convert<string>(_writer_memory_limit.get()));
+	}
+
+	/* [XML] WriteBehind 1 to write picture and sound MXF data to disk as it is produced, and then drop it from the
+	   operating system's cache, otherwise 0.  This only has an effect on Linux.
+	*/
+	root->add_child("WriteBehind")->add_child_text(_write_behind ? "1" : "0");
+
+	/* [XML] DecodeAhead 1 to decode each piece of content on its own thread when making DCPs, otherwise 0. */
+	root->add_child("DecodeAhead")->add_child_text(_decode_ahead ? "1" : "0");
+
 	/* [XML] DecodeReduction power of 2 to reduce DCP images by before decoding in the player. */
 	if (_decode_reduction) {
 		root->add_child("DecodeReduction")->add_child_text(raw_convert<string>(_decode_reduction.get()));
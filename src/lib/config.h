@@ -162,6 +162,10 @@ public:
 		return _allow_any_container;
 	}
 
+	bool fused_video_pipeline () const {
+		return _fused_video_pipeline;
+	}
+
 	ISDCFMetadata default_isdcf_metadata () const {
 		return _default_isdcf_metadata;
 	}
@@ -422,6 +426,25 @@ public:
 		return _frames_in_memory_multiplier;
 	}
 
+	/** @return maximum number of bytes of encoded frames that the Writer should hold in
+	 *  memory, or none to use frames_in_memory_multiplier() instead.
+	 */
+	boost::optional<int64_t> writer_memory_limit () const {
+		return _writer_memory_limit;
+	}
+
+	/** @return true to push picture and sound MXF data to disk as it is written, and then
+	 *  drop it from the page cache.
+	 */
+	bool write_behind () const {
+		return _write_behind;
+	}
+
+	/** @return true to decode each piece of content on its own thread when making DCPs */
+	bool decode_ahead () const {
+		return _decode_ahead;
+	}
+
 	boost::optional<int> decode_reduction () const {
 		return _decode_reduction;
 	}
@@ -614,6 +637,10 @@ public:
 		maybe_set (_allow_any_container, a);
 	}
 
+	void set_fused_video_pipeline (bool f) {
+		maybe_set (_fused_video_pipeline, f);
+	}
+
 	void set_default_isdcf_metadata (ISDCFMetadata d) {
 		maybe_set (_default_isdcf_metadata, d);
 	}
@@ -852,6 +879,18 @@ public:
 		maybe_set (_frames_in_memory_multiplier, m);
 	}
 
+	void set_writer_memory_limit (boost::optional<int64_t> l) {
+		maybe_set (_writer_memory_limit, l);
+	}
+
+	void set_write_behind (bool w) {
+		maybe_set (_write_behind, w);
+	}
+
+	void set_decode_ahead (bool d) {
+		maybe_set (_decode_ahead, d);
+	}
+
 	void set_decode_reduction (boost::optional<int> r) {
 		maybe_set (_decode_reduction, r);
 	}
@@ -1163,6 +1202,10 @@ private:
 	    https://www.dcpomatic.com/forum/viewtopic.php?f=2&t=1119&p=4468
 	*/
 	bool _allow_any_container;
+	/** true to crop, scale, blend, fade and colour-convert video for encoding in one pass
+	    (see Image::crop_scale_window_xyz), false to use separate passes.
+	*/
+	bool _fused_video_pipeline;
 	/** Default ISDCF metadata for newly-created Films */
 	ISDCFMetadata _default_isdcf_metadata;
 	boost::optional<std::string> _language;
@@ -1241,6 +1284,9 @@ private:
 	boost::optional<KDMWriteType> _last_kdm_write_type;
 	boost::optional<DKDMWriteType> _last_dkdm_write_type;
 	int _frames_in_memory_multiplier;
+	boost::optional<int64_t> _writer_memory_limit;
+	bool _write_behind;
+	bool _decode_ahead;
 	boost::optional<int> _decode_reduction;
 	bool _default_notify;
 	bool _notification[NOTIFICATION_COUNT];
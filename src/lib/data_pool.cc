@@ -0,0 +1,150 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/data_pool.cc
+ *  @brief DataPool class.
+ */
+
+#include "data_pool.h"
+#include "dcpomatic_assert.h"
+#include <boost/shared_array.hpp>
+
+#include "i18n.h"
+
+using std::list;
+using std::max;
+using boost::shared_array;
+
+/** Granularity of the buffers that we allocate, so that frames of slightly different
+ *  sizes can use the same buffer.
+ */
+static size_t const granularity = 64 * 1024;
+
+DataPool::DataPool ()
+	: _idle_bytes (0)
+	/* Enough for a couple of hundred 2K frames at the highest bandwidth */
+	, _idle_limit (256 * 1024 * 1024)
+{
+
+}
+
+DataPool*
+DataPool::instance ()
+{
+	/* This is never destroyed, as Data may be destroyed very late on during shutdown */
+	static DataPool* pool = new DataPool ();
+	return pool;
+}
+
+/** @param size Size in bytes.
+ *  @return Data of the given size, whose memory will be given back to the pool when
+ *  it is no longer used.
+ */
+dcp::Data
+DataPool::get (int size)
+{
+	DCPOMATIC_ASSERT (size >= 0);
+
+	uint8_t* data = 0;
+	size_t capacity = 0;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		/* Use the smallest idle buffer which is big enough */
+		list<Entry>::iterator best = _idle.end ();
+		for (list<Entry>::iterator i = _idle.begin(); i != _idle.end(); ++i) {
+			if (i->capacity >= size_t (size) && (best == _idle.end() || i->capacity < best->capacity)) {
+				best = i;
+			}
+		}
+
+		if (best != _idle.end ()) {
+			data = best->data;
+			capacity = best->capacity;
+			_idle_bytes -= capacity;
+			_idle.erase (best);
+		}
+	}
+
+	if (!data) {
+		capacity = ((max (size, 1) + granularity - 1) / granularity) * granularity;
+		data = new uint8_t[capacity];
+	}
+
+	return dcp::Data (shared_array<uint8_t> (data, Returner (capacity)), size);
+}
+
+void
+DataPool::put (Entry entry)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_idle.push_front (entry);
+	_idle_bytes += entry.capacity;
+	trim ();
+}
+
+/** Free buffers which were returned longest ago until we are within our limit.
+ *  Must be called with a lock held on _mutex.
+ */
+void
+DataPool::trim ()
+{
+	while (_idle_bytes > _idle_limit) {
+		DCPOMATIC_ASSERT (!_idle.empty ());
+		_idle_bytes -= _idle.back().capacity;
+		delete[] _idle.back().data;
+		_idle.pop_back ();
+	}
+}
+
+size_t
+DataPool::idle_limit () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _idle_limit;
+}
+
+void
+DataPool::set_idle_limit (size_t limit)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_idle_limit = limit;
+	trim ();
+}
+
+/** @return total size of the buffers that are waiting in the pool */
+size_t
+DataPool::idle () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _idle_bytes;
+}
+
+/** Free everything that is waiting in the pool */
+void
+DataPool::clear ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	while (!_idle.empty ()) {
+		delete[] _idle.front().data;
+		_idle.pop_front ();
+	}
+	_idle_bytes = 0;
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_DATA_POOL_H
+#define DCPOMATIC_DATA_POOL_H
+
+/** @file  src/lib/data_pool.h
+ *  @brief DataPool class.
+ */
+
+#include <dcp/data.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <list>
+
+/** @class DataPool
+ *  @brief A store of buffers for encoded frames, so that frames which are received
+ *  from encode servers or read back from disk don't each need new memory.
+ *
+ *  dcp::Data returned by get() gives its buffer back to the pool when the last copy
+ *  of it is destroyed (usually after the Writer has written it to the MXF).  Up to
+ *  idle_limit() bytes are kept; beyond that the buffers which were returned longest
+ *  ago are freed.
+ */
+class DataPool : public boost::noncopyable
+{
+public:
+	dcp::Data get (int size);
+
+	size_t idle_limit () const;
+	void set_idle_limit (size_t limit);
+	size_t idle () const;
+	void clear ();
+
+	static DataPool* instance ();
+
+private:
+	DataPool ();
+
+	struct Entry
+	{
+		Entry (uint8_t* data_, size_t capacity_)
+			: data (data_)
+			, capacity (capacity_)
+		{}
+
+		uint8_t* data;
+		size_t capacity;
+	};
+
+	/** Function object used as the deleter of the shared_arrays that we give out */
+	class Returner
+	{
+	public:
+		explicit Returner (size_t capacity)
+			: _capacity (capacity)
+		{}
+
+		void operator() (uint8_t* data) const {
+			DataPool::instance()->put (Entry (data, _capacity));
+		}
+
+	private:
+		size_t _capacity;
+	};
+
+	friend class Returner;
+
+	void put (Entry entry);
+	void trim ();
+
+	/** mutex for everything below */
+	mutable boost::mutex _mutex;
+	/** idle buffers, most recently returned first */
+	std::list<Entry> _idle;
+	/** total capacity of the buffers in _idle */
+	size_t _idle_bytes;
+	size_t _idle_limit;
+};
+
+#endif
@@ -37,6 +37,7 @@
 #include "referenced_reel_asset.h"
 #include "text_content.h"
 #include "player_video.h"
+#include "config.h"
 #include <boost/signals2.hpp>
 #include <boost/foreach.hpp>
 #include <iostream>
@@ -60,6 +61,10 @@ DCPEncoder::DCPEncoder (shared_ptr<const Film> film, weak_ptr<Job> job)
 	, _finishing (false)
 	, _non_burnt_subtitles (false)
 {
+	if (Config::instance()->decode_ahead()) {
+		_player->set_decode_ahead ();
+	}
+
 	_player_video_connection = _player->Video.connect (bind (&DCPEncoder::video, this, _1, _2));
 	_player_audio_connection = _player->Audio.connect (bind (&DCPEncoder::audio, this, _1, _2));
 	_player_text_connection = _player->Text.connect (bind (&DCPEncoder::text, this, _1, _2, _3, _4));
@@ -87,6 +92,12 @@ DCPEncoder::go ()
 	_writer.reset (new Writer (_film, _job));
 	_writer->start ();
 
+	list<DCPTimePeriod> const reused = _writer->reused_picture_periods ();
+	if (!reused.empty()) {
+		/* We don't need to decode video for reels whose picture assets are being re-used */
+		_player->set_skip_video (reused);
+	}
+
 	_j2k_encoder.reset (new J2KEncoder (_film, _writer));
 	_j2k_encoder->begin ();
 
@@ -170,3 +181,14 @@ DCPEncoder::frames_done () const
 
 	return _j2k_encoder->video_frames_enqueued ();
 }
+
+optional<int64_t>
+DCPEncoder::memory_used () const
+{
+	shared_ptr<Writer> writer = _writer;
+	if (!writer) {
+		return optional<int64_t> ();
+	}
+
+	return writer->memory_used ();
+}
@@ -43,6 +43,7 @@ public:
 
 	float current_rate () const;
 	Frame frames_done () const;
+	boost::optional<int64_t> memory_used () const;
 
 	/** @return true if we are in the process of calling Encoder::process_end */
 	bool finishing () const {
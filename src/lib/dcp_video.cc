@@ -39,14 +39,17 @@
 #include "cross.h"
 #include "player_video.h"
 #include "compose.hpp"
+#include "binary_metadata.h"
+#include "xyz_converter.h"
+#include "data_pool.h"
 #include <libcxml/cxml.h>
 #include <dcp/raw_convert.h>
 #include <dcp/openjpeg_image.h>
-#include <dcp/rgb_xyz.h>
 #include <dcp/j2k.h>
 #include <libxml++/libxml++.h>
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
+#include <boost/foreach.hpp>
 #include <stdint.h>
 #include <iomanip>
 #include <iostream>
@@ -88,18 +91,37 @@ DCPVideo::DCPVideo (shared_ptr<const PlayerVideo> frame, shared_ptr<const cxml::
 	_resolution = Resolution (node->optional_number_child<int>("Resolution").get_value_or (RESOLUTION_2K));
 }
 
+/** Construct a DCPVideo from binary metadata; the magic number and version
+ *  written by add_binary_metadata() must already have been read from \p reader.
+ */
+DCPVideo::DCPVideo (BinaryReader& reader, shared_ptr<Socket> socket)
+{
+	_index = reader.read_int32 ();
+	_frames_per_second = reader.read_int32 ();
+	_j2k_bandwidth = reader.read_int32 ();
+	_resolution = Resolution (reader.read_int32 ());
+	TransportCodec const codec = static_cast<TransportCodec> (reader.read_uint8 ());
+	_frame.reset (new PlayerVideo (reader, socket, codec));
+}
+
 shared_ptr<dcp::OpenJPEGImage>
 DCPVideo::convert_to_xyz (shared_ptr<const PlayerVideo> frame, dcp::NoteHandler note)
 {
 	shared_ptr<dcp::OpenJPEGImage> xyz;
 
+	if (Config::instance()->fused_video_pipeline()) {
+		xyz = frame->xyz_image (note);
+		if (xyz) {
+			return xyz;
+		}
+	}
+
 	shared_ptr<Image> image = frame->image (bind (&PlayerVideo::keep_xyz_or_rgb, _1), true, false);
 	if (frame->colour_conversion()) {
-		xyz = dcp::rgb_to_xyz (
+		xyz = XYZConverter::get(frame->colour_conversion().get())->convert (
 			image->data()[0],
 			image->size(),
 			image->stride()[0],
-			frame->colour_conversion().get(),
 			note
 			);
 	} else {
@@ -157,28 +179,15 @@ DCPVideo::encode_remotely (EncodeServerDescription serv, int timeout)
 
 	socket->connect (*endpoint_iterator);
 
-	/* Collect all XML metadata */
-	xmlpp::Document doc;
-	xmlpp::Element* root = doc.create_root_node ("EncodingRequest");
-	root->add_child("Version")->add_child_text (raw_convert<string> (SERVER_LINK_VERSION));
-	add_metadata (root);
-
 	LOG_DEBUG_ENCODE (N_("Sending frame %1 to remote"), _index);
 
-	/* Send XML metadata */
-	string xml = doc.write_to_string ("UTF-8");
-	socket->write (xml.length() + 1);
-	socket->write ((uint8_t *) xml.c_str(), xml.length() + 1);
-
-	/* Send binary data */
-	LOG_TIMING("start-remote-send thread=%1", thread_id ());
-	_frame->send_binary (socket);
+	send_request (socket, serv);
 
 	/* Read the response (JPEG2000-encoded data); this blocks until the data
 	   is ready and sent back.
 	*/
 	LOG_TIMING("start-remote-encode thread=%1", thread_id ());
-	Data e (socket->read_uint32 ());
+	Data e = DataPool::instance()->get (socket->read_uint32 ());
 	LOG_TIMING("start-remote-receive thread=%1", thread_id ());
 	socket->read (e.data().get(), e.size());
 	LOG_TIMING("finish-remote-receive thread=%1", thread_id ());
@@ -188,6 +197,48 @@ DCPVideo::encode_remotely (EncodeServerDescription serv, int timeout)
 	return e;
 }
 
+/** Send the metadata and image data for this frame to an encode server.
+ *  @param socket Socket to write to.
+ *  @param server Server that we are talking to; its link version decides the form
+ *  of the request, and the transport codecs that it accepts decide how any uncompressed
+ *  image data is sent.
+ */
+void
+DCPVideo::send_request (shared_ptr<Socket> socket, EncodeServerDescription const & server) const
+{
+	TransportCodec codec = TRANSPORT_CODEC_NONE;
+
+	if (server.link_version() >= SERVER_LINK_VERSION_BINARY) {
+		/* Use the last (i.e. best) codec that both we and the server can handle */
+		BOOST_FOREACH (TransportCodec i, Image::supported_transport_codecs()) {
+			if (server.supports_transport_codec (i)) {
+				codec = i;
+			}
+		}
+
+		/* Send binary metadata, which is much quicker to build and parse than XML */
+		BinaryWriter writer;
+		add_binary_metadata (writer, codec);
+		socket->write (writer.size());
+		socket->write (writer.data(), writer.size());
+	} else {
+		/* Collect all XML metadata */
+		xmlpp::Document doc;
+		xmlpp::Element* root = doc.create_root_node ("EncodingRequest");
+		root->add_child("Version")->add_child_text (raw_convert<string> (server.link_version()));
+		add_metadata (root);
+
+		/* Send XML metadata */
+		string xml = doc.write_to_string ("UTF-8");
+		socket->write (xml.length() + 1);
+		socket->write ((uint8_t *) xml.c_str(), xml.length() + 1);
+	}
+
+	/* Send binary data */
+	LOG_TIMING("start-remote-send thread=%1", thread_id ());
+	_frame->send_binary (socket, codec);
+}
+
 void
 DCPVideo::add_metadata (xmlpp::Element* el) const
 {
@@ -198,12 +249,32 @@ DCPVideo::add_metadata (xmlpp::Element* el) const
 	_frame->add_metadata (el);
 }
 
+void
+DCPVideo::add_binary_metadata (BinaryWriter& writer, TransportCodec codec) const
+{
+	writer.write_uint32 (ENCODING_REQUEST_MAGIC);
+	writer.write_uint32 (ENCODING_REQUEST_VERSION);
+	writer.write_int32 (_index);
+	writer.write_int32 (_frames_per_second);
+	writer.write_int32 (_j2k_bandwidth);
+	writer.write_int32 (static_cast<int> (_resolution));
+	writer.write_uint8 (static_cast<uint8_t> (codec));
+	_frame->add_binary_metadata (writer);
+}
+
 Eyes
 DCPVideo::eyes () const
 {
 	return _frame->eyes ();
 }
 
+/** @return true if this frame is entirely black */
+bool
+DCPVideo::black () const
+{
+	return _frame->black ();
+}
+
 /** @return true if this DCPVideo is definitely the same as another;
  *  (apart from the frame index), false if it is probably not.
  */
@@ -29,6 +29,9 @@
 
 class Log;
 class PlayerVideo;
+class Socket;
+class BinaryWriter;
+class BinaryReader;
 
 /** @class DCPVideo
  *  @brief A single frame of video destined for a DCP.
@@ -44,15 +47,18 @@ class DCPVideo : public boost::noncopyable
 public:
 	DCPVideo (boost::shared_ptr<const PlayerVideo>, int, int, int, Resolution);
 	DCPVideo (boost::shared_ptr<const PlayerVideo>, cxml::ConstNodePtr);
+	DCPVideo (BinaryReader &, boost::shared_ptr<Socket>);
 
 	dcp::Data encode_locally ();
 	dcp::Data encode_remotely (EncodeServerDescription, int timeout = 30);
+	void send_request (boost::shared_ptr<Socket> socket, EncodeServerDescription const & server) const;
 
 	int index () const {
 		return _index;
 	}
 
 	Eyes eyes () const;
+	bool black () const;
 
 	bool same (boost::shared_ptr<const DCPVideo> other) const;
 
@@ -61,6 +67,7 @@ public:
 private:
 
 	void add_metadata (xmlpp::Element *) const;
+	void add_binary_metadata (BinaryWriter &, TransportCodec codec) const;
 
 	boost::shared_ptr<const PlayerVideo> _frame;
 	int _index;			 ///< frame index within the DCP's intrinsic duration
@@ -22,16 +22,18 @@
 #include "compose.hpp"
 #include "exceptions.h"
 #include <boost/bind.hpp>
-#include <boost/lambda/lambda.hpp>
 #include <iostream>
 
 #include "i18n.h"
 
 /** @param timeout Timeout in seconds */
 Socket::Socket (int timeout)
-	: _deadline (_io_service)
+	: _running (false)
+	, _deadline (_io_service)
 	, _socket (_io_service)
 	, _timeout (timeout)
+	, _bytes_written (0)
+	, _bytes_read (0)
 {
 	_deadline.expires_at (boost::posix_time::pos_infin);
 	check ();
@@ -40,6 +42,8 @@ Socket::Socket (int timeout)
 void
 Socket::check ()
 {
+	boost::mutex::scoped_lock lm (_mutex);
+
 	if (_deadline.expires_at() <= boost::asio::deadline_timer::traits_type::now ()) {
 		_socket.close ();
 		_deadline.expires_at (boost::posix_time::pos_infin);
@@ -48,18 +52,58 @@ Socket::check ()
 	_deadline.async_wait (boost::bind (&Socket::check, this));
 }
 
+/** Called when an asynchronous operation has finished */
+void
+Socket::finished (boost::system::error_code* target, boost::system::error_code const & result)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	*target = result;
+	_run_condition.notify_all ();
+}
+
+/** Run our io_service until ec is no longer would_block.  If another thread is
+ *  already running it we wait for that thread to complete our operation
+ *  (or to finish, so that we can take over).
+ */
+void
+Socket::run (boost::system::error_code& ec)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	while (ec == boost::asio::error::would_block) {
+		if (_running) {
+			_run_condition.wait (lm);
+			continue;
+		}
+
+		_running = true;
+		lm.unlock ();
+		try {
+			_io_service.run_one ();
+		} catch (...) {
+			lm.lock ();
+			_running = false;
+			_run_condition.notify_all ();
+			throw;
+		}
+		lm.lock ();
+		_running = false;
+		_run_condition.notify_all ();
+	}
+}
+
 /** Blocking connect.
  *  @param endpoint End-point to connect to.
  */
 void
 Socket::connect (boost::asio::ip::tcp::endpoint endpoint)
 {
-	_deadline.expires_from_now (boost::posix_time::seconds (_timeout));
 	boost::system::error_code ec = boost::asio::error::would_block;
-	_socket.async_connect (endpoint, boost::lambda::var(ec) = boost::lambda::_1);
-	do {
-		_io_service.run_one();
-	} while (ec == boost::asio::error::would_block);
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_deadline.expires_from_now (boost::posix_time::seconds (_timeout));
+		_socket.async_connect (endpoint, boost::bind (&Socket::finished, this, &ec, boost::asio::placeholders::error));
+	}
+	run (ec);
 
 	if (ec) {
 		throw NetworkError (String::compose (_("error during async_connect (%1)"), ec.value ()));
@@ -77,18 +121,19 @@ Socket::connect (boost::asio::ip::tcp::endpoint endpoint)
 void
 Socket::write (uint8_t const * data, int size)
 {
-	_deadline.expires_from_now (boost::posix_time::seconds (_timeout));
 	boost::system::error_code ec = boost::asio::error::would_block;
-
-	boost::asio::async_write (_socket, boost::asio::buffer (data, size), boost::lambda::var(ec) = boost::lambda::_1);
-
-	do {
-		_io_service.run_one ();
-	} while (ec == boost::asio::error::would_block);
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_deadline.expires_from_now (boost::posix_time::seconds (_timeout));
+		boost::asio::async_write (_socket, boost::asio::buffer (data, size), boost::bind (&Socket::finished, this, &ec, boost::asio::placeholders::error));
+	}
+	run (ec);
 
 	if (ec) {
 		throw NetworkError (String::compose (_("error during async_write (%1)"), ec.value ()));
 	}
+
+	_bytes_written += size;
 }
 
 void
@@ -105,18 +150,19 @@ Socket::write (uint32_t v)
 void
 Socket::read (uint8_t* data, int size)
 {
-	_deadline.expires_from_now (boost::posix_time::seconds (_timeout));
 	boost::system::error_code ec = boost::asio::error::would_block;
-
-	boost::asio::async_read (_socket, boost::asio::buffer (data, size), boost::lambda::var(ec) = boost::lambda::_1);
-
-	do {
-		_io_service.run_one ();
-	} while (ec == boost::asio::error::would_block);
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_deadline.expires_from_now (boost::posix_time::seconds (_timeout));
+		boost::asio::async_read (_socket, boost::asio::buffer (data, size), boost::bind (&Socket::finished, this, &ec, boost::asio::placeholders::error));
+	}
+	run (ec);
 
 	if (ec) {
 		throw NetworkError (String::compose (_("error during async_read (%1)"), ec.value ()));
 	}
+
+	_bytes_read += size;
 }
 
 uint32_t
@@ -126,3 +172,14 @@ Socket::read_uint32 ()
 	read (reinterpret_cast<uint8_t *> (&v), 4);
 	return ntohl (v);
 }
+
+/** Shut down both directions of the connection, so that any blocked read
+ *  or write fails promptly.  Can be called from any thread.
+ */
+void
+Socket::shutdown ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	boost::system::error_code ec;
+	_socket.shutdown (boost::asio::ip::tcp::socket::shutdown_both, ec);
+}
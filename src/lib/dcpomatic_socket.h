@@ -20,6 +20,9 @@
 
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/atomic.hpp>
 
 /** @class Socket
  *  @brief A class to wrap a boost::asio::ip::tcp::socket with some things
@@ -27,6 +30,9 @@
  *
  *  This class wraps some things that I could not work out how to do easily with boost;
  *  most notably, sync read/write calls with timeouts.
+ *
+ *  One thread may read while another writes; this is needed for connections
+ *  which carry several requests at once.
  */
 class Socket : public boost::noncopyable
 {
@@ -46,13 +52,35 @@ public:
 	void read (uint8_t* data, int size);
 	uint32_t read_uint32 ();
 
+	void shutdown ();
+
+	/** @return total number of bytes that have been written to this socket */
+	uint64_t bytes_written () const {
+		return _bytes_written;
+	}
+
+	/** @return total number of bytes that have been read from this socket */
+	uint64_t bytes_read () const {
+		return _bytes_read;
+	}
+
 private:
 	void check ();
+	void run (boost::system::error_code& ec);
+	void finished (boost::system::error_code* target, boost::system::error_code const & result);
 
 	Socket (Socket const &);
 
+	/** mutex for _running, _deadline and the error codes of operations in progress */
+	boost::mutex _mutex;
+	/** true if some thread is currently running _io_service */
+	bool _running;
+	boost::condition _run_condition;
+
 	boost::asio::io_service _io_service;
 	boost::asio::deadline_timer _deadline;
 	boost::asio::ip::tcp::socket _socket;
 	int _timeout;
+	boost::atomic<uint64_t> _bytes_written;
+	boost::atomic<uint64_t> _bytes_read;
 };
@@ -0,0 +1,212 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/decode_ahead.cc
+ *  @brief DecodeAhead class.
+ */
+
+#include "decode_ahead.h"
+#include "decoder.h"
+#include "dcpomatic_assert.h"
+#include <boost/foreach.hpp>
+
+using std::vector;
+using boost::shared_ptr;
+using boost::optional;
+using boost::function;
+
+/** Maximum number of decoder passes to keep; a pass can give a whole video frame
+ *  so this should not be large.
+ */
+int const DecodeAhead::maximum_passes = 8;
+
+/** Time to wait before checking again when nothing can be done because our content
+ *  might be changing.
+ */
+static boost::posix_time::milliseconds const suspended_wait (100);
+
+/** @param decoder Decoder to run; it must not be used by anything else while we exist.
+ *  @param suspended Counter which is > 0 while the decoder should not be used, as its
+ *  content might be changing.
+ */
+DecodeAhead::DecodeAhead (shared_ptr<Decoder> decoder, boost::atomic<int> const & suspended)
+	: _decoder (decoder)
+	, _suspended (suspended)
+	, _finished (false)
+	, _died (false)
+	, _stop (false)
+	, _thread (0)
+{
+
+}
+
+/** Start decoding.  This must not be called until everything that the decoder emits
+ *  has been connected to one of our defer() methods, or the output of the first passes
+ *  will be lost.
+ */
+void
+DecodeAhead::start ()
+{
+	DCPOMATIC_ASSERT (!_thread);
+	_thread = new boost::thread (boost::bind (&DecodeAhead::thread, this));
+#ifdef DCPOMATIC_LINUX
+	pthread_setname_np (_thread->native_handle(), "decode-ahead");
+#endif
+}
+
+DecodeAhead::~DecodeAhead ()
+{
+	if (!_thread) {
+		return;
+	}
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_stop = true;
+		_condition.notify_all ();
+	}
+
+	_thread->interrupt ();
+	try {
+		_thread->join ();
+	} catch (boost::thread_interrupted &) {
+		/* No problem */
+	}
+	delete _thread;
+}
+
+void
+DecodeAhead::thread ()
+try
+{
+	while (true) {
+		boost::mutex::scoped_lock lm (_mutex);
+		while (!_stop && (_finished || _suspended > 0 || static_cast<int>(_passes.size()) >= maximum_passes)) {
+			if (_suspended > 0) {
+				_condition.timed_wait (lm, suspended_wait);
+			} else {
+				_condition.wait (lm);
+			}
+		}
+
+		if (_stop) {
+			return;
+		}
+
+		lm.unlock ();
+
+		boost::mutex::scoped_lock dm (_decoder_mutex);
+		Pass pass;
+		pass.position = _decoder->position ();
+		pass.done = _decoder->pass ();
+		pass.events.swap (_events);
+
+		/* Queue the pass with _decoder_mutex still held so that seek() can't get in first
+		   and leave us queuing something from before the seek.
+		*/
+		lm.lock ();
+		_passes.push_back (pass);
+		_finished = pass.done;
+		_condition.notify_all ();
+	}
+}
+catch (boost::thread_interrupted &)
+{
+	/* We are being destroyed */
+}
+catch (...)
+{
+	store_current ();
+	boost::mutex::scoped_lock lm (_mutex);
+	_died = true;
+	_condition.notify_all ();
+}
+
+/** @return The decoder's position before the next pass(), waiting for that pass to
+ *  happen if necessary, or none if we can't wait because our content might be changing.
+ */
+optional<ContentTime>
+DecodeAhead::position ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	while (_passes.empty() && !_finished && !_died) {
+		if (_suspended > 0) {
+			return optional<ContentTime> ();
+		}
+		_condition.timed_wait (lm, suspended_wait);
+	}
+
+	rethrow ();
+
+	/* If the decoder finished it will have queued a pass to say so, and if our thread
+	   died we have already rethrown its exception.
+	*/
+	DCPOMATIC_ASSERT (!_passes.empty());
+	return _passes.front().position;
+}
+
+/** Call the handlers for whatever the decoder emitted in its next pass.  position()
+ *  must have been called (and returned something) first.
+ *  @return true if the decoder will emit no more data unless a seek() happens.
+ */
+bool
+DecodeAhead::pass ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	DCPOMATIC_ASSERT (!_passes.empty());
+	Pass pass = _passes.front ();
+	_passes.pop_front ();
+	_condition.notify_all ();
+	lm.unlock ();
+
+	run (pass.events);
+	return pass.done;
+}
+
+/** Seek the decoder, discarding anything that it has already done.  Anything emitted
+ *  by the decoder as part of the seek is passed on straight away.
+ */
+void
+DecodeAhead::seek (ContentTime time, bool accurate)
+{
+	vector<function<void ()> > events;
+
+	{
+		boost::mutex::scoped_lock dm (_decoder_mutex);
+		_events.clear ();
+		_decoder->seek (time, accurate);
+		events.swap (_events);
+
+		boost::mutex::scoped_lock lm (_mutex);
+		_passes.clear ();
+		_finished = false;
+		_condition.notify_all ();
+	}
+
+	run (events);
+}
+
+void
+DecodeAhead::run (vector<function<void ()> > const & events) const
+{
+	BOOST_FOREACH (function<void ()> const & i, events) {
+		i ();
+	}
+}
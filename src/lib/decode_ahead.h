@@ -0,0 +1,120 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_DECODE_AHEAD_H
+#define DCPOMATIC_DECODE_AHEAD_H
+
+/** @file  src/lib/decode_ahead.h
+ *  @brief DecodeAhead class.
+ */
+
+#include "dcpomatic_time.h"
+#include "exception_store.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/atomic.hpp>
+#include <boost/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <vector>
+
+class Decoder;
+
+/** @class DecodeAhead
+ *  @brief Run a decoder on its own thread, ahead of whatever wants its output.
+ *
+ *  The decoder's pass() is called repeatedly on our thread.  Anything that it emits
+ *  must be handed to one of the defer() methods, which keep it (bound to the handler
+ *  that should receive it) rather than passing it on straight away.  What came out
+ *  of each pass() is kept, along with the decoder's position before that pass(),
+ *  in a queue which is not allowed to grow beyond a few passes.
+ *
+ *  Nothing is decoded until start() is called, which must be after the decoder's
+ *  signals have been connected.
+ *
+ *  Our user then calls position() and pass() instead of the decoder's methods of the
+ *  same name, and the same handlers will be called with the same data, in the same
+ *  order and with the same positions as if the decoder were being used directly; it
+ *  is just that the decoding itself has already been done.
+ */
+class DecodeAhead : public ExceptionStore, public boost::noncopyable
+{
+public:
+	DecodeAhead (boost::shared_ptr<Decoder> decoder, boost::atomic<int> const & suspended);
+	~DecodeAhead ();
+
+	void start ();
+	boost::optional<ContentTime> position ();
+	bool pass ();
+	void seek (ContentTime time, bool accurate);
+
+	template <class A>
+	void defer (boost::function<void (A)> handler, A a) {
+		_events.push_back (boost::bind (handler, a));
+	}
+
+	template <class A, class B>
+	void defer2 (boost::function<void (A, B)> handler, A a, B b) {
+		_events.push_back (boost::bind (handler, a, b));
+	}
+
+	static int const maximum_passes;
+
+private:
+	void thread ();
+	void run (std::vector<boost::function<void ()> > const & events) const;
+
+	/** The results of one call to Decoder::pass() */
+	struct Pass
+	{
+		/** decoder position before the pass */
+		ContentTime position;
+		/** value returned by the pass */
+		bool done;
+		/** handlers to call, bound to the data that the decoder emitted */
+		std::vector<boost::function<void ()> > events;
+	};
+
+	boost::shared_ptr<Decoder> _decoder;
+	/** > 0 if the content that we are decoding might be changing, so we should not decode */
+	boost::atomic<int> const & _suspended;
+
+	/** mutex which is held while the decoder is being used */
+	boost::mutex _decoder_mutex;
+	/** things emitted by the decoder since the last pass was queued; protected by _decoder_mutex */
+	std::vector<boost::function<void ()> > _events;
+
+	/** mutex to protect _passes, _finished, _died and _stop */
+	boost::mutex _mutex;
+	boost::condition _condition;
+	std::list<Pass> _passes;
+	/** true if the decoder has finished */
+	bool _finished;
+	/** true if our thread threw an exception, in which case it has stopped */
+	bool _died;
+	bool _stop;
+
+	boost::thread* _thread;
+};
+
+#endif
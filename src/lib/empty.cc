@@ -40,7 +40,7 @@ Empty::Empty (shared_ptr<const Film> film, list<shared_ptr<Piece> > pieces, func
 	list<DCPTimePeriod> full;
 	BOOST_FOREACH (shared_ptr<Piece> i, pieces) {
 		if (part(i)) {
-			full.push_back (DCPTimePeriod (i->content->position(), i->content->end(film)));
+			full.push_back (DCPTimePeriod (i->position, i->end()));
 		}
 	}
 
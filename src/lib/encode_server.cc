@@ -36,6 +36,7 @@
 #include "dcpomatic_log.h"
 #include "encoded_log_entry.h"
 #include "version.h"
+#include "binary_metadata.h"
 #include <dcp/raw_convert.h>
 #include <libcxml/cxml.h>
 #include <libxml++/libxml++.h>
@@ -97,6 +98,16 @@ EncodeServer::~EncodeServer ()
 		delete i;
 	}
 
+	/* _terminate is set, so nothing can add to _connections now */
+	BOOST_FOREACH (shared_ptr<Connection> i, _connections) {
+		/* Make any blocked read fail */
+		i->socket->shutdown ();
+		if (i->thread->joinable ()) {
+			i->thread->join ();
+		}
+		delete i->thread;
+	}
+
 	{
 		boost::mutex::scoped_lock lm (_broadcast.mutex);
 		if (_broadcast.socket) {
@@ -118,35 +129,67 @@ EncodeServer::~EncodeServer ()
 	}
 }
 
-/** @param after_read Filled in with gettimeofday() after reading the input from the network.
- *  @param after_encode Filled in with gettimeofday() after encoding the image.
+/** Read an EncodingRequest, in either binary or XML form, and its image data.
+ *  @param length Length of the metadata part of the request.
+ *  @return Frame to encode, or 0 if the request came from an incompatible client.
  */
-int
-EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, struct timeval& after_encode)
+shared_ptr<DCPVideo>
+EncodeServer::read_request (shared_ptr<Socket> socket, uint32_t length)
 {
-	uint32_t length = socket->read_uint32 ();
+	if (length == 0) {
+		return shared_ptr<DCPVideo> ();
+	}
+
 	scoped_array<char> buffer (new char[length]);
 	socket->read (reinterpret_cast<uint8_t*> (buffer.get()), length);
 
+	if (length >= 4) {
+		BinaryReader reader (reinterpret_cast<uint8_t*> (buffer.get()), length);
+		if (reader.read_uint32() == ENCODING_REQUEST_MAGIC) {
+			if (reader.read_uint32() != ENCODING_REQUEST_VERSION) {
+				cerr << "Mismatched binary request version\n";
+				LOG_ERROR_NC ("Mismatched binary request version");
+				return shared_ptr<DCPVideo> ();
+			}
+			return shared_ptr<DCPVideo> (new DCPVideo (reader, socket));
+		}
+	}
+
+	/* Otherwise it's an XML request from an older client */
+	buffer[length - 1] = '\0';
 	string s (buffer.get());
 	shared_ptr<cxml::Document> xml (new cxml::Document ("EncodingRequest"));
 	xml->read_string (s);
 	/* This is a double-check; the server shouldn't even be on the candidate list
 	   if it is the wrong version, but it doesn't hurt to make sure here.
 	*/
-	if (xml->number_child<int> ("Version") != SERVER_LINK_VERSION) {
+	int const version = xml->number_child<int> ("Version");
+	if (version < SERVER_LINK_VERSION_SINGLE_FRAME || version > SERVER_LINK_VERSION) {
 		cerr << "Mismatched server/client versions\n";
 		LOG_ERROR_NC ("Mismatched server/client versions");
-		return -1;
+		return shared_ptr<DCPVideo> ();
 	}
 
 	shared_ptr<PlayerVideo> pvf (new PlayerVideo (xml, socket));
+	return shared_ptr<DCPVideo> (new DCPVideo (pvf, xml));
+}
 
-	DCPVideo dcp_video_frame (pvf, xml);
+/** Handle a single-frame request; read the frame, encode it and send it back.
+ *  @param length Length of the XML part of the request, which has already been read.
+ *  @param after_read Filled in with gettimeofday() after reading the input from the network.
+ *  @param after_encode Filled in with gettimeofday() after encoding the image.
+ */
+int
+EncodeServer::process (shared_ptr<Socket> socket, uint32_t length, struct timeval& after_read, struct timeval& after_encode)
+{
+	shared_ptr<DCPVideo> dcp_video_frame = read_request (socket, length);
+	if (!dcp_video_frame) {
+		return -1;
+	}
 
 	gettimeofday (&after_read, 0);
 
-	Data encoded = dcp_video_frame.encode_locally ();
+	Data encoded = dcp_video_frame->encode_locally ();
 
 	gettimeofday (&after_encode, 0);
 
@@ -154,12 +197,51 @@ EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, st
 		socket->write (encoded.size());
 		socket->write (encoded.data().get(), encoded.size());
 	} catch (std::exception& e) {
-		cerr << "Send failed; frame " << dcp_video_frame.index() << "\n";
-		LOG_ERROR ("Send failed; frame %1", dcp_video_frame.index());
+		cerr << "Send failed; frame " << dcp_video_frame->index() << "\n";
+		LOG_ERROR ("Send failed; frame %1", dcp_video_frame->index());
 		throw;
 	}
 
-	return dcp_video_frame.index ();
+	return dcp_video_frame->index ();
+}
+
+/** Encode a frame which arrived on a persistent connection and send back the result,
+ *  tagged as the client asked.
+ *  @param after_read Filled in with gettimeofday() before encoding (the frame has already been read).
+ *  @param after_encode Filled in with gettimeofday() after encoding the image.
+ */
+int
+EncodeServer::process (Request request, struct timeval& after_read, struct timeval& after_encode)
+{
+	gettimeofday (&after_read, 0);
+
+	optional<Data> encoded;
+	try {
+		encoded = request.frame->encode_locally ();
+	} catch (std::exception& e) {
+		cerr << "Encode failed; frame " << request.frame->index() << ": " << e.what() << "\n";
+		LOG_ERROR ("Encode failed; frame %1 (%2)", request.frame->index(), e.what());
+	}
+
+	gettimeofday (&after_encode, 0);
+
+	boost::mutex::scoped_lock lm (request.connection->write_mutex);
+	try {
+		request.connection->socket->write (request.tag);
+		if (encoded) {
+			request.connection->socket->write (encoded->size());
+			request.connection->socket->write (encoded->data().get(), encoded->size());
+		} else {
+			/* Tell the client that we failed */
+			request.connection->socket->write (0);
+		}
+	} catch (std::exception& e) {
+		cerr << "Send failed; frame " << request.frame->index() << "\n";
+		LOG_ERROR ("Send failed; frame %1", request.frame->index());
+		throw;
+	}
+
+	return encoded ? request.frame->index() : -1;
 }
 
 void
@@ -175,7 +257,7 @@ EncodeServer::worker_thread ()
 			return;
 		}
 
-		shared_ptr<Socket> socket = _queue.front ();
+		Request request = _queue.front ();
 		_queue.pop_front ();
 
 		lock.unlock ();
@@ -191,8 +273,18 @@ EncodeServer::worker_thread ()
 		gettimeofday (&start, 0);
 
 		try {
-			frame = process (socket, after_read, after_encode);
-			ip = socket->socket().remote_endpoint().address().to_string();
+			if (request.frame) {
+				frame = process (request, after_read, after_encode);
+				ip = request.connection->socket->socket().remote_endpoint().address().to_string();
+			} else {
+				uint32_t const length = request.socket->read_uint32 ();
+				if (length == ENCODE_SERVER_PERSISTENT_CONNECTION) {
+					start_connection (request.socket);
+				} else {
+					frame = process (request.socket, length, after_read, after_encode);
+					ip = request.socket->socket().remote_endpoint().address().to_string();
+				}
+			}
 		} catch (std::exception& e) {
 			cerr << "Error: " << e.what() << "\n";
 			LOG_ERROR ("Error: %1", e.what());
@@ -200,7 +292,7 @@ EncodeServer::worker_thread ()
 
 		gettimeofday (&end, 0);
 
-		socket.reset ();
+		request = Request ();
 
 		lock.lock ();
 
@@ -287,6 +379,9 @@ EncodeServer::broadcast_received ()
 		xmlpp::Element* root = doc.create_root_node ("ServerAvailable");
 		root->add_child("Threads")->add_child_text (raw_convert<string> (_worker_threads.size ()));
 		root->add_child("Version")->add_child_text (raw_convert<string> (SERVER_LINK_VERSION));
+		BOOST_FOREACH (TransportCodec i, Image::supported_transport_codecs()) {
+			root->add_child("TransportCodec")->add_child_text (transport_codec_to_string (i));
+		}
 		string xml = doc.write_to_string ("UTF-8");
 
 		if (_verbose) {
@@ -334,6 +429,86 @@ EncodeServer::handle (shared_ptr<Socket> socket)
 		_full_condition.wait (lock);
 	}
 
-	_queue.push_back (socket);
+	Request request;
+	request.socket = socket;
+	_queue.push_back (request);
 	_empty_condition.notify_all ();
 }
+
+/** Start a thread to read frames from a client which has asked for a persistent connection */
+void
+EncodeServer::start_connection (shared_ptr<Socket> socket)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (_terminate) {
+		return;
+	}
+
+	/* Tidy up after any connections which have closed */
+	list<shared_ptr<Connection> >::iterator i = _connections.begin ();
+	while (i != _connections.end()) {
+		list<shared_ptr<Connection> >::iterator tmp = i;
+		++tmp;
+		if ((*i)->finished) {
+			(*i)->thread->join ();
+			delete (*i)->thread;
+			_connections.erase (i);
+		}
+		i = tmp;
+	}
+
+	shared_ptr<Connection> c (new Connection);
+	c->socket = socket;
+	c->thread = new thread (bind (&EncodeServer::connection_thread, this, c));
+#ifdef DCPOMATIC_LINUX
+	pthread_setname_np (c->thread->native_handle(), "encode-server-connection");
+#endif
+	_connections.push_back (c);
+
+	if (_verbose) {
+		cout << "Persistent connection from " << socket->socket().remote_endpoint().address().to_string() << "\n";
+	}
+}
+
+/** Read frames from a persistent connection and queue them up for our worker threads.
+ *  We stop when the client closes the connection or stays quiet for longer than our timeout.
+ */
+void
+EncodeServer::connection_thread (shared_ptr<Connection> connection)
+{
+	try {
+		while (true) {
+			uint32_t const tag = connection->socket->read_uint32 ();
+			uint32_t const length = connection->socket->read_uint32 ();
+
+			Request request;
+			request.connection = connection;
+			request.tag = tag;
+			request.frame = read_request (connection->socket, length);
+			if (!request.frame) {
+				break;
+			}
+
+			boost::mutex::scoped_lock lock (_mutex);
+
+			/* Wait until the queue has gone down a bit */
+			while (_queue.size() >= _worker_threads.size() * 2 && !_terminate) {
+				_full_condition.wait (lock);
+			}
+
+			if (_terminate) {
+				break;
+			}
+
+			_queue.push_back (request);
+			_empty_condition.notify_all ();
+		}
+	} catch (std::exception& e) {
+		/* The client has gone away, or something else went wrong */
+		LOG_GENERAL ("Persistent connection closed (%1)", e.what());
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	connection->finished = true;
+}
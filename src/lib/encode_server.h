@@ -34,6 +34,7 @@
 
 class Socket;
 class Log;
+class DCPVideo;
 
 /** @class EncodeServer
  *  @brief A class to run a server which can accept requests to perform JPEG2000
@@ -48,14 +49,55 @@ public:
 	void run ();
 
 private:
+	/** A persistent connection from a client, which may have several frames
+	 *  being encoded at once.
+	 */
+	struct Connection
+	{
+		Connection ()
+			: thread (0)
+			, finished (false)
+		{}
+
+		boost::shared_ptr<Socket> socket;
+		/** mutex held while writing a reply to socket */
+		boost::mutex write_mutex;
+		/** thread which reads requests from socket */
+		boost::thread* thread;
+		/** true when thread has finished */
+		bool finished;
+	};
+
+	/** Something for a worker thread to do; either a new connection whose
+	 *  first request has not yet been read, or a frame from a persistent connection.
+	 */
+	struct Request
+	{
+		Request ()
+			: tag (0)
+		{}
+
+		boost::shared_ptr<Socket> socket;
+		boost::shared_ptr<Connection> connection;
+		/** client's tag for frame, to go back with the reply */
+		uint32_t tag;
+		boost::shared_ptr<DCPVideo> frame;
+	};
+
 	void handle (boost::shared_ptr<Socket>);
 	void worker_thread ();
-	int process (boost::shared_ptr<Socket> socket, struct timeval &, struct timeval &);
+	boost::shared_ptr<DCPVideo> read_request (boost::shared_ptr<Socket> socket, uint32_t length);
+	int process (boost::shared_ptr<Socket> socket, uint32_t length, struct timeval &, struct timeval &);
+	int process (Request request, struct timeval &, struct timeval &);
+	void start_connection (boost::shared_ptr<Socket> socket);
+	void connection_thread (boost::shared_ptr<Connection> connection);
 	void broadcast_thread ();
 	void broadcast_received ();
 
 	std::vector<boost::thread *> _worker_threads;
-	std::list<boost::shared_ptr<Socket> > _queue;
+	std::list<Request> _queue;
+	/** persistent connections from clients */
+	std::list<boost::shared_ptr<Connection> > _connections;
 	boost::condition _full_condition;
 	boost::condition _empty_condition;
 	bool _verbose;
@@ -0,0 +1,230 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/encode_server_connection.cc
+ *  @brief EncodeServerConnection class.
+ */
+
+#include "encode_server_connection.h"
+#include "dcpomatic_socket.h"
+#include "dcp_video.h"
+#include "data_pool.h"
+#include "exceptions.h"
+#include "dcpomatic_assert.h"
+#include "config.h"
+#include "cross.h"
+#include "log.h"
+#include "dcpomatic_log.h"
+#include "compose.hpp"
+#include <dcp/raw_convert.h>
+#include <boost/asio.hpp>
+
+#include "i18n.h"
+
+using std::map;
+using std::string;
+using boost::shared_ptr;
+using boost::optional;
+using dcp::Data;
+using dcp::raw_convert;
+
+/** @param server Server to connect to.
+ *  @param timeout Timeout for network operations, in seconds.
+ */
+EncodeServerConnection::EncodeServerConnection (EncodeServerDescription server, int timeout)
+	: _server (server)
+	, _timeout (timeout)
+	, _next_tag (0)
+	, _bytes_sent (0)
+{
+
+}
+
+EncodeServerConnection::~EncodeServerConnection ()
+{
+	/* Nobody can be in encode() by now, so we don't need any locks */
+	if (_link) {
+		_link->socket->shutdown ();
+	}
+}
+
+/** Must be called with _send_mutex held.
+ *  @return Link to send the next request on, making a new connection if necessary.
+ */
+shared_ptr<EncodeServerConnection::Link>
+EncodeServerConnection::link ()
+{
+	boost::posix_time::ptime const now = boost::posix_time::microsec_clock::universal_time ();
+
+	if (_link) {
+		boost::mutex::scoped_lock lm (_mutex);
+		/* The server will drop the connection if it hears nothing from us for
+		   a while, so don't use a link which has been idle for a long time.
+		*/
+		if (!_link->broken && (now - _link->last_used).total_seconds() < (_timeout / 2)) {
+			return _link;
+		}
+	}
+
+	LOG_GENERAL ("Opening persistent connection to %1", _server.host_name());
+
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::resolver resolver (io_service);
+	boost::asio::ip::tcp::resolver::query query (_server.host_name(), raw_convert<string> (ENCODE_FRAME_PORT));
+	boost::asio::ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve (query);
+
+	shared_ptr<Link> l (new Link);
+	l->socket.reset (new Socket (_timeout));
+	l->socket->connect (*endpoint_iterator);
+	l->socket->write (ENCODE_SERVER_PERSISTENT_CONNECTION);
+	l->last_used = now;
+
+	_link = l;
+	return _link;
+}
+
+/** J2K-encode a frame on our server.  This can be called from any thread,
+ *  and blocks until the encoded data is available.
+ *  @return Encoded data.
+ */
+Data
+EncodeServerConnection::encode (shared_ptr<const DCPVideo> frame)
+{
+	shared_ptr<Link> l;
+	uint32_t tag;
+
+	{
+		boost::mutex::scoped_lock lm (_send_mutex);
+
+		l = link ();
+		tag = _next_tag++;
+
+		{
+			boost::mutex::scoped_lock lm2 (_mutex);
+			_replies[tag].link = l;
+		}
+
+		LOG_DEBUG_ENCODE (N_("Sending frame %1 to %2 with tag %3"), frame->index(), _server.host_name(), tag);
+
+		try {
+			uint64_t const before = l->socket->bytes_written ();
+			l->socket->write (tag);
+			frame->send_request (l->socket, _server);
+			_bytes_sent += l->socket->bytes_written() - before;
+			l->last_used = boost::posix_time::microsec_clock::universal_time ();
+		} catch (...) {
+			boost::mutex::scoped_lock lm2 (_mutex);
+			broken (l);
+			_replies.erase (tag);
+			throw;
+		}
+	}
+
+	LOG_TIMING ("start-remote-encode thread=%1", thread_id ());
+
+	boost::mutex::scoped_lock lm (_mutex);
+	while (true) {
+		map<uint32_t, Reply>::iterator i = _replies.find (tag);
+		DCPOMATIC_ASSERT (i != _replies.end());
+
+		if (i->second.data) {
+			Data data = i->second.data.get ();
+			_replies.erase (i);
+			LOG_DEBUG_ENCODE (N_("Finished remotely-encoded frame %1"), frame->index());
+			return data;
+		}
+
+		if (i->second.failed) {
+			_replies.erase (i);
+			throw NetworkError (String::compose (_("Encode of frame %1 on %2 failed"), frame->index(), _server.host_name()));
+		}
+
+		if (l->receiving) {
+			/* Someone else is reading replies; wait for them to find ours */
+			_condition.wait (lm);
+		} else {
+			receive (l, lm);
+		}
+	}
+}
+
+/** Read one reply from a link.
+ *  @param lm Lock on _mutex, which is released while we are reading.
+ */
+void
+EncodeServerConnection::receive (shared_ptr<Link> l, boost::mutex::scoped_lock& lm)
+{
+	l->receiving = true;
+	lm.unlock ();
+
+	uint32_t tag = 0;
+	optional<Data> data;
+
+	try {
+		tag = l->socket->read_uint32 ();
+		uint32_t const size = l->socket->read_uint32 ();
+		/* A zero size means that the server failed to encode the frame */
+		if (size > 0) {
+			LOG_TIMING ("start-remote-receive thread=%1", thread_id ());
+			Data d = DataPool::instance()->get (size);
+			l->socket->read (d.data().get(), d.size());
+			LOG_TIMING ("finish-remote-receive thread=%1", thread_id ());
+			data = d;
+		}
+	} catch (std::exception& e) {
+		LOG_ERROR ("Persistent connection to %1 failed (%2)", _server.host_name(), e.what());
+		lm.lock ();
+		l->receiving = false;
+		broken (l);
+		return;
+	}
+
+	lm.lock ();
+	l->receiving = false;
+
+	map<uint32_t, Reply>::iterator i = _replies.find (tag);
+	if (i != _replies.end()) {
+		if (data) {
+			i->second.data = data;
+		} else {
+			i->second.failed = true;
+		}
+	}
+
+	_condition.notify_all ();
+}
+
+/** Mark a link as broken and fail everything that was waiting for a reply on it.
+ *  Must be called with _mutex held.
+ */
+void
+EncodeServerConnection::broken (shared_ptr<Link> l)
+{
+	l->broken = true;
+	l->socket->shutdown ();
+
+	for (map<uint32_t, Reply>::iterator i = _replies.begin(); i != _replies.end(); ++i) {
+		if (i->second.link == l && !i->second.data) {
+			i->second.failed = true;
+		}
+	}
+
+	_condition.notify_all ();
+}
@@ -0,0 +1,116 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_ENCODE_SERVER_CONNECTION_H
+#define DCPOMATIC_ENCODE_SERVER_CONNECTION_H
+
+/** @file  src/lib/encode_server_connection.h
+ *  @brief EncodeServerConnection class.
+ */
+
+#include "encode_server_description.h"
+#include <dcp/data.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/atomic.hpp>
+#include <map>
+
+class Socket;
+class DCPVideo;
+
+/** @class EncodeServerConnection
+ *  @brief A persistent connection to an encode server which can carry several frames at once.
+ *
+ *  encode() can be called from many threads at the same time.  Each call sends its
+ *  frame as soon as the connection is free for writing, then waits for the reply;
+ *  the server can return replies in any order, and each is tagged so that we can
+ *  give it to the right caller.  The connection is made (or re-made) when needed.
+ *
+ *  This should only be used with servers whose EncodeServerDescription::persistent_connection()
+ *  is true.
+ */
+class EncodeServerConnection : public boost::noncopyable
+{
+public:
+	EncodeServerConnection (EncodeServerDescription server, int timeout = 30);
+	~EncodeServerConnection ();
+
+	dcp::Data encode (boost::shared_ptr<const DCPVideo> frame);
+
+	/** @return total number of bytes that have been sent to the server */
+	uint64_t bytes_sent () const {
+		return _bytes_sent;
+	}
+
+private:
+	/** One TCP connection to the server */
+	struct Link
+	{
+		Link ()
+			: receiving (false)
+			, broken (false)
+		{}
+
+		boost::shared_ptr<Socket> socket;
+		/** true if some thread is reading replies from the socket */
+		bool receiving;
+		/** true if the socket has failed */
+		bool broken;
+		/** time that we last sent something on the socket */
+		boost::posix_time::ptime last_used;
+	};
+
+	struct Reply
+	{
+		Reply ()
+			: failed (false)
+		{}
+
+		boost::shared_ptr<Link> link;
+		boost::optional<dcp::Data> data;
+		bool failed;
+	};
+
+	boost::shared_ptr<Link> link ();
+	void receive (boost::shared_ptr<Link> link, boost::mutex::scoped_lock& lm);
+	void broken (boost::shared_ptr<Link> link);
+
+	EncodeServerDescription _server;
+	int _timeout;
+
+	/** mutex which is held while sending a request, and which protects _link and _next_tag */
+	boost::mutex _send_mutex;
+	boost::shared_ptr<Link> _link;
+	uint32_t _next_tag;
+	boost::atomic<uint64_t> _bytes_sent;
+
+	/** mutex for _replies and the state of the Links */
+	boost::mutex _mutex;
+	/** condition which is notified when replies arrive */
+	boost::condition _condition;
+	/** replies that we are waiting for, or which have arrived, indexed by tag */
+	std::map<uint32_t, Reply> _replies;
+};
+
+#endif
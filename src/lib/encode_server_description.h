@@ -23,6 +23,8 @@
 
 #include "types.h"
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <algorithm>
+#include <list>
 
 /** @class EncodeServerDescription
  *  @brief Class to describe a server to which we can send encoding work.
@@ -60,8 +62,31 @@ public:
 		return _threads;
 	}
 
+	int link_version () const {
+		return _link_version;
+	}
+
+	/** @return true if we can talk to this server */
 	bool current_link_version () const {
-		return _link_version == SERVER_LINK_VERSION;
+		return _link_version >= SERVER_LINK_VERSION_SINGLE_FRAME && _link_version <= SERVER_LINK_VERSION;
+	}
+
+	/** @return true if this server can keep a connection open for many frames */
+	bool persistent_connection () const {
+		return _link_version >= SERVER_LINK_VERSION_PERSISTENT;
+	}
+
+	/** @return true if this server can read images sent with the given codec */
+	bool supports_transport_codec (TransportCodec c) const {
+		return c == TRANSPORT_CODEC_NONE || std::find (_transport_codecs.begin(), _transport_codecs.end(), c) != _transport_codecs.end();
+	}
+
+	std::list<TransportCodec> transport_codecs () const {
+		return _transport_codecs;
+	}
+
+	void set_transport_codecs (std::list<TransportCodec> c) {
+		_transport_codecs = c;
 	}
 
 	void set_host_name (std::string n) {
@@ -87,6 +112,8 @@ private:
 	int _threads;
 	/** server link (i.e. protocol) version number */
 	int _link_version;
+	/** codecs that the server can accept for image data */
+	std::list<TransportCodec> _transport_codecs;
 	boost::posix_time::ptime _last_seen;
 };
 
@@ -28,6 +28,7 @@
 #include <dcp/raw_convert.h>
 #include <libcxml/cxml.h>
 #include <boost/lambda/lambda.hpp>
+#include <boost/foreach.hpp>
 #include <iostream>
 
 #include "i18n.h"
@@ -230,12 +231,33 @@ EncodeServerFinder::handle_accept (boost::system::error_code ec, shared_ptr<Sock
 	shared_ptr<cxml::Document> xml (new cxml::Document ("ServerAvailable"));
 	xml->read_string (s);
 
+	list<TransportCodec> codecs;
+	BOOST_FOREACH (cxml::ConstNodePtr i, xml->node_children ("TransportCodec")) {
+		optional<TransportCodec> c = string_to_transport_codec (i->content ());
+		if (c) {
+			codecs.push_back (*c);
+		}
+	}
+
 	string const ip = socket->socket().remote_endpoint().address().to_string ();
 	optional<list<EncodeServerDescription>::iterator> found = server_found (ip);
 	if (found) {
-		(*found)->set_seen ();
+		bool changed = false;
+		{
+			boost::mutex::scoped_lock lm (_servers_mutex);
+			(*found)->set_seen ();
+			/* The server may have been restarted with different codecs */
+			if ((*found)->transport_codecs() != codecs) {
+				(*found)->set_transport_codecs (codecs);
+				changed = true;
+			}
+		}
+		if (changed) {
+			emit (boost::bind (boost::ref (ServersListChanged)));
+		}
 	} else {
 		EncodeServerDescription sd (ip, xml->number_child<int>("Threads"), xml->optional_number_child<int>("Version").get_value_or(0));
+		sd.set_transport_codecs (codecs);
 		{
 			boost::mutex::scoped_lock lm (_servers_mutex);
 			_servers.push_back (sd);
@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/encode_server_statistics.cc
+ *  @brief EncodeServerStatistics class.
+ */
+
+#include "encode_server_statistics.h"
+#include <boost/foreach.hpp>
+#include <algorithm>
+
+using std::min;
+using std::max;
+using boost::optional;
+
+/** Number of latencies to keep */
+static int const latency_history = 32;
+
+/** @param threads Number of threads that the server says it has */
+EncodeServerStatistics::EncodeServerStatistics (int threads)
+	: _history (latency_history)
+	, _maximum (max (1, threads * 2))
+	, _limit (max (1, threads))
+	, _in_flight (0)
+	, _since_change (0)
+{
+
+}
+
+/** Wait until another frame may be sent to the server.  This is a
+ *  boost::thread interruption point.
+ */
+void
+EncodeServerStatistics::acquire ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	while (_in_flight >= _limit) {
+		_condition.wait (lm);
+	}
+	++_in_flight;
+}
+
+/** Note that a frame which was allowed by acquire() is no longer in flight */
+void
+EncodeServerStatistics::release ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	--_in_flight;
+	_condition.notify_all ();
+}
+
+/** Add the result of an encode.
+ *  @param latency Time in seconds between sending the frame and getting it back,
+ *  or none if the encode failed.
+ */
+void
+EncodeServerStatistics::add (optional<double> latency)
+{
+	if (latency) {
+		_history.event ();
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (!latency) {
+		_limit = max (1, _limit / 2);
+		_since_change = 0;
+		_condition.notify_all ();
+		return;
+	}
+
+	_latencies.push_front (*latency);
+	if (int (_latencies.size()) > latency_history) {
+		_latencies.pop_back ();
+	}
+
+	++_since_change;
+
+	/* Wait for a few results at each setting before judging it */
+	if (_since_change < _limit || int (_latencies.size()) < 4) {
+		_condition.notify_all ();
+		return;
+	}
+
+	double fastest = _latencies.front ();
+	BOOST_FOREACH (double i, _latencies) {
+		fastest = min (fastest, i);
+	}
+
+	if (*latency < fastest * 1.5 && _limit < _maximum) {
+		++_limit;
+		_since_change = 0;
+	} else if (*latency > fastest * 2.5 && _limit > 1) {
+		--_limit;
+		_since_change = 0;
+	}
+
+	_condition.notify_all ();
+}
+
+/** @return current maximum number of frames that may be in flight */
+int
+EncodeServerStatistics::limit () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _limit;
+}
+
+/** @return number of frames currently in flight */
+int
+EncodeServerStatistics::in_flight () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _in_flight;
+}
+
+/** @return mean of recent encode latencies in seconds, or 0 if not known */
+double
+EncodeServerStatistics::latency () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	if (_latencies.empty ()) {
+		return 0;
+	}
+
+	double total = 0;
+	BOOST_FOREACH (double i, _latencies) {
+		total += i;
+	}
+	return total / _latencies.size ();
+}
+
+/** @return recent rate of successful encodes in frames per second, or 0 if not known */
+float
+EncodeServerStatistics::rate () const
+{
+	return _history.rate ();
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_ENCODE_SERVER_STATISTICS_H
+#define DCPOMATIC_ENCODE_SERVER_STATISTICS_H
+
+/** @file  src/lib/encode_server_statistics.h
+ *  @brief EncodeServerStatistics class.
+ */
+
+#include "event_history.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
+#include <list>
+
+/** @class EncodeServerStatistics
+ *  @brief Record of how quickly a server is encoding frames, which also
+ *  decides how many frames the server should have in flight at once.
+ *
+ *  Encoder threads call acquire() before taking a frame to send to the server,
+ *  add() with the result and then release().  The number of frames that
+ *  may be in flight starts at the number of threads that the server advertises and
+ *  then changes between 1 and twice that number.  If frames come back almost as
+ *  quickly as the fastest recent frame the limit is raised, as the server probably
+ *  has capacity to spare; if they take much longer the server is queueing work (or
+ *  is busy with something else) so the limit is lowered.  Failures halve the limit.
+ */
+class EncodeServerStatistics : public boost::noncopyable
+{
+public:
+	explicit EncodeServerStatistics (int threads);
+
+	void acquire ();
+	void release ();
+	void add (boost::optional<double> latency);
+
+	/** @return maximum number of frames that acquire() will ever allow in flight */
+	int maximum () const {
+		return _maximum;
+	}
+
+	int limit () const;
+	int in_flight () const;
+	double latency () const;
+	float rate () const;
+
+private:
+	/** mutex for everything except _history */
+	mutable boost::mutex _mutex;
+	/** condition which is notified when a frame is released or the limit changes */
+	boost::condition _condition;
+	EventHistory _history;
+	/** recent encode latencies in seconds, most recent first */
+	std::list<double> _latencies;
+	int const _maximum;
+	int _limit;
+	int _in_flight;
+	/** number of successful frames since _limit last changed */
+	int _since_change;
+};
+
+#endif
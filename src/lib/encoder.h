@@ -24,6 +24,7 @@
 #include "types.h"
 #include "player_text.h"
 #include <boost/weak_ptr.hpp>
+#include <boost/optional.hpp>
 #include <boost/signals2.hpp>
 
 class Film;
@@ -47,6 +48,10 @@ public:
 	/** @return the number of frames that are done */
 	virtual Frame frames_done () const = 0;
 	virtual bool finishing () const = 0;
+	/** @return bytes of encoded data being held in memory, if this is known */
+	virtual boost::optional<int64_t> memory_used () const {
+		return boost::optional<int64_t> ();
+	}
 
 protected:
 	boost::shared_ptr<const Film> _film;
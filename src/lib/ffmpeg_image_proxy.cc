@@ -23,6 +23,7 @@
 #include "exceptions.h"
 #include "dcpomatic_socket.h"
 #include "image.h"
+#include "binary_metadata.h"
 #include "compose.hpp"
 #include "util.h"
 #include <dcp/raw_convert.h>
@@ -68,6 +69,15 @@ FFmpegImageProxy::FFmpegImageProxy (shared_ptr<cxml::Node>, shared_ptr<Socket> s
 	socket->read (_data.data().get(), size);
 }
 
+/** The image data itself follows the metadata on the socket, so there is nothing to read from \p reader */
+FFmpegImageProxy::FFmpegImageProxy (BinaryReader &, shared_ptr<Socket> socket)
+	: _pos (0)
+{
+	uint32_t const size = socket->read_uint32 ();
+	_data = dcp::Data (size);
+	socket->read (_data.data().get(), size);
+}
+
 static int
 avio_read_wrapper (void* data, uint8_t* buffer, int amount)
 {
@@ -202,7 +212,13 @@ FFmpegImageProxy::add_metadata (xmlpp::Node* node) const
 }
 
 void
-FFmpegImageProxy::send_binary (shared_ptr<Socket> socket) const
+FFmpegImageProxy::add_binary_metadata (BinaryWriter& writer) const
+{
+	writer.write_uint8 (IMAGE_PROXY_FFMPEG);
+}
+
+void
+FFmpegImageProxy::send_binary (shared_ptr<Socket> socket, TransportCodec) const
 {
 	socket->write (_data.size());
 	socket->write (_data.data().get(), _data.size());
@@ -29,13 +29,15 @@ public:
 	explicit FFmpegImageProxy (boost::filesystem::path);
 	explicit FFmpegImageProxy (dcp::Data);
 	FFmpegImageProxy (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
+	FFmpegImageProxy (BinaryReader& reader, boost::shared_ptr<Socket> socket);
 
 	std::pair<boost::shared_ptr<Image>, int> image (
 		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
 		) const;
 
 	void add_metadata (xmlpp::Node *) const;
-	void send_binary (boost::shared_ptr<Socket>) const;
+	void add_binary_metadata (BinaryWriter &) const;
+	void send_binary (boost::shared_ptr<Socket>, TransportCodec codec) const;
 	bool same (boost::shared_ptr<const ImageProxy> other) const;
 	size_t memory_used () const;
 
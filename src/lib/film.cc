@@ -213,12 +213,28 @@ Film::~Film ()
 
 string
 Film::video_identifier () const
+{
+	return video_identifier (_playlist->video_identifier());
+}
+
+/** @return Identifier for the video in one reel, which changes only when something changes
+ *  that would affect that reel's picture asset.
+ */
+string
+Film::reel_video_identifier (DCPTimePeriod period) const
+{
+	return video_identifier (_playlist->video_identifier(shared_from_this(), period));
+}
+
+/** @param playlist_identifier Identifier for the part of our playlist that the video is made from */
+string
+Film::video_identifier (string playlist_identifier) const
 {
 	DCPOMATIC_ASSERT (container ());
 
 	string s = container()->id()
 		+ "_" + resolution_to_string (_resolution)
-		+ "_" + _playlist->video_identifier()
+		+ "_" + playlist_identifier
 		+ "_" + raw_convert<string>(_video_frame_rate)
 		+ "_" + raw_convert<string>(j2k_bandwidth());
 
@@ -247,7 +263,17 @@ Film::info_file (DCPTimePeriod period) const
 {
 	boost::filesystem::path p;
 	p /= "info";
-	p /= video_identifier () + "_" + raw_convert<string> (period.from.get()) + "_" + raw_convert<string> (period.to.get());
+	p /= reel_video_identifier (period) + "_" + raw_convert<string> (period.from.get()) + "_" + raw_convert<string> (period.to.get());
+	return file (p);
+}
+
+/** @return The file to write the digest of a finished internal video asset to */
+boost::filesystem::path
+Film::picture_digest_file (DCPTimePeriod period) const
+{
+	boost::filesystem::path p;
+	p /= "info";
+	p /= reel_video_identifier (period) + "_" + raw_convert<string> (period.from.get()) + "_" + raw_convert<string> (period.to.get()) + ".digest";
 	return file (p);
 }
 
@@ -260,7 +286,7 @@ Film::internal_video_asset_dir () const
 boost::filesystem::path
 Film::internal_video_asset_filename (DCPTimePeriod p) const
 {
-	return video_identifier() + "_" + raw_convert<string> (p.from.get()) + "_" + raw_convert<string> (p.to.get()) + ".mxf";
+	return reel_video_identifier(p) + "_" + raw_convert<string> (p.from.get()) + "_" + raw_convert<string> (p.to.get()) + ".mxf";
 }
 
 boost::filesystem::path
@@ -1040,30 +1066,15 @@ Film::set_isdcf_date_today ()
 	_isdcf_date = boost::gregorian::day_clock::local_day ();
 }
 
+/** @return Path of a file which Writer can use to hold encoded frames which it
+ *  cannot write to the DCP yet.
+ */
 boost::filesystem::path
-Film::j2c_path (int reel, Frame frame, Eyes eyes, bool tmp) const
+Film::j2c_spill_path () const
 {
 	boost::filesystem::path p;
 	p /= "j2c";
-	p /= video_identifier ();
-
-	char buffer[256];
-	snprintf(buffer, sizeof(buffer), "%08d_%08" PRId64, reel, frame);
-	string s (buffer);
-
-	if (eyes == EYES_LEFT) {
-		s += ".L";
-	} else if (eyes == EYES_RIGHT) {
-		s += ".R";
-	}
-
-	s += ".j2c";
-
-	if (tmp) {
-		s += ".tmp";
-	}
-
-	p /= s;
+	p /= video_identifier () + ".spill";
 	return file (p);
 }
 
@@ -1701,37 +1712,3 @@ Film::closed_caption_tracks () const
 
 	return tt;
 }
-
-shared_ptr<InfoFileHandle>
-Film::info_file_handle (DCPTimePeriod period, bool read) const
-{
-	return shared_ptr<InfoFileHandle> (new InfoFileHandle(_info_file_mutex, info_file(period), read));
-}
-
-InfoFileHandle::InfoFileHandle (boost::mutex& mutex, boost::filesystem::path file, bool read)
-	: _lock (mutex)
-	, _file (file)
-{
-	if (read) {
-		_handle = fopen_boost (file, "rb");
-		if (!_handle) {
-			throw OpenFileError (file, errno, OpenFileError::READ);
-		}
-	} else {
-		bool const exists = boost::filesystem::exists (file);
-		if (exists) {
-			_handle = fopen_boost (file, "r+b");
-		} else {
-			_handle = fopen_boost (file, "wb");
-		}
-
-		if (!_handle) {
-			throw OpenFileError (file, errno, exists ? OpenFileError::READ_WRITE : OpenFileError::WRITE);
-		}
-	}
-}
-
-InfoFileHandle::~InfoFileHandle ()
-{
-	fclose (_handle);
-}
@@ -61,29 +61,6 @@ class ScreenKDM;
 class Film;
 struct isdcf_name_test;
 
-class InfoFileHandle
-{
-public:
-	~InfoFileHandle ();
-
-	FILE* get () const {
-		return _handle;
-	}
-
-	boost::filesystem::path file () const {
-		return _file;
-	}
-
-private:
-	friend class Film;
-
-	InfoFileHandle (boost::mutex& mutex, boost::filesystem::path file, bool read);
-
-	boost::mutex::scoped_lock _lock;
-	FILE* _handle;
-	boost::filesystem::path _file;
-};
-
 /** @class Film
  *
  *  @brief A representation of some audio and video content, and details of
@@ -97,8 +74,11 @@ public:
 	explicit Film (boost::optional<boost::filesystem::path> dir);
 	~Film ();
 
-	boost::shared_ptr<InfoFileHandle> info_file_handle (DCPTimePeriod period, bool read) const;
-	boost::filesystem::path j2c_path (int, Frame, Eyes, bool) const;
+	std::string video_identifier () const;
+	std::string reel_video_identifier (DCPTimePeriod period) const;
+	boost::filesystem::path info_file (DCPTimePeriod p) const;
+	boost::filesystem::path picture_digest_file (DCPTimePeriod p) const;
+	boost::filesystem::path j2c_spill_path () const;
 	boost::filesystem::path internal_video_asset_dir () const;
 	boost::filesystem::path internal_video_asset_filename (DCPTimePeriod p) const;
 
@@ -371,11 +351,9 @@ private:
 	friend struct ::isdcf_name_test;
 	template <typename> friend class ChangeSignaller;
 
-	boost::filesystem::path info_file (DCPTimePeriod p) const;
-
 	void signal_change (ChangeType, Property);
 	void signal_change (ChangeType, int);
-	std::string video_identifier () const;
+	std::string video_identifier (std::string playlist_identifier) const;
 	void playlist_change (ChangeType);
 	void playlist_order_changed ();
 	void playlist_content_change (ChangeType type, boost::weak_ptr<Content>, int, bool frequent);
@@ -442,9 +420,6 @@ private:
 	/** film being used as a template, or 0 */
 	boost::shared_ptr<Film> _template_film;
 
-
-	mutable boost::mutex _info_file_mutex;
-
 	boost::signals2::scoped_connection _playlist_change_connection;
 	boost::signals2::scoped_connection _playlist_order_changed_connection;
 	boost::signals2::scoped_connection _playlist_content_change_connection;
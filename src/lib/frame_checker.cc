@@ -0,0 +1,216 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/frame_checker.cc
+ *  @brief FrameChecker class.
+ */
+
+#include "frame_checker.h"
+#include "digester.h"
+#include "exceptions.h"
+#include "cross.h"
+#include "dcpomatic_log.h"
+#include <dcp/data.h>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <sys/time.h>
+
+using std::vector;
+using std::max;
+using boost::optional;
+using boost::shared_array;
+using boost::shared_ptr;
+using boost::bind;
+
+/** Size of the blocks that we read from the asset */
+static int64_t const block_size = 32 * 1024 * 1024;
+/** Maximum number of bytes that can be read and waiting to be hashed */
+static int64_t const maximum_pending_bytes = 256 * 1024 * 1024;
+
+FrameChecker::FrameChecker (boost::filesystem::path asset)
+	: _asset (asset)
+	, _pending_bytes (0)
+{
+	_file = fopen_boost (_asset, "rb");
+	if (!_file) {
+		throw OpenFileError (_asset, errno, OpenFileError::READ);
+	}
+}
+
+FrameChecker::~FrameChecker ()
+{
+	fclose (_file);
+}
+
+/** @return true if the frame described by info is present and correct in the asset */
+bool
+FrameChecker::check (dcp::FrameInfo const & info)
+{
+	if (info.size == 0) {
+		return false;
+	}
+
+	dcpomatic_fseek (_file, info.offset, SEEK_SET);
+	dcp::Data data (info.size);
+	size_t const read = fread (data.data().get(), 1, data.size(), _file);
+	if (read != static_cast<size_t> (data.size ())) {
+		LOG_GENERAL ("Read %1 bytes of asset data; wanted %2", read, info.size);
+		return false;
+	}
+
+	Digester digester;
+	digester.add (data.data().get(), data.size());
+	if (digester.get() != info.hash) {
+		LOG_GENERAL ("Hash %1 vs %2", digester.get(), info.hash);
+		return false;
+	}
+
+	return true;
+}
+
+/** Check some frames.  They must be in the order that they appear in the asset.
+ *  @param frames Frames to check.
+ *  @param progress Function to call with the proportion of the frames that have been read
+ *  and the rate at which we are reading them in MB/s.
+ *  @return Index into frames of the first frame that is not correct, or none if they are all correct.
+ */
+optional<size_t>
+FrameChecker::first_bad (vector<dcp::FrameInfo> const & frames, boost::function<void (float, float)> progress)
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_ok.assign (frames.size(), false);
+		_pending_bytes = 0;
+	}
+
+	int64_t total = 0;
+	for (vector<dcp::FrameInfo>::const_iterator i = frames.begin(); i != frames.end(); ++i) {
+		total += i->size;
+	}
+
+	boost::asio::io_service service;
+	shared_ptr<boost::asio::io_service::work> work (new boost::asio::io_service::work (service));
+	boost::thread_group pool;
+	for (unsigned int i = 0; i < max (1U, boost::thread::hardware_concurrency()); ++i) {
+		pool.create_thread (bind (&boost::asio::io_service::run, &service));
+	}
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+	int64_t done = 0;
+
+	try {
+		size_t i = 0;
+		while (i < frames.size()) {
+			if (frames[i].size == 0) {
+				/* This frame was never written */
+				++i;
+				continue;
+			}
+
+			/* Make a block of frames which follow each other in the asset; the gaps
+			   between them are small, so we just read those too.
+			*/
+			int64_t const block_start = frames[i].offset;
+			int64_t block_end = frames[i].offset + frames[i].size;
+			int64_t frame_bytes = frames[i].size;
+			size_t j = i + 1;
+			while (
+				j < frames.size() &&
+				frames[j].size > 0 &&
+				static_cast<int64_t> (frames[j].offset) >= block_end &&
+				static_cast<int64_t> (frames[j].offset + frames[j].size) - block_start <= block_size
+				) {
+				block_end = frames[j].offset + frames[j].size;
+				frame_bytes += frames[j].size;
+				++j;
+			}
+
+			{
+				boost::mutex::scoped_lock lm (_mutex);
+				while (_pending_bytes > maximum_pending_bytes) {
+					_hashed.wait (lm);
+				}
+				_pending_bytes += frame_bytes;
+			}
+
+			shared_array<uint8_t> block (new uint8_t[block_end - block_start]);
+			dcpomatic_fseek (_file, block_start, SEEK_SET);
+			int64_t const read = fread (block.get(), 1, block_end - block_start, _file);
+
+			for (size_t k = i; k < j; ++k) {
+				size_t const offset = frames[k].offset - block_start;
+				if (static_cast<int64_t> (offset + frames[k].size) <= read) {
+					service.post (bind (&FrameChecker::hash, this, block, offset, k, frames[k]));
+				} else {
+					/* This frame is not all there so it stays marked as bad */
+					boost::mutex::scoped_lock lm (_mutex);
+					_pending_bytes -= frames[k].size;
+				}
+			}
+
+			done += frame_bytes;
+
+			struct timeval now;
+			gettimeofday (&now, 0);
+			double const seconds = (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+			if (progress && total > 0) {
+				progress (float (done) / total, seconds > 0 ? done / (seconds * 1000000) : 0);
+			}
+
+			i = j;
+		}
+	} catch (...) {
+		work.reset ();
+		pool.join_all ();
+		throw;
+	}
+
+	work.reset ();
+	pool.join_all ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+	for (size_t i = 0; i < _ok.size(); ++i) {
+		if (!_ok[i]) {
+			return i;
+		}
+	}
+
+	return optional<size_t> ();
+}
+
+/** Hash one frame and record whether it was correct.
+ *  @param block Block of data from the asset.
+ *  @param offset Offset of the frame within block.
+ *  @param index Index of the frame within the frames passed to first_bad().
+ *  @param info Frame information.
+ */
+void
+FrameChecker::hash (shared_array<uint8_t> block, size_t offset, size_t index, dcp::FrameInfo info)
+{
+	Digester digester;
+	digester.add (block.get() + offset, info.size);
+	bool const ok = digester.get() == info.hash;
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_ok[index] = ok;
+	_pending_bytes -= info.size;
+	_hashed.notify_all ();
+}
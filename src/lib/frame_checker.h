@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_FRAME_CHECKER_H
+#define DCPOMATIC_FRAME_CHECKER_H
+
+/** @file  src/lib/frame_checker.h
+ *  @brief FrameChecker class.
+ */
+
+#include <dcp/picture_asset_writer.h>
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
+#include <cstdio>
+
+/** @class FrameChecker
+ *  @brief Check that frames in an existing picture asset match the dcp::FrameInfo
+ *  that we recorded when we wrote them.
+ *
+ *  Single frames can be checked with check().  Runs of frames can be checked with
+ *  first_bad(), which reads the asset sequentially in large blocks and hashes the
+ *  frames on as many threads as there are cores.
+ */
+class FrameChecker : public boost::noncopyable
+{
+public:
+	explicit FrameChecker (boost::filesystem::path asset);
+	~FrameChecker ();
+
+	bool check (dcp::FrameInfo const & info);
+	boost::optional<size_t> first_bad (std::vector<dcp::FrameInfo> const & frames, boost::function<void (float, float)> progress);
+
+private:
+	void hash (boost::shared_array<uint8_t> block, size_t offset, size_t index, dcp::FrameInfo info);
+
+	boost::filesystem::path _asset;
+	FILE* _file;
+
+	/** mutex for _ok and _pending_bytes */
+	boost::mutex _mutex;
+	/** condition which is signalled when a frame has been hashed */
+	boost::condition _hashed;
+	/** result of the check of each frame passed to first_bad() */
+	std::vector<bool> _ok;
+	/** number of bytes of frames that have been read but not yet hashed */
+	int64_t _pending_bytes;
+};
+
+#endif
@@ -0,0 +1,319 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/frame_info_file.cc
+ *  @brief FrameInfoFile class.
+ */
+
+#include "frame_info_file.h"
+#include "dcpomatic_assert.h"
+#include "exceptions.h"
+#include "cross.h"
+#include "util.h"
+#include "dcpomatic_log.h"
+#include <boost/scoped_array.hpp>
+#ifdef DCPOMATIC_WINDOWS
+#include <windows.h>
+#endif
+#include <cstring>
+#include <cstdio>
+
+using std::string;
+using std::max;
+using boost::scoped_array;
+using boost::shared_lock;
+using boost::unique_lock;
+using boost::shared_mutex;
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::read_write;
+
+/** Magic bytes at the start of the file, followed by a uint32_t version and a uint32_t record size */
+static char const magic[8] = { 'D', 'C', 'P', 'O', 'M', 'F', 'I', '\0' };
+int const FrameInfoFile::header_size = 16;
+/** int64_t offset, int64_t size, 16-byte MD5 digest */
+int const FrameInfoFile::record_size = 32;
+/** int64_t offset, int64_t size, 32-character hex MD5 digest */
+int const FrameInfoFile::old_record_size = 48;
+uint32_t const FrameInfoFile::version = 2;
+
+/** Number of records to add to the file when it needs to grow */
+static int const growth = 4096;
+
+static void
+write_header (FILE* f, boost::filesystem::path path)
+{
+	uint8_t header[FrameInfoFile::header_size];
+	memset (header, 0, sizeof (header));
+	memcpy (header, magic, sizeof (magic));
+	uint32_t const rs = FrameInfoFile::record_size;
+	memcpy (header + 8, &FrameInfoFile::version, 4);
+	memcpy (header + 12, &rs, 4);
+	checked_fwrite (header, sizeof (header), f, path);
+}
+
+/** @param file File to open, which will be created or converted from the old format if required.
+ *  @param records Number of records that the file should be able to hold without growing.
+ */
+FrameInfoFile::FrameInfoFile (boost::filesystem::path file, int records)
+	: _file (file)
+#ifdef DCPOMATIC_WINDOWS
+	, _file_handle (INVALID_HANDLE_VALUE)
+	, _mapping_handle (0)
+#endif
+	, _address (0)
+	, _records (0)
+{
+	check_format ();
+
+	if (!boost::filesystem::exists (_file)) {
+		FILE* f = fopen_boost (_file, "wb");
+		if (!f) {
+			throw OpenFileError (_file, errno, OpenFileError::WRITE);
+		}
+		write_header (f, _file);
+		fclose (f);
+	}
+
+	map (max (1, records));
+}
+
+FrameInfoFile::~FrameInfoFile ()
+{
+	unmap ();
+}
+
+/** If our file is in the old format, convert it to the new one.  This is done
+ *  via a temporary file so that the old file is not lost if we fail.  If it is
+ *  in a format that we don't understand, remove it.
+ */
+void
+FrameInfoFile::check_format () const
+{
+	if (!boost::filesystem::exists (_file)) {
+		return;
+	}
+
+	boost::uintmax_t const size = boost::filesystem::file_size (_file);
+
+	FILE* in = fopen_boost (_file, "rb");
+	if (!in) {
+		throw OpenFileError (_file, errno, OpenFileError::READ);
+	}
+
+	uint8_t header[header_size];
+	if (size >= boost::uintmax_t (header_size) && fread (header, 1, header_size, in) == size_t (header_size) && memcmp (header, magic, sizeof (magic)) == 0) {
+		fclose (in);
+		uint32_t file_version;
+		uint32_t file_record_size;
+		memcpy (&file_version, header + 8, 4);
+		memcpy (&file_record_size, header + 12, 4);
+		if (file_version != version || file_record_size != uint32_t (record_size)) {
+			LOG_WARNING ("Frame info file %1 has unknown version %2; starting again", _file.string(), file_version);
+			boost::filesystem::remove (_file);
+		}
+		return;
+	}
+
+	int const N = size / old_record_size;
+	LOG_GENERAL ("Converting frame info file %1 with %2 records to the new format", _file.string(), N);
+
+	boost::filesystem::path tmp = _file;
+	tmp += ".tmp";
+	FILE* out = fopen_boost (tmp, "wb");
+	if (!out) {
+		fclose (in);
+		throw OpenFileError (tmp, errno, OpenFileError::WRITE);
+	}
+
+	write_header (out, tmp);
+
+	dcpomatic_fseek (in, 0, SEEK_SET);
+	for (int i = 0; i < N; ++i) {
+		uint8_t old_record[old_record_size];
+		checked_fread (old_record, old_record_size, in, _file);
+		uint8_t new_record[record_size];
+		memcpy (new_record, old_record, 16);
+		for (int j = 0; j < 16; ++j) {
+			char hex[3] = { char (old_record[16 + j * 2]), char (old_record[17 + j * 2]), '\0' };
+			new_record[16 + j] = strtol (hex, 0, 16);
+		}
+		checked_fwrite (new_record, record_size, out, tmp);
+	}
+
+	fclose (in);
+	fclose (out);
+
+	boost::filesystem::rename (tmp, _file);
+}
+
+/** Map our file, first making it big enough for a given number of records if necessary.
+ *  Must be called with an exclusive lock on _mutex, or from the constructor.
+ */
+void
+FrameInfoFile::map (int records)
+{
+	unmap ();
+
+	boost::uintmax_t const needed = header_size + boost::uintmax_t (records) * record_size;
+	if (boost::filesystem::file_size (_file) < needed) {
+		/* New space reads as zeros, which is what we want for unwritten records */
+		FILE* f = fopen_boost (_file, "r+b");
+		if (!f) {
+			throw OpenFileError (_file, errno, OpenFileError::WRITE);
+		}
+		dcpomatic_fseek (f, needed - 1, SEEK_SET);
+		uint8_t const zero = 0;
+		checked_fwrite (&zero, 1, f, _file);
+		fclose (f);
+	}
+
+	size_t const size = boost::filesystem::file_size (_file);
+
+#ifdef DCPOMATIC_WINDOWS
+	/* c_str() here should give a UTF-16 string */
+	_file_handle = CreateFileW (
+		_file.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0
+		);
+	if (_file_handle == INVALID_HANDLE_VALUE) {
+		throw OpenFileError (_file, GetLastError(), OpenFileError::WRITE);
+	}
+
+	_mapping_handle = CreateFileMappingW (_file_handle, 0, PAGE_READWRITE, 0, 0, 0);
+	if (_mapping_handle) {
+		_address = reinterpret_cast<uint8_t*> (MapViewOfFile (_mapping_handle, FILE_MAP_WRITE, 0, 0, 0));
+	}
+	if (!_address) {
+		DWORD const error = GetLastError ();
+		unmap ();
+		throw OpenFileError (_file, error, OpenFileError::WRITE);
+	}
+#else
+	_mapping.reset (new file_mapping (_file.c_str(), read_write));
+	_region.reset (new mapped_region (*_mapping, read_write));
+	_address = reinterpret_cast<uint8_t*> (_region->get_address ());
+#endif
+
+	_records = (size - header_size) / record_size;
+}
+
+/** Flush and drop any mapping of our file.  Must be called with an exclusive lock on _mutex,
+ *  or from the constructor or destructor.
+ */
+void
+FrameInfoFile::unmap ()
+{
+#ifdef DCPOMATIC_WINDOWS
+	if (_address) {
+		FlushViewOfFile (_address, 0);
+		UnmapViewOfFile (_address);
+	}
+	if (_mapping_handle) {
+		CloseHandle (_mapping_handle);
+		_mapping_handle = 0;
+	}
+	if (_file_handle != INVALID_HANDLE_VALUE) {
+		CloseHandle (_file_handle);
+		_file_handle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (_region) {
+		_region->flush ();
+	}
+	_region.reset ();
+	_mapping.reset ();
+#endif
+
+	_address = 0;
+	_records = 0;
+}
+
+uint8_t*
+FrameInfoFile::record (int index) const
+{
+	return _address + header_size + index * record_size;
+}
+
+/** Write a record.  Only one thread should write to a FrameInfoFile at any one time. */
+void
+FrameInfoFile::write (int index, dcp::FrameInfo const & info)
+{
+	DCPOMATIC_ASSERT (index >= 0);
+
+	uint8_t r[record_size];
+	memcpy (r, &info.offset, 8);
+	memcpy (r + 8, &info.size, 8);
+	memset (r + 16, 0, 16);
+	if (info.hash.length() == 32) {
+		for (int i = 0; i < 16; ++i) {
+			r[16 + i] = strtol (info.hash.substr(i * 2, 2).c_str(), 0, 16);
+		}
+	}
+
+	/* Hold readers off while we copy, so that none of them sees a half-written record */
+	unique_lock<shared_mutex> lm (_mutex);
+	if (index >= _records) {
+		map (index + growth);
+	}
+	memcpy (record (index), r, record_size);
+}
+
+/** Read a record; a record that has not been written will come back with size 0 */
+dcp::FrameInfo
+FrameInfoFile::read (int index) const
+{
+	DCPOMATIC_ASSERT (index >= 0);
+
+	uint8_t r[record_size];
+	{
+		shared_lock<shared_mutex> lm (_mutex);
+		if (index >= _records) {
+			return dcp::FrameInfo ();
+		}
+		memcpy (r, record (index), record_size);
+	}
+
+	dcp::FrameInfo info;
+	memcpy (&info.offset, r, 8);
+	memcpy (&info.size, r + 8, 8);
+
+	char hex[33];
+	for (int i = 0; i < 16; ++i) {
+		snprintf (hex + i * 2, 3, "%02x", r[16 + i]);
+	}
+	info.hash = hex;
+	return info;
+}
+
+/** @return Index of the last record that has been written, or -1 if none has */
+int
+FrameInfoFile::last_written () const
+{
+	shared_lock<shared_mutex> lm (_mutex);
+	for (int i = _records - 1; i >= 0; --i) {
+		int64_t size;
+		memcpy (&size, record (i) + 8, 8);
+		if (size != 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
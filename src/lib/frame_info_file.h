@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_FRAME_INFO_FILE_H
+#define DCPOMATIC_FRAME_INFO_FILE_H
+
+/** @file  src/lib/frame_info_file.h
+ *  @brief FrameInfoFile class.
+ */
+
+#include <dcp/picture_asset_writer.h>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+/** @class FrameInfoFile
+ *  @brief A file of dcp::FrameInfo, one fixed-size record for each frame of a picture asset.
+ *
+ *  The file is memory-mapped, so reading and writing a record is just a copy.  It starts
+ *  with a header giving its version, followed by records each holding the frame's offset
+ *  and size in the asset, and its MD5 digest in binary.  A record whose size is 0 has not
+ *  been written.
+ *
+ *  Files in the previous format (48-byte records with hex digests and no header) are
+ *  converted when they are opened.  Files with a version that we don't know are removed,
+ *  which just means that their frames will be encoded again.
+ *
+ *  The file is made big enough for the number of records asked for when it is opened,
+ *  and it grows if records beyond that are written.  Different threads can read at the
+ *  same time as each other; a write, which is just a short copy, holds them off so that
+ *  nobody sees a half-written record.
+ */
+class FrameInfoFile : public boost::noncopyable
+{
+public:
+	FrameInfoFile (boost::filesystem::path file, int records);
+	~FrameInfoFile ();
+
+	void write (int index, dcp::FrameInfo const & info);
+	dcp::FrameInfo read (int index) const;
+	int last_written () const;
+
+	boost::filesystem::path file () const {
+		return _file;
+	}
+
+	static int const header_size;
+	static int const record_size;
+	static int const old_record_size;
+	static uint32_t const version;
+
+private:
+	void map (int records);
+	void unmap ();
+	void check_format () const;
+	uint8_t* record (int index) const;
+
+	boost::filesystem::path _file;
+
+	/** mutex which is held exclusively while a record is written or the mapping is changed */
+	mutable boost::shared_mutex _mutex;
+#ifdef DCPOMATIC_WINDOWS
+	/* boost::interprocess can only open narrow paths, so we use the Windows API with wide ones */
+	void* _file_handle;
+	void* _mapping_handle;
+#else
+	boost::scoped_ptr<boost::interprocess::file_mapping> _mapping;
+	boost::scoped_ptr<boost::interprocess::mapped_region> _region;
+#endif
+	/** start of our mapping of the file, or 0 */
+	uint8_t* _address;
+	/** number of records that the file can currently hold */
+	int _records;
+};
+
+#endif
@@ -0,0 +1,332 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/frame_spill.cc
+ *  @brief FrameSpill class.
+ */
+
+#include "frame_spill.h"
+#include "exceptions.h"
+#include "dcpomatic_assert.h"
+#include "cross.h"
+#include "data_pool.h"
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <cerrno>
+
+using std::list;
+using std::map;
+using boost::optional;
+using dcp::Data;
+
+/** @param file File to spill to; it will be created when it is first needed, and removed
+ *  when this object is destroyed.
+ *  @param maximum_pending_bytes Number of bytes which can be waiting to be written before
+ *  wait_for_space() waits for the disk.
+ */
+FrameSpill::FrameSpill (boost::filesystem::path file, int64_t maximum_pending_bytes)
+	: _path (file)
+	, _file (0)
+	, _pending_bytes (0)
+	, _memory_bytes (0)
+	, _maximum_pending_bytes (maximum_pending_bytes)
+	, _end (0)
+	, _finish (false)
+{
+	_thread = new boost::thread (boost::bind (&FrameSpill::thread, this));
+#ifdef DCPOMATIC_LINUX
+	pthread_setname_np (_thread->native_handle(), "frame-spill");
+#endif
+}
+
+FrameSpill::~FrameSpill ()
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_finish = true;
+		_work_condition.notify_all ();
+	}
+
+	if (_thread->joinable ()) {
+		_thread->join ();
+	}
+	delete _thread;
+
+	if (_file) {
+		fclose (_file);
+		boost::system::error_code ec;
+		boost::filesystem::remove (_path, ec);
+	}
+}
+
+/** @return QueueItem to use as a key in _entries for some frame */
+QueueItem
+FrameSpill::key (QueueItem const & frame)
+{
+	QueueItem k = frame;
+	k.encoded = optional<Data> ();
+	return k;
+}
+
+/** Throw the exception that stopped our thread, if there was one.
+ *  @param lm Lock on _mutex, which will be released if there is something to throw.
+ */
+void
+FrameSpill::check_failed (boost::mutex::scoped_lock& lm) const
+{
+	if (_exception) {
+		boost::exception_ptr e = _exception;
+		lm.unlock ();
+		boost::rethrow_exception (e);
+	}
+}
+
+/** Wait until there is not too much data waiting to be written */
+void
+FrameSpill::wait_for_space ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	while (_pending_bytes > _maximum_pending_bytes) {
+		check_failed (lm);
+		_done_condition.wait (lm);
+	}
+	check_failed (lm);
+}
+
+/** Spill a frame.  This does not wait for anything; call wait_for_space() first
+ *  to avoid too much data building up in memory.
+ *  @param frame Frame.
+ *  @param data Frame's data.
+ */
+void
+FrameSpill::put (QueueItem const & frame, Data data)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	check_failed (lm);
+
+	QueueItem const k = key (frame);
+	Entry& e = _entries[k];
+	e.data = data;
+	e.size = data.size ();
+	e.offset = 0;
+	e.written = false;
+	e.wanted = false;
+	_to_write.push_back (k);
+	_pending_bytes += data.size ();
+	_memory_bytes += data.size ();
+	_work_condition.notify_all ();
+}
+
+/** Ask for a spilled frame to be read back into memory ready for get().  Asking
+ *  for a frame which has not been spilled, or asking more than once, does nothing.
+ */
+void
+FrameSpill::prefetch (QueueItem const & frame)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	map<QueueItem, Entry>::iterator i = _entries.find (key (frame));
+	if (i == _entries.end() || i->second.wanted) {
+		return;
+	}
+
+	i->second.wanted = true;
+	if (i->second.written && !i->second.data) {
+		_to_read.push_back (i->first);
+		_work_condition.notify_all ();
+	}
+}
+
+/** Take a frame back from the spill, waiting for it to be read if necessary.
+ *  The frame must have been given to put(), and get() can only be called once for each put().
+ */
+Data
+FrameSpill::get (QueueItem const & frame)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	map<QueueItem, Entry>::iterator i = _entries.find (key (frame));
+	DCPOMATIC_ASSERT (i != _entries.end());
+
+	if (!i->second.data) {
+		/* We need this now, so put it before anything that was only prefetched */
+		i->second.wanted = true;
+		_to_read.push_front (i->first);
+		_work_condition.notify_all ();
+		while (!i->second.data) {
+			check_failed (lm);
+			_done_condition.wait (lm);
+		}
+	}
+
+	if (!i->second.written) {
+		/* Our thread has not written this yet, and now it need not.  If it is in a batch
+		   that is already being written write() will find that its entry has gone.
+		*/
+		_to_write.remove (i->first);
+		_pending_bytes -= i->second.size;
+		_done_condition.notify_all ();
+	}
+
+	Data data = i->second.data.get ();
+	_memory_bytes -= data.size ();
+	_entries.erase (i);
+	return data;
+}
+
+void
+FrameSpill::thread ()
+try
+{
+	while (true) {
+		boost::mutex::scoped_lock lm (_mutex);
+		while (!_finish && _to_write.empty() && _to_read.empty()) {
+			_work_condition.wait (lm);
+		}
+
+		if (_finish) {
+			return;
+		}
+
+		/* Reads first, as the writer may be waiting for them */
+		if (!_to_read.empty ()) {
+			QueueItem const k = _to_read.front ();
+			_to_read.pop_front ();
+			lm.unlock ();
+			read (k);
+			continue;
+		}
+
+		list<QueueItem> batch;
+		batch.swap (_to_write);
+		lm.unlock ();
+		write (batch);
+	}
+}
+catch (...)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_exception = boost::current_exception ();
+	_done_condition.notify_all ();
+}
+
+/** Append some frames to the spill file; called from our thread */
+void
+FrameSpill::write (list<QueueItem> const & frames)
+{
+	/* Take references to the data, which stays in _entries (so that get() can
+	   find it) until it has been written.  Anything that get() has already taken
+	   back does not need writing.
+	*/
+	list<QueueItem> keys;
+	list<Data> data;
+	int64_t offset;
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		BOOST_FOREACH (QueueItem const & i, frames) {
+			map<QueueItem, Entry>::const_iterator j = _entries.find (i);
+			if (j != _entries.end() && !j->second.written) {
+				DCPOMATIC_ASSERT (j->second.data);
+				keys.push_back (i);
+				data.push_back (j->second.data.get());
+			}
+		}
+		offset = _end;
+	}
+
+	if (keys.empty ()) {
+		return;
+	}
+
+	if (!_file) {
+		_file = fopen_boost (_path, "w+b");
+		if (!_file) {
+			throw OpenFileError (_path, errno, OpenFileError::WRITE);
+		}
+	}
+
+	dcpomatic_fseek (_file, offset, SEEK_SET);
+	list<int64_t> offsets;
+	BOOST_FOREACH (Data const & i, data) {
+		if (fwrite (i.data().get(), 1, i.size(), _file) != size_t (i.size())) {
+			throw WriteFileError (_path, errno);
+		}
+		offsets.push_back (offset);
+		offset += i.size ();
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_end = offset;
+	list<int64_t>::const_iterator o = offsets.begin ();
+	list<Data>::const_iterator d = data.begin ();
+	BOOST_FOREACH (QueueItem const & i, keys) {
+		map<QueueItem, Entry>::iterator j = _entries.find (i);
+		/* The entry may have gone if get() was called while we were writing, in which case
+		   get() has already accounted for its pending bytes; it may also have been put()
+		   again since, in which case it is not the data that we wrote.
+		*/
+		if (j != _entries.end() && !j->second.written && j->second.data && j->second.data->data() == d->data()) {
+			_pending_bytes -= j->second.size;
+			j->second.offset = *o;
+			j->second.written = true;
+			if (!j->second.wanted) {
+				j->second.data = optional<Data> ();
+				_memory_bytes -= j->second.size;
+			}
+		}
+		++o;
+		++d;
+	}
+
+	_done_condition.notify_all ();
+}
+
+/** Read a frame back from the spill file; called from our thread */
+void
+FrameSpill::read (QueueItem const & frame)
+{
+	int64_t offset;
+	int size;
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		map<QueueItem, Entry>::const_iterator i = _entries.find (frame);
+		if (i == _entries.end() || i->second.data || !i->second.written) {
+			/* Already read, or not written yet (in which case it still has its data) */
+			return;
+		}
+		offset = i->second.offset;
+		size = i->second.size;
+	}
+
+	Data data = DataPool::instance()->get (size);
+	dcpomatic_fseek (_file, offset, SEEK_SET);
+	if (fread (data.data().get(), 1, size, _file) != size_t (size)) {
+		throw ReadFileError (_path, errno);
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	map<QueueItem, Entry>::iterator i = _entries.find (frame);
+	if (i != _entries.end()) {
+		i->second.data = data;
+		_memory_bytes += size;
+	}
+	_done_condition.notify_all ();
+}
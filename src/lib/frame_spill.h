@@ -0,0 +1,131 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_FRAME_SPILL_H
+#define DCPOMATIC_FRAME_SPILL_H
+
+/** @file  src/lib/frame_spill.h
+ *  @brief FrameSpill class.
+ */
+
+#include "writer_queue.h"
+#include <dcp/data.h>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/exception_ptr.hpp>
+#include <map>
+#include <list>
+
+/** @class FrameSpill
+ *  @brief A place on disk for encoded frames which the Writer can't write yet.
+ *
+ *  Frames are given to put() and are then appended to a single file by an I/O thread,
+ *  which writes everything that has built up since it last looked in one batch.
+ *  An index in memory records where each frame is in the file.
+ *
+ *  prefetch() asks the I/O thread to read a frame back into memory ready for get(),
+ *  so that the caller does not usually have to wait for the disk.
+ *
+ *  Frames are identified by the reel, frame and eyes of a QueueItem; any encoded
+ *  data in the QueueItems used as keys is ignored.
+ */
+class FrameSpill : public boost::noncopyable
+{
+public:
+	FrameSpill (boost::filesystem::path file, int64_t maximum_pending_bytes);
+	~FrameSpill ();
+
+	void wait_for_space ();
+	void put (QueueItem const & frame, dcp::Data data);
+	void prefetch (QueueItem const & frame);
+	dcp::Data get (QueueItem const & frame);
+
+	/** @return number of bytes of frames held in memory, either waiting to be written or read back */
+	int64_t memory_used () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _memory_bytes;
+	}
+
+	/** @return number of bytes written to the spill file so far */
+	int64_t bytes_written () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _end;
+	}
+
+private:
+	void thread ();
+	void write (std::list<QueueItem> const & frames);
+	void read (QueueItem const & frame);
+	void check_failed (boost::mutex::scoped_lock& lm) const;
+	static QueueItem key (QueueItem const & frame);
+
+	struct Entry
+	{
+		Entry ()
+			: size (0)
+			, offset (0)
+			, written (false)
+			, wanted (false)
+		{}
+
+		/** the frame's data, if it is waiting to be written or has been read back */
+		boost::optional<dcp::Data> data;
+		/** size of the frame's data in bytes */
+		int size;
+		/** offset of the frame's data within the file, if written is true */
+		int64_t offset;
+		bool written;
+		/** true if someone has asked for this frame to be read back */
+		bool wanted;
+	};
+
+	boost::filesystem::path _path;
+	/** spill file, which is only used by our thread */
+	FILE* _file;
+
+	/** mutex for everything below */
+	mutable boost::mutex _mutex;
+	/** condition to wake our thread when there is something to do */
+	boost::condition _work_condition;
+	/** condition to wake callers when something has been written or read */
+	boost::condition _done_condition;
+	std::map<QueueItem, Entry> _entries;
+	/** frames waiting to be written */
+	std::list<QueueItem> _to_write;
+	/** frames waiting to be read back; anything that is needed now goes at the front */
+	std::list<QueueItem> _to_read;
+	/** number of bytes waiting to be written */
+	int64_t _pending_bytes;
+	/** number of bytes of frame data held in _entries */
+	int64_t _memory_bytes;
+	/** maximum value of _pending_bytes before wait_for_space() blocks */
+	int64_t _maximum_pending_bytes;
+	/** offset of the end of the file */
+	int64_t _end;
+	bool _finish;
+	/** exception which stopped our thread, if there was one */
+	boost::exception_ptr _exception;
+
+	boost::thread* _thread;
+};
+
+#endif
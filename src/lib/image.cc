@@ -29,8 +29,12 @@
 #include "util.h"
 #include "compose.hpp"
 #include "dcpomatic_socket.h"
+#include "dcpomatic_assert.h"
+#include "xyz_converter.h"
+#include "image_pool.h"
 #include <dcp/rgb_xyz.h>
 #include <dcp/transfer_function.h>
+#include <dcp/openjpeg_image.h>
 extern "C" {
 #include <libswscale/swscale.h>
 #include <libavutil/pixfmt.h>
@@ -38,10 +42,19 @@ extern "C" {
 #include <libavutil/frame.h>
 }
 #include <png.h>
+#ifdef DCPOMATIC_HAVE_LZ4
+#include <lz4.h>
+#endif
+#include <boost/scoped_array.hpp>
 #if HAVE_VALGRIND_MEMCHECK_H
 #include <valgrind/memcheck.h>
 #endif
 #include <iostream>
+/* SSE2 is always there on x86_64, and when it's asked for on x86 */
+#ifdef __SSE2__
+#define DCPOMATIC_BLEND_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "i18n.h"
 
@@ -53,6 +66,8 @@ using std::cerr;
 using std::list;
 using std::runtime_error;
 using boost::shared_ptr;
+using boost::scoped_array;
+using boost::optional;
 using dcp::Size;
 
 int
@@ -117,6 +132,192 @@ Image::planes () const
 	return d->nb_components;
 }
 
+/** Tables of alpha and 1 - alpha for each 8-bit alpha value, holding exactly what
+ *  float (a) / 255 and 1 - float (a) / 255 would give.
+ */
+class AlphaTable
+{
+public:
+	AlphaTable ()
+	{
+		for (int i = 0; i < 256; ++i) {
+			alpha[i] = float (i) / 255;
+			one_minus_alpha[i] = 1 - alpha[i];
+		}
+	}
+
+	float alpha[256];
+	float one_minus_alpha[256];
+};
+
+static AlphaTable const alpha_table;
+
+/** Find the part of a line of RGBA or BGRA pixels which is not completely transparent.
+ *  @param op First pixel.
+ *  @param pixels Number of pixels.
+ *  @param first Filled in with the index of the first pixel whose alpha is not 0.
+ *  @param end Filled in with one more than the index of the last pixel whose alpha is not 0;
+ *  this will be equal to first if the whole line is transparent.
+ */
+static void
+opaque_span (uint8_t const * op, int pixels, int& first, int& end)
+{
+	first = 0;
+#ifdef DCPOMATIC_BLEND_SSE2
+	__m128i const alpha_mask = _mm_set1_epi32 (0xff000000);
+	__m128i const zero = _mm_setzero_si128 ();
+	while (first + 4 <= pixels) {
+		__m128i const a = _mm_and_si128 (_mm_loadu_si128 (reinterpret_cast<__m128i const *> (op + first * 4)), alpha_mask);
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (a, zero)) != 0xffff) {
+			break;
+		}
+		first += 4;
+	}
+#endif
+	while (first < pixels && op[first * 4 + 3] == 0) {
+		++first;
+	}
+
+	end = pixels;
+	while (end > first && op[end * 4 - 1] == 0) {
+		--end;
+	}
+}
+
+/** Blend one component of some pixels.  Each result is what the expression
+ *  o * alpha + t * (1 - alpha) would give with alpha = float (a) / 255.
+ *  @param tp First sample to blend onto.
+ *  @param t_step Distance in samples between the pixels of tp.
+ *  @param op First sample to blend.
+ *  @param o_step Distance in samples between the pixels of op.
+ *  @param ap First RGBA or BGRA pixel, from which the alpha is taken.
+ *  @param pixels Number of pixels.
+ */
+template <class T, class O>
+static void
+alpha_blend_samples (T* tp, int t_step, O const * op, int o_step, uint8_t const * ap, int pixels)
+{
+	int i = 0;
+
+#ifdef DCPOMATIC_BLEND_SSE2
+	__m128i const zero = _mm_setzero_si128 ();
+	__m128i const opaque = _mm_set1_epi32 (255);
+	__m128 const one = _mm_set1_ps (1);
+	__m128 const max_alpha = _mm_set1_ps (255);
+	int32_t out[4];
+	for (; i + 4 <= pixels; i += 4) {
+		__m128i const a = _mm_srli_epi32 (_mm_loadu_si128 (reinterpret_cast<__m128i const *> (ap)), 24);
+		ap += 16;
+		int const transparent = _mm_movemask_epi8 (_mm_cmpeq_epi32 (a, zero));
+		if (transparent == 0xffff) {
+			/* Nothing to do */
+			tp += t_step * 4;
+			op += o_step * 4;
+			continue;
+		}
+
+		if (transparent == 0 && _mm_movemask_epi8 (_mm_cmpeq_epi32 (a, opaque)) == 0xffff) {
+			/* Blending with an alpha of 1 gives exactly o */
+			for (int j = 0; j < 4; ++j) {
+				*tp = *op;
+				tp += t_step;
+				op += o_step;
+			}
+			continue;
+		}
+
+		__m128 const alpha = _mm_div_ps (_mm_cvtepi32_ps (a), max_alpha);
+		__m128 const o = _mm_cvtepi32_ps (_mm_setr_epi32 (op[0], op[o_step], op[o_step * 2], op[o_step * 3]));
+		__m128 const t = _mm_cvtepi32_ps (_mm_setr_epi32 (tp[0], tp[t_step], tp[t_step * 2], tp[t_step * 3]));
+		_mm_storeu_si128 (
+			reinterpret_cast<__m128i*> (out),
+			_mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (o, alpha), _mm_mul_ps (t, _mm_sub_ps (one, alpha))))
+			);
+		for (int j = 0; j < 4; ++j) {
+			*tp = out[j];
+			tp += t_step;
+		}
+		op += o_step * 4;
+	}
+#endif
+
+	for (; i < pixels; ++i) {
+		uint8_t const a = ap[3];
+		*tp = *op * alpha_table.alpha[a] + *tp * alpha_table.one_minus_alpha[a];
+		tp += t_step;
+		op += o_step;
+		ap += 4;
+	}
+}
+
+/** Blend a line of RGBA or BGRA pixels onto a line of RGB48LE pixels; only the high byte
+ *  of each RGB48LE sample is changed.
+ *  @param tp First RGB48LE pixel to blend onto.
+ *  @param op First RGBA or BGRA pixel to blend.
+ *  @param pixels Number of pixels.
+ *  @param red Offset of red within each RGBA/BGRA pixel.
+ *  @param blue Offset of blue within each RGBA/BGRA pixel.
+ */
+static void
+alpha_blend_rgb48le_line (uint8_t* tp, uint8_t const * op, int pixels, int red, int blue)
+{
+	int first;
+	int end;
+	opaque_span (op, pixels, first, end);
+	if (first == end) {
+		return;
+	}
+
+	tp += first * 6;
+	op += first * 4;
+	int const n = end - first;
+
+	/* Blend high bytes */
+	alpha_blend_samples (tp + 1, 6, op + red, 4, op, n);
+	alpha_blend_samples (tp + 3, 6, op + 1, 4, op, n);
+	alpha_blend_samples (tp + 5, 6, op + blue, 4, op, n);
+}
+
+/** Blend a line of RGBA or BGRA pixels onto a line of 8-bit packed RGB pixels.
+ *  @param tp First pixel to blend onto.
+ *  @param this_bpp Bytes per pixel of tp; 3 or 4.
+ *  @param op First RGBA or BGRA pixel to blend.
+ *  @param pixels Number of pixels.
+ *  @param first Offset within op of the component to blend onto the first byte of each tp pixel.
+ *  @param third Offset within op of the component to blend onto the third byte of each tp pixel.
+ */
+static void
+alpha_blend_packed_line (uint8_t* tp, int this_bpp, uint8_t const * op, int pixels, int first, int third)
+{
+	int start;
+	int end;
+	opaque_span (op, pixels, start, end);
+	if (start == end) {
+		return;
+	}
+
+	tp += start * this_bpp;
+	op += start * 4;
+	int const n = end - start;
+
+	alpha_blend_samples (tp, this_bpp, op + first, 4, op, n);
+	alpha_blend_samples (tp + 1, this_bpp, op + 1, 4, op, n);
+	alpha_blend_samples (tp + 2, this_bpp, op + third, 4, op, n);
+	if (this_bpp == 4) {
+		alpha_blend_samples (tp + 3, this_bpp, op + 3, 4, op, n);
+	}
+}
+
+/** Fade a line of 16-bit samples */
+static void
+fade_16_line (uint16_t* p, int samples, float f)
+{
+	for (int i = 0; i < samples; ++i) {
+		*p = int (float (*p) * f);
+		++p;
+	}
+}
+
 /** Crop this image, scale it to `inter_size' and then place it in a black frame of `out_size'.
  *  @param crop Amount to crop by.
  *  @param inter_size Size to scale the cropped image to.
@@ -141,12 +342,181 @@ Image::crop_scale_window (
 	DCPOMATIC_ASSERT (out_size.height >= inter_size.height);
 
 	shared_ptr<Image> out (new Image(out_format, out_size, out_aligned));
-	out->make_black ();
+	if (inter_size != out_size) {
+		/* There will be some padding; otherwise sws_scale will write over every pixel */
+		out->make_black ();
+	}
 
 	/* Size of the image after any crop */
 	dcp::Size const cropped_size = crop.apply (size ());
 
-	/* Scale context for a scale from cropped_size to inter_size */
+	struct SwsContext* scale_context = crop_scale_context (cropped_size, inter_size, out_format, yuv_to_rgb, fast);
+
+	/* Prepare input data pointers with crop */
+	uint8_t* scale_in_data[planes()];
+	crop_data (crop, scale_in_data);
+
+	/* Corner of the image within out_size */
+	Position<int> const corner ((out_size.width - inter_size.width) / 2, (out_size.height - inter_size.height) / 2);
+
+	AVPixFmtDescriptor const * out_desc = av_pix_fmt_desc_get (out_format);
+	if (!out_desc) {
+		throw PixelFormatError ("crop_scale_window()", out_format);
+	}
+
+	uint8_t* scale_out_data[out->planes()];
+	for (int c = 0; c < out->planes(); ++c) {
+		/* See the note in crop_data() */
+		int const x = lrintf (out->bytes_per_pixel(c) * corner.x) & ~ ((int) out_desc->log2_chroma_w);
+		scale_out_data[c] = out->data()[c] + x + out->stride()[c] * (corner.y / out->vertical_factor(c));
+	}
+
+	sws_scale (
+		scale_context,
+		scale_in_data, stride(),
+		0, cropped_size.height,
+		scale_out_data, out->stride()
+		);
+
+	sws_freeContext (scale_context);
+
+	if (crop != Crop() && cropped_size == inter_size && _pixel_format == out_format) {
+		/* We are cropping without any scaling or pixel format conversion, so FFmpeg may have left some
+		   data behind in our image.  Clear it out.  It may get to the point where we should just stop
+		   trying to be clever with cropping.
+		*/
+		out->make_part_black (corner.x + cropped_size.width, out_size.width - cropped_size.width);
+	}
+
+	return out;
+}
+
+/** Do the same as crop_scale_window() to RGB48LE, then (if required) alpha_blend() of some text,
+ *  fade() and conversion to XYZ, but in horizontal stripes so that each part of the image
+ *  is only taken from main memory once.  The results are the same as doing each step separately.
+ *  @param crop Amount to crop by.
+ *  @param inter_size Size to scale the cropped image to.
+ *  @param out_size Size of output frame; if this is larger than inter_size there will be black padding.
+ *  @param yuv_to_rgb YUV to RGB transformation to use, if required.
+ *  @param fast Try to be fast at the possible expense of quality.
+ *  @param text RGBA or BGRA image to blend onto the output, or 0.
+ *  @param text_position Position of text within the output frame.
+ *  @param fade Fade to apply, if any.
+ *  @param converter Converter to XYZ.
+ *  @param note Handler to be told if any XYZ values were clamped.
+ */
+shared_ptr<dcp::OpenJPEGImage>
+Image::crop_scale_window_xyz (
+	Crop crop,
+	dcp::Size inter_size,
+	dcp::Size out_size,
+	dcp::YUVToRGB yuv_to_rgb,
+	bool fast,
+	shared_ptr<const Image> text,
+	Position<int> text_position,
+	optional<float> fade,
+	XYZConverter const & converter,
+	optional<dcp::NoteHandler> note
+	) const
+{
+	/* See crop_scale_window() */
+	DCPOMATIC_ASSERT (aligned ());
+
+	DCPOMATIC_ASSERT (out_size.width >= inter_size.width);
+	DCPOMATIC_ASSERT (out_size.height >= inter_size.height);
+
+	/* See alpha_blend() */
+	DCPOMATIC_ASSERT (!text || text->pixel_format() == AV_PIX_FMT_BGRA || text->pixel_format() == AV_PIX_FMT_RGBA);
+	int const blue = text && text->pixel_format() == AV_PIX_FMT_BGRA ? 0 : 2;
+	int const red = text && text->pixel_format() == AV_PIX_FMT_BGRA ? 2 : 0;
+
+	/* Number of input lines to give the scaler at once */
+	int stripe_height = 32;
+	int const bpp = 6;
+
+	/* The scaler writes into a window in this, as in crop_scale_window() */
+	Image rgb (AV_PIX_FMT_RGB48LE, out_size, true);
+	shared_ptr<dcp::OpenJPEGImage> xyz (new dcp::OpenJPEGImage (out_size));
+
+	dcp::Size const cropped_size = crop.apply (size ());
+	struct SwsContext* scale_context = crop_scale_context (cropped_size, inter_size, AV_PIX_FMT_RGB48LE, yuv_to_rgb, fast);
+
+	uint8_t* scale_in_data[planes()];
+	crop_data (crop, scale_in_data);
+
+	Position<int> const corner ((out_size.width - inter_size.width) / 2, (out_size.height - inter_size.height) / 2);
+	uint8_t* scale_out_data[1] = { rgb.data()[0] + corner.x * bpp + rgb.stride()[0] * corner.y };
+
+	int in_y = 0;
+	int scaled = 0;
+	int done = 0;
+	int clamped = 0;
+	while (done < out_size.height) {
+		/* Give the scaler another stripe, if there is one, and see how many more output lines are ready */
+		int ready = out_size.height;
+		if (in_y < cropped_size.height) {
+			int const h = min (stripe_height, cropped_size.height - in_y);
+			uint8_t* slice[planes()];
+			for (int c = 0; c < planes(); ++c) {
+				slice[c] = scale_in_data[c] + stride()[c] * (in_y / vertical_factor(c));
+			}
+			int const r = sws_scale (scale_context, slice, stride(), in_y, h, scale_out_data, rgb.stride());
+			if (r < 0) {
+				/* Some conversions, which need more than one scaler inside FFmpeg, cannot be done in slices */
+				DCPOMATIC_ASSERT (in_y == 0 && stripe_height < cropped_size.height);
+				stripe_height = cropped_size.height;
+				continue;
+			}
+			scaled += r;
+			in_y += h;
+			ready = corner.y + scaled;
+		}
+
+		for (int y = done; y < ready; ++y) {
+			uint8_t* line = rgb.data()[0] + y * rgb.stride()[0];
+
+			/* Black padding, also clearing anything that the scaler may have left outside its window */
+			if (y < corner.y || y >= (corner.y + inter_size.height)) {
+				memset (line, 0, rgb.line_size()[0]);
+			} else {
+				int const right = corner.x + inter_size.width;
+				memset (line, 0, corner.x * bpp);
+				memset (line + right * bpp, 0, (out_size.width - right) * bpp);
+			}
+
+			if (text && y >= text_position.y && y < (text_position.y + text->size().height)) {
+				int const start_x = max (0, text_position.x);
+				int const pixels = min (out_size.width - start_x, text->size().width - (start_x - text_position.x));
+				/* As in alpha_blend(), the text is read from the start of its line */
+				uint8_t const * op = text->data()[0] + (y - text_position.y) * text->stride()[0];
+				alpha_blend_rgb48le_line (line + start_x * bpp, op, pixels, red, blue);
+			}
+
+			if (fade) {
+				fade_16_line (reinterpret_cast<uint16_t*> (line), rgb.line_size()[0] / 2, fade.get());
+			}
+		}
+
+		/* Convert the lines that are now finished */
+		int const offset = done * out_size.width;
+		clamped += converter.convert_lines (
+			rgb.data()[0] + done * rgb.stride()[0], dcp::Size (out_size.width, ready - done), rgb.stride()[0],
+			xyz->data(0) + offset, xyz->data(1) + offset, xyz->data(2) + offset
+			);
+
+		done = ready;
+	}
+
+	sws_freeContext (scale_context);
+
+	XYZConverter::note_clamped (clamped, note);
+	return xyz;
+}
+
+/** @return Scale context for a scale from cropped_size (in our pixel format) to inter_size (in out_format) */
+struct SwsContext *
+Image::crop_scale_context (dcp::Size cropped_size, dcp::Size inter_size, AVPixelFormat out_format, dcp::YUVToRGB yuv_to_rgb, bool fast) const
+{
 	struct SwsContext* scale_context = sws_getContext (
 			cropped_size.width, cropped_size.height, pixel_format(),
 			inter_size.width, inter_size.height, out_format,
@@ -182,13 +552,20 @@ Image::crop_scale_window (
 		0, 1 << 16, 1 << 16
 		);
 
+	return scale_context;
+}
+
+/** Find the start of the data in each of our planes after a crop.
+ *  @param data Array of planes() pointers to fill in.
+ */
+void
+Image::crop_data (Crop crop, uint8_t** data) const
+{
 	AVPixFmtDescriptor const * in_desc = av_pix_fmt_desc_get (_pixel_format);
 	if (!in_desc) {
 		throw PixelFormatError ("crop_scale_window()", _pixel_format);
 	}
 
-	/* Prepare input data pointers with crop */
-	uint8_t* scale_in_data[planes()];
 	for (int c = 0; c < planes(); ++c) {
 		/* To work out the crop in bytes, start by multiplying
 		   the crop by the (average) bytes per pixel.  Then
@@ -196,42 +573,8 @@ Image::crop_scale_window (
 		   we've cropped all of its Y-channel pixels.
 		*/
 		int const x = lrintf (bytes_per_pixel(c) * crop.left) & ~ ((int) in_desc->log2_chroma_w);
-		scale_in_data[c] = data()[c] + x + stride()[c] * (crop.top / vertical_factor(c));
-	}
-
-	/* Corner of the image within out_size */
-	Position<int> const corner ((out_size.width - inter_size.width) / 2, (out_size.height - inter_size.height) / 2);
-
-	AVPixFmtDescriptor const * out_desc = av_pix_fmt_desc_get (out_format);
-	if (!out_desc) {
-		throw PixelFormatError ("crop_scale_window()", out_format);
+		data[c] = this->data()[c] + x + stride()[c] * (crop.top / vertical_factor(c));
 	}
-
-	uint8_t* scale_out_data[out->planes()];
-	for (int c = 0; c < out->planes(); ++c) {
-		/* See the note in the crop loop above */
-		int const x = lrintf (out->bytes_per_pixel(c) * corner.x) & ~ ((int) out_desc->log2_chroma_w);
-		scale_out_data[c] = out->data()[c] + x + out->stride()[c] * (corner.y / out->vertical_factor(c));
-	}
-
-	sws_scale (
-		scale_context,
-		scale_in_data, stride(),
-		0, cropped_size.height,
-		scale_out_data, out->stride()
-		);
-
-	sws_freeContext (scale_context);
-
-	if (crop != Crop() && cropped_size == inter_size && _pixel_format == out_format) {
-		/* We are cropping without any scaling or pixel format conversion, so FFmpeg may have left some
-		   data behind in our image.  Clear it out.  It may get to the point where we should just stop
-		   trying to be clever with cropping.
-		*/
-		out->make_part_black (corner.x + cropped_size.width, out_size.width - cropped_size.width);
-	}
-
-	return out;
 }
 
 shared_ptr<Image>
@@ -520,78 +863,29 @@ Image::alpha_blend (shared_ptr<const Image> other, Position<int> position)
 
 	switch (_pixel_format) {
 	case AV_PIX_FMT_RGB24:
-	{
-		/* Going onto RGB24.  First byte is red, second green, third blue */
-		int const this_bpp = 3;
-		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
-			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				tp[0] = op[red] * alpha + tp[0] * (1 - alpha);
-				tp[1] = op[1] * alpha + tp[1] * (1 - alpha);
-				tp[2] = op[blue] * alpha + tp[2] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
-			}
-		}
-		break;
-	}
 	case AV_PIX_FMT_BGRA:
-	{
-		int const this_bpp = 4;
-		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
-			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				tp[0] = op[blue] * alpha + tp[0] * (1 - alpha);
-				tp[1] = op[1] * alpha + tp[1] * (1 - alpha);
-				tp[2] = op[red] * alpha + tp[2] * (1 - alpha);
-				tp[3] = op[3] * alpha + tp[3] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
-			}
-		}
-		break;
-	}
 	case AV_PIX_FMT_RGBA:
 	{
-		int const this_bpp = 4;
+		/* RGB24: first byte is red, second green, third blue.  BGRA and RGBA have alpha fourth */
+		int const this_bpp = _pixel_format == AV_PIX_FMT_RGB24 ? 3 : 4;
+		int const first = _pixel_format == AV_PIX_FMT_BGRA ? blue : red;
+		int const third = _pixel_format == AV_PIX_FMT_BGRA ? red : blue;
+		int const pixels = min (size().width - start_tx, other->size().width - start_ox);
 		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
 			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
 			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				tp[0] = op[red] * alpha + tp[0] * (1 - alpha);
-				tp[1] = op[1] * alpha + tp[1] * (1 - alpha);
-				tp[2] = op[blue] * alpha + tp[2] * (1 - alpha);
-				tp[3] = op[3] * alpha + tp[3] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
-			}
+			alpha_blend_packed_line (tp, this_bpp, op, pixels, first, third);
 		}
 		break;
 	}
 	case AV_PIX_FMT_RGB48LE:
 	{
 		int const this_bpp = 6;
+		int const pixels = min (size().width - start_tx, other->size().width - start_ox);
 		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
 			uint8_t* tp = data()[0] + ty * stride()[0] + start_tx * this_bpp;
 			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-				/* Blend high bytes */
-				tp[1] = op[red] * alpha + tp[1] * (1 - alpha);
-				tp[3] = op[1] * alpha + tp[3] * (1 - alpha);
-				tp[5] = op[blue] * alpha + tp[5] * (1 - alpha);
-
-				tp += this_bpp;
-				op += other_bpp;
-			}
+			alpha_blend_rgb48le_line (tp, op, pixels, red, blue);
 		}
 		break;
 	}
@@ -603,134 +897,76 @@ Image::alpha_blend (shared_ptr<const Image> other, Position<int> position)
 		double const * lut_in = conv.in()->lut (8, false);
 		double const * lut_out = conv.out()->lut (16, true);
 		int const this_bpp = 6;
+		int const pixels = min (size().width - start_tx, other->size().width - start_ox);
+		/* XYZ of each overlay pixel, interleaved */
+		scoped_array<uint16_t> xyz (new uint16_t[max (0, pixels) * 3]);
 		for (int ty = start_ty, oy = start_oy; ty < size().height && oy < other->size().height; ++ty, ++oy) {
-			uint16_t* tp = reinterpret_cast<uint16_t*> (data()[0] + ty * stride()[0] + start_tx * this_bpp);
 			uint8_t* op = other->data()[0] + oy * other->stride()[0];
-			for (int tx = start_tx, ox = start_ox; tx < size().width && ox < other->size().width; ++tx, ++ox) {
-				float const alpha = float (op[3]) / 255;
-
-				/* Convert sRGB to XYZ; op is BGRA.  First, input gamma LUT */
-				double const r = lut_in[op[red]];
-				double const g = lut_in[op[1]];
-				double const b = lut_in[op[blue]];
-
-				/* RGB to XYZ, including Bradford transform and DCI companding */
-				double const x = max (0.0, min (65535.0, r * fast_matrix[0] + g * fast_matrix[1] + b * fast_matrix[2]));
-				double const y = max (0.0, min (65535.0, r * fast_matrix[3] + g * fast_matrix[4] + b * fast_matrix[5]));
-				double const z = max (0.0, min (65535.0, r * fast_matrix[6] + g * fast_matrix[7] + b * fast_matrix[8]));
-
-				/* Out gamma LUT and blend */
-				tp[0] = lrint(lut_out[lrint(x)] * 65535) * alpha + tp[0] * (1 - alpha);
-				tp[1] = lrint(lut_out[lrint(y)] * 65535) * alpha + tp[1] * (1 - alpha);
-				tp[2] = lrint(lut_out[lrint(z)] * 65535) * alpha + tp[2] * (1 - alpha);
-
-				tp += this_bpp / 2;
-				op += other_bpp;
+			int first;
+			int end;
+			opaque_span (op, pixels, first, end);
+			if (first == end) {
+				continue;
+			}
+
+			uint16_t* tp = reinterpret_cast<uint16_t*> (data()[0] + ty * stride()[0] + (start_tx + first) * this_bpp);
+			op += first * other_bpp;
+			int const n = end - first;
+
+			/* Subtitles are mostly made of long runs of the same colour, so remember the last one we converted */
+			optional<int32_t> last_rgb;
+			uint8_t const * p = op;
+			uint16_t* q = xyz.get();
+			for (int i = 0; i < n; ++i) {
+				int32_t const rgb = (p[red] << 16) | (p[1] << 8) | p[blue];
+				if (!last_rgb || rgb != *last_rgb) {
+					/* Convert sRGB to XYZ; op is BGRA.  First, input gamma LUT */
+					double const r = lut_in[p[red]];
+					double const g = lut_in[p[1]];
+					double const b = lut_in[p[blue]];
+
+					/* RGB to XYZ, including Bradford transform and DCI companding */
+					double const x = max (0.0, min (65535.0, r * fast_matrix[0] + g * fast_matrix[1] + b * fast_matrix[2]));
+					double const y = max (0.0, min (65535.0, r * fast_matrix[3] + g * fast_matrix[4] + b * fast_matrix[5]));
+					double const z = max (0.0, min (65535.0, r * fast_matrix[6] + g * fast_matrix[7] + b * fast_matrix[8]));
+
+					/* Out gamma LUT */
+					q[0] = lrint(lut_out[lrint(x)] * 65535);
+					q[1] = lrint(lut_out[lrint(y)] * 65535);
+					q[2] = lrint(lut_out[lrint(z)] * 65535);
+					last_rgb = rgb;
+				} else {
+					q[0] = q[-3];
+					q[1] = q[-2];
+					q[2] = q[-1];
+				}
+				p += other_bpp;
+				q += 3;
+			}
+
+			/* Blend */
+			for (int c = 0; c < 3; ++c) {
+				alpha_blend_samples (tp + c, 3, xyz.get() + c, 3, op, n);
 			}
 		}
 		break;
 	}
 	case AV_PIX_FMT_YUV420P:
 	{
-		shared_ptr<Image> yuv = other->convert_pixel_format (dcp::YUV_TO_RGB_REC709, _pixel_format, false, false);
-		dcp::Size const ts = size();
-		dcp::Size const os = yuv->size();
-		for (int ty = start_ty, oy = start_oy; ty < ts.height && oy < os.height; ++ty, ++oy) {
-			int const hty = ty / 2;
-			int const hoy = oy / 2;
-			uint8_t* tY = data()[0] + (ty * stride()[0]) + start_tx;
-			uint8_t* tU = data()[1] + (hty * stride()[1]) + start_tx / 2;
-			uint8_t* tV = data()[2] + (hty * stride()[2]) + start_tx / 2;
-			uint8_t* oY = yuv->data()[0] + (oy * yuv->stride()[0]) + start_ox;
-			uint8_t* oU = yuv->data()[1] + (hoy * yuv->stride()[1]) + start_ox / 2;
-			uint8_t* oV = yuv->data()[2] + (hoy * yuv->stride()[2]) + start_ox / 2;
-			uint8_t* alpha = other->data()[0] + (oy * other->stride()[0]) + start_ox * 4;
-			for (int tx = start_tx, ox = start_ox; tx < ts.width && ox < os.width; ++tx, ++ox) {
-				float const a = float(alpha[3]) / 255;
-				*tY = *oY * a + *tY * (1 - a);
-				*tU = *oU * a + *tU * (1 - a);
-				*tV = *oV * a + *tV * (1 - a);
-				++tY;
-				++oY;
-				if (tx % 2) {
-					++tU;
-					++tV;
-				}
-				if (ox % 2) {
-					++oU;
-					++oV;
-				}
-				alpha += 4;
-			}
-		}
+		shared_ptr<Image> yuv = ensure_aligned(other)->convert_pixel_format (dcp::YUV_TO_RGB_REC709, _pixel_format, false, false);
+		alpha_blend_yuv<uint8_t> (yuv, other, start_tx, start_ty, start_ox, start_oy, 2);
 		break;
 	}
 	case AV_PIX_FMT_YUV420P10:
 	{
-		shared_ptr<Image> yuv = other->convert_pixel_format (dcp::YUV_TO_RGB_REC709, _pixel_format, false, false);
-		dcp::Size const ts = size();
-		dcp::Size const os = yuv->size();
-		for (int ty = start_ty, oy = start_oy; ty < ts.height && oy < os.height; ++ty, ++oy) {
-			int const hty = ty / 2;
-			int const hoy = oy / 2;
-			uint16_t* tY = ((uint16_t *) (data()[0] + (ty * stride()[0]))) + start_tx;
-			uint16_t* tU = ((uint16_t *) (data()[1] + (hty * stride()[1]))) + start_tx / 2;
-			uint16_t* tV = ((uint16_t *) (data()[2] + (hty * stride()[2]))) + start_tx / 2;
-			uint16_t* oY = ((uint16_t *) (yuv->data()[0] + (oy * yuv->stride()[0]))) + start_ox;
-			uint16_t* oU = ((uint16_t *) (yuv->data()[1] + (hoy * yuv->stride()[1]))) + start_ox / 2;
-			uint16_t* oV = ((uint16_t *) (yuv->data()[2] + (hoy * yuv->stride()[2]))) + start_ox / 2;
-			uint8_t* alpha = other->data()[0] + (oy * other->stride()[0]) + start_ox * 4;
-			for (int tx = start_tx, ox = start_ox; tx < ts.width && ox < os.width; ++tx, ++ox) {
-				float const a = float(alpha[3]) / 255;
-				*tY = *oY * a + *tY * (1 - a);
-				*tU = *oU * a + *tU * (1 - a);
-				*tV = *oV * a + *tV * (1 - a);
-				++tY;
-				++oY;
-				if (tx % 2) {
-					++tU;
-					++tV;
-				}
-				if (ox % 2) {
-					++oU;
-					++oV;
-				}
-				alpha += 4;
-			}
-		}
+		shared_ptr<Image> yuv = ensure_aligned(other)->convert_pixel_format (dcp::YUV_TO_RGB_REC709, _pixel_format, false, false);
+		alpha_blend_yuv<uint16_t> (yuv, other, start_tx, start_ty, start_ox, start_oy, 2);
 		break;
 	}
 	case AV_PIX_FMT_YUV422P10LE:
 	{
-		shared_ptr<Image> yuv = other->convert_pixel_format (dcp::YUV_TO_RGB_REC709, _pixel_format, false, false);
-		dcp::Size const ts = size();
-		dcp::Size const os = yuv->size();
-		for (int ty = start_ty, oy = start_oy; ty < ts.height && oy < os.height; ++ty, ++oy) {
-			uint16_t* tY = ((uint16_t *) (data()[0] + (ty * stride()[0]))) + start_tx;
-			uint16_t* tU = ((uint16_t *) (data()[1] + (ty * stride()[1]))) + start_tx / 2;
-			uint16_t* tV = ((uint16_t *) (data()[2] + (ty * stride()[2]))) + start_tx / 2;
-			uint16_t* oY = ((uint16_t *) (yuv->data()[0] + (oy * yuv->stride()[0]))) + start_ox;
-			uint16_t* oU = ((uint16_t *) (yuv->data()[1] + (oy * yuv->stride()[1]))) + start_ox / 2;
-			uint16_t* oV = ((uint16_t *) (yuv->data()[2] + (oy * yuv->stride()[2]))) + start_ox / 2;
-			uint8_t* alpha = other->data()[0] + (oy * other->stride()[0]) + start_ox * 4;
-			for (int tx = start_tx, ox = start_ox; tx < ts.width && ox < os.width; ++tx, ++ox) {
-				float const a = float(alpha[3]) / 255;
-				*tY = *oY * a + *tY * (1 - a);
-				*tU = *oU * a + *tU * (1 - a);
-				*tV = *oV * a + *tV * (1 - a);
-				++tY;
-				++oY;
-				if (tx % 2) {
-					++tU;
-					++tV;
-				}
-				if (ox % 2) {
-					++oU;
-					++oV;
-				}
-				alpha += 4;
-			}
-		}
+		shared_ptr<Image> yuv = ensure_aligned(other)->convert_pixel_format (dcp::YUV_TO_RGB_REC709, _pixel_format, false, false);
+		alpha_blend_yuv<uint16_t> (yuv, other, start_tx, start_ty, start_ox, start_oy, 1);
 		break;
 	}
 	default:
@@ -738,6 +974,55 @@ Image::alpha_blend (shared_ptr<const Image> other, Position<int> position)
 	}
 }
 
+/** Blend a YUV version of an image onto this one, which must be of the same YUV format.
+ *  @param yuv YUV version of the image to blend.
+ *  @param other RGBA or BGRA image to take the alpha from.
+ *  @param start_tx x position in this image to start at.
+ *  @param start_ty y position in this image to start at.
+ *  @param start_ox x position in the other image to start at.
+ *  @param start_oy y position in the other image to start at.
+ *  @param chroma_lines Number of luma lines for each line of chroma.
+ */
+template <class T>
+void
+Image::alpha_blend_yuv (shared_ptr<const Image> yuv, shared_ptr<const Image> other, int start_tx, int start_ty, int start_ox, int start_oy, int chroma_lines)
+{
+	dcp::Size const ts = size();
+	dcp::Size const os = yuv->size();
+	int const pixels = min (ts.width - start_tx, os.width - start_ox);
+	for (int ty = start_ty, oy = start_oy; ty < ts.height && oy < os.height; ++ty, ++oy) {
+		uint8_t const * alpha = other->data()[0] + (oy * other->stride()[0]) + start_ox * 4;
+		int first;
+		int end;
+		opaque_span (alpha, pixels, first, end);
+		if (first == end) {
+			continue;
+		}
+
+		int const cty = ty / chroma_lines;
+		int const coy = oy / chroma_lines;
+		T* tY = reinterpret_cast<T*> (data()[0] + (ty * stride()[0])) + start_tx;
+		T* tU = reinterpret_cast<T*> (data()[1] + (cty * stride()[1]));
+		T* tV = reinterpret_cast<T*> (data()[2] + (cty * stride()[2]));
+		T const * oY = reinterpret_cast<T const *> (yuv->data()[0] + (oy * yuv->stride()[0])) + start_ox;
+		T const * oU = reinterpret_cast<T const *> (yuv->data()[1] + (coy * yuv->stride()[1]));
+		T const * oV = reinterpret_cast<T const *> (yuv->data()[2] + (coy * yuv->stride()[2]));
+
+		alpha_blend_samples (tY + first, 1, oY + first, 1, alpha + first * 4, end - first);
+
+		/* Each chroma sample is blended once for each of the luma samples that share it */
+		for (int i = first; i < end; ++i) {
+			uint8_t const a = alpha[i * 4 + 3];
+			float const f = alpha_table.alpha[a];
+			float const g = alpha_table.one_minus_alpha[a];
+			int const tc = (start_tx + i) / 2;
+			int const oc = (start_ox + i) / 2;
+			tU[tc] = oU[oc] * f + tU[tc] * g;
+			tV[tc] = oV[oc] * f + tV[tc] * g;
+		}
+	}
+}
+
 void
 Image::copy (shared_ptr<const Image> other, Position<int> position)
 {
@@ -753,32 +1038,144 @@ Image::copy (shared_ptr<const Image> other, Position<int> position)
 	}
 }
 
+/** @return Number of bytes needed to hold our image data without any padding */
+int
+Image::packed_size () const
+{
+	int size = 0;
+	for (int i = 0; i < planes(); ++i) {
+		size += line_size()[i] * sample_size(i).height;
+	}
+	return size;
+}
+
+/** Copy our image data, without any padding, to \p out, which must have
+ *  space for packed_size() bytes.
+ */
 void
-Image::read_from_socket (shared_ptr<Socket> socket)
+Image::pack (uint8_t* out) const
 {
 	for (int i = 0; i < planes(); ++i) {
 		uint8_t* p = data()[i];
 		int const lines = sample_size(i).height;
 		for (int y = 0; y < lines; ++y) {
-			socket->read (p, line_size()[i]);
+			memcpy (out, p, line_size()[i]);
+			out += line_size()[i];
 			p += stride()[i];
 		}
 	}
 }
 
+/** Reverse of pack() */
 void
-Image::write_to_socket (shared_ptr<Socket> socket) const
+Image::unpack (uint8_t const * in)
 {
 	for (int i = 0; i < planes(); ++i) {
 		uint8_t* p = data()[i];
 		int const lines = sample_size(i).height;
 		for (int y = 0; y < lines; ++y) {
-			socket->write (p, line_size()[i]);
+			memcpy (p, in, line_size()[i]);
+			in += line_size()[i];
 			p += stride()[i];
 		}
 	}
 }
 
+/** @return Codecs which this build can use with read_from_socket() and write_to_socket() */
+list<TransportCodec>
+Image::supported_transport_codecs ()
+{
+	list<TransportCodec> c;
+	c.push_back (TRANSPORT_CODEC_NONE);
+#ifdef DCPOMATIC_HAVE_LZ4
+	c.push_back (TRANSPORT_CODEC_LZ4);
+#endif
+	return c;
+}
+
+/** Read image data written by write_to_socket().
+ *  @param codec Codec that the data was written with.
+ */
+void
+Image::read_from_socket (shared_ptr<Socket> socket, TransportCodec codec)
+{
+	switch (codec) {
+	case TRANSPORT_CODEC_NONE:
+		for (int i = 0; i < planes(); ++i) {
+			uint8_t* p = data()[i];
+			int const lines = sample_size(i).height;
+			for (int y = 0; y < lines; ++y) {
+				socket->read (p, line_size()[i]);
+				p += stride()[i];
+			}
+		}
+		break;
+	case TRANSPORT_CODEC_LZ4:
+	{
+#ifdef DCPOMATIC_HAVE_LZ4
+		uint32_t const compressed_size = socket->read_uint32 ();
+		int const size = packed_size ();
+		if (compressed_size > static_cast<uint32_t> (LZ4_compressBound (size))) {
+			throw NetworkError (_("Badly-formed compressed image"));
+		}
+		scoped_array<uint8_t> compressed (new uint8_t[compressed_size]);
+		socket->read (compressed.get(), compressed_size);
+		scoped_array<uint8_t> packed (new uint8_t[size]);
+		int const r = LZ4_decompress_safe (
+			reinterpret_cast<char const *> (compressed.get()), reinterpret_cast<char *> (packed.get()), compressed_size, size
+			);
+		if (r != size) {
+			throw NetworkError (_("Badly-formed compressed image"));
+		}
+		unpack (packed.get ());
+#else
+		throw NetworkError (_("Unsupported image compression"));
+#endif
+		break;
+	}
+	}
+}
+
+/** Write our image data to a socket.
+ *  @param codec Codec to use; this must be one of supported_transport_codecs(),
+ *  and the reader must be told which it is.
+ */
+void
+Image::write_to_socket (shared_ptr<Socket> socket, TransportCodec codec) const
+{
+	switch (codec) {
+	case TRANSPORT_CODEC_NONE:
+		for (int i = 0; i < planes(); ++i) {
+			uint8_t* p = data()[i];
+			int const lines = sample_size(i).height;
+			for (int y = 0; y < lines; ++y) {
+				socket->write (p, line_size()[i]);
+				p += stride()[i];
+			}
+		}
+		break;
+	case TRANSPORT_CODEC_LZ4:
+	{
+#ifdef DCPOMATIC_HAVE_LZ4
+		int const size = packed_size ();
+		scoped_array<uint8_t> packed (new uint8_t[size]);
+		pack (packed.get ());
+		int const bound = LZ4_compressBound (size);
+		scoped_array<uint8_t> compressed (new uint8_t[bound]);
+		int const compressed_size = LZ4_compress_default (
+			reinterpret_cast<char const *> (packed.get()), reinterpret_cast<char *> (compressed.get()), size, bound
+			);
+		DCPOMATIC_ASSERT (compressed_size > 0);
+		socket->write (compressed_size);
+		socket->write (compressed.get(), compressed_size);
+#else
+		DCPOMATIC_ASSERT (false);
+#endif
+		break;
+	}
+	}
+}
+
 float
 Image::bytes_per_pixel (int c) const
 {
@@ -843,6 +1240,14 @@ Image::Image (AVPixelFormat p, dcp::Size s, bool aligned)
 void
 Image::allocate ()
 {
+	ImagePool::Storage storage;
+	if (ImagePool::instance()->get (_pixel_format, _size, _aligned, storage)) {
+		_data = storage.data;
+		_line_size = storage.line_size;
+		_stride = storage.stride;
+		return;
+	}
+
 	_data = (uint8_t **) wrapped_av_malloc (4 * sizeof (uint8_t *));
 	_data[0] = _data[1] = _data[2] = _data[3] = 0;
 
@@ -901,6 +1306,8 @@ Image::allocate ()
 		VALGRIND_MAKE_MEM_DEFINED (_data[i], _stride[i] * (sample_size(i).height + 1) + 32);
 #endif
 	}
+
+	ImagePool::instance()->allocated (storage_for_pool ());
 }
 
 Image::Image (Image const & other)
@@ -990,16 +1397,24 @@ Image::swap (Image & other)
 	std::swap (_aligned, other._aligned);
 }
 
-/** Destroy a Image */
+/** Destroy a Image, giving its memory to the ImagePool */
 Image::~Image ()
 {
+	ImagePool::instance()->put (_pixel_format, _size, _aligned, storage_for_pool ());
+}
+
+ImagePool::Storage
+Image::storage_for_pool () const
+{
+	ImagePool::Storage s;
+	s.data = _data;
+	s.line_size = _line_size;
+	s.stride = _stride;
 	for (int i = 0; i < planes(); ++i) {
-		av_free (_data[i]);
+		/* See allocate() */
+		s.bytes += _stride[i] * (sample_size(i).height + 1) + 32;
 	}
-
-	av_free (_data);
-	av_free (_line_size);
-	av_free (_stride);
+	return s;
 }
 
 uint8_t * const *
@@ -1153,11 +1568,7 @@ Image::fade (float f)
 			uint16_t* p = reinterpret_cast<uint16_t*> (data()[c]);
 			int const lines = sample_size(c).height;
 			for (int y = 0; y < lines; ++y) {
-				uint16_t* q = p;
-				for (int x = 0; x < line_size_pixels; ++x) {
-					*q = int (float (*q) * f);
-					++q;
-				}
+				fade_16_line (p, line_size_pixels, f);
 				p += stride_pixels;
 			}
 		}
@@ -28,15 +28,24 @@
 #include "position.h"
 #include "position_image.h"
 #include "types.h"
+#include "image_pool.h"
 extern "C" {
 #include <libavutil/pixfmt.h>
 }
 #include <dcp/colour_conversion.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/optional.hpp>
+#include <list>
 
 struct AVFrame;
+struct SwsContext;
 class Socket;
+class XYZConverter;
+
+namespace dcp {
+	class OpenJPEGImage;
+}
 
 class Image : public boost::enable_shared_from_this<Image>
 {
@@ -65,6 +74,18 @@ public:
 	boost::shared_ptr<Image> crop_scale_window (
 		Crop crop, dcp::Size inter_size, dcp::Size out_size, dcp::YUVToRGB yuv_to_rgb, AVPixelFormat out_format, bool aligned, bool fast
 		) const;
+	boost::shared_ptr<dcp::OpenJPEGImage> crop_scale_window_xyz (
+		Crop crop,
+		dcp::Size inter_size,
+		dcp::Size out_size,
+		dcp::YUVToRGB yuv_to_rgb,
+		bool fast,
+		boost::shared_ptr<const Image> text,
+		Position<int> text_position,
+		boost::optional<float> fade,
+		XYZConverter const & converter,
+		boost::optional<dcp::NoteHandler> note
+		) const;
 
 	void make_black ();
 	void make_transparent ();
@@ -72,8 +93,8 @@ public:
 	void copy (boost::shared_ptr<const Image> image, Position<int> pos);
 	void fade (float);
 
-	void read_from_socket (boost::shared_ptr<Socket>);
-	void write_to_socket (boost::shared_ptr<Socket>) const;
+	void read_from_socket (boost::shared_ptr<Socket>, TransportCodec codec = TRANSPORT_CODEC_NONE);
+	void write_to_socket (boost::shared_ptr<Socket>, TransportCodec codec = TRANSPORT_CODEC_NONE) const;
 
 	AVPixelFormat pixel_format () const {
 		return _pixel_format;
@@ -86,14 +107,23 @@ public:
 	void png_error (char const * message);
 
 	static boost::shared_ptr<const Image> ensure_aligned (boost::shared_ptr<const Image> image);
+	static std::list<TransportCodec> supported_transport_codecs ();
 
 private:
 	friend struct pixel_formats_test;
 
 	void allocate ();
+	ImagePool::Storage storage_for_pool () const;
 	void swap (Image &);
 	void make_part_black (int x, int w);
+	struct SwsContext* crop_scale_context (dcp::Size cropped_size, dcp::Size inter_size, AVPixelFormat out_format, dcp::YUVToRGB yuv_to_rgb, bool fast) const;
+	void crop_data (Crop crop, uint8_t** data) const;
+	template <class T>
+	void alpha_blend_yuv (boost::shared_ptr<const Image> yuv, boost::shared_ptr<const Image> other, int start_tx, int start_ty, int start_ox, int start_oy, int chroma_lines);
 	void yuv_16_black (uint16_t, bool);
+	int packed_size () const;
+	void pack (uint8_t* out) const;
+	void unpack (uint8_t const * in);
 	static uint16_t swap_16 (uint16_t);
 
 	dcp::Size _size;
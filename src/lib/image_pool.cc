@@ -0,0 +1,169 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/image_pool.cc
+ *  @brief ImagePool class.
+ */
+
+#include "image_pool.h"
+#include "dcpomatic_assert.h"
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include "i18n.h"
+
+using std::list;
+
+ImagePool::ImagePool ()
+	/* Enough for a few 4K RGB48 frames */
+	: _idle_limit (256 * 1024 * 1024)
+{
+
+}
+
+ImagePool*
+ImagePool::instance ()
+{
+	/* This is never destroyed, as Images may be destroyed very late on during shutdown */
+	static ImagePool* pool = new ImagePool ();
+	return pool;
+}
+
+/** Try to find some memory for an Image.
+ *  @param storage Filled in with the memory, if it was found.
+ *  @return true if memory was found, false if the caller must allocate some and then call allocated().
+ */
+bool
+ImagePool::get (AVPixelFormat format, dcp::Size size, bool aligned, Storage& storage)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	for (list<Entry>::iterator i = _idle.begin(); i != _idle.end(); ++i) {
+		if (i->format == format && i->size == size && i->aligned == aligned) {
+			storage = i->storage;
+			_statistics.idle -= storage.bytes;
+			_statistics.in_use += storage.bytes;
+			++_statistics.hits;
+			_idle.erase (i);
+			return true;
+		}
+	}
+
+	++_statistics.misses;
+	return false;
+}
+
+/** Tell the pool about some memory that an Image has allocated because get() could not find any */
+void
+ImagePool::allocated (Storage const & storage)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_statistics.in_use += storage.bytes;
+}
+
+/** Give the memory of an Image which is being destroyed to the pool */
+void
+ImagePool::put (AVPixelFormat format, dcp::Size size, bool aligned, Storage storage)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	DCPOMATIC_ASSERT (_statistics.in_use >= storage.bytes);
+	_statistics.in_use -= storage.bytes;
+
+	if (storage.bytes > _idle_limit) {
+		lm.unlock ();
+		deallocate (storage);
+		return;
+	}
+
+	Entry e;
+	e.format = format;
+	e.size = size;
+	e.aligned = aligned;
+	e.storage = storage;
+	_idle.push_front (e);
+	_statistics.idle += storage.bytes;
+
+	trim ();
+}
+
+/** Free memory which was returned longest ago until we are within our limit.
+ *  Must be called with a lock held on _mutex.
+ */
+void
+ImagePool::trim ()
+{
+	while (_statistics.idle > _idle_limit) {
+		DCPOMATIC_ASSERT (!_idle.empty ());
+		Storage const s = _idle.back().storage;
+		_statistics.idle -= s.bytes;
+		_idle.pop_back ();
+		deallocate (s);
+	}
+}
+
+void
+ImagePool::deallocate (Storage storage)
+{
+	/* Planes which an Image does not use are 0, and av_free ignores those */
+	for (int i = 0; i < 4; ++i) {
+		av_free (storage.data[i]);
+	}
+
+	av_free (storage.data);
+	av_free (storage.line_size);
+	av_free (storage.stride);
+}
+
+ImagePool::Statistics
+ImagePool::statistics () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _statistics;
+}
+
+size_t
+ImagePool::idle_limit () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _idle_limit;
+}
+
+/** Set the maximum number of bytes of plane memory to keep for re-use; 0 disables the pool */
+void
+ImagePool::set_idle_limit (size_t limit)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_idle_limit = limit;
+	trim ();
+}
+
+/** Free everything that is waiting in the pool */
+void
+ImagePool::clear ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	while (!_idle.empty ()) {
+		deallocate (_idle.front().storage);
+		_statistics.idle -= _idle.front().storage.bytes;
+		_idle.pop_front ();
+	}
+}
@@ -0,0 +1,126 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_IMAGE_POOL_H
+#define DCPOMATIC_IMAGE_POOL_H
+
+/** @file  src/lib/image_pool.h
+ *  @brief ImagePool class.
+ */
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+#include <dcp/types.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <list>
+
+/** @class ImagePool
+ *  @brief A store of memory from Images which have been destroyed, so that it can
+ *  be given to new Images of the same format and size.
+ *
+ *  Each entry is everything that Image::allocate() makes: the arrays of plane pointers,
+ *  line sizes and strides and the planes themselves.  Up to idle_limit() bytes are kept;
+ *  beyond that the memory which was returned longest ago is freed.
+ */
+class ImagePool : public boost::noncopyable
+{
+public:
+	/** Memory for one Image */
+	struct Storage
+	{
+		Storage ()
+			: data (0)
+			, line_size (0)
+			, stride (0)
+			, bytes (0)
+		{}
+
+		uint8_t** data;
+		int* line_size;
+		int* stride;
+		/** total size of the planes */
+		size_t bytes;
+	};
+
+	struct Statistics
+	{
+		Statistics ()
+			: hits (0)
+			, misses (0)
+			, in_use (0)
+			, idle (0)
+		{}
+
+		/** number of requests which were given memory from the pool */
+		uint64_t hits;
+		/** number of requests which had to allocate new memory */
+		uint64_t misses;
+		/** bytes of plane memory that are being used by Images */
+		size_t in_use;
+		/** bytes of plane memory that are waiting in the pool */
+		size_t idle;
+
+		/** @return proportion of requests which were given memory from the pool */
+		double hit_rate () const {
+			if (hits + misses == 0) {
+				return 0;
+			}
+			return double (hits) / (hits + misses);
+		}
+	};
+
+	bool get (AVPixelFormat format, dcp::Size size, bool aligned, Storage& storage);
+	void allocated (Storage const & storage);
+	void put (AVPixelFormat format, dcp::Size size, bool aligned, Storage storage);
+
+	Statistics statistics () const;
+
+	size_t idle_limit () const;
+	void set_idle_limit (size_t limit);
+	void clear ();
+
+	static ImagePool* instance ();
+
+private:
+	ImagePool ();
+
+	struct Entry
+	{
+		AVPixelFormat format;
+		dcp::Size size;
+		bool aligned;
+		Storage storage;
+	};
+
+	void trim ();
+	static void deallocate (Storage storage);
+
+	/** mutex for everything below */
+	mutable boost::mutex _mutex;
+	/** idle entries, most recently returned first */
+	std::list<Entry> _idle;
+	size_t _idle_limit;
+	Statistics _statistics;
+};
+
+#endif
@@ -25,6 +25,7 @@
 #include "image.h"
 #include "exceptions.h"
 #include "cross.h"
+#include "binary_metadata.h"
 #include <dcp/util.h>
 #include <libcxml/cxml.h>
 #include <iostream>
@@ -48,3 +49,18 @@ image_proxy_factory (shared_ptr<cxml::Node> xml, shared_ptr<Socket> socket)
 
 	throw NetworkError (_("Unexpected image type received by server"));
 }
+
+shared_ptr<ImageProxy>
+image_proxy_factory (BinaryReader& reader, shared_ptr<Socket> socket, TransportCodec codec)
+{
+	switch (reader.read_uint8 ()) {
+	case IMAGE_PROXY_RAW:
+		return shared_ptr<ImageProxy> (new RawImageProxy (reader, socket, codec));
+	case IMAGE_PROXY_FFMPEG:
+		return shared_ptr<ImageProxy> (new FFmpegImageProxy (reader, socket));
+	case IMAGE_PROXY_J2K:
+		return shared_ptr<ImageProxy> (new J2KImageProxy (reader, socket));
+	}
+
+	throw NetworkError (_("Unexpected image type received by server"));
+}
@@ -28,6 +28,7 @@
 extern "C" {
 #include <libavutil/pixfmt.h>
 }
+#include "types.h"
 #include <dcp/types.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/optional.hpp>
@@ -35,6 +36,8 @@ extern "C" {
 
 class Image;
 class Socket;
+class BinaryWriter;
+class BinaryReader;
 
 namespace xmlpp {
 	class Node;
@@ -72,7 +75,14 @@ public:
 		) const = 0;
 
 	virtual void add_metadata (xmlpp::Node *) const = 0;
-	virtual void send_binary (boost::shared_ptr<Socket>) const = 0;
+	/** Write the same information as add_metadata(), but in the compact binary
+	 *  form that is read by image_proxy_factory (BinaryReader &, ...).
+	 */
+	virtual void add_binary_metadata (BinaryWriter &) const = 0;
+	/** Send our image data.
+	 *  @param codec Codec to use for any uncompressed image data.
+	 */
+	virtual void send_binary (boost::shared_ptr<Socket>, TransportCodec codec) const = 0;
 	/** @return true if our image is definitely the same as another, false if it is probably not */
 	virtual bool same (boost::shared_ptr<const ImageProxy>) const = 0;
 	/** Do any useful work that would speed up a subsequent call to ::image().
@@ -83,6 +93,15 @@ public:
 	virtual size_t memory_used () const = 0;
 };
 
+/** Type codes for image proxies in binary metadata */
+enum ImageProxyType
+{
+	IMAGE_PROXY_RAW,
+	IMAGE_PROXY_FFMPEG,
+	IMAGE_PROXY_J2K
+};
+
 boost::shared_ptr<ImageProxy> image_proxy_factory (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
+boost::shared_ptr<ImageProxy> image_proxy_factory (BinaryReader& reader, boost::shared_ptr<Socket> socket, TransportCodec codec);
 
 #endif
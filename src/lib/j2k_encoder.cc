@@ -35,6 +35,8 @@
 #include "player.h"
 #include "player_video.h"
 #include "encode_server_description.h"
+#include "encode_server_connection.h"
+#include "encode_server_statistics.h"
 #include "compose.hpp"
 #include <libcxml/cxml.h>
 #include <boost/foreach.hpp>
@@ -43,6 +45,12 @@
 #include "i18n.h"
 
 using std::list;
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::string;
+using std::min;
+using std::max;
 using std::cout;
 using std::exception;
 using boost::shared_ptr;
@@ -56,6 +64,7 @@ using dcp::Data;
 J2KEncoder::J2KEncoder (shared_ptr<const Film> film, shared_ptr<Writer> writer)
 	: _film (film)
 	, _history (200)
+	, _nominal_threads (0)
 	, _writer (writer)
 {
 	servers_list_changed ();
@@ -98,25 +107,18 @@ J2KEncoder::call_servers_list_changed (weak_ptr<J2KEncoder> encoder)
 void
 J2KEncoder::end ()
 {
-	boost::mutex::scoped_lock lock (_queue_mutex);
-
 	LOG_GENERAL (N_("Clearing queue of %1"), _queue.size ());
 
-	/* Keep waking workers until the queue is empty */
+	/* Wait until the workers have emptied the queue */
 	while (!_queue.empty ()) {
 		rethrow ();
-		_empty_condition.notify_all ();
-		_full_condition.wait (lock);
+		_queue.wait_for_space (1);
 	}
 
-	lock.unlock ();
-
 	LOG_GENERAL_NC (N_("Terminating encoder threads"));
 
 	terminate_threads ();
 
-	LOG_GENERAL (N_("Mopping up %1"), _queue.size());
-
 	/* The following sequence of events can occur in the above code:
 	     1. a remote worker takes the last image off the queue
 	     2. the loop above terminates
@@ -126,19 +128,29 @@ J2KEncoder::end ()
 	     So just mop up anything left in the queue here.
 	*/
 
-	for (list<shared_ptr<DCPVideo> >::iterator i = _queue.begin(); i != _queue.end(); ++i) {
+	list<shared_ptr<DCPVideo> > left = _queue.take_all ();
+
+	LOG_GENERAL (N_("Mopping up %1"), left.size());
+
+	for (list<shared_ptr<DCPVideo> >::iterator i = left.begin(); i != left.end(); ++i) {
+		if (!start_encode (*i, "")) {
+			/* This is a re-issued copy of a frame which has already been encoded */
+			continue;
+		}
 		LOG_GENERAL (N_("Encode left-over frame %1"), (*i)->index ());
 		try {
-			_writer->write (
-				(*i)->encode_locally(),
-				(*i)->index(),
-				(*i)->eyes()
-				);
-			frame_done ();
+			Data encoded = (*i)->encode_locally ();
+			if (finish_encode (*i, "", true)) {
+				_writer->write (encoded, (*i)->index(), (*i)->eyes());
+				frame_done ();
+			}
 		} catch (std::exception& e) {
 			LOG_ERROR (N_("Local encode failed (%1)"), e.what ());
 		}
 	}
+
+	boost::mutex::scoped_lock lm (_progress_mutex);
+	_progress.clear ();
 }
 
 /** @return an estimate of the current number of frames we are encoding per second,
@@ -184,18 +196,17 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 	size_t threads = 0;
 	{
 		boost::mutex::scoped_lock threads_lock (_threads_mutex);
-		threads = _threads.size ();
+		threads = _nominal_threads;
 	}
 
-	boost::mutex::scoped_lock queue_lock (_queue_mutex);
-
 	/* Wait until the queue has gone down a bit.  Allow one thing in the queue even
 	   when there are no threads.
 	*/
 	while (_queue.size() >= (threads * 2) + 1) {
 		LOG_TIMING ("decoder-sleep queue=%1 threads=%2", _queue.size(), threads);
-		_full_condition.wait (queue_lock);
+		_queue.wait_for_space ((threads * 2) + 1);
 		LOG_TIMING ("decoder-wake queue=%1 threads=%2", _queue.size(), threads);
+		rethrow ();
 	}
 
 	_writer->rethrow ();
@@ -206,6 +217,8 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 	rethrow ();
 
 	Frame const position = time.frames_floor(_film->video_frame_rate());
+	/* Once one black frame has been encoded by our threads, the rest can just be written */
+	optional<Data> const black = pv->black() ? black_j2k(pv->eyes()) : optional<Data>();
 
 	if (_writer->can_fake_write (position)) {
 		/* We can fake-write this frame */
@@ -219,45 +232,86 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 	} else if (_last_player_video[pv->eyes()] && _writer->can_repeat(position) && pv->same (_last_player_video[pv->eyes()])) {
 		LOG_DEBUG_ENCODE("Frame @ %1 REPEAT", to_string(time));
 		_writer->repeat (position, pv->eyes ());
+	} else if (black) {
+		LOG_DEBUG_ENCODE("Frame @ %1 BLACK", to_string(time));
+		_writer->write (black.get(), position, pv->eyes ());
+		frame_done ();
 	} else {
 		LOG_DEBUG_ENCODE("Frame @ %1 ENCODE", to_string(time));
 		/* Queue this new frame for encoding */
 		LOG_TIMING ("add-frame-to-queue queue=%1", _queue.size ());
-		_queue.push_back (shared_ptr<DCPVideo> (
-					  new DCPVideo (
-						  pv,
-						  position,
-						  _film->video_frame_rate(),
-						  _film->j2k_bandwidth(),
-						  _film->resolution()
-						  )
-					  ));
-
-		/* The queue might not be empty any more, so notify anything which is
-		   waiting on that.
-		*/
-		_empty_condition.notify_all ();
+		shared_ptr<DCPVideo> dv (
+			new DCPVideo (
+				pv,
+				position,
+				_film->video_frame_rate(),
+				_film->j2k_bandwidth(),
+				_film->resolution()
+				)
+			);
+		{
+			boost::mutex::scoped_lock lm (_progress_mutex);
+			_progress[dv] = Progress ();
+		}
+		_queue.push (dv);
 	}
 
 	_last_player_video[pv->eyes()] = pv;
 	_last_player_video_time = time;
 }
 
+/** @return Encoded data for a black frame for some eyes at the current resolution and bandwidth,
+ *  if one has been encoded yet.
+ */
+optional<Data>
+J2KEncoder::black_j2k (Eyes eyes) const
+{
+	boost::mutex::scoped_lock lm (_black_j2k_mutex);
+	map<pair<Resolution, int>, Data>::const_iterator i = _black_j2k[eyes].find (make_pair(_film->resolution(), _film->j2k_bandwidth()));
+	if (i == _black_j2k[eyes].end()) {
+		return optional<Data> ();
+	}
+	return i->second;
+}
+
+/** Remember the encoded data for a black frame, so that later black frames need not be encoded */
+void
+J2KEncoder::set_black_j2k (Eyes eyes, Data data)
+{
+	boost::mutex::scoped_lock lm (_black_j2k_mutex);
+	_black_j2k[eyes][make_pair(_film->resolution(), _film->j2k_bandwidth())] = data;
+}
+
 void
 J2KEncoder::terminate_threads ()
 {
 	boost::mutex::scoped_lock threads_lock (_threads_mutex);
+	stop_threads (_threads);
+	_threads.clear ();
+	_nominal_threads = 0;
+}
+
+/** Stop some threads and remove their parts of the queue.  Frames that they are
+ *  encoding will be finished first.  The caller must remove the threads from _threads,
+ *  and must hold a lock on _threads_mutex.
+ */
+void
+J2KEncoder::stop_threads (list<EncoderThread> const & threads)
+{
+	/* Ask everything to stop first so that they can all finish what they are doing at the same time */
+	for (list<EncoderThread>::const_iterator i = threads.begin(); i != threads.end(); ++i) {
+		i->thread->interrupt ();
+	}
 
 	int n = 0;
-	for (list<boost::thread *>::iterator i = _threads.begin(); i != _threads.end(); ++i) {
-		/* Be careful not to throw in here otherwise _threads will not be clear()ed */
-		LOG_GENERAL ("Terminating thread %1 of %2", n + 1, _threads.size ());
-		(*i)->interrupt ();
-		if (!(*i)->joinable()) {
+	for (list<EncoderThread>::const_iterator i = threads.begin(); i != threads.end(); ++i) {
+		/* Be careful not to throw in here otherwise the caller will not clean up */
+		LOG_GENERAL ("Terminating thread %1 of %2", n + 1, threads.size ());
+		if (!i->thread->joinable()) {
 			LOG_ERROR_NC ("About to join() a non-joinable thread");
 		}
 		try {
-			(*i)->join ();
+			i->thread->join ();
 		} catch (boost::thread_interrupted& e) {
 			/* This is to be expected (I think?) */
 		} catch (exception& e) {
@@ -265,20 +319,36 @@ J2KEncoder::terminate_threads ()
 		} catch (...) {
 			LOG_ERROR_NC ("join() threw an exception");
 		}
-		delete *i;
+		delete i->thread;
+		/* Any frames left with this thread will be picked up by others, or by end() */
+		_queue.remove_worker (i->worker);
+		{
+			boost::mutex::scoped_lock lm (_progress_mutex);
+			_servers[i->server].workers.remove (i->worker);
+			if (_servers[i->server].workers.empty ()) {
+				_servers.erase (i->server);
+			}
+		}
 		LOG_GENERAL_NC ("Thread terminated");
 		++n;
 	}
-
-	_threads.clear ();
 }
 
+/** @param worker Our worker ID in _queue.
+ *  @param server Server to send frames to, or none to encode them locally.
+ *  @param connection Persistent connection to use for server, or 0 to use a new connection for each frame.
+ *  @param statistics Statistics for the server, or for the local machine.
+ */
 void
-J2KEncoder::encoder_thread (optional<EncodeServerDescription> server)
+J2KEncoder::encoder_thread (
+	int worker, optional<EncodeServerDescription> server, shared_ptr<EncodeServerConnection> connection, shared_ptr<EncodeServerStatistics> statistics
+	)
 try
 {
+	string const name = server ? server->host_name() : "";
+
 	if (server) {
-		LOG_TIMING ("start-encoder-thread thread=%1 server=%2", thread_id (), server->host_name ());
+		LOG_TIMING ("start-encoder-thread thread=%1 server=%2", thread_id (), name);
 	} else {
 		LOG_TIMING ("start-encoder-thread thread=%1 server=localhost", thread_id ());
 	}
@@ -291,14 +361,23 @@ try
 
 	while (true) {
 
-		LOG_TIMING ("encoder-sleep thread=%1", thread_id ());
-		boost::mutex::scoped_lock lock (_queue_mutex);
-		while (_queue.empty ()) {
-			_empty_condition.wait (lock);
+		if (server) {
+			/* Wait until the server is ready for another frame; this is an interruption point */
+			statistics->acquire ();
 		}
 
+		LOG_TIMING ("encoder-sleep thread=%1", thread_id ());
+		shared_ptr<DCPVideo> vf;
+		try {
+			/* This is an interruption point, and once it has returned we own the frame */
+			vf = _queue.pop (worker);
+		} catch (...) {
+			if (server) {
+				statistics->release ();
+			}
+			throw;
+		}
 		LOG_TIMING ("encoder-wake thread=%1 queue=%2", thread_id(), _queue.size());
-		shared_ptr<DCPVideo> vf = _queue.front ();
 
 		/* We're about to commit to either encoding this frame or putting it back onto the queue,
 		   so we must not be interrupted until one or other of these things have happened.  This
@@ -307,33 +386,45 @@ try
 		{
 			boost::this_thread::disable_interruption dis;
 
-			LOG_TIMING ("encoder-pop thread=%1 frame=%2 eyes=%3", thread_id(), vf->index(), (int) vf->eyes ());
-			_queue.pop_front ();
+			if (!start_encode (vf, name)) {
+				/* This is a re-issued copy of a frame which has already been encoded, or which
+				   our server is already encoding.
+				*/
+				if (server) {
+					statistics->release ();
+				}
+				continue;
+			}
 
-			lock.unlock ();
+			LOG_TIMING ("encoder-pop thread=%1 frame=%2 eyes=%3", thread_id(), vf->index(), (int) vf->eyes ());
 
 			optional<Data> encoded;
+			boost::posix_time::ptime const start = boost::posix_time::microsec_clock::universal_time ();
 
 			/* We need to encode this input */
 			if (server) {
 				try {
-					encoded = vf->encode_remotely (server.get ());
+					if (connection) {
+						encoded = connection->encode (vf);
+					} else {
+						encoded = vf->encode_remotely (server.get ());
+					}
 
 					if (remote_backoff > 0) {
-						LOG_GENERAL ("%1 was lost, but now she is found; removing backoff", server->host_name ());
+						LOG_GENERAL ("%1 was lost, but now she is found; removing backoff", name);
 					}
 
 					/* This job succeeded, so remove any backoff */
 					remote_backoff = 0;
 
 				} catch (std::exception& e) {
-					if (remote_backoff < 60) {
-						/* back off more */
-						remote_backoff += 10;
-					}
+					/* Back off more; the other threads for this server will be held back
+					   by its statistics while we wait.
+					*/
+					remote_backoff = min (60, max (1, remote_backoff * 2));
 					LOG_ERROR (
 						N_("Remote encode of %1 on %2 failed (%3); thread sleeping for %4s"),
-						vf->index(), server->host_name(), e.what(), remote_backoff
+						vf->index(), name, e.what(), remote_backoff
 						);
 				}
 
@@ -349,44 +440,190 @@ try
 				}
 			}
 
+			optional<double> latency;
 			if (encoded) {
-				_writer->write (encoded.get(), vf->index (), vf->eyes ());
-				frame_done ();
-			} else {
-				lock.lock ();
-				LOG_GENERAL (N_("[%1] J2KEncoder thread pushes frame %2 back onto queue after failure"), thread_id(), vf->index());
-				_queue.push_front (vf);
-				lock.unlock ();
+				latency = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+			}
+			statistics->add (latency);
+			if (server) {
+				statistics->release ();
+			}
+
+			if (finish_encode (vf, name, static_cast<bool> (encoded))) {
+				if (encoded) {
+					_writer->write (encoded.get(), vf->index (), vf->eyes ());
+					frame_done ();
+					if (vf->black ()) {
+						set_black_j2k (vf->eyes(), encoded.get());
+					}
+				} else {
+					/* Other threads will steal this frame while we are backing off */
+					LOG_GENERAL (N_("[%1] J2KEncoder thread pushes frame %2 back onto queue after failure"), thread_id(), vf->index());
+					_queue.push_front (worker, vf);
+				}
+			}
+
+			if (encoded) {
+				reissue_stragglers ();
 			}
 		}
 
 		if (remote_backoff > 0) {
 			boost::this_thread::sleep (boost::posix_time::seconds (remote_backoff));
 		}
-
-		/* The queue might not be full any more, so notify anything that is waiting on that */
-		lock.lock ();
-		_full_condition.notify_all ();
 	}
 }
 catch (boost::thread_interrupted& e) {
 	/* Ignore these and just stop the thread */
-	_full_condition.notify_all ();
+	_queue.wake ();
 }
 catch (...)
 {
 	store_current ();
-	/* Wake anything waiting on _full_condition so it can see the exception */
-	_full_condition.notify_all ();
+	/* Wake anything waiting for space in the queue so it can see the exception */
+	_queue.wake ();
+}
+
+/** Note that a server (or the local machine) is about to start encoding a frame.
+ *  @param server Host name of the server, or empty for the local machine.
+ *  @return true to go ahead, false if the frame has already been encoded or is
+ *  already being encoded by the same server.
+ */
+bool
+J2KEncoder::start_encode (shared_ptr<DCPVideo> frame, string server)
+{
+	boost::mutex::scoped_lock lm (_progress_mutex);
+	map<shared_ptr<DCPVideo>, Progress>::iterator i = _progress.find (frame);
+	if (i == _progress.end()) {
+		return false;
+	}
+
+	if (i->second.encoding.find(server) != i->second.encoding.end()) {
+		/* This is a re-issued copy that has been stolen by another thread working for the
+		   server which is already encoding the frame.  Drop it, but allow the frame to be
+		   re-issued again; reissue_stragglers() won't give it to this server.
+		*/
+		i->second.reissued = false;
+		return false;
+	}
+
+	i->second.encoding[server] = boost::posix_time::microsec_clock::universal_time ();
+	return true;
+}
+
+/** Note that a server (or the local machine) has finished trying to encode a frame.
+ *  @param server Host name of the server, or empty for the local machine.
+ *  @param success true if the frame was encoded.
+ *  @return If success is true, true if the caller should write the frame (i.e. it is
+ *  the first copy to be finished).  If success is false, true if the caller should put
+ *  the frame back on the queue (i.e. nobody else is encoding it).
+ */
+bool
+J2KEncoder::finish_encode (shared_ptr<DCPVideo> frame, string server, bool success)
+{
+	boost::mutex::scoped_lock lm (_progress_mutex);
+	map<shared_ptr<DCPVideo>, Progress>::iterator i = _progress.find (frame);
+	if (i == _progress.end()) {
+		/* Another copy got there first */
+		return false;
+	}
+
+	i->second.encoding.erase (server);
+
+	if (success) {
+		_progress.erase (i);
+		if (!_newest_encoded || frame->index() > *_newest_encoded) {
+			_newest_encoded = frame->index ();
+		}
+		return true;
+	}
+
+	return i->second.encoding.empty ();
 }
 
+/** Look for a frame which is much older than the newest one that has been encoded, and which
+ *  has been with its server for much longer than that server usually takes.  If there is one,
+ *  give a copy of it to the fastest other server (or the local machine) that we have.
+ */
 void
-J2KEncoder::servers_list_changed ()
+J2KEncoder::reissue_stragglers ()
 {
-	terminate_threads ();
+	boost::mutex::scoped_lock lm (_progress_mutex);
+
+	if (!_newest_encoded) {
+		return;
+	}
+
+	/* A frame is far behind if more than one frame for every thread has been encoded since it */
+	int behind = 0;
+	for (map<string, Server>::const_iterator i = _servers.begin(); i != _servers.end(); ++i) {
+		behind += i->second.workers.size ();
+	}
+
+	boost::posix_time::ptime const now = boost::posix_time::microsec_clock::universal_time ();
+
+	for (map<shared_ptr<DCPVideo>, Progress>::iterator i = _progress.begin(); i != _progress.end(); ++i) {
+		if (i->second.reissued || i->second.encoding.empty() || (*_newest_encoded - i->first->index()) <= behind) {
+			continue;
+		}
+
+		/* See if every copy of this frame is taking much longer than expected */
+		bool late = true;
+		for (map<string, boost::posix_time::ptime>::const_iterator j = i->second.encoding.begin(); j != i->second.encoding.end(); ++j) {
+			map<string, Server>::const_iterator k = _servers.find (j->first);
+			if (k == _servers.end()) {
+				late = false;
+				break;
+			}
+			double const expected = k->second.statistics->latency ();
+			if (expected == 0 || (now - j->second).total_microseconds() / 1e6 < (expected * 2 + 1)) {
+				late = false;
+				break;
+			}
+		}
+
+		if (!late) {
+			continue;
+		}
+
+		/* Find the server with the lowest latency which does not already have the frame */
+		optional<map<string, Server>::const_iterator> fastest;
+		for (map<string, Server>::const_iterator j = _servers.begin(); j != _servers.end(); ++j) {
+			if (i->second.encoding.find(j->first) != i->second.encoding.end() || j->second.workers.empty()) {
+				continue;
+			}
+			double const latency = j->second.statistics->latency ();
+			if (latency > 0 && (!fastest || latency < (*fastest)->second.statistics->latency())) {
+				fastest = j;
+			}
+		}
+
+		if (!fastest) {
+			return;
+		}
+
+		LOG_GENERAL (
+			N_("Re-issuing frame %1 from %2 to %3"),
+			i->first->index(),
+			i->second.encoding.begin()->first.empty() ? "localhost" : i->second.encoding.begin()->first,
+			(*fastest)->first.empty() ? "localhost" : (*fastest)->first
+			);
+
+		i->second.reissued = true;
+		_queue.push_front ((*fastest)->second.workers.front(), i->first);
 
-	/* XXX: could re-use threads */
+		/* One at a time is enough */
+		return;
+	}
+}
 
+/** Make our threads match the current configuration and list of servers.  Only threads
+ *  for servers which have appeared, disappeared or changed are started or stopped, so
+ *  other encoding carries on undisturbed.
+ */
+void
+J2KEncoder::servers_list_changed ()
+{
 	boost::mutex::scoped_lock lm (_threads_mutex);
 
 #ifdef BOOST_THREAD_PLATFORM_WIN32
@@ -399,31 +636,138 @@ J2KEncoder::servers_list_changed ()
 	}
 #endif
 
-	if (!Config::instance()->only_servers_encode ()) {
-		for (int i = 0; i < Config::instance()->master_encoding_threads (); ++i) {
-			boost::thread* t = new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, optional<EncodeServerDescription> ()));
-#ifdef DCPOMATIC_LINUX
-			pthread_setname_np (t->native_handle(), "encode-worker");
-#endif
-			_threads.push_back (t);
+	/* Servers that we should be using, indexed by host name */
+	map<string, EncodeServerDescription> wanted;
+	BOOST_FOREACH (EncodeServerDescription i, EncodeServerFinder::instance()->servers()) {
+		if (i.current_link_version()) {
+			wanted[i.host_name()] = i;
+		}
+	}
+
+	int const local_wanted = Config::instance()->only_servers_encode() ? 0 : Config::instance()->master_encoding_threads ();
+
+	/* Find threads which we no longer want: surplus local ones, and those for
+	   servers which have gone away or whose details have changed.
+	*/
+	list<EncoderThread> stop;
+	int local = 0;
+	for (list<EncoderThread>::iterator i = _threads.begin(); i != _threads.end(); ) {
+		list<EncoderThread>::iterator j = i;
+		++j;
+
+		bool keep = true;
+		if (!i->description) {
+			keep = local < local_wanted;
+			if (keep) {
+				++local;
+			}
+		} else {
+			map<string, EncodeServerDescription>::const_iterator w = wanted.find (i->server);
+			keep = w != wanted.end() &&
+				w->second.threads() == i->description->threads() &&
+				w->second.link_version() == i->description->link_version() &&
+				w->second.transport_codecs() == i->description->transport_codecs();
+		}
+
+		if (!keep) {
+			stop.push_back (*i);
+			_threads.erase (i);
+		}
+
+		i = j;
+	}
+
+	if (!stop.empty ()) {
+		LOG_GENERAL (N_("Stopping %1 encoder threads"), stop.size ());
+		stop_threads (stop);
+	}
+
+	/* Start any local threads that we need */
+	if (local < local_wanted) {
+		/* Local threads only use their statistics to decide where to re-issue frames */
+		shared_ptr<EncodeServerStatistics> statistics;
+		{
+			boost::mutex::scoped_lock lm2 (_progress_mutex);
+			map<string, Server>::const_iterator i = _servers.find ("");
+			if (i != _servers.end()) {
+				statistics = i->second.statistics;
+			}
+		}
+		if (!statistics) {
+			statistics.reset (new EncodeServerStatistics (local_wanted));
+		}
+
+		for (int i = local; i < local_wanted; ++i) {
+			add_thread (optional<EncodeServerDescription> (), shared_ptr<EncodeServerConnection> (), statistics);
 #ifdef BOOST_THREAD_PLATFORM_WIN32
 			if (windows_xp) {
-				SetThreadAffinityMask (t->native_handle(), 1 << i);
+				SetThreadAffinityMask (_threads.back().thread->native_handle(), 1 << i);
 			}
 #endif
 		}
 	}
 
-	BOOST_FOREACH (EncodeServerDescription i, EncodeServerFinder::instance()->servers()) {
-		if (!i.current_link_version()) {
+	/* Start threads for servers that we are not yet using */
+	_nominal_threads = local_wanted;
+	for (map<string, EncodeServerDescription>::const_iterator i = wanted.begin(); i != wanted.end(); ++i) {
+		_nominal_threads += i->second.threads ();
+
+		bool have = false;
+		for (list<EncoderThread>::const_iterator j = _threads.begin(); j != _threads.end(); ++j) {
+			if (j->server == i->first) {
+				have = true;
+				break;
+			}
+		}
+
+		if (have) {
 			continue;
 		}
 
-		LOG_GENERAL (N_("Adding %1 worker threads for remote %2"), i.threads(), i.host_name ());
-		for (int j = 0; j < i.threads(); ++j) {
-			_threads.push_back (new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, i)));
+		/* Servers which can keep a connection open get one connection shared between all
+		   the threads that we use for them, so that each thread's frame can be in flight at the same time.
+		*/
+		shared_ptr<EncodeServerConnection> connection;
+		if (i->second.persistent_connection ()) {
+			connection.reset (new EncodeServerConnection (i->second));
+		}
+
+		/* Start enough threads for the most frames that the server will ever be
+		   allowed to have in flight; its statistics decide how many of them can
+		   be busy at any time.
+		*/
+		shared_ptr<EncodeServerStatistics> statistics (new EncodeServerStatistics (i->second.threads ()));
+		LOG_GENERAL (N_("Adding %1 worker threads for remote %2"), statistics->maximum(), i->first);
+		for (int j = 0; j < statistics->maximum(); ++j) {
+			add_thread (i->second, connection, statistics);
 		}
 	}
 
-	_writer->set_encoder_threads (_threads.size ());
+	_writer->set_encoder_threads (_nominal_threads);
+}
+
+/** Start a new encoder thread with its own part of the queue.
+ *  Must be called with a lock held on _threads_mutex.
+ */
+void
+J2KEncoder::add_thread (
+	optional<EncodeServerDescription> server, shared_ptr<EncodeServerConnection> connection, shared_ptr<EncodeServerStatistics> statistics
+	)
+{
+	string const name = server ? server->host_name() : "";
+	int const worker = _queue.add_worker ();
+
+	{
+		boost::mutex::scoped_lock lm (_progress_mutex);
+		_servers[name].statistics = statistics;
+		_servers[name].workers.push_back (worker);
+	}
+
+	boost::thread* t = new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, worker, server, connection, statistics));
+#ifdef DCPOMATIC_LINUX
+	if (!server) {
+		pthread_setname_np (t->native_handle(), "encode-worker");
+	}
+#endif
+	_threads.push_back (EncoderThread (t, worker, server));
 }
@@ -29,6 +29,9 @@
 #include "cross.h"
 #include "event_history.h"
 #include "exception_store.h"
+#include "work_stealing_queue.h"
+#include "encode_server_description.h"
+#include <dcp/data.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
@@ -37,10 +40,12 @@
 #include <boost/signals2.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <list>
+#include <map>
 #include <stdint.h>
 
 class Film;
-class EncodeServerDescription;
+class EncodeServerConnection;
+class EncodeServerStatistics;
 class DCPVideo;
 class Writer;
 class Job;
@@ -50,7 +55,14 @@ class PlayerVideo;
  *  @brief Class to manage encoding to J2K.
  *
  *  This class keeps a queue of frames to be encoded and distributes
- *  the work around threads and encoding servers.
+ *  the work around threads and encoding servers.  Each thread has its
+ *  own part of the queue, and steals from the others when it runs out.
+ *
+ *  The number of frames that each server has in flight is adjusted according
+ *  to how quickly it is returning them (see EncodeServerStatistics), and frames
+ *  which are taking much longer than they should, while later frames are being
+ *  finished, are re-issued to the fastest server so that the Writer is not
+ *  kept waiting for them.  Whichever copy comes back first is written.
  */
 
 class J2KEncoder : public boost::noncopyable, public ExceptionStore, public boost::enable_shared_from_this<J2KEncoder>
@@ -78,24 +90,91 @@ private:
 	static void call_servers_list_changed (boost::weak_ptr<J2KEncoder> encoder);
 
 	void frame_done ();
+	boost::optional<dcp::Data> black_j2k (Eyes eyes) const;
+	void set_black_j2k (Eyes eyes, dcp::Data data);
+
+	void encoder_thread (
+		int worker,
+		boost::optional<EncodeServerDescription>,
+		boost::shared_ptr<EncodeServerConnection>,
+		boost::shared_ptr<EncodeServerStatistics>
+		);
+	void add_thread (
+		boost::optional<EncodeServerDescription> server,
+		boost::shared_ptr<EncodeServerConnection> connection,
+		boost::shared_ptr<EncodeServerStatistics> statistics
+		);
+	struct EncoderThread;
 
-	void encoder_thread (boost::optional<EncodeServerDescription>);
 	void terminate_threads ();
+	void stop_threads (std::list<EncoderThread> const & threads);
+
+	bool start_encode (boost::shared_ptr<DCPVideo> frame, std::string server);
+	bool finish_encode (boost::shared_ptr<DCPVideo> frame, std::string server, bool success);
+	void reissue_stragglers ();
 
 	/** Film that we are encoding */
 	boost::shared_ptr<const Film> _film;
 
 	EventHistory _history;
 
-	/** Mutex for _threads */
+	struct EncoderThread {
+		EncoderThread (boost::thread* t, int w, boost::optional<EncodeServerDescription> d)
+			: thread (t)
+			, worker (w)
+			, description (d)
+		{
+			if (d) {
+				server = d->host_name ();
+			}
+		}
+
+		boost::thread* thread;
+		/** our worker ID in _queue */
+		int worker;
+		/** the server that we send frames to, or none for local encoding */
+		boost::optional<EncodeServerDescription> description;
+		/** host name of the server that we send frames to, or empty for local encoding */
+		std::string server;
+	};
+
+	/** Mutex for _threads and _nominal_threads */
 	mutable boost::mutex _threads_mutex;
-	std::list<boost::thread *> _threads;
-	mutable boost::mutex _queue_mutex;
-	std::list<boost::shared_ptr<DCPVideo> > _queue;
-	/** condition to manage thread wakeups when we have nothing to do */
-	boost::condition _empty_condition;
-	/** condition to manage thread wakeups when we have too much to do */
-	boost::condition _full_condition;
+	std::list<EncoderThread> _threads;
+	/** number of frames that our servers and local threads say they can encode at once */
+	int _nominal_threads;
+	/** frames waiting to be encoded, split between the threads */
+	WorkStealingQueue<boost::shared_ptr<DCPVideo> > _queue;
+
+	/** Details of a frame which has been queued but not yet encoded */
+	struct Progress {
+		Progress ()
+			: reissued (false)
+		{}
+
+		/** host names of servers (or empty for local) which are encoding the frame, with the times that they started */
+		std::map<std::string, boost::posix_time::ptime> encoding;
+		/** true if the frame has been re-issued because it was taking too long */
+		bool reissued;
+	};
+
+	/** Our knowledge of a server (or the local machine) */
+	struct Server {
+		boost::shared_ptr<EncodeServerStatistics> statistics;
+		/** IDs in _queue of the threads which are working for this server */
+		std::list<int> workers;
+	};
+
+	/** Mutex for _progress, _newest_encoded and _servers; this is never held while
+	 *  waiting for threads, so encoder threads can always take it.
+	 */
+	mutable boost::mutex _progress_mutex;
+	/** frames which have been queued but not yet encoded */
+	std::map<boost::shared_ptr<DCPVideo>, Progress> _progress;
+	/** highest index of any frame that has been encoded */
+	boost::optional<int> _newest_encoded;
+	/** servers indexed by host name, with an empty name for the local machine */
+	std::map<std::string, Server> _servers;
 
 	boost::shared_ptr<Writer> _writer;
 	Waker _waker;
@@ -103,6 +182,11 @@ private:
 	boost::shared_ptr<PlayerVideo> _last_player_video[EYES_COUNT];
 	boost::optional<DCPTime> _last_player_video_time;
 
+	/** Mutex for _black_j2k */
+	mutable boost::mutex _black_j2k_mutex;
+	/** Encoded black frames for each eye, indexed by resolution and J2K bandwidth */
+	std::map<std::pair<Resolution, int>, dcp::Data> _black_j2k[EYES_COUNT];
+
 	boost::signals2::scoped_connection _server_found_connection;
 };
 
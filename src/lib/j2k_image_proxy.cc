@@ -22,6 +22,7 @@
 #include "dcpomatic_socket.h"
 #include "image.h"
 #include "dcpomatic_assert.h"
+#include "binary_metadata.h"
 #include <dcp/raw_convert.h>
 #include <dcp/openjpeg_image.h>
 #include <dcp/mono_picture_frame.h>
@@ -113,6 +114,20 @@ J2KImageProxy::J2KImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> soc
 	socket->read (_data.data().get (), _data.size ());
 }
 
+J2KImageProxy::J2KImageProxy (BinaryReader& reader, shared_ptr<Socket> socket)
+{
+	int const width = reader.read_int32 ();
+	int const height = reader.read_int32 ();
+	_size = dcp::Size (width, height);
+	if (reader.read_bool ()) {
+		_eye = static_cast<dcp::Eye> (reader.read_int32 ());
+	}
+	_data = Data (reader.read_int32 ());
+	/* See the comment in the XML constructor */
+	_pixel_format = AV_PIX_FMT_XYZ12LE;
+	socket->read (_data.data().get (), _data.size ());
+}
+
 int
 J2KImageProxy::prepare (optional<dcp::Size> target_size) const
 {
@@ -190,7 +205,20 @@ J2KImageProxy::add_metadata (xmlpp::Node* node) const
 }
 
 void
-J2KImageProxy::send_binary (shared_ptr<Socket> socket) const
+J2KImageProxy::add_binary_metadata (BinaryWriter& writer) const
+{
+	writer.write_uint8 (IMAGE_PROXY_J2K);
+	writer.write_int32 (_size.width);
+	writer.write_int32 (_size.height);
+	writer.write_bool (static_cast<bool> (_eye));
+	if (_eye) {
+		writer.write_int32 (static_cast<int> (_eye.get ()));
+	}
+	writer.write_int32 (_data.size ());
+}
+
+void
+J2KImageProxy::send_binary (shared_ptr<Socket> socket, TransportCodec) const
 {
 	socket->write (_data.data().get(), _data.size());
 }
@@ -49,13 +49,15 @@ public:
 		);
 
 	J2KImageProxy (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
+	J2KImageProxy (BinaryReader& reader, boost::shared_ptr<Socket> socket);
 
 	std::pair<boost::shared_ptr<Image>, int> image (
 		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
 		) const;
 
 	void add_metadata (xmlpp::Node *) const;
-	void send_binary (boost::shared_ptr<Socket>) const;
+	void add_binary_metadata (BinaryWriter &) const;
+	void send_binary (boost::shared_ptr<Socket>, TransportCodec codec) const;
 	/** @return true if our image is definitely the same as another, false if it is probably not */
 	bool same (boost::shared_ptr<const ImageProxy>) const;
 	int prepare (boost::optional<dcp::Size> = boost::optional<dcp::Size>()) const;
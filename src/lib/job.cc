@@ -397,6 +397,14 @@ Job::sub (string n)
 	_sub_start_time = time (0);
 }
 
+/** Change the name of the current sub-job without starting a new one */
+void
+Job::set_sub_name (string n)
+{
+	boost::mutex::scoped_lock lm (_progress_mutex);
+	_sub_name = n;
+}
+
 string
 Job::error_details () const
 {
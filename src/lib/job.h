@@ -78,6 +78,7 @@ public:
 	void set_progress_unknown ();
 	void set_progress (float, bool force = false);
 	void sub (std::string);
+	void set_sub_name (std::string);
 	boost::optional<float> progress () const;
 
 	boost::shared_ptr<const Film> film () const {
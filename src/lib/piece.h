@@ -23,9 +23,11 @@
 
 #include "types.h"
 #include "frame_rate_change.h"
+#include "dcpomatic_time.h"
 
 class Content;
 class Decoder;
+class DecodeAhead;
 
 class Piece
 {
@@ -35,12 +37,29 @@ public:
 		, decoder (d)
 		, frc (f)
 		, done (false)
+		, skip_video (false)
 	{}
 
 	boost::shared_ptr<Content> content;
 	boost::shared_ptr<Decoder> decoder;
+	/** thing running decoder on its own thread, if we are doing that */
+	boost::shared_ptr<DecodeAhead> decode_ahead;
 	FrameRateChange frc;
 	bool done;
+	/** true if we are not decoding this piece's video, and are filling its period with black instead */
+	bool skip_video;
+
+	/* Details of the content which are needed many times for each frame; they are set up by
+	   Player::setup_pieces_unlocked(), and pieces are re-made whenever the content changes.
+	*/
+	DCPTime position;
+	ContentTime trim_start;
+	DCPTime length_after_trim;
+
+	/** @return Time immediately after the last thing in the content */
+	DCPTime end () const {
+		return position + length_after_trim;
+	}
 };
 
 #endif
@@ -48,6 +48,8 @@
 #include "image_decoder.h"
 #include "compose.hpp"
 #include "shuffler.h"
+#include "decode_ahead.h"
+#include "dcpomatic_time_coalesce.h"
 #include <dcp/reel.h>
 #include <dcp/reel_sound_asset.h>
 #include <dcp/reel_subtitle_asset.h>
@@ -75,6 +77,7 @@ using boost::weak_ptr;
 using boost::dynamic_pointer_cast;
 using boost::optional;
 using boost::scoped_ptr;
+using boost::function;
 
 int const PlayerProperty::VIDEO_CONTAINER_SIZE = 700;
 int const PlayerProperty::PLAYLIST = 701;
@@ -86,12 +89,14 @@ Player::Player (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist
 	: _film (film)
 	, _playlist (playlist)
 	, _suspended (0)
+	, _piece_queue_stale (true)
 	, _ignore_video (false)
 	, _ignore_audio (false)
 	, _ignore_text (false)
 	, _always_burn_open_subtitles (false)
 	, _fast (false)
 	, _play_referenced (false)
+	, _decode_ahead (false)
 	, _audio_merger (_film->audio_frame_rate())
 	, _shuffler (0)
 {
@@ -121,10 +126,35 @@ Player::setup_pieces ()
 	setup_pieces_unlocked ();
 }
 
+/** @return A function to connect to one of a piece's decoder's signals; handler if the piece's
+ *  decoder is being used directly, otherwise something to give the data to its DecodeAhead.
+ */
+template <class A>
+static function<void (A)>
+deferred (shared_ptr<Piece> piece, function<void (A)> handler)
+{
+	if (!piece->decode_ahead) {
+		return handler;
+	}
+
+	return bind (&DecodeAhead::defer<A>, piece->decode_ahead.get(), handler, _1);
+}
+
+template <class A, class B>
+static function<void (A, B)>
+deferred (shared_ptr<Piece> piece, function<void (A, B)> handler)
+{
+	if (!piece->decode_ahead) {
+		return handler;
+	}
+
+	return bind (&DecodeAhead::defer2<A, B>, piece->decode_ahead.get(), handler, _1, _2);
+}
+
 bool
 have_video (shared_ptr<Piece> piece)
 {
-	return piece->decoder && piece->decoder->video;
+	return piece->decoder && piece->decoder->video && !piece->skip_video;
 }
 
 bool
@@ -183,51 +213,88 @@ Player::setup_pieces_unlocked ()
 			}
 		}
 
+		bool skip_video = false;
+		if (decoder->video && !_skip_video.empty()) {
+			/* We need not decode this content's video if all of it is in periods that we are skipping */
+			skip_video = subtract(DCPTimePeriod(i->position(), i->end(_film)), coalesce(_skip_video)).empty();
+			if (skip_video) {
+				decoder->video->set_ignore (true);
+				if (!decoder->audio && decoder->text.empty()) {
+					/* There is nothing else to get from this content */
+					continue;
+				}
+			}
+		}
+
 		shared_ptr<Piece> piece (new Piece (i, decoder, frc));
+		piece->position = i->position ();
+		piece->trim_start = i->trim_start ();
+		piece->length_after_trim = i->length_after_trim (_film);
+		piece->skip_video = skip_video;
+		if (_decode_ahead) {
+			piece->decode_ahead.reset (new DecodeAhead (decoder, _suspended));
+		}
 		_pieces.push_back (piece);
 
 		if (decoder->video) {
+			function<void (ContentVideo)> handler;
 			if (i->video->frame_type() == VIDEO_FRAME_TYPE_3D_LEFT || i->video->frame_type() == VIDEO_FRAME_TYPE_3D_RIGHT) {
 				/* We need a Shuffler to cope with 3D L/R video data arriving out of sequence */
-				decoder->video->Data.connect (bind (&Shuffler::video, _shuffler, weak_ptr<Piece>(piece), _1));
+				handler = bind (&Shuffler::video, _shuffler, weak_ptr<Piece>(piece), _1);
 			} else {
-				decoder->video->Data.connect (bind (&Player::video, this, weak_ptr<Piece>(piece), _1));
+				handler = bind (&Player::video, this, weak_ptr<Piece>(piece), _1);
 			}
+			decoder->video->Data.connect (deferred (piece, handler));
 		}
 
 		if (decoder->audio) {
-			decoder->audio->Data.connect (bind (&Player::audio, this, weak_ptr<Piece> (piece), _1, _2));
+			function<void (AudioStreamPtr, ContentAudio)> handler = bind (&Player::audio, this, weak_ptr<Piece> (piece), _1, _2);
+			decoder->audio->Data.connect (deferred (piece, handler));
 		}
 
 		list<shared_ptr<TextDecoder> >::const_iterator j = decoder->text.begin();
 
 		while (j != decoder->text.end()) {
-			(*j)->BitmapStart.connect (
-				bind(&Player::bitmap_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
+			function<void (ContentBitmapText)> bitmap_start = bind (
+				&Player::bitmap_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1
 				);
-			(*j)->PlainStart.connect (
-				bind(&Player::plain_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
+			(*j)->BitmapStart.connect (deferred (piece, bitmap_start));
+			function<void (ContentStringText)> plain_start = bind (
+				&Player::plain_text_start, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1
 				);
-			(*j)->Stop.connect (
-				bind(&Player::subtitle_stop, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1)
+			(*j)->PlainStart.connect (deferred (piece, plain_start));
+			function<void (ContentTime)> stop = bind (
+				&Player::subtitle_stop, this, weak_ptr<Piece>(piece), weak_ptr<const TextContent>((*j)->content()), _1
 				);
+			(*j)->Stop.connect (deferred (piece, stop));
 
 			++j;
 		}
+
+		if (piece->decode_ahead) {
+			/* Only now that everything the decoder emits is connected can it start */
+			piece->decode_ahead->start ();
+		}
 	}
 
 	_stream_states.clear ();
 	BOOST_FOREACH (shared_ptr<Piece> i, _pieces) {
 		if (i->content->audio) {
 			BOOST_FOREACH (AudioStreamPtr j, i->content->audio->streams()) {
-				_stream_states[j] = StreamState (i, i->content->position ());
+				_stream_states[j] = StreamState (i, i->position);
 			}
 		}
 	}
 
+	_playlist_length = _playlist->length (_film);
+	_film_length = _film->length ();
+
 	_black = Empty (_film, _pieces, bind(&have_video, _1));
 	_silent = Empty (_film, _pieces, bind(&have_audio, _1));
 
+	_piece_queue.clear ();
+	_piece_queue_stale = true;
+
 	_last_video_time = DCPTime ();
 	_last_video_eyes = EYES_BOTH;
 	_last_audio_time = DCPTime ();
@@ -269,8 +336,9 @@ Player::set_video_container_size (dcp::Size s)
 
 		_video_container_size = s;
 
-		_black_image.reset (new Image (AV_PIX_FMT_RGB24, _video_container_size, true));
-		_black_image->make_black ();
+		shared_ptr<Image> black (new Image (AV_PIX_FMT_RGB24, _video_container_size, true));
+		black->make_black ();
+		_black_image.reset (new RawImageProxy (black));
 	}
 
 	Change (CHANGE_TYPE_DONE, PlayerProperty::VIDEO_CONTAINER_SIZE, false);
@@ -316,12 +384,86 @@ Player::film_change (ChangeType type, Film::Property p)
 	}
 }
 
+/** @return The position of a piece's decoder, or none if it can't be found at the moment */
+optional<ContentTime>
+Player::decoder_position (shared_ptr<const Piece> piece) const
+{
+	if (piece->decode_ahead) {
+		return piece->decode_ahead->position ();
+	}
+
+	return piece->decoder->position ();
+}
+
+/** Make a piece's decoder emit some data.
+ *  @return true if the decoder will emit no more data unless a seek() happens.
+ */
+bool
+Player::decoder_pass (shared_ptr<Piece> piece)
+{
+	if (piece->decode_ahead) {
+		return piece->decode_ahead->pass ();
+	}
+
+	return piece->decoder->pass ();
+}
+
+/** Rebuild _piece_queue from the positions of all our pieces' decoders.
+ *  @return false if the position of some piece can't be found at the moment.
+ */
+bool
+Player::queue_pieces ()
+{
+	_piece_queue.clear ();
+
+	int index = 0;
+	BOOST_FOREACH (shared_ptr<Piece> i, _pieces) {
+		if (!i->done) {
+			/* Given two pieces at the same time, pick the one with texts so we see it before
+			   the video.  Otherwise the last piece with texts, or the first piece without, wins.
+			*/
+			int const rank = i->decoder->text.empty() ? index : -1 - index;
+			if (!queue_piece (i, rank)) {
+				_piece_queue.clear ();
+				return false;
+			}
+		}
+		++index;
+	}
+
+	_piece_queue_stale = false;
+	return true;
+}
+
+/** Add a piece to _piece_queue at its decoder's current position, or mark it done
+ *  if it has passed the end of its content.
+ *  @return false if the position of the piece can't be found at the moment.
+ */
+bool
+Player::queue_piece (shared_ptr<Piece> piece, int rank)
+{
+	optional<ContentTime> const position = decoder_position (piece);
+	if (!position) {
+		/* We can't find out where this piece has got to while its content might be changing */
+		return false;
+	}
+
+	DCPTime const t = content_time_to_dcp (piece, max(*position, piece->trim_start));
+	if (t > piece->end()) {
+		piece->done = true;
+	} else {
+		_piece_queue[make_pair(t, rank)] = piece;
+	}
+
+	return true;
+}
+
 shared_ptr<PlayerVideo>
 Player::black_player_video_frame (Eyes eyes) const
 {
-	return shared_ptr<PlayerVideo> (
+	shared_ptr<PlayerVideo> pv (
 		new PlayerVideo (
-			shared_ptr<const ImageProxy> (new RawImageProxy (_black_image)),
+			_black_image,
 			Crop (),
 			optional<double> (),
 			_video_container_size,
@@ -333,14 +475,17 @@ Player::black_player_video_frame (Eyes eyes) const
 			boost::optional<Frame>()
 		)
 	);
+
+	pv->set_black ();
+	return pv;
 }
 
 Frame
 Player::dcp_to_content_video (shared_ptr<const Piece> piece, DCPTime t) const
 {
-	DCPTime s = t - piece->content->position ();
-	s = min (piece->content->length_after_trim(_film), s);
-	s = max (DCPTime(), s + DCPTime (piece->content->trim_start(), piece->frc));
+	DCPTime s = t - piece->position;
+	s = min (piece->length_after_trim, s);
+	s = max (DCPTime(), s + DCPTime (piece->trim_start, piece->frc));
 
 	/* It might seem more logical here to convert s to a ContentTime (using the FrameRateChange)
 	   then convert that ContentTime to frames at the content's rate.  However this fails for
@@ -356,17 +501,17 @@ DCPTime
 Player::content_video_to_dcp (shared_ptr<const Piece> piece, Frame f) const
 {
 	/* See comment in dcp_to_content_video */
-	DCPTime const d = DCPTime::from_frames (f * piece->frc.factor(), piece->frc.dcp) - DCPTime(piece->content->trim_start(), piece->frc);
-	return d + piece->content->position();
+	DCPTime const d = DCPTime::from_frames (f * piece->frc.factor(), piece->frc.dcp) - DCPTime(piece->trim_start, piece->frc);
+	return d + piece->position;
 }
 
 Frame
 Player::dcp_to_resampled_audio (shared_ptr<const Piece> piece, DCPTime t) const
 {
-	DCPTime s = t - piece->content->position ();
-	s = min (piece->content->length_after_trim(_film), s);
+	DCPTime s = t - piece->position;
+	s = min (piece->length_after_trim, s);
 	/* See notes in dcp_to_content_video */
-	return max (DCPTime (), DCPTime (piece->content->trim_start (), piece->frc) + s).frames_floor (_film->audio_frame_rate ());
+	return max (DCPTime (), DCPTime (piece->trim_start, piece->frc) + s).frames_floor (_film->audio_frame_rate ());
 }
 
 DCPTime
@@ -374,22 +519,22 @@ Player::resampled_audio_to_dcp (shared_ptr<const Piece> piece, Frame f) const
 {
 	/* See comment in dcp_to_content_video */
 	return DCPTime::from_frames (f, _film->audio_frame_rate())
-		- DCPTime (piece->content->trim_start(), piece->frc)
-		+ piece->content->position();
+		- DCPTime (piece->trim_start, piece->frc)
+		+ piece->position;
 }
 
 ContentTime
 Player::dcp_to_content_time (shared_ptr<const Piece> piece, DCPTime t) const
 {
-	DCPTime s = t - piece->content->position ();
-	s = min (piece->content->length_after_trim(_film), s);
-	return max (ContentTime (), ContentTime (s, piece->frc) + piece->content->trim_start());
+	DCPTime s = t - piece->position;
+	s = min (piece->length_after_trim, s);
+	return max (ContentTime (), ContentTime (s, piece->frc) + piece->trim_start);
 }
 
 DCPTime
 Player::content_time_to_dcp (shared_ptr<const Piece> piece, ContentTime t) const
 {
-	return max (DCPTime (), DCPTime (t - piece->content->trim_start(), piece->frc) + piece->content->position());
+	return max (DCPTime (), DCPTime (t - piece->trim_start, piece->frc) + piece->position);
 }
 
 list<shared_ptr<Font> >
@@ -461,6 +606,28 @@ Player::set_play_referenced ()
 	setup_pieces_unlocked ();
 }
 
+/** Don't decode the video of any content which is entirely within some periods, and
+ *  emit black in its place.  This is for when the caller has no use for the video there.
+ */
+void
+Player::set_skip_video (list<DCPTimePeriod> periods)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_skip_video = periods;
+	setup_pieces_unlocked ();
+}
+
+/** Run each piece's decoder on its own thread so that they can decode ahead of us,
+ *  and at the same time as each other.  Our output is not changed.
+ */
+void
+Player::set_decode_ahead ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_decode_ahead = true;
+	setup_pieces_unlocked ();
+}
+
 static void
 maybe_add_asset (list<ReferencedReelAsset>& a, shared_ptr<dcp::ReelAsset> r, Frame reel_trim_start, Frame reel_trim_end, DCPTime from, int const ffr)
 {
@@ -555,35 +722,29 @@ Player::pass ()
 		return false;
 	}
 
-	if (_playlist->length(_film) == DCPTime()) {
+	if (_playlist_length == DCPTime()) {
 		/* Special case of an empty Film; just give one black frame */
 		emit_video (black_player_video_frame(EYES_BOTH), DCPTime());
 		return true;
 	}
 
-	/* Find the decoder or empty which is farthest behind where we are and make it emit some data */
+	/* Find the decoder or empty which is farthest behind where we are and make it emit some data.
+	   Only the piece that we pass can move, so _piece_queue is kept in order as we go and only
+	   needs rebuilding after a seek or a change to our pieces.
+	*/
+
+	if (_piece_queue_stale && !queue_pieces()) {
+		return false;
+	}
 
 	shared_ptr<Piece> earliest_content;
 	optional<DCPTime> earliest_time;
+	int earliest_rank = 0;
 
-	BOOST_FOREACH (shared_ptr<Piece> i, _pieces) {
-		if (i->done) {
-			continue;
-		}
-
-		DCPTime const t = content_time_to_dcp (i, max(i->decoder->position(), i->content->trim_start()));
-		if (t > i->content->end(_film)) {
-			i->done = true;
-		} else {
-
-			/* Given two choices at the same time, pick the one with texts so we see it before
-			   the video.
-			*/
-			if (!earliest_time || t < *earliest_time || (t == *earliest_time && !i->decoder->text.empty())) {
-				earliest_time = t;
-				earliest_content = i;
-			}
-		}
+	if (!_piece_queue.empty()) {
+		earliest_time = _piece_queue.begin()->first.first;
+		earliest_rank = _piece_queue.begin()->first.second;
+		earliest_content = _piece_queue.begin()->second;
 	}
 
 	bool done = false;
@@ -612,14 +773,18 @@ Player::pass ()
 	switch (which) {
 	case CONTENT:
 	{
-		earliest_content->done = earliest_content->decoder->pass ();
+		_piece_queue.erase (_piece_queue.begin());
+		earliest_content->done = decoder_pass (earliest_content);
+		if (!earliest_content->done && !queue_piece(earliest_content, earliest_rank)) {
+			_piece_queue_stale = true;
+		}
 		shared_ptr<DCPContent> dcp = dynamic_pointer_cast<DCPContent>(earliest_content->content);
 		if (dcp && !_play_referenced && dcp->reference_audio()) {
 			/* We are skipping some referenced DCP audio content, so we need to update _last_audio_time
 			   to `hide' the fact that no audio was emitted during the referenced DCP (though
 			   we need to behave as though it was).
 			*/
-			_last_audio_time = dcp->end (_film);
+			_last_audio_time = earliest_content->end ();
 		}
 		break;
 	}
@@ -662,7 +827,7 @@ Player::pass ()
 	/* Work out the time before which the audio is definitely all here.  This is the earliest last_push_end of one
 	   of our streams, or the position of the _silent.
 	*/
-	DCPTime pull_to = _film->length ();
+	DCPTime pull_to = _film_length;
 	for (map<AudioStreamPtr, StreamState>::const_iterator i = _stream_states.begin(); i != _stream_states.end(); ++i) {
 		if (!i->second.piece->done && i->second.last_push_end < pull_to) {
 			pull_to = i->second.last_push_end;
@@ -765,17 +930,17 @@ Player::video (weak_ptr<Piece> wp, ContentVideo video)
 	   if it's after the content's period here as in that case we still need to fill any gap between
 	   `now' and the end of the content's period.
 	*/
-	if (time < piece->content->position() || (_last_video_time && time < *_last_video_time)) {
+	if (time < piece->position || (_last_video_time && time < *_last_video_time)) {
 		return;
 	}
 
 	/* Fill gaps that we discover now that we have some video which needs to be emitted.
 	   This is where we need to fill to.
 	*/
-	DCPTime fill_to = min (time, piece->content->end(_film));
+	DCPTime fill_to = min (time, piece->end());
 
 	if (_last_video_time) {
-		DCPTime fill_from = max (*_last_video_time, piece->content->position());
+		DCPTime fill_from = max (*_last_video_time, piece->position);
 
 		/* Fill if we have more than half a frame to do */
 		if ((fill_to - fill_from) > one_video_frame() / 2) {
@@ -785,7 +950,7 @@ Player::video (weak_ptr<Piece> wp, ContentVideo video)
 				if (fill_to_eyes == EYES_BOTH) {
 					fill_to_eyes = EYES_LEFT;
 				}
-				if (fill_to == piece->content->end(_film)) {
+				if (fill_to == piece->end()) {
 					/* Don't fill after the end of the content */
 					fill_to_eyes = EYES_LEFT;
 				}
@@ -838,7 +1003,7 @@ Player::video (weak_ptr<Piece> wp, ContentVideo video)
 
 	DCPTime t = time;
 	for (int i = 0; i < frc.repeat; ++i) {
-		if (t < piece->content->end(_film)) {
+		if (t < piece->end()) {
 			emit_video (_last_video[wp], t);
 		}
 		t += one_video_frame ();
@@ -866,19 +1031,19 @@ Player::audio (weak_ptr<Piece> wp, AudioStreamPtr stream, ContentAudio content_a
 	DCPTime end = time + DCPTime::from_frames(content_audio.audio->frames(), rfr);
 
 	/* Remove anything that comes before the start or after the end of the content */
-	if (time < piece->content->position()) {
-		pair<shared_ptr<AudioBuffers>, DCPTime> cut = discard_audio (content_audio.audio, time, piece->content->position());
+	if (time < piece->position) {
+		pair<shared_ptr<AudioBuffers>, DCPTime> cut = discard_audio (content_audio.audio, time, piece->position);
 		if (!cut.first) {
 			/* This audio is entirely discarded */
 			return;
 		}
 		content_audio.audio = cut.first;
 		time = cut.second;
-	} else if (time > piece->content->end(_film)) {
+	} else if (time > piece->end()) {
 		/* Discard it all */
 		return;
-	} else if (end > piece->content->end(_film)) {
-		Frame const remaining_frames = DCPTime(piece->content->end(_film) - time).frames_round(rfr);
+	} else if (end > piece->end()) {
+		Frame const remaining_frames = DCPTime(piece->end() - time).frames_round(rfr);
 		if (remaining_frames == 0) {
 			return;
 		}
@@ -964,7 +1129,7 @@ Player::plain_text_start (weak_ptr<Piece> wp, weak_ptr<const TextContent> wc, Co
 	PlayerText ps;
 	DCPTime const from (content_time_to_dcp (piece, subtitle.from()));
 
-	if (from > piece->content->end(_film)) {
+	if (from > piece->end()) {
 		return;
 	}
 
@@ -1015,7 +1180,7 @@ Player::subtitle_stop (weak_ptr<Piece> wp, weak_ptr<const TextContent> wc, Conte
 
 	DCPTime const dcp_to = content_time_to_dcp (piece, to);
 
-	if (dcp_to > piece->content->end(_film)) {
+	if (dcp_to > piece->end()) {
 		return;
 	}
 
@@ -1053,13 +1218,21 @@ Player::seek (DCPTime time, bool accurate)
 	}
 
 	BOOST_FOREACH (shared_ptr<Piece> i, _pieces) {
-		if (time < i->content->position()) {
+		if (time < i->position) {
 			/* Before; seek to the start of the content */
-			i->decoder->seek (dcp_to_content_time (i, i->content->position()), accurate);
+			if (i->decode_ahead) {
+				i->decode_ahead->seek (dcp_to_content_time (i, i->position), accurate);
+			} else {
+				i->decoder->seek (dcp_to_content_time (i, i->position), accurate);
+			}
 			i->done = false;
-		} else if (i->content->position() <= time && time < i->content->end(_film)) {
+		} else if (i->position <= time && time < i->end()) {
 			/* During; seek to position */
-			i->decoder->seek (dcp_to_content_time (i, time), accurate);
+			if (i->decode_ahead) {
+				i->decode_ahead->seek (dcp_to_content_time (i, time), accurate);
+			} else {
+				i->decoder->seek (dcp_to_content_time (i, time), accurate);
+			}
 			i->done = false;
 		} else {
 			/* After; this piece is done */
@@ -1067,6 +1240,8 @@ Player::seek (DCPTime time, bool accurate)
 		}
 	}
 
+	_piece_queue_stale = true;
+
 	if (accurate) {
 		_last_video_time = time;
 		_last_video_eyes = EYES_LEFT;
@@ -1136,6 +1311,28 @@ Player::emit_audio (shared_ptr<AudioBuffers> data, DCPTime time)
 	_last_audio_time = time + DCPTime::from_frames (data->frames(), _film->audio_frame_rate());
 }
 
+/** @return A silent buffer of a given length with the film's channel count.  Gaps are usually
+ *  filled with the same few lengths, so these are kept and re-used.
+ */
+shared_ptr<AudioBuffers>
+Player::silence (Frame samples)
+{
+	pair<int, Frame> const key (_film->audio_channels(), samples);
+	SilenceMap::const_iterator i = _silence.find (key);
+	if (i != _silence.end()) {
+		return i->second;
+	}
+
+	if (_silence.size() > 16) {
+		_silence.clear ();
+	}
+
+	shared_ptr<AudioBuffers> silence (new AudioBuffers (key.first, samples));
+	silence->make_silent ();
+	_silence[key] = silence;
+	return silence;
+}
+
 void
 Player::fill_audio (DCPTimePeriod period)
 {
@@ -1150,9 +1347,7 @@ Player::fill_audio (DCPTimePeriod period)
 		DCPTime block = min (DCPTime::from_seconds (0.5), period.to - t);
 		Frame const samples = block.frames_round(_film->audio_frame_rate());
 		if (samples) {
-			shared_ptr<AudioBuffers> silence (new AudioBuffers (_film->audio_channels(), samples));
-			silence->make_silent ();
-			emit_audio (silence, t);
+			emit_audio (silence(samples), t);
 		}
 		t += block;
 	}
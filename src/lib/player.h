@@ -43,6 +43,7 @@ namespace dcp {
 }
 
 class PlayerVideo;
+class ImageProxy;
 class Playlist;
 class Font;
 class AudioBuffers;
@@ -85,7 +86,9 @@ public:
 	void set_always_burn_open_subtitles ();
 	void set_fast ();
 	void set_play_referenced ();
+	void set_decode_ahead ();
 	void set_dcp_decode_reduction (boost::optional<int> reduction);
+	void set_skip_video (std::list<DCPTimePeriod> periods);
 
 	boost::optional<DCPTime> content_time_to_dcp (boost::shared_ptr<Content> content, ContentTime t);
 
@@ -121,6 +124,10 @@ private:
 	DCPTime resampled_audio_to_dcp (boost::shared_ptr<const Piece> piece, Frame f) const;
 	ContentTime dcp_to_content_time (boost::shared_ptr<const Piece> piece, DCPTime t) const;
 	DCPTime content_time_to_dcp (boost::shared_ptr<const Piece> piece, ContentTime t) const;
+	boost::optional<ContentTime> decoder_position (boost::shared_ptr<const Piece> piece) const;
+	bool decoder_pass (boost::shared_ptr<Piece> piece);
+	bool queue_pieces ();
+	bool queue_piece (boost::shared_ptr<Piece> piece, int rank);
 	boost::shared_ptr<PlayerVideo> black_player_video_frame (Eyes eyes) const;
 	void video (boost::weak_ptr<Piece>, ContentVideo);
 	void audio (boost::weak_ptr<Piece>, AudioStreamPtr, ContentAudio);
@@ -128,6 +135,7 @@ private:
 	void plain_text_start (boost::weak_ptr<Piece>, boost::weak_ptr<const TextContent>, ContentStringText);
 	void subtitle_stop (boost::weak_ptr<Piece>, boost::weak_ptr<const TextContent>, ContentTime);
 	DCPTime one_video_frame () const;
+	boost::shared_ptr<AudioBuffers> silence (Frame samples);
 	void fill_audio (DCPTimePeriod period);
 	std::pair<boost::shared_ptr<AudioBuffers>, DCPTime> discard_audio (
 		boost::shared_ptr<const AudioBuffers> audio, DCPTime time, DCPTime discard_to
@@ -145,14 +153,32 @@ private:
 
 	boost::shared_ptr<const Film> _film;
 	boost::shared_ptr<const Playlist> _playlist;
+	/** length of _playlist and of the film, cached when our pieces are set up */
+	DCPTime _playlist_length;
+	DCPTime _film_length;
 
 	/** > 0 if we are suspended (i.e. pass() and seek() do nothing) */
 	boost::atomic<int> _suspended;
 	std::list<boost::shared_ptr<Piece> > _pieces;
 
+	/** Pieces which are not yet done, keyed by the DCP time that their decoder has
+	 *  reached and then by a rank which breaks ties in the same way each time.
+	 *  The first entry is the piece that pass() should use next.
+	 */
+	typedef std::map<std::pair<DCPTime, int>, boost::shared_ptr<Piece> > PieceQueue;
+	PieceQueue _piece_queue;
+	/** true if _piece_queue needs to be rebuilt from _pieces before it is next used */
+	bool _piece_queue_stale;
+
 	/** Size of the image in the DCP (e.g. 1990x1080 for flat) */
 	dcp::Size _video_container_size;
-	boost::shared_ptr<Image> _black_image;
+	/** Black image of _video_container_size, shared by all the black frames that we emit */
+	boost::shared_ptr<const ImageProxy> _black_image;
+	/** Silent buffers that we have emitted, indexed by channel count and length in frames;
+	 *  these are shared by all the silence that we emit, so nothing may write to them.
+	 */
+	typedef std::map<std::pair<int, Frame>, boost::shared_ptr<AudioBuffers> > SilenceMap;
+	SilenceMap _silence;
 
 	/** true if the player should ignore all video; i.e. never produce any */
 	bool _ignore_video;
@@ -164,6 +190,10 @@ private:
 	bool _fast;
 	/** true if we should `play' (i.e output) referenced DCP data (e.g. for preview) */
 	bool _play_referenced;
+	/** true if each piece's decoder should run ahead on its own thread */
+	bool _decode_ahead;
+	/** periods whose video the caller does not need; content entirely within them is not decoded */
+	std::list<DCPTimePeriod> _skip_video;
 
 	/** Time just after the last video frame we emitted, or the time of the last accurate seek */
 	boost::optional<DCPTime> _last_video_time;
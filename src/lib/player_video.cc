@@ -25,6 +25,8 @@
 #include "image_proxy.h"
 #include "j2k_image_proxy.h"
 #include "film.h"
+#include "binary_metadata.h"
+#include "xyz_converter.h"
 #include <dcp/raw_convert.h>
 extern "C" {
 #include <libavutil/pixfmt.h>
@@ -65,11 +67,13 @@ PlayerVideo::PlayerVideo (
 	, _colour_conversion (colour_conversion)
 	, _content (content)
 	, _video_frame (video_frame)
+	, _black (false)
 {
 
 }
 
 PlayerVideo::PlayerVideo (shared_ptr<cxml::Node> node, shared_ptr<Socket> socket)
+	: _black (false)
 {
 	_crop = Crop (node);
 	_fade = node->optional_number_child<double> ("Fade");
@@ -96,6 +100,50 @@ PlayerVideo::PlayerVideo (shared_ptr<cxml::Node> node, shared_ptr<Socket> socket
 	}
 }
 
+/** Construct a PlayerVideo from metadata written by add_binary_metadata() */
+PlayerVideo::PlayerVideo (BinaryReader& reader, shared_ptr<Socket> socket, TransportCodec codec)
+	: _black (false)
+{
+	_crop.left = reader.read_int32 ();
+	_crop.right = reader.read_int32 ();
+	_crop.top = reader.read_int32 ();
+	_crop.bottom = reader.read_int32 ();
+	if (reader.read_bool ()) {
+		_fade = reader.read_double ();
+	}
+
+	int const inter_width = reader.read_int32 ();
+	int const inter_height = reader.read_int32 ();
+	_inter_size = dcp::Size (inter_width, inter_height);
+	int const out_width = reader.read_int32 ();
+	int const out_height = reader.read_int32 ();
+	_out_size = dcp::Size (out_width, out_height);
+	_eyes = (Eyes) reader.read_int32 ();
+	_part = (Part) reader.read_int32 ();
+
+	if (reader.read_bool ()) {
+		_colour_conversion = ColourConversion (reader);
+	}
+
+	bool const has_text = reader.read_bool ();
+	dcp::Size text_size;
+	Position<int> text_position;
+	if (has_text) {
+		text_size.width = reader.read_int32 ();
+		text_size.height = reader.read_int32 ();
+		text_position.x = reader.read_int32 ();
+		text_position.y = reader.read_int32 ();
+	}
+
+	_in = image_proxy_factory (reader, socket, codec);
+
+	if (has_text) {
+		shared_ptr<Image> image (new Image (AV_PIX_FMT_BGRA, text_size, true));
+		image->read_from_socket (socket, codec);
+		_text = PositionImage (image, text_position);
+	}
+}
+
 void
 PlayerVideo::set_text (PositionImage image)
 {
@@ -131,21 +179,45 @@ PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, b
 
 	pair<shared_ptr<Image>, int> prox = _in->image (_inter_size);
 	shared_ptr<Image> im = prox.first;
-	int const reduce = prox.second;
 
-	Crop total_crop = _crop;
+	dcp::YUVToRGB yuv_to_rgb = dcp::YUV_TO_RGB_REC601;
+	if (_colour_conversion) {
+		yuv_to_rgb = _colour_conversion.get().yuv_to_rgb();
+	}
+
+	_image = im->crop_scale_window (
+		total_crop (im->size(), prox.second), _inter_size, _out_size, yuv_to_rgb, pixel_format (im->pixel_format()), aligned, fast
+		);
+
+	if (_text) {
+		_image->alpha_blend (_text->image, _text->position);
+	}
+
+	if (_fade) {
+		_image->fade (_fade.get ());
+	}
+}
+
+/** @param proxy_size Size of the image from our ImageProxy.
+ *  @param reduce Power of 2 by which the ImageProxy has already scaled the image down.
+ *  @return Crop to apply to the image from our ImageProxy, including any crop for our part.
+ */
+Crop
+PlayerVideo::total_crop (dcp::Size proxy_size, int reduce) const
+{
+	Crop total = _crop;
 	switch (_part) {
 	case PART_LEFT_HALF:
-		total_crop.right += im->size().width / 2;
+		total.right += proxy_size.width / 2;
 		break;
 	case PART_RIGHT_HALF:
-		total_crop.left += im->size().width / 2;
+		total.left += proxy_size.width / 2;
 		break;
 	case PART_TOP_HALF:
-		total_crop.bottom += im->size().height / 2;
+		total.bottom += proxy_size.height / 2;
 		break;
 	case PART_BOTTOM_HALF:
-		total_crop.top += im->size().height / 2;
+		total.top += proxy_size.height / 2;
 		break;
 	default:
 		break;
@@ -154,28 +226,59 @@ PlayerVideo::make_image (function<AVPixelFormat (AVPixelFormat)> pixel_format, b
 	if (reduce > 0) {
 		/* Scale the crop down to account for the scaling that has already happened in ImageProxy::image */
 		int const r = pow(2, reduce);
-		total_crop.left /= r;
-		total_crop.right /= r;
-		total_crop.top /= r;
-		total_crop.bottom /= r;
+		total.left /= r;
+		total.right /= r;
+		total.top /= r;
+		total.bottom /= r;
 	}
 
-	dcp::YUVToRGB yuv_to_rgb = dcp::YUV_TO_RGB_REC601;
-	if (_colour_conversion) {
-		yuv_to_rgb = _colour_conversion.get().yuv_to_rgb();
+	return total;
+}
+
+/** Make the XYZ image that DCPVideo would get by converting image (keep_xyz_or_rgb, true, false),
+ *  but using Image::crop_scale_window_xyz to do all the work in one pass.  The result is not cached.
+ *  @param note Handler to be told if any XYZ values were clamped.
+ *  @return XYZ image, or 0 if this frame has no colour conversion or its image is already XYZ.
+ */
+shared_ptr<dcp::OpenJPEGImage>
+PlayerVideo::xyz_image (dcp::NoteHandler note) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (!_colour_conversion) {
+		return shared_ptr<dcp::OpenJPEGImage> ();
 	}
 
-	_image = im->crop_scale_window (
-		total_crop, _inter_size, _out_size, yuv_to_rgb, pixel_format (im->pixel_format()), aligned, fast
-		);
+	pair<shared_ptr<Image>, int> prox = _in->image (_inter_size);
+	shared_ptr<Image> im = prox.first;
+	if (keep_xyz_or_rgb (im->pixel_format()) != AV_PIX_FMT_RGB48LE) {
+		return shared_ptr<dcp::OpenJPEGImage> ();
+	}
 
+	shared_ptr<const Image> text;
+	Position<int> text_position;
 	if (_text) {
-		_image->alpha_blend (Image::ensure_aligned (_text->image), _text->position);
+		text = _text->image;
+		text_position = _text->position;
 	}
 
+	optional<float> fade;
 	if (_fade) {
-		_image->fade (_fade.get ());
+		fade = _fade.get ();
 	}
+
+	return im->crop_scale_window_xyz (
+		total_crop (im->size(), prox.second),
+		_inter_size,
+		_out_size,
+		_colour_conversion.get().yuv_to_rgb(),
+		false,
+		text,
+		text_position,
+		fade,
+		*XYZConverter::get (_colour_conversion.get()),
+		note
+		);
 }
 
 void
@@ -203,12 +306,46 @@ PlayerVideo::add_metadata (xmlpp::Node* node) const
 	}
 }
 
+/** Write the same information as add_metadata() in binary form.  The image
+ *  proxy's metadata goes last as it is followed by the data that send_binary() sends.
+ */
+void
+PlayerVideo::add_binary_metadata (BinaryWriter& writer) const
+{
+	writer.write_int32 (_crop.left);
+	writer.write_int32 (_crop.right);
+	writer.write_int32 (_crop.top);
+	writer.write_int32 (_crop.bottom);
+	writer.write_bool (static_cast<bool> (_fade));
+	if (_fade) {
+		writer.write_double (_fade.get ());
+	}
+	writer.write_int32 (_inter_size.width);
+	writer.write_int32 (_inter_size.height);
+	writer.write_int32 (_out_size.width);
+	writer.write_int32 (_out_size.height);
+	writer.write_int32 (static_cast<int> (_eyes));
+	writer.write_int32 (static_cast<int> (_part));
+	writer.write_bool (static_cast<bool> (_colour_conversion));
+	if (_colour_conversion) {
+		_colour_conversion->as_binary (writer);
+	}
+	writer.write_bool (static_cast<bool> (_text));
+	if (_text) {
+		writer.write_int32 (_text->image->size().width);
+		writer.write_int32 (_text->image->size().height);
+		writer.write_int32 (_text->position.x);
+		writer.write_int32 (_text->position.y);
+	}
+	_in->add_binary_metadata (writer);
+}
+
 void
-PlayerVideo::send_binary (shared_ptr<Socket> socket) const
+PlayerVideo::send_binary (shared_ptr<Socket> socket, TransportCodec codec) const
 {
-	_in->send_binary (socket);
+	_in->send_binary (socket, codec);
 	if (_text) {
-		_text->image->write_to_socket (socket);
+		_text->image->write_to_socket (socket, codec);
 	}
 }
 
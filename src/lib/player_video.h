@@ -37,6 +37,12 @@ class Image;
 class ImageProxy;
 class Film;
 class Socket;
+class BinaryWriter;
+class BinaryReader;
+
+namespace dcp {
+	class OpenJPEGImage;
+}
 
 /** Everything needed to describe a video frame coming out of the player, but with the
  *  bits still their raw form.  We may want to combine the bits on a remote machine,
@@ -59,19 +65,32 @@ public:
 		);
 
 	PlayerVideo (boost::shared_ptr<cxml::Node>, boost::shared_ptr<Socket>);
+	PlayerVideo (BinaryReader &, boost::shared_ptr<Socket>, TransportCodec codec);
 
 	boost::shared_ptr<PlayerVideo> shallow_copy () const;
 
 	void set_text (PositionImage);
 
+	/** Mark this frame as being entirely black, so that it need not be encoded */
+	void set_black () {
+		_black = true;
+	}
+
+	/** @return true if this frame is black with nothing burnt into it */
+	bool black () const {
+		return _black && !_text;
+	}
+
 	void prepare (boost::function<AVPixelFormat (AVPixelFormat)> pixel_format, bool aligned, bool fast);
 	boost::shared_ptr<Image> image (boost::function<AVPixelFormat (AVPixelFormat)> pixel_format, bool aligned, bool fast) const;
+	boost::shared_ptr<dcp::OpenJPEGImage> xyz_image (dcp::NoteHandler note) const;
 
 	static AVPixelFormat force (AVPixelFormat, AVPixelFormat);
 	static AVPixelFormat keep_xyz_or_rgb (AVPixelFormat);
 
 	void add_metadata (xmlpp::Node* node) const;
-	void send_binary (boost::shared_ptr<Socket> socket) const;
+	void add_binary_metadata (BinaryWriter& writer) const;
+	void send_binary (boost::shared_ptr<Socket> socket, TransportCodec codec) const;
 
 	bool reset_metadata (boost::shared_ptr<const Film> film, dcp::Size video_container_size, dcp::Size film_frame_size);
 
@@ -108,6 +127,7 @@ public:
 
 private:
 	void make_image (boost::function<AVPixelFormat (AVPixelFormat)> pixel_format, bool aligned, bool fast) const;
+	Crop total_crop (dcp::Size proxy_size, int reduce) const;
 
 	boost::shared_ptr<const ImageProxy> _in;
 	Crop _crop;
@@ -124,6 +144,8 @@ private:
 	boost::weak_ptr<Content> _content;
 	/** Video frame that we came from.  Again, this is for reset_metadata() */
 	boost::optional<Frame> _video_frame;
+	/** true if _in is known to be black */
+	bool _black;
 
 	mutable boost::mutex _mutex;
 	mutable boost::shared_ptr<Image> _image;
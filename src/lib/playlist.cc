@@ -172,23 +172,54 @@ Playlist::maybe_sequence (shared_ptr<const Film> film)
 	_sequencing = false;
 }
 
+/** @return Identifier for the video and burnt-in text of some content */
+static string
+content_video_identifier (shared_ptr<const Content> content)
+{
+	bool burn = false;
+	BOOST_FOREACH (shared_ptr<TextContent> j, content->text) {
+		if (j->burn()) {
+			burn = true;
+		}
+	}
+
+	if (content->video || burn) {
+		return content->identifier ();
+	}
+
+	return "";
+}
+
 string
 Playlist::video_identifier () const
 {
 	string t;
 
 	BOOST_FOREACH (shared_ptr<const Content> i, content()) {
-		bool burn = false;
-		BOOST_FOREACH (shared_ptr<TextContent> j, i->text) {
-			if (j->burn()) {
-				burn = true;
-			}
-		}
-		if (i->video || burn) {
-			t += i->identifier ();
+		t += content_video_identifier (i);
+	}
+
+	Digester digester;
+	digester.add (t.c_str(), t.length());
+	return digester.get ();
+}
+
+/** @return Identifier for the video of the part of this playlist within a period; this
+ *  depends only on the content which overlaps the period, along with its summary.
+ */
+string
+Playlist::video_identifier (shared_ptr<const Film> film, DCPTimePeriod period) const
+{
+	string t;
+
+	BOOST_FOREACH (shared_ptr<const Content> i, content()) {
+		if (DCPTimePeriod(i->position(), i->end(film)).overlap(period)) {
+			t += content_video_identifier (i);
 		}
 	}
 
+	t += content_summary (film, period);
+
 	Digester digester;
 	digester.add (t.c_str(), t.length());
 	return digester.get ();
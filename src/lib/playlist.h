@@ -58,6 +58,7 @@ public:
 	ContentList content () const;
 
 	std::string video_identifier () const;
+	std::string video_identifier (boost::shared_ptr<const Film> film, DCPTimePeriod period) const;
 
 	DCPTime length (boost::shared_ptr<const Film> film) const;
 	boost::optional<DCPTime> start () const;
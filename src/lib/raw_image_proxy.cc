@@ -20,6 +20,7 @@
 
 #include "raw_image_proxy.h"
 #include "image.h"
+#include "binary_metadata.h"
 #include <dcp/raw_convert.h>
 #include <dcp/util.h>
 #include <libcxml/cxml.h>
@@ -54,6 +55,16 @@ RawImageProxy::RawImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> soc
 	_image->read_from_socket (socket);
 }
 
+RawImageProxy::RawImageProxy (BinaryReader& reader, shared_ptr<Socket> socket, TransportCodec codec)
+{
+	int const width = reader.read_int32 ();
+	int const height = reader.read_int32 ();
+	AVPixelFormat const pixel_format = static_cast<AVPixelFormat> (reader.read_int32 ());
+
+	_image.reset (new Image (pixel_format, dcp::Size (width, height), true));
+	_image->read_from_socket (socket, codec);
+}
+
 pair<shared_ptr<Image>, int>
 RawImageProxy::image (optional<dcp::Size>) const
 {
@@ -70,9 +81,18 @@ RawImageProxy::add_metadata (xmlpp::Node* node) const
 }
 
 void
-RawImageProxy::send_binary (shared_ptr<Socket> socket) const
+RawImageProxy::add_binary_metadata (BinaryWriter& writer) const
+{
+	writer.write_uint8 (IMAGE_PROXY_RAW);
+	writer.write_int32 (_image->size().width);
+	writer.write_int32 (_image->size().height);
+	writer.write_int32 (static_cast<int> (_image->pixel_format ()));
+}
+
+void
+RawImageProxy::send_binary (shared_ptr<Socket> socket, TransportCodec codec) const
 {
-	_image->write_to_socket (socket);
+	_image->write_to_socket (socket, codec);
 }
 
 bool
@@ -83,6 +103,11 @@ RawImageProxy::same (shared_ptr<const ImageProxy> other) const
 		return false;
 	}
 
+	if (_image == rp->_image) {
+		/* Same image (as happens with black frames from the Player) so no need to compare the pixels */
+		return true;
+	}
+
 	return (*_image.get()) == (*rp->image().first.get());
 }
 
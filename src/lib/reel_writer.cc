@@ -24,11 +24,15 @@
 #include "job.h"
 #include "log.h"
 #include "dcpomatic_log.h"
-#include "digester.h"
 #include "font.h"
 #include "compose.hpp"
 #include "audio_buffers.h"
 #include "image.h"
+#include "frame_info_file.h"
+#include "frame_checker.h"
+#include "write_behind.h"
+#include "config.h"
+#include "util.h"
 #include <dcp/mono_picture_asset.h>
 #include <dcp/stereo_picture_asset.h>
 #include <dcp/sound_asset.h>
@@ -55,13 +59,18 @@ using std::string;
 using std::cout;
 using std::exception;
 using std::map;
+using std::vector;
+using std::max;
 using boost::shared_ptr;
 using boost::optional;
 using boost::dynamic_pointer_cast;
 using dcp::Data;
 using dcp::raw_convert;
 
-int const ReelWriter::_info_size = 48;
+/** Number of seconds of existing picture frames, before the last good one, whose data we check fully
+ *  when resuming an encode.
+ */
+static int const existing_picture_check_seconds = 10;
 
 /** @param job Related job, or 0 */
 ReelWriter::ReelWriter (
@@ -71,6 +80,11 @@ ReelWriter::ReelWriter (
 	, _period (period)
 	, _last_written_video_frame (-1)
 	, _last_written_eyes (EYES_RIGHT)
+	, _picture_finished (false)
+	, _picture_reused (false)
+	, _picture_bytes_written (0)
+	, _picture_write_time (0)
+	, _sound_bytes_written (0)
 	, _reel_index (reel_index)
 	, _reel_count (reel_count)
 	, _content_summary (content_summary)
@@ -100,12 +114,25 @@ ReelWriter::ReelWriter (
 		_film->internal_video_asset_dir() / _film->internal_video_asset_filename(_period)
 		);
 
-	_first_nonexistant_frame = check_existing_picture_asset ();
+	/* Room for two records per frame so that we don't need to grow the file for 3D */
+	_info_file.reset (new FrameInfoFile(_film->info_file(_period), _period.duration().frames_round(_film->video_frame_rate()) * 2 + 2));
 
-	_picture_asset_writer = _picture_asset->start_write (
-		_film->internal_video_asset_dir() / _film->internal_video_asset_filename(_period),
-		_first_nonexistant_frame > 0
-		);
+	if (!reuse_existing_picture_asset ()) {
+		/* Any digest that we saved is about to become wrong */
+		boost::system::error_code ec;
+		boost::filesystem::remove (_film->picture_digest_file(_period), ec);
+
+		_first_nonexistant_frame = check_existing_picture_asset ();
+
+		_picture_asset_writer = _picture_asset->start_write (
+			_film->internal_video_asset_dir() / _film->internal_video_asset_filename(_period),
+			_first_nonexistant_frame > 0
+			);
+
+		if (Config::instance()->write_behind()) {
+			_picture_write_behind.reset (new WriteBehind(_film->internal_video_asset_dir() / _film->internal_video_asset_filename(_period)));
+		}
+	}
 
 	if (_film->audio_channels ()) {
 		_sound_asset.reset (
@@ -121,9 +148,12 @@ ReelWriter::ReelWriter (
 		/* Write the sound asset into the film directory so that we leave the creation
 		   of the DCP directory until the last minute.
 		*/
-		_sound_asset_writer = _sound_asset->start_write (
-			_film->directory().get() / audio_asset_filename (_sound_asset, _reel_index, _reel_count, _content_summary)
-			);
+		boost::filesystem::path const sound_file = _film->directory().get() / audio_asset_filename (_sound_asset, _reel_index, _reel_count, _content_summary);
+		_sound_asset_writer = _sound_asset->start_write (sound_file);
+
+		if (Config::instance()->write_behind()) {
+			_sound_write_behind.reset (new WriteBehind(sound_file));
+		}
 	}
 }
 
@@ -131,39 +161,28 @@ ReelWriter::ReelWriter (
 void
 ReelWriter::write_frame_info (Frame frame, Eyes eyes, dcp::FrameInfo info) const
 {
-	shared_ptr<InfoFileHandle> handle = _film->info_file_handle(_period, false);
-	dcpomatic_fseek (handle->get(), frame_info_position(frame, eyes), SEEK_SET);
-	checked_fwrite (&info.offset, sizeof(info.offset), handle->get(), handle->file());
-	checked_fwrite (&info.size, sizeof (info.size), handle->get(), handle->file());
-	checked_fwrite (info.hash.c_str(), info.hash.size(), handle->get(), handle->file());
+	_info_file->write (frame_info_index(frame, eyes), info);
 }
 
+/** @param frame reel-relative frame
+ *  @return Details of the frame, with size 0 if it has not been written.
+ */
 dcp::FrameInfo
-ReelWriter::read_frame_info (shared_ptr<InfoFileHandle> info, Frame frame, Eyes eyes) const
+ReelWriter::read_frame_info (Frame frame, Eyes eyes) const
 {
-	dcp::FrameInfo frame_info;
-	dcpomatic_fseek (info->get(), frame_info_position(frame, eyes), SEEK_SET);
-	checked_fread (&frame_info.offset, sizeof(frame_info.offset), info->get(), info->file());
-	checked_fread (&frame_info.size, sizeof(frame_info.size), info->get(), info->file());
-
-	char hash_buffer[33];
-	checked_fread (hash_buffer, 32, info->get(), info->file());
-	hash_buffer[32] = '\0';
-	frame_info.hash = hash_buffer;
-
-	return frame_info;
+	return _info_file->read (frame_info_index(frame, eyes));
 }
 
-long
-ReelWriter::frame_info_position (Frame frame, Eyes eyes) const
+int
+ReelWriter::frame_info_index (Frame frame, Eyes eyes) const
 {
 	switch (eyes) {
 	case EYES_BOTH:
-		return frame * _info_size;
+		return frame;
 	case EYES_LEFT:
-		return frame * _info_size * 2;
+		return frame * 2;
 	case EYES_RIGHT:
-		return frame * _info_size * 2 + _info_size;
+		return frame * 2 + 1;
 	default:
 		DCPOMATIC_ASSERT (false);
 	}
@@ -171,6 +190,115 @@ ReelWriter::frame_info_position (Frame frame, Eyes eyes) const
 	DCPOMATIC_ASSERT (false);
 }
 
+/** See if a previous encode left us a complete picture asset for this reel, along with its
+ *  digest, and if so set things up to use it as it is.
+ *  @return true if the existing asset will be used.
+ */
+bool
+ReelWriter::reuse_existing_picture_asset ()
+{
+	if (_film->encrypted()) {
+		/* For the same reason that Writer::can_fake_write() won't do it */
+		return false;
+	}
+
+	DCPOMATIC_ASSERT (_picture_asset->file());
+	boost::filesystem::path const asset = _picture_asset->file().get();
+
+	optional<string> digest = existing_picture_digest ();
+	if (!digest) {
+		return false;
+	}
+
+	Frame const duration = _period.duration().frames_round(_film->video_frame_rate());
+	if (duration == 0 || _info_file->last_written() < frame_info_index(duration - 1, _film->three_d() ? EYES_RIGHT : EYES_BOTH)) {
+		return false;
+	}
+
+	try {
+		if (_film->three_d ()) {
+			_picture_asset.reset (new dcp::StereoPictureAsset (asset));
+		} else {
+			_picture_asset.reset (new dcp::MonoPictureAsset (asset));
+		}
+	} catch (exception& e) {
+		LOG_WARNING ("Could not re-use existing asset at %1 (%2)", asset.string(), e.what());
+		return false;
+	}
+
+	LOG_GENERAL ("Re-using existing asset at %1", asset.string());
+
+	_picture_digest = digest;
+	_picture_reused = true;
+	_picture_finished = true;
+	_first_nonexistant_frame = duration;
+	return true;
+}
+
+/** @return The digest of our internal video asset, if it was saved by a previous encode
+ *  and the asset has not changed since.
+ */
+optional<string>
+ReelWriter::existing_picture_digest () const
+{
+	boost::filesystem::path const asset = _picture_asset->file().get();
+	boost::filesystem::path const file = _film->picture_digest_file (_period);
+	if (!boost::filesystem::exists(asset) || !boost::filesystem::exists(file)) {
+		return optional<string> ();
+	}
+
+	FILE* f = fopen_boost (file, "r");
+	if (!f) {
+		return optional<string> ();
+	}
+
+	char digest[64];
+	char size[64];
+	char modified[64];
+	int const N = fscanf (f, "%63s %63s %63s", digest, size, modified);
+	fclose (f);
+
+	if (
+		N != 3 ||
+		raw_convert<int64_t> (string (size)) != static_cast<int64_t> (boost::filesystem::file_size(asset)) ||
+		raw_convert<int64_t> (string (modified)) != static_cast<int64_t> (boost::filesystem::last_write_time(asset))
+		) {
+		return optional<string> ();
+	}
+
+	return string (digest);
+}
+
+/** Save the digest of our finished picture asset, along with enough details of the asset
+ *  to tell if it has been changed, so that a later encode can re-use the asset.
+ */
+void
+ReelWriter::save_picture_digest () const
+{
+	DCPOMATIC_ASSERT (_picture_asset->file());
+	DCPOMATIC_ASSERT (_picture_digest);
+
+	boost::filesystem::path const asset = _picture_asset->file().get();
+	boost::filesystem::path const file = _film->picture_digest_file (_period);
+
+	string const s = String::compose (
+		"%1 %2 %3\n",
+		*_picture_digest,
+		static_cast<int64_t> (boost::filesystem::file_size(asset)),
+		static_cast<int64_t> (boost::filesystem::last_write_time(asset))
+		);
+
+	FILE* f = fopen_boost (file, "w");
+	if (!f) {
+		/* This only means that the asset can't be re-used later */
+		LOG_WARNING ("Could not open %1 to save picture digest (errno=%2)", file.string(), errno);
+		return;
+	}
+
+	checked_fwrite (s.c_str(), s.length(), f, file);
+	fclose (f);
+}
+
 Frame
 ReelWriter::check_existing_picture_asset ()
 {
@@ -199,68 +327,107 @@ ReelWriter::check_existing_picture_asset ()
 	}
 
 	/* Try to open the existing asset */
-	FILE* asset_file = fopen_boost (asset, "rb");
-	if (!asset_file) {
+	shared_ptr<FrameChecker> checker;
+	try {
+		checker.reset (new FrameChecker (asset));
+		LOG_GENERAL ("Opened existing asset at %1", asset.string());
+	} catch (OpenFileError &) {
 		LOG_GENERAL ("Could not open existing asset at %1 (errno=%2)", asset.string(), errno);
 		return 0;
-	} else {
-		LOG_GENERAL ("Opened existing asset at %1", asset.string());
 	}
 
-	shared_ptr<InfoFileHandle> info_file;
-
-	try {
-		info_file = _film->info_file_handle (_period, true);
-	} catch (OpenFileError) {
-		LOG_GENERAL_NC ("Could not open film info file");
-		fclose (asset_file);
+	/* Index of the last dcp::FrameInfo in the info file */
+	int const n = _info_file->last_written ();
+	LOG_GENERAL ("The last FI is %1", n);
+	if (n < 0) {
 		return 0;
 	}
 
-	/* Offset of the last dcp::FrameInfo in the info file */
-	int const n = (boost::filesystem::file_size(info_file->file()) / _info_size) - 1;
-	LOG_GENERAL ("The last FI is %1; info file is %2, info size %3", n, boost::filesystem::file_size(info_file->file()), _info_size);
-
-	Frame first_nonexistant_frame;
-	if (_film->three_d ()) {
-		/* Start looking at the last left frame */
-		first_nonexistant_frame = n / 2;
-	} else {
-		first_nonexistant_frame = n;
+	/* Find the last good frame (for 3D, the last good left frame).  Frames are usually good
+	   up to some point and bad after it, so if the last frame is bad we can do a binary search.
+	*/
+	Frame last_good = _film->three_d() ? n / 2 : n;
+	if (!existing_picture_frame_ok(checker, last_good)) {
+		if (!existing_picture_frame_ok(checker, 0)) {
+			LOG_GENERAL_NC ("First existing frame is bad");
+			return 0;
+		}
+		Frame bad = last_good;
+		last_good = 0;
+		while (bad - last_good > 1) {
+			Frame const mid = (last_good + bad) / 2;
+			if (existing_picture_frame_ok(checker, mid)) {
+				last_good = mid;
+			} else {
+				bad = mid;
+			}
+		}
 	}
 
-	while (!existing_picture_frame_ok(asset_file, info_file, first_nonexistant_frame) && first_nonexistant_frame > 0) {
-		--first_nonexistant_frame;
+	/* Now check every frame leading up to that one (both eyes, for 3D) in case there is
+	   damage that the search missed.
+	*/
+	Frame const check_from = max (Frame (0), last_good - existing_picture_check_seconds * _film->video_frame_rate() + 1);
+	vector<dcp::FrameInfo> frames;
+	for (Frame i = check_from; i <= last_good; ++i) {
+		if (_film->three_d()) {
+			frames.push_back (read_frame_info(i, EYES_LEFT));
+			frames.push_back (read_frame_info(i, EYES_RIGHT));
+		} else {
+			frames.push_back (read_frame_info(i, EYES_BOTH));
+		}
 	}
 
-	if (!_film->three_d() && first_nonexistant_frame > 0) {
-		/* If we are doing 3D we might have found a good L frame with no R, so only
-		   do this if we're in 2D and we've just found a good B(oth) frame.
-		*/
-		++first_nonexistant_frame;
+	LOG_GENERAL ("Checking existing frames %1 to %2", check_from, last_good);
+	optional<size_t> bad = checker->first_bad (frames, bind(&ReelWriter::existing_picture_check_progress, this, _1, _2));
+	Frame first_nonexistant_frame = last_good + 1;
+	if (bad) {
+		first_nonexistant_frame = check_from + *bad / (_film->three_d() ? 2 : 1);
+		LOG_GENERAL ("Existing frame %1 failed check", first_nonexistant_frame);
 	}
 
 	LOG_GENERAL ("Proceeding with first nonexistant frame %1", first_nonexistant_frame);
 
-	fclose (asset_file);
-
 	return first_nonexistant_frame;
 }
 
+/** Write some picture data to our asset and note where it went */
 void
-ReelWriter::write (optional<Data> encoded, Frame frame, Eyes eyes)
+ReelWriter::write_picture (Frame frame, Eyes eyes, uint8_t const * data, int size)
 {
-	dcp::FrameInfo fin = _picture_asset_writer->write (encoded->data().get (), encoded->size());
+	DCPOMATIC_ASSERT (!_picture_finished);
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+	dcp::FrameInfo fin = _picture_asset_writer->write (data, size);
+	if (_picture_write_behind) {
+		_picture_write_behind->written (fin.offset + fin.size);
+	}
+	struct timeval end;
+	gettimeofday (&end, 0);
+
+	_picture_write_time += seconds (end) - seconds (start);
+	_picture_bytes_written += size;
+
 	write_frame_info (frame, eyes, fin);
-	_last_written[eyes] = encoded;
 	_last_written_video_frame = frame;
 	_last_written_eyes = eyes;
 }
 
+void
+ReelWriter::write (optional<Data> encoded, Frame frame, Eyes eyes)
+{
+	write_picture (frame, eyes, encoded->data().get(), encoded->size());
+	_last_written[eyes] = encoded;
+}
+
 void
 ReelWriter::fake_write (Frame frame, Eyes eyes, int size)
 {
-	_picture_asset_writer->fake_write (size);
+	if (!_picture_reused) {
+		DCPOMATIC_ASSERT (!_picture_finished);
+		_picture_asset_writer->fake_write (size);
+	}
 	_last_written_video_frame = frame;
 	_last_written_eyes = eyes;
 }
@@ -268,29 +435,23 @@ ReelWriter::fake_write (Frame frame, Eyes eyes, int size)
 void
 ReelWriter::repeat_write (Frame frame, Eyes eyes)
 {
-	dcp::FrameInfo fin = _picture_asset_writer->write (
-		_last_written[eyes]->data().get(),
-		_last_written[eyes]->size()
-		);
-	write_frame_info (frame, eyes, fin);
-	_last_written_video_frame = frame;
-	_last_written_eyes = eyes;
+	write_picture (frame, eyes, _last_written[eyes]->data().get(), _last_written[eyes]->size());
 }
 
 void
 ReelWriter::finish ()
 {
-	if (!_picture_asset_writer->finalize ()) {
-		/* Nothing was written to the picture asset */
-		LOG_GENERAL ("Nothing was written to reel %1 of %2", _reel_index, _reel_count);
-		_picture_asset.reset ();
-	}
+	finish_picture ();
 
 	if (_sound_asset_writer && !_sound_asset_writer->finalize ()) {
 		/* Nothing was written to the sound asset */
 		_sound_asset.reset ();
 	}
 
+	if (_sound_write_behind) {
+		_sound_write_behind->finish ();
+	}
+
 	/* Hard-link any video asset file into the DCP */
 	if (_picture_asset) {
 		DCPOMATIC_ASSERT (_picture_asset->file());
@@ -540,11 +701,68 @@ ReelWriter::create_reel (list<ReferencedReelAsset> const & refs, list<shared_ptr
 	return reel;
 }
 
+/** @return true if every frame of our picture asset has been written */
+bool
+ReelWriter::picture_complete () const
+{
+	return _last_written_video_frame == _period.duration().frames_round(_film->video_frame_rate()) - 1 && _last_written_eyes != EYES_LEFT;
+}
+
+/** Finish writing our picture asset, if we have not already done so.  No more frames
+ *  may be written after this.
+ */
+void
+ReelWriter::finish_picture ()
+{
+	if (_picture_finished) {
+		return;
+	}
+
+	if (!_picture_asset_writer->finalize ()) {
+		/* Nothing was written to the picture asset */
+		LOG_GENERAL ("Nothing was written to reel %1 of %2", _reel_index, _reel_count);
+		_picture_asset.reset ();
+	}
+
+	if (_picture_write_behind) {
+		_picture_write_behind->finish ();
+	}
+
+	if (_picture_write_time > 0) {
+		LOG_GENERAL (
+			"Wrote %1MB of picture data for reel %2 in %3s (%4MB/s)",
+			_picture_bytes_written / 1000000, _reel_index, _picture_write_time, _picture_bytes_written / (_picture_write_time * 1000000)
+			);
+	}
+
+	_picture_finished = true;
+}
+
+/** Calculate the digest of our picture asset, which must have been finished, so that
+ *  calculate_digests() need not do it later.  This can be called from any thread.
+ */
+void
+ReelWriter::calculate_picture_digest (boost::function<void (float)> set_progress)
+{
+	DCPOMATIC_ASSERT (_picture_finished);
+	if (_picture_asset && !_picture_digest) {
+		_picture_digest = _picture_asset->hash (set_progress);
+		if (picture_complete ()) {
+			save_picture_digest ();
+		}
+	}
+}
+
 void
 ReelWriter::calculate_digests (boost::function<void (float)> set_progress)
 {
 	if (_picture_asset) {
-		_picture_asset->hash (set_progress);
+		if (_picture_digest) {
+			/* We did this already, before our asset was moved into the DCP */
+			_picture_asset->set_hash (*_picture_digest);
+		} else {
+			_picture_asset->hash (set_progress);
+		}
 	}
 
 	if (_sound_asset) {
@@ -568,6 +786,15 @@ ReelWriter::write (shared_ptr<const AudioBuffers> audio)
 
 	DCPOMATIC_ASSERT (audio);
 	_sound_asset_writer->write (audio->data(), audio->frames());
+
+	if (_sound_write_behind) {
+		/* We don't know exactly where the data went, but this is close enough (MXF
+		   overheads mean that it will be an under-estimate) as we only drop data
+		   that has already been written out.
+		*/
+		_sound_bytes_written += int64_t(audio->frames()) * audio->channels() * 3;
+		_sound_write_behind->written (_sound_bytes_written);
+	}
 }
 
 void
@@ -653,34 +880,25 @@ ReelWriter::write (PlayerText subs, TextType type, optional<DCPTextTrack> track,
 }
 
 bool
-ReelWriter::existing_picture_frame_ok (FILE* asset_file, shared_ptr<InfoFileHandle> info_file, Frame frame) const
+ReelWriter::existing_picture_frame_ok (shared_ptr<FrameChecker> checker, Frame frame) const
 {
 	LOG_GENERAL ("Checking existing picture frame %1", frame);
 
-	/* Read the data from the info file; for 3D we just check the left
-	   frames until we find a good one.
-	*/
-	dcp::FrameInfo const info = read_frame_info (info_file, frame, _film->three_d () ? EYES_LEFT : EYES_BOTH);
-
-	bool ok = true;
-
-	/* Read the data from the asset and hash it */
-	dcpomatic_fseek (asset_file, info.offset, SEEK_SET);
-	Data data (info.size);
-	size_t const read = fread (data.data().get(), 1, data.size(), asset_file);
-	LOG_GENERAL ("Read %1 bytes of asset data; wanted %2", read, info.size);
-	if (read != static_cast<size_t> (data.size ())) {
-		LOG_GENERAL ("Existing frame %1 is incomplete", frame);
-		ok = false;
-	} else {
-		Digester digester;
-		digester.add (data.data().get(), data.size());
-		LOG_GENERAL ("Hash %1 vs %2", digester.get(), info.hash);
-		if (digester.get() != info.hash) {
-			LOG_GENERAL ("Existing frame %1 failed hash check", frame);
-			ok = false;
-		}
+	/* Read the data from the info file; for 3D we just check the left frame */
+	if (!checker->check(read_frame_info(frame, _film->three_d() ? EYES_LEFT : EYES_BOTH))) {
+		LOG_GENERAL ("Existing frame %1 failed check", frame);
+		return false;
 	}
 
-	return ok;
+	return true;
+}
+
+void
+ReelWriter::existing_picture_check_progress (float progress, float rate) const
+{
+	shared_ptr<Job> job = _job.lock ();
+	if (job) {
+		job->set_sub_name (String::compose(_("Checking existing image data (%1MB/s)"), lrintf(rate)));
+		job->set_progress (progress);
+	}
 }
@@ -31,7 +31,9 @@ class Film;
 class Job;
 class Font;
 class AudioBuffers;
-class InfoFileHandle;
+class FrameInfoFile;
+class FrameChecker;
+class WriteBehind;
 struct write_frame_info_test;
 
 namespace dcp {
@@ -66,6 +68,9 @@ public:
 	void write (boost::shared_ptr<const AudioBuffers> audio);
 	void write (PlayerText text, TextType type, boost::optional<DCPTextTrack> track, DCPTimePeriod period);
 
+	bool picture_complete () const;
+	void finish_picture ();
+	void calculate_picture_digest (boost::function<void (float)> set_progress);
 	void finish ();
 	boost::shared_ptr<dcp::Reel> create_reel (std::list<ReferencedReelAsset> const & refs, std::list<boost::shared_ptr<Font> > const & fonts);
 	void calculate_digests (boost::function<void (float)> set_progress);
@@ -88,20 +93,32 @@ public:
 		return _first_nonexistant_frame;
 	}
 
-	dcp::FrameInfo read_frame_info (boost::shared_ptr<InfoFileHandle> info, Frame frame, Eyes eyes) const;
+	/** @return true if our picture asset was left by a previous encode and nothing need be written to it */
+	bool picture_reused () const {
+		return _picture_reused;
+	}
+
+	dcp::FrameInfo read_frame_info (Frame frame, Eyes eyes) const;
 
 private:
 
 	friend struct ::write_frame_info_test;
 
+	void write_picture (Frame frame, Eyes eyes, uint8_t const * data, int size);
 	void write_frame_info (Frame frame, Eyes eyes, dcp::FrameInfo info) const;
-	long frame_info_position (Frame frame, Eyes eyes) const;
+	int frame_info_index (Frame frame, Eyes eyes) const;
+	bool reuse_existing_picture_asset ();
+	boost::optional<std::string> existing_picture_digest () const;
+	void save_picture_digest () const;
 	Frame check_existing_picture_asset ();
-	bool existing_picture_frame_ok (FILE* asset_file, boost::shared_ptr<InfoFileHandle> info_file, Frame frame) const;
+	bool existing_picture_frame_ok (boost::shared_ptr<FrameChecker> checker, Frame frame) const;
+	void existing_picture_check_progress (float progress, float rate) const;
 
 	boost::shared_ptr<const Film> _film;
 
 	DCPTimePeriod _period;
+	/** details of each picture frame that we have written */
+	boost::shared_ptr<FrameInfoFile> _info_file;
 	/** the first picture frame index that does not already exist in our MXF */
 	int _first_nonexistant_frame;
 	/** the data of the last written frame, if there is one */
@@ -109,6 +126,18 @@ private:
 	/** the index of the last written video frame within the reel */
 	int _last_written_video_frame;
 	Eyes _last_written_eyes;
+	/** true if _picture_asset_writer has been finalized */
+	bool _picture_finished;
+	/** true if _picture_asset was left complete by a previous encode and we are using it as it is */
+	bool _picture_reused;
+	/** digest of _picture_asset, if it was calculated by calculate_picture_digest() */
+	boost::optional<std::string> _picture_digest;
+	/** number of bytes of picture data that we have written (not including fake writes) */
+	int64_t _picture_bytes_written;
+	/** total time in seconds spent writing picture data */
+	double _picture_write_time;
+	/** approximate number of bytes of sound data that we have written */
+	int64_t _sound_bytes_written;
 	/** index of this reel within the DCP (starting from 0) */
 	int _reel_index;
 	/** number of reels in the DCP */
@@ -120,8 +149,9 @@ private:
 	boost::shared_ptr<dcp::PictureAssetWriter> _picture_asset_writer;
 	boost::shared_ptr<dcp::SoundAsset> _sound_asset;
 	boost::shared_ptr<dcp::SoundAssetWriter> _sound_asset_writer;
+	/** write-behind for our picture and sound MXFs, if Config::write_behind() is set */
+	boost::shared_ptr<WriteBehind> _picture_write_behind;
+	boost::shared_ptr<WriteBehind> _sound_write_behind;
 	boost::shared_ptr<dcp::SubtitleAsset> _subtitle_asset;
 	std::map<DCPTextTrack, boost::shared_ptr<dcp::SubtitleAsset> > _closed_caption_assets;
-
-	static int const _info_size;
 };
@@ -0,0 +1,194 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "seek_cache.h"
+#include "player_video.h"
+#include <boost/foreach.hpp>
+
+using std::list;
+using std::pair;
+using std::make_pair;
+using std::string;
+using std::max;
+using boost::shared_ptr;
+using boost::optional;
+
+int const SeekCache::maximum_frames = 48;
+int const SeekCache::prefetch_behind = 12;
+
+bool
+SeekCache::Key::operator< (Key const & other) const
+{
+	if (identifier != other.identifier) {
+		return identifier < other.identifier;
+	}
+
+	if (time != other.time) {
+		return time < other.time;
+	}
+
+	return eyes < other.eyes;
+}
+
+SeekCache::SeekCache ()
+	: _video_frame_rate (24)
+{
+
+}
+
+/** Set the identifier of the frames that will be given to put() from now on.
+ *  @param identifier New identifier.
+ *  @param video_frame_rate Video frame rate of those frames.
+ */
+void
+SeekCache::set_identifier (string identifier, int video_frame_rate)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_identifier = identifier;
+	_video_frame_rate = video_frame_rate;
+}
+
+/** Stop storing or returning frames until set_identifier() is next called; this should be
+ *  called when the frames that we are given are about to change.
+ */
+void
+SeekCache::invalidate ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_identifier = optional<string> ();
+}
+
+void
+SeekCache::put (shared_ptr<PlayerVideo> video, DCPTime time)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (!_identifier) {
+		return;
+	}
+
+	Key const key (*_identifier, time, video->eyes());
+	Map::iterator i = _data.find (key);
+	if (i != _data.end()) {
+		i->second.video = video;
+		_lru.splice (_lru.begin(), _lru, i->second.lru);
+		return;
+	}
+
+	_lru.push_front (key);
+	Entry entry;
+	entry.video = video;
+	entry.lru = _lru.begin();
+	_data[key] = entry;
+
+	while (int(_data.size()) > maximum_frames) {
+		_data.erase (_lru.back());
+		_lru.pop_back ();
+	}
+}
+
+/** @return The frames (one, or two for 3D) that a Player would emit first after an
+ *  accurate seek to `time', or an empty list if we don't have them all.
+ */
+list<pair<shared_ptr<PlayerVideo>, DCPTime> >
+SeekCache::get (DCPTime time)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	list<pair<shared_ptr<PlayerVideo>, DCPTime> > frames;
+	if (!_identifier) {
+		return frames;
+	}
+
+	DCPTime const end = time + DCPTime::from_frames (1, _video_frame_rate);
+
+	Map::iterator i = _data.lower_bound (Key(*_identifier, time, EYES_BOTH));
+	if (i == _data.end() || i->first.identifier != *_identifier || i->first.time >= end) {
+		return frames;
+	}
+
+	DCPTime const found = i->first.time;
+	list<Map::iterator> used;
+	while (i != _data.end() && i->first.identifier == *_identifier && i->first.time == found) {
+		frames.push_back (make_pair (i->second.video, found));
+		used.push_back (i);
+		++i;
+	}
+
+	if (!complete (frames)) {
+		return list<pair<shared_ptr<PlayerVideo>, DCPTime> > ();
+	}
+
+	BOOST_FOREACH (Map::iterator j, used) {
+		_lru.splice (_lru.begin(), _lru, j->second.lru);
+	}
+
+	return frames;
+}
+
+/** @return true if some frames from the same time are a complete picture (either mono, or both eyes) */
+bool
+SeekCache::complete (list<pair<shared_ptr<PlayerVideo>, DCPTime> > const & frames) const
+{
+	bool eyes[EYES_COUNT] = { false, false, false };
+	for (list<pair<shared_ptr<PlayerVideo>, DCPTime> >::const_iterator i = frames.begin(); i != frames.end(); ++i) {
+		eyes[i->first->eyes()] = true;
+	}
+
+	return eyes[EYES_BOTH] || (eyes[EYES_LEFT] && eyes[EYES_RIGHT]);
+}
+
+/** @param time Position that we are about to seek to.
+ *  @return Position that a Player should be started from so that we also get the frames
+ *  just before `time'.  Decoding from a key frame often means that these frames are
+ *  decoded anyway, so this usually costs little.
+ */
+DCPTime
+SeekCache::prefetch_from (DCPTime time) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (!_identifier) {
+		return time;
+	}
+
+	Map::const_iterator i = _data.lower_bound (Key(*_identifier, time - DCPTime::from_frames(1, _video_frame_rate), EYES_BOTH));
+	if (i != _data.end() && i->first.identifier == *_identifier && i->first.time < time) {
+		/* We already have the frame before `time' */
+		return time;
+	}
+
+	return max (DCPTime(), time - DCPTime::from_frames(prefetch_behind, _video_frame_rate));
+}
+
+void
+SeekCache::clear ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	_data.clear ();
+	_lru.clear ();
+}
+
+Frame
+SeekCache::size () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _data.size ();
+}
@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_SEEK_CACHE_H
+#define DCPOMATIC_SEEK_CACHE_H
+
+/** @file  src/lib/seek_cache.h
+ *  @brief SeekCache class.
+ */
+
+#include "dcpomatic_time.h"
+#include "types.h"
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+class PlayerVideo;
+
+/** @class SeekCache
+ *  @brief A store of the PlayerVideos that a Butler has recently been given, so that
+ *  seeking back to them (as happens when scrubbing in the viewer) does not mean
+ *  decoding them again.
+ *
+ *  Frames are indexed by an identifier for everything that might change the way they
+ *  look, as well as by time and eyes.  The least recently used frames are dropped
+ *  once there are more than maximum_frames.
+ */
+class SeekCache : public boost::noncopyable
+{
+public:
+	SeekCache ();
+
+	void set_identifier (std::string identifier, int video_frame_rate);
+	void invalidate ();
+	void put (boost::shared_ptr<PlayerVideo> video, DCPTime time);
+	std::list<std::pair<boost::shared_ptr<PlayerVideo>, DCPTime> > get (DCPTime time);
+	DCPTime prefetch_from (DCPTime time) const;
+	void clear ();
+
+	Frame size () const;
+
+	/** Maximum number of frames that we keep */
+	static int const maximum_frames;
+	/** Number of frames before a seek position that prefetch_from() will ask for */
+	static int const prefetch_behind;
+
+private:
+	struct Key
+	{
+		Key (std::string identifier_, DCPTime time_, Eyes eyes_)
+			: identifier (identifier_)
+			, time (time_)
+			, eyes (eyes_)
+		{}
+
+		bool operator< (Key const & other) const;
+
+		std::string identifier;
+		DCPTime time;
+		Eyes eyes;
+	};
+
+	typedef std::list<Key> LRU;
+
+	struct Entry
+	{
+		boost::shared_ptr<PlayerVideo> video;
+		/** our position in _lru */
+		LRU::iterator lru;
+	};
+
+	typedef std::map<Key, Entry> Map;
+
+	bool complete (std::list<std::pair<boost::shared_ptr<PlayerVideo>, DCPTime> > const & frames) const;
+
+	mutable boost::mutex _mutex;
+	/** identifier of the frames that we are being given now, or none if we should neither
+	 *  store nor return anything until we are told what it is.
+	 */
+	boost::optional<std::string> _identifier;
+	int _video_frame_rate;
+	Map _data;
+	/** keys of _data with the most recently used at the front */
+	LRU _lru;
+};
+
+#endif
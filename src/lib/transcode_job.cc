@@ -43,6 +43,7 @@ using std::setprecision;
 using std::cout;
 using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
+using boost::optional;
 
 /** @param film Film to use */
 TranscodeJob::TranscodeJob (shared_ptr<const Film> film)
@@ -139,7 +140,14 @@ TranscodeJob::status () const
 			char fps_buffer[64];
 			/// TRANSLATORS: fps here is an abbreviation for frames per second
 			snprintf (fps_buffer, sizeof(fps_buffer), _("; %.1f fps"), fps);
-			strncat (buffer, fps_buffer, strlen(buffer) - 1);
+			strncat (buffer, fps_buffer, sizeof(buffer) - strlen(buffer) - 1);
+		}
+
+		optional<int64_t> const memory = _encoder->memory_used ();
+		if (memory) {
+			char memory_buffer[64];
+			snprintf (memory_buffer, sizeof(memory_buffer), _("; %dMB in memory"), int (*memory / (1024 * 1024)));
+			strncat (buffer, memory_buffer, sizeof(buffer) - strlen(buffer) - 1);
 		}
 	}
 
@@ -36,6 +36,7 @@ using std::max;
 using std::min;
 using std::string;
 using boost::shared_ptr;
+using boost::optional;
 using dcp::raw_convert;
 
 bool operator== (Crop const & a, Crop const & b)
@@ -81,6 +82,38 @@ string_to_resolution (string s)
 	return RESOLUTION_2K;
 }
 
+/** @param c Transport codec.
+ *  @return Untranslated string representation, as used in ServerAvailable messages.
+ */
+string
+transport_codec_to_string (TransportCodec c)
+{
+	switch (c) {
+	case TRANSPORT_CODEC_NONE:
+		return "None";
+	case TRANSPORT_CODEC_LZ4:
+		return "LZ4";
+	}
+
+	DCPOMATIC_ASSERT (false);
+	return "";
+}
+
+/** @return TransportCodec, or none if \p s is not something we know about
+ *  (for example if it came from a newer encode server).
+ */
+optional<TransportCodec>
+string_to_transport_codec (string s)
+{
+	if (s == "None") {
+		return TRANSPORT_CODEC_NONE;
+	} else if (s == "LZ4") {
+		return TRANSPORT_CODEC_LZ4;
+	}
+
+	return optional<TransportCodec> ();
+}
+
 Crop::Crop (shared_ptr<cxml::Node> node)
 {
 	left = node->number_child<int> ("LeftCrop");
@@ -25,6 +25,7 @@
 #include "rect.h"
 #include <dcp/util.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
 #include <vector>
 #include <stdint.h>
 
@@ -46,7 +47,30 @@ namespace xmlpp {
  *  with servers.  Intended to be bumped when incompatibilities
  *  are introduced.  v2 uses 64+n
  */
-#define SERVER_LINK_VERSION (64+0)
+#define SERVER_LINK_VERSION (64+2)
+
+/** The oldest server link version that we can still use.  Servers
+ *  with this version are sent one frame per connection.
+ */
+#define SERVER_LINK_VERSION_SINGLE_FRAME (64+0)
+/** The first server link version which can keep a connection open
+ *  and encode several frames from it at once.
+ */
+#define SERVER_LINK_VERSION_PERSISTENT (64+1)
+/** The first server link version which accepts EncodingRequests in
+ *  binary form rather than XML.
+ */
+#define SERVER_LINK_VERSION_BINARY (64+2)
+
+/** First thing in a binary EncodingRequest */
+#define ENCODING_REQUEST_MAGIC 0x444f4d52
+/** Version of the binary EncodingRequest format, to be bumped when it changes */
+#define ENCODING_REQUEST_VERSION 1
+
+/** Sent as the first thing on a connection to an encode server to ask for
+ *  a persistent connection, rather than the length of a single EncodingRequest.
+ */
+#define ENCODE_SERVER_PERSISTENT_CONNECTION 0xffffffff
 
 /** A film of F seconds at f FPS will be Ff frames;
     Consider some delta FPS d, so if we run the same
@@ -236,6 +260,17 @@ enum Resolution {
 std::string resolution_to_string (Resolution);
 Resolution string_to_resolution (std::string);
 
+/** Ways of packing uncompressed images when sending them to encode servers */
+enum TransportCodec {
+	/** send the raw image data */
+	TRANSPORT_CODEC_NONE,
+	/** compress the image data with LZ4 */
+	TRANSPORT_CODEC_LZ4
+};
+
+std::string transport_codec_to_string (TransportCodec);
+boost::optional<TransportCodec> string_to_transport_codec (std::string);
+
 enum FileTransferProtocol {
 	FILE_TRANSFER_PROTOCOL_SCP,
 	FILE_TRANSFER_PROTOCOL_FTP
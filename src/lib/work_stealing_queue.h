@@ -0,0 +1,334 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_WORK_STEALING_QUEUE_H
+#define DCPOMATIC_WORK_STEALING_QUEUE_H
+
+/** @file  src/lib/work_stealing_queue.h
+ *  @brief WorkStealingQueue class.
+ */
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+#include <deque>
+#include <vector>
+#include <list>
+
+/** @class WorkStealingQueue
+ *  @brief A queue of work items split into one deque per worker.
+ *
+ *  Items are distributed round-robin to the workers' deques.  Each worker takes
+ *  items from its own deque and, when that is empty, steals from the others.
+ *  Idle workers sleep on a single condition which is notified once per push,
+ *  so that only one sleeper is woken for each new item.
+ *
+ *  Producers can wait for the total number of queued items to drop below some
+ *  limit with wait_for_space(); they are only woken when an item is taken and
+ *  somebody is waiting.
+ */
+template <class T>
+class WorkStealingQueue : public boost::noncopyable
+{
+public:
+	WorkStealingQueue ()
+		: _next_id (0)
+		, _next_push (0)
+		, _size (0)
+		, _sleepers (0)
+		, _space_waiters (0)
+		, _wake_generation (0)
+		, _orphans (new Slot (-1))
+	{}
+
+	/** Add a new worker's deque.
+	 *  @return ID to pass to pop() and remove_worker().
+	 */
+	int add_worker ()
+	{
+		boost::unique_lock<boost::shared_mutex> lm (_slots_mutex);
+		boost::shared_ptr<Slot> s (new Slot (_next_id++));
+		_slots.push_back (s);
+		return s->id;
+	}
+
+	/** Remove a worker's deque, keeping any items that were in it so that
+	 *  the remaining workers can steal them.
+	 */
+	void remove_worker (int id)
+	{
+		{
+			boost::unique_lock<boost::shared_mutex> lm (_slots_mutex);
+			for (typename std::vector<boost::shared_ptr<Slot> >::iterator i = _slots.begin(); i != _slots.end(); ++i) {
+				if ((*i)->id == id) {
+					{
+						boost::mutex::scoped_lock lm2 ((*i)->mutex);
+						boost::mutex::scoped_lock lm3 (_orphans->mutex);
+						_orphans->items.insert (_orphans->items.end(), (*i)->items.begin(), (*i)->items.end());
+					}
+					_slots.erase (i);
+					break;
+				}
+			}
+		}
+
+		/* Someone else may need to pick up what this worker left behind */
+		wake_one ();
+	}
+
+	int workers () const
+	{
+		boost::shared_lock<boost::shared_mutex> lm (_slots_mutex);
+		return _slots.size ();
+	}
+
+	/** Add an item to the back of the next worker's deque */
+	void push (T item)
+	{
+		{
+			boost::shared_lock<boost::shared_mutex> lm (_slots_mutex);
+			boost::shared_ptr<Slot> s = _orphans;
+			if (!_slots.empty ()) {
+				s = _slots[_next_push++ % _slots.size()];
+			}
+			boost::mutex::scoped_lock lm2 (s->mutex);
+			s->items.push_back (item);
+			++_size;
+		}
+
+		wake_one ();
+	}
+
+	/** Put an item back at the front of a worker's deque, for example after that
+	 *  worker failed to process it.  Other workers will steal it if the worker
+	 *  does not get back to it first.
+	 */
+	void push_front (int id, T item)
+	{
+		{
+			boost::shared_lock<boost::shared_mutex> lm (_slots_mutex);
+			boost::shared_ptr<Slot> s = find (id);
+			if (!s) {
+				s = _orphans;
+			}
+			boost::mutex::scoped_lock lm2 (s->mutex);
+			s->items.push_front (item);
+			++_size;
+		}
+
+		wake_one ();
+	}
+
+	/** Take an item for worker \p id, waiting until one is available.  This is a
+	 *  boost::thread interruption point.
+	 */
+	T pop (int id)
+	{
+		while (true) {
+			T item;
+			if (try_pop (id, item)) {
+				return item;
+			}
+
+			boost::mutex::scoped_lock lm (_sleep_mutex);
+			while (_size == 0) {
+				++_sleepers;
+				try {
+					_work_condition.wait (lm);
+				} catch (...) {
+					--_sleepers;
+					throw;
+				}
+				--_sleepers;
+			}
+		}
+	}
+
+	/** Take an item for worker \p id without waiting.
+	 *  @return true if an item was taken.
+	 */
+	bool try_pop (int id, T& item)
+	{
+		boost::shared_lock<boost::shared_mutex> lm (_slots_mutex);
+
+		size_t const N = _slots.size ();
+		size_t start = 0;
+		for (size_t i = 0; i < N; ++i) {
+			if (_slots[i]->id == id) {
+				start = i;
+				break;
+			}
+		}
+
+		/* Our own deque first, then the others in turn, then anything orphaned.
+		   We take from the front of others' deques, as the front is what whoever
+		   is consuming our results is most likely to be waiting for.
+		*/
+		for (size_t i = 0; i <= N; ++i) {
+			boost::shared_ptr<Slot> s = i < N ? _slots[(start + i) % N] : _orphans;
+			boost::mutex::scoped_lock lm2 (s->mutex);
+			if (!s->items.empty ()) {
+				item = s->items.front ();
+				s->items.pop_front ();
+				--_size;
+				lm2.unlock ();
+				item_taken ();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/** @return total number of queued items across all workers */
+	size_t size () const
+	{
+		return _size;
+	}
+
+	bool empty () const
+	{
+		return _size == 0;
+	}
+
+	/** Wait until size() is less than \p limit, or until wake() is called.
+	 *  This is a boost::thread interruption point.
+	 */
+	void wait_for_space (size_t limit)
+	{
+		boost::mutex::scoped_lock lm (_space_mutex);
+		int const generation = _wake_generation;
+		while (_size >= limit && _wake_generation == generation) {
+			++_space_waiters;
+			try {
+				_space_condition.wait (lm);
+			} catch (...) {
+				--_space_waiters;
+				throw;
+			}
+			--_space_waiters;
+		}
+	}
+
+	/** Wake anything in wait_for_space(), for example so that it can
+	 *  see an exception that a worker has stored.
+	 */
+	void wake ()
+	{
+		boost::mutex::scoped_lock lm (_space_mutex);
+		++_wake_generation;
+		_space_condition.notify_all ();
+	}
+
+	/** Remove and return every queued item */
+	std::list<T> take_all ()
+	{
+		std::list<T> all;
+		boost::unique_lock<boost::shared_mutex> lm (_slots_mutex);
+		for (size_t i = 0; i <= _slots.size(); ++i) {
+			boost::shared_ptr<Slot> s = i < _slots.size() ? _slots[i] : _orphans;
+			boost::mutex::scoped_lock lm2 (s->mutex);
+			all.insert (all.end(), s->items.begin(), s->items.end());
+			_size -= s->items.size ();
+			s->items.clear ();
+		}
+		lm.unlock ();
+		item_taken ();
+		return all;
+	}
+
+private:
+	struct Slot : public boost::noncopyable
+	{
+		explicit Slot (int id_)
+			: id (id_)
+		{}
+
+		int const id;
+		boost::mutex mutex;
+		std::deque<T> items;
+	};
+
+	/** Must be called with a lock on _slots_mutex */
+	boost::shared_ptr<Slot> find (int id) const
+	{
+		for (typename std::vector<boost::shared_ptr<Slot> >::const_iterator i = _slots.begin(); i != _slots.end(); ++i) {
+			if ((*i)->id == id) {
+				return *i;
+			}
+		}
+		return boost::shared_ptr<Slot> ();
+	}
+
+	void wake_one ()
+	{
+		/* _size has been changed before we get here, and sleepers check it
+		   with _sleep_mutex held, so nobody can miss this wakeup.
+		*/
+		boost::mutex::scoped_lock lm (_sleep_mutex);
+		if (_sleepers > 0) {
+			_work_condition.notify_one ();
+		}
+	}
+
+	void item_taken ()
+	{
+		boost::mutex::scoped_lock lm (_space_mutex);
+		if (_space_waiters > 0) {
+			_space_condition.notify_all ();
+		}
+	}
+
+	/** Mutex for _slots; held shared for pushing and popping, exclusive for
+	 *  adding and removing workers.
+	 */
+	mutable boost::shared_mutex _slots_mutex;
+	std::vector<boost::shared_ptr<Slot> > _slots;
+	int _next_id;
+	boost::atomic<size_t> _next_push;
+	/** total number of items in all slots */
+	boost::atomic<size_t> _size;
+
+	/** mutex for _sleepers */
+	boost::mutex _sleep_mutex;
+	/** number of workers waiting in pop() */
+	int _sleepers;
+	/** condition to wake workers when there is something to do */
+	boost::condition _work_condition;
+
+	/** mutex for _space_waiters and _wake_generation */
+	boost::mutex _space_mutex;
+	int _space_waiters;
+	int _wake_generation;
+	/** condition to wake producers when items have been taken */
+	boost::condition _space_condition;
+
+	/** items which are not assigned to any worker, either because there
+	 *  were no workers when they were pushed or because their worker
+	 *  has been removed.
+	 */
+	boost::shared_ptr<Slot> _orphans;
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/write_behind.cc
+ *  @brief WriteBehind class.
+ */
+
+#include "write_behind.h"
+#include "dcpomatic_log.h"
+#ifdef DCPOMATIC_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+
+/** Amount of data to wait for before starting writeback */
+int64_t const WriteBehind::chunk_size = 8 * 1024 * 1024;
+
+/** @param file File which is being written.  It need not exist until written() is first called */
+WriteBehind::WriteBehind (boost::filesystem::path file)
+	: _file (file)
+	, _fd (-1)
+	, _opened (false)
+	, _started (0)
+	, _dropped (0)
+{
+
+}
+
+WriteBehind::~WriteBehind ()
+{
+#ifdef DCPOMATIC_LINUX
+	if (_fd != -1) {
+		close (_fd);
+	}
+#endif
+}
+
+void
+WriteBehind::open ()
+{
+	_opened = true;
+
+#ifdef DCPOMATIC_LINUX
+	_fd = ::open (_file.string().c_str(), O_RDONLY);
+	if (_fd == -1) {
+		LOG_WARNING ("Could not open %1 for write-behind (errno=%2)", _file.string(), errno);
+	}
+#endif
+}
+
+/** Call this when the file has been written up to a given offset.  It may block
+ *  while earlier data is written to disk.
+ *  @param end Offset of the end of the data which has been written.
+ */
+void
+WriteBehind::written (int64_t end)
+{
+	if (end - _started < chunk_size) {
+		return;
+	}
+
+	if (!_opened) {
+		open ();
+	}
+
+	if (_fd == -1) {
+		return;
+	}
+
+#ifdef DCPOMATIC_LINUX
+	/* Start writeback of the new data, without waiting for it */
+	sync_file_range (_fd, _started, end - _started, SYNC_FILE_RANGE_WRITE);
+
+	/* Then wait for the previous chunk, which should have been written by now, and drop it */
+	if (_started > _dropped) {
+		sync_file_range (
+			_fd, _dropped, _started - _dropped,
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER
+			);
+		posix_fadvise (_fd, _dropped, _started - _dropped, POSIX_FADV_DONTNEED);
+		_dropped = _started;
+	}
+#endif
+
+	_started = end;
+}
+
+/** Call this when the file has been completely written (and closed by whatever wrote it)
+ *  to write out and drop the rest of it.  Anything at the start of the file which has been
+ *  re-written (such as a header) is dealt with as well.
+ */
+void
+WriteBehind::finish ()
+{
+	if (_fd == -1) {
+		return;
+	}
+
+#ifdef DCPOMATIC_LINUX
+	/* A length of 0 means everything from the offset to the end of the file */
+	sync_file_range (_fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise (_fd, 0, 0, POSIX_FADV_DONTNEED);
+	close (_fd);
+#endif
+
+	_fd = -1;
+}
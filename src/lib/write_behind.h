@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_WRITE_BEHIND_H
+#define DCPOMATIC_WRITE_BEHIND_H
+
+/** @file  src/lib/write_behind.h
+ *  @brief WriteBehind class.
+ */
+
+#include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+
+/** @class WriteBehind
+ *  @brief Push data that something else is appending to a file out to disk as it
+ *  arrives, and then drop it from the page cache.
+ *
+ *  Writing a very large file through the page cache can evict things that are
+ *  more useful to us (such as the content that we are reading) and leaves the
+ *  kernel to write the data back in large, stalling bursts.  Instead we start
+ *  writeback of each chunk as soon as it has been written, wait for the previous
+ *  chunk to reach the disk and then tell the kernel that we will not need it again.
+ *
+ *  The writes themselves are not affected, so this can be used on files that are
+ *  written by libraries which we don't control.  It only does anything on Linux.
+ */
+class WriteBehind : public boost::noncopyable
+{
+public:
+	explicit WriteBehind (boost::filesystem::path file);
+	~WriteBehind ();
+
+	void written (int64_t end);
+	void finish ();
+
+	static int64_t const chunk_size;
+
+private:
+	void open ();
+
+	boost::filesystem::path _file;
+	/** our descriptor for _file, or -1 */
+	int _fd;
+	/** true if we have tried to open _file */
+	bool _opened;
+	/** offset up to which we have started writeback */
+	int64_t _started;
+	/** offset up to which data has been written and dropped from the cache */
+	int64_t _dropped;
+};
+
+#endif
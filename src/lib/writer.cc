@@ -36,6 +36,7 @@
 #include "util.h"
 #include "reel_writer.h"
 #include "text_content.h"
+#include "frame_spill.h"
 #include <dcp/cpl.h>
 #include <dcp/locale_convert.h>
 #include <boost/foreach.hpp>
@@ -64,19 +65,29 @@ using boost::dynamic_pointer_cast;
 using boost::optional;
 using dcp::Data;
 
+/** Number of bytes of frames which can be waiting to be pushed to disk before the writer
+ *  thread waits for the disk to catch up.
+ */
+static int64_t const spill_pending_bytes = 64 * 1024 * 1024;
+/** Number of frames from the head of each reel's part of the queue which we will read back from disk in advance */
+static int const spill_prefetch_frames = 8;
+/** Maximum number of reels whose picture assets we will write at the same time */
+static size_t const maximum_writer_threads = 4;
+
 Writer::Writer (shared_ptr<const Film> film, weak_ptr<Job> j)
 	: _film (film)
 	, _job (j)
-	, _thread (0)
 	, _finish (false)
-	, _queued_full_in_memory (0)
 	/* These will be reset to sensible values when J2KEncoder is created */
 	, _maximum_frames_in_memory (8)
 	, _maximum_queue_size (8)
+	, _memory_limit (Config::instance()->writer_memory_limit())
 	, _full_written (0)
 	, _fake_written (0)
 	, _repeat_written (0)
 	, _pushed_to_disk (0)
+	, _busy_reels (0)
+	, _report_digest_progress (false)
 {
 	shared_ptr<Job> job = _job.lock ();
 	DCPOMATIC_ASSERT (job);
@@ -106,15 +117,39 @@ Writer::Writer (shared_ptr<const Film> film, weak_ptr<Job> j)
 void
 Writer::start ()
 {
-	_thread = new boost::thread (boost::bind (&Writer::thread, this));
+	/* Frames waiting to be spilled count towards any memory limit, so don't let too many build up */
+	int64_t const pending = _memory_limit ? min (spill_pending_bytes, *_memory_limit / 4) : spill_pending_bytes;
+	_spill.reset (new FrameSpill (_film->j2c_spill_path(), pending));
+	_reel_busy.resize (_reels.size(), false);
+
+	/* Each reel's picture asset is written by one thread at a time, but different
+	   reels can be written at the same time.
+	*/
+	size_t const threads = min (_reels.size(), maximum_writer_threads);
+	for (size_t i = 0; i < threads; ++i) {
+		boost::thread* t = new boost::thread (boost::bind (&Writer::thread, this));
 #ifdef DCPOMATIC_LINUX
-	pthread_setname_np (_thread->native_handle(), "writer");
+		pthread_setname_np (t->native_handle(), "writer");
+#endif
+		_threads.push_back (t);
+	}
+
+	/* Another thread calculates the digests of picture assets as they are finished */
+	_digest_work.reset (new boost::asio::io_service::work (_digest_service));
+	boost::thread* t = _digest_pool.create_thread (boost::bind (&boost::asio::io_service::run, &_digest_service));
+#ifdef DCPOMATIC_LINUX
+	pthread_setname_np (t->native_handle(), "writer-digest");
 #endif
 }
 
 Writer::~Writer ()
 {
-	terminate_thread (false);
+	terminate_threads (false);
+
+	_digest_work.reset ();
+	_digest_service.stop ();
+	_digest_pool.interrupt_all ();
+	_digest_pool.join_all ();
 }
 
 /** Pass a video frame to the writer for writing to disk at some point.
@@ -128,9 +163,9 @@ Writer::write (Data encoded, Frame frame, Eyes eyes)
 {
 	boost::mutex::scoped_lock lock (_state_mutex);
 
-	while (_queued_full_in_memory > _maximum_frames_in_memory) {
-		/* There are too many full frames in memory; wake the main writer thread and
-		   wait until it sorts everything out */
+	while (too_much_in_memory ()) {
+		/* There are too many full frames in memory; wake the writer threads and
+		   wait until they sort everything out */
 		_empty_condition.notify_all ();
 		_full_condition.wait (lock);
 	}
@@ -144,15 +179,12 @@ Writer::write (Data encoded, Frame frame, Eyes eyes)
 	if (_film->three_d() && eyes == EYES_BOTH) {
 		/* 2D material in a 3D DCP; fake the 3D */
 		qi.eyes = EYES_LEFT;
-		_queue.push_back (qi);
-		++_queued_full_in_memory;
+		_queue.push (qi);
 		qi.eyes = EYES_RIGHT;
-		_queue.push_back (qi);
-		++_queued_full_in_memory;
+		_queue.push (qi);
 	} else {
 		qi.eyes = eyes;
-		_queue.push_back (qi);
-		++_queued_full_in_memory;
+		_queue.push (qi);
 	}
 
 	/* Now there's something to do: wake anything wait()ing on _empty_condition */
@@ -174,8 +206,8 @@ Writer::repeat (Frame frame, Eyes eyes)
 {
 	boost::mutex::scoped_lock lock (_state_mutex);
 
-	while (_queue.size() > _maximum_queue_size && have_sequenced_image_at_queue_head()) {
-		/* The queue is too big, and the main writer thread can run and fix it, so
+	while (_queue.size() > _maximum_queue_size && can_write()) {
+		/* The queue is too big, and the writer threads can run and fix it, so
 		   wake it and wait until it has done.
 		*/
 		_empty_condition.notify_all ();
@@ -188,12 +220,12 @@ Writer::repeat (Frame frame, Eyes eyes)
 	qi.frame = frame - _reels[qi.reel].start ();
 	if (_film->three_d() && eyes == EYES_BOTH) {
 		qi.eyes = EYES_LEFT;
-		_queue.push_back (qi);
+		_queue.push (qi);
 		qi.eyes = EYES_RIGHT;
-		_queue.push_back (qi);
+		_queue.push (qi);
 	} else {
 		qi.eyes = eyes;
-		_queue.push_back (qi);
+		_queue.push (qi);
 	}
 
 	/* Now there's something to do: wake anything wait()ing on _empty_condition */
@@ -205,8 +237,8 @@ Writer::fake_write (Frame frame, Eyes eyes)
 {
 	boost::mutex::scoped_lock lock (_state_mutex);
 
-	while (_queue.size() > _maximum_queue_size && have_sequenced_image_at_queue_head()) {
-		/* The queue is too big, and the main writer thread can run and fix it, so
+	while (_queue.size() > _maximum_queue_size && can_write()) {
+		/* The queue is too big, and the writer threads can run and fix it, so
 		   wake it and wait until it has done.
 		*/
 		_empty_condition.notify_all ();
@@ -218,22 +250,18 @@ Writer::fake_write (Frame frame, Eyes eyes)
 
 	QueueItem qi;
 	qi.type = QueueItem::FAKE;
-
-	{
-		shared_ptr<InfoFileHandle> info_file = _film->info_file_handle(_reels[reel].period(), true);
-		qi.size = _reels[reel].read_frame_info(info_file, reel_frame, eyes).size;
-	}
+	qi.size = _reels[reel].read_frame_info(reel_frame, eyes).size;
 
 	qi.reel = reel;
 	qi.frame = reel_frame;
 	if (_film->three_d() && eyes == EYES_BOTH) {
 		qi.eyes = EYES_LEFT;
-		_queue.push_back (qi);
+		_queue.push (qi);
 		qi.eyes = EYES_RIGHT;
-		_queue.push_back (qi);
+		_queue.push (qi);
 	} else {
 		qi.eyes = eyes;
-		_queue.push_back (qi);
+		_queue.push (qi);
 	}
 
 	/* Now there's something to do: wake anything wait()ing on _empty_condition */
@@ -303,18 +331,19 @@ Writer::write (shared_ptr<const AudioBuffers> audio, DCPTime const time)
 	}
 }
 
-/** This must be called from Writer::thread() with an appropriate lock held */
+/** This must be called with a lock on _state_mutex held.
+ *  @return true if the next frame to be written to a given reel is at the head of that reel's part of the queue.
+ */
 bool
-Writer::have_sequenced_image_at_queue_head ()
+Writer::have_sequenced_image (size_t reel_index) const
 {
-	if (_queue.empty ()) {
+	WriterQueue::const_iterator i = _queue.first (reel_index);
+	if (i == _queue.end ()) {
 		return false;
 	}
 
-	_queue.sort ();
-
-	QueueItem const & f = _queue.front();
-	ReelWriter const & reel = _reels[f.reel];
+	QueueItem const & f = *i;
+	ReelWriter const & reel = _reels[reel_index];
 
 	/* The queue should contain only EYES_LEFT/EYES_RIGHT pairs or EYES_BOTH */
 
@@ -336,17 +365,96 @@ Writer::have_sequenced_image_at_queue_head ()
 	return false;
 }
 
+/** This must be called with a lock on _state_mutex held.
+ *  @return Index of the first reel which no writer thread is working on and which has
+ *  its next frame in the queue, if there is one.
+ */
+optional<size_t>
+Writer::sequenced_reel () const
+{
+	for (size_t i = 0; i < _reels.size(); ++i) {
+		if (!_reel_busy[i] && have_sequenced_image (i)) {
+			return i;
+		}
+	}
+
+	return optional<size_t> ();
+}
+
+/** This must be called with a lock on _state_mutex held.
+ *  @return true if a writer thread is writing, or could write, something.
+ */
+bool
+Writer::can_write () const
+{
+	return _busy_reels > 0 || sequenced_reel ();
+}
+
+/** @return true if we are holding too many frames in memory, and some of them are in the
+ *  queue so that they can be pushed to disk.  Must be called with a lock held on _state_mutex.
+ */
+bool
+Writer::too_much_in_memory () const
+{
+	if (_memory_limit) {
+		return _queue.full_in_memory() > 0 && held_in_memory() > *_memory_limit;
+	}
+
+	return _queue.full_in_memory() > _maximum_frames_in_memory;
+}
+
+/** @return number of bytes of encoded frames that are in the queue or in memory in the
+ *  spill.  Must be called with a lock held on _state_mutex.
+ */
+int64_t
+Writer::held_in_memory () const
+{
+	return _queue.full_in_memory_bytes() + (_spill ? _spill->memory_used() : 0);
+}
+
+/** @return number of bytes of encoded frames that we are holding in memory while they
+ *  wait to be written.
+ */
+int64_t
+Writer::memory_used () const
+{
+	boost::mutex::scoped_lock lm (_state_mutex);
+	return held_in_memory ();
+}
+
+/** Ask for any frames near the head of a reel's part of the queue which have been
+ *  pushed to disk to be read back, so that they are ready when we need them.
+ *  This must be called from Writer::thread() with an appropriate lock held.
+ */
+void
+Writer::prefetch_spilled_frames (size_t reel)
+{
+	if (_memory_limit && held_in_memory() > *_memory_limit) {
+		/* Frames will have to be read when they are needed */
+		return;
+	}
+
+	int n = 0;
+	for (WriterQueue::const_iterator i = _queue.first(reel); i != _queue.end() && i->reel == reel && n < spill_prefetch_frames; ++i, ++n) {
+		if (i->type == QueueItem::FULL && !i->encoded) {
+			_spill->prefetch (*i);
+		}
+	}
+}
+
 void
 Writer::thread ()
 try
 {
+	boost::mutex::scoped_lock lock (_state_mutex);
+
 	while (true)
 	{
-		boost::mutex::scoped_lock lock (_state_mutex);
+		optional<size_t> reel;
 
 		while (true) {
-
-			if (_finish || _queued_full_in_memory > _maximum_frames_in_memory || have_sequenced_image_at_queue_head ()) {
+			reel = sequenced_reel ();
+			if (_finish || reel || too_much_in_memory()) {
 				/* We've got something to do: go and do it */
 				break;
 			}
@@ -357,114 +465,135 @@ try
 			LOG_TIMING (N_("writer-wake queue=%1"), _queue.size());
 		}
 
-		if (_finish && _queue.empty()) {
-			return;
+		if (reel) {
+			write_reel (*reel, lock);
+			continue;
 		}
 
-		/* We stop here if we have been asked to finish, and if either the queue
-		   is empty or we do not have a sequenced image at its head (if this is the
-		   case we will never terminate as no new frames will be sent once
-		   _finish is true).
+		/* We stop here if we have been asked to finish and there is nothing that we can
+		   write (if this is the case we will never terminate as no new frames will be sent
+		   once _finish is true).  Any other threads which are still writing will carry on.
 		*/
-		if (_finish && (!have_sequenced_image_at_queue_head() || _queue.empty())) {
-			/* (Hopefully temporarily) log anything that was not written */
-			if (!_queue.empty() && !have_sequenced_image_at_queue_head()) {
-				LOG_WARNING (N_("Finishing writer with a left-over queue of %1:"), _queue.size());
-				for (list<QueueItem>::const_iterator i = _queue.begin(); i != _queue.end(); ++i) {
-					if (i->type == QueueItem::FULL) {
-						LOG_WARNING (N_("- type FULL, frame %1, eyes %2"), i->frame, (int) i->eyes);
-					} else {
-						LOG_WARNING (N_("- type FAKE, size %1, frame %2, eyes %3"), i->size, i->frame, (int) i->eyes);
-					}
-				}
-			}
+		if (_finish) {
 			return;
 		}
 
-		/* Write any frames that we can write; i.e. those that are in sequence. */
-		while (have_sequenced_image_at_queue_head ()) {
-			QueueItem qi = _queue.front ();
-			_queue.pop_front ();
-			if (qi.type == QueueItem::FULL && qi.encoded) {
-				--_queued_full_in_memory;
+		while (too_much_in_memory ()) {
+			/* Too many frames in memory which can't yet be written to the stream.
+			   Write some FULL frames to disk.
+			*/
+
+			lock.unlock ();
+			_spill->wait_for_space ();
+			lock.lock ();
+
+			if (!too_much_in_memory ()) {
+				/* Someone else sorted it out while we were waiting */
+				break;
 			}
 
+			/* Take the one nearest the back of the queue */
+			WriterQueue::const_iterator i = _queue.last_full_in_memory ();
+			++_pushed_to_disk;
+			QueueItem const qi = *i;
+			/* Give the frame to the spill before anybody can take it from the queue */
+			_spill->put (qi, qi.encoded.get());
+			_queue.pushed_to_disk (i);
 			lock.unlock ();
 
-			ReelWriter& reel = _reels[qi.reel];
+			LOG_GENERAL ("Writer full; pushes frame %1 of reel %2 to disk", qi.frame, qi.reel);
+
+			lock.lock ();
+			_full_condition.notify_all ();
+		}
+	}
+}
+catch (...)
+{
+	store_current ();
+}
 
+/** Write everything that we can to one reel's picture asset.  Other threads may be
+ *  writing to other reels at the same time.
+ *  @param reel_index Reel index.
+ *  @param lock Lock on _state_mutex, which is released while we are writing.
+ */
+void
+Writer::write_reel (size_t reel_index, boost::mutex::scoped_lock& lock)
+{
+	_reel_busy[reel_index] = true;
+	++_busy_reels;
+
+	ReelWriter& reel = _reels[reel_index];
+
+	/* Write any frames that we can write; i.e. those that are in sequence. */
+	while (have_sequenced_image (reel_index)) {
+		QueueItem qi = _queue.pop (_queue.first (reel_index));
+
+		lock.unlock ();
+
+		try {
 			switch (qi.type) {
 			case QueueItem::FULL:
-				LOG_DEBUG_ENCODE (N_("Writer FULL-writes %1 (%2)"), qi.frame, (int) qi.eyes);
+				LOG_DEBUG_ENCODE (N_("Writer FULL-writes %1 (%2) to reel %3"), qi.frame, (int) qi.eyes, reel_index);
 				if (!qi.encoded) {
-					qi.encoded = Data (_film->j2c_path (qi.reel, qi.frame, qi.eyes, false));
+					qi.encoded = _spill->get (qi);
 				}
 				reel.write (qi.encoded, qi.frame, qi.eyes);
-				++_full_written;
 				break;
 			case QueueItem::FAKE:
-				LOG_DEBUG_ENCODE (N_("Writer FAKE-writes %1"), qi.frame);
+				LOG_DEBUG_ENCODE (N_("Writer FAKE-writes %1 to reel %2"), qi.frame, reel_index);
 				reel.fake_write (qi.frame, qi.eyes, qi.size);
-				++_fake_written;
 				break;
 			case QueueItem::REPEAT:
-				LOG_DEBUG_ENCODE (N_("Writer REPEAT-writes %1"), qi.frame);
+				LOG_DEBUG_ENCODE (N_("Writer REPEAT-writes %1 to reel %2"), qi.frame, reel_index);
 				reel.repeat_write (qi.frame, qi.eyes);
-				++_repeat_written;
 				break;
 			}
 
+			if (reel.picture_complete ()) {
+				/* Nothing more will be written to this picture asset so we can close it
+				   and calculate its digest while we carry on with the others.
+				*/
+				reel.finish_picture ();
+				_digest_service.post (boost::bind (&Writer::calculate_picture_digest, this, reel_index));
+			}
+		} catch (...) {
 			lock.lock ();
+			_reel_busy[reel_index] = false;
+			--_busy_reels;
 			_full_condition.notify_all ();
+			throw;
 		}
 
-		while (_queued_full_in_memory > _maximum_frames_in_memory) {
-			/* Too many frames in memory which can't yet be written to the stream.
-			   Write some FULL frames to disk.
-			*/
-
-			/* Find one from the back of the queue */
-			_queue.sort ();
-			list<QueueItem>::reverse_iterator i = _queue.rbegin ();
-			while (i != _queue.rend() && (i->type != QueueItem::FULL || !i->encoded)) {
-				++i;
-			}
-
-			DCPOMATIC_ASSERT (i != _queue.rend());
-			++_pushed_to_disk;
-			/* For the log message below */
-			int const awaiting = _reels[_queue.front().reel].last_written_video_frame() + 1;
-			lock.unlock ();
-
-			/* i is valid here, even though we don't hold a lock on the mutex,
-			   since list iterators are unaffected by insertion and only this
-			   thread could erase the last item in the list.
-			*/
-
-			LOG_GENERAL ("Writer full; pushes %1 to disk while awaiting %2", i->frame, awaiting);
-
-			i->encoded->write_via_temp (
-				_film->j2c_path (i->reel, i->frame, i->eyes, true),
-				_film->j2c_path (i->reel, i->frame, i->eyes, false)
-				);
-
-			lock.lock ();
-			i->encoded.reset ();
-			--_queued_full_in_memory;
-			_full_condition.notify_all ();
+		lock.lock ();
+
+		switch (qi.type) {
+		case QueueItem::FULL:
+			++_full_written;
+			break;
+		case QueueItem::FAKE:
+			++_fake_written;
+			break;
+		case QueueItem::REPEAT:
+			++_repeat_written;
+			break;
 		}
+
+		prefetch_spilled_frames (reel_index);
+		_full_condition.notify_all ();
 	}
-}
-catch (...)
-{
-	store_current ();
+
+	_reel_busy[reel_index] = false;
+	--_busy_reels;
+	_full_condition.notify_all ();
 }
 
 void
-Writer::terminate_thread (bool can_throw)
+Writer::terminate_threads (bool can_throw)
 {
 	boost::mutex::scoped_lock lock (_state_mutex);
-	if (_thread == 0) {
+	if (_threads.empty ()) {
 		return;
 	}
 
@@ -473,28 +602,58 @@ Writer::terminate_thread (bool can_throw)
 	_full_condition.notify_all ();
 	lock.unlock ();
 
-	if (_thread->joinable ()) {
-		_thread->join ();
+	BOOST_FOREACH (boost::thread* i, _threads) {
+		if (i->joinable ()) {
+			i->join ();
+		}
+	}
+
+	/* (Hopefully temporarily) log anything that was not written */
+	if (!_queue.empty ()) {
+		LOG_WARNING (N_("Finishing writer with a left-over queue of %1:"), _queue.size());
+		for (WriterQueue::const_iterator i = _queue.begin(); i != _queue.end(); ++i) {
+			if (i->type == QueueItem::FULL) {
+				LOG_WARNING (N_("- type FULL, reel %1, frame %2, eyes %3"), i->reel, i->frame, (int) i->eyes);
+			} else {
+				LOG_WARNING (N_("- type FAKE, size %1, reel %2, frame %3, eyes %4"), i->size, i->reel, i->frame, (int) i->eyes);
+			}
+		}
 	}
 
 	if (can_throw) {
 		rethrow ();
 	}
 
-	delete _thread;
-	_thread = 0;
+	BOOST_FOREACH (boost::thread* i, _threads) {
+		delete i;
+	}
+	_threads.clear ();
+	/* This removes the spill file */
+	_spill.reset ();
 }
 
 void
 Writer::finish ()
 {
-	if (!_thread) {
+	if (_threads.empty ()) {
 		return;
 	}
 
-	LOG_GENERAL_NC ("Terminating writer thread");
+	LOG_GENERAL_NC ("Terminating writer threads");
+
+	terminate_threads (true);
 
-	terminate_thread (true);
+	shared_ptr<Job> job = _job.lock ();
+	job->sub (_("Computing digests"));
+
+	/* Wait for the digests that are being calculated in the background */
+	{
+		boost::mutex::scoped_lock lm (_digest_progresses_mutex);
+		_report_digest_progress = true;
+	}
+	_digest_work.reset ();
+	_digest_pool.join_all ();
+	rethrow ();
 
 	LOG_GENERAL_NC ("Finishing ReelWriters");
 
@@ -515,10 +674,7 @@ Writer::finish ()
 
 	dcp.add (cpl);
 
-	/* Calculate digests for each reel in parallel */
-
-	shared_ptr<Job> job = _job.lock ();
-	job->sub (_("Computing digests"));
+	/* Calculate any digests that we don't already have for each reel in parallel */
 
 	boost::asio::io_service service;
 	boost::thread_group pool;
@@ -649,6 +805,21 @@ Writer::write_cover_sheet ()
 	fclose (f);
 }
 
+/** @return Periods of reels whose picture assets are being re-used from a previous encode,
+ *  so that nothing that is given to us for them will be written.
+ */
+list<DCPTimePeriod>
+Writer::reused_picture_periods () const
+{
+	list<DCPTimePeriod> periods;
+	BOOST_FOREACH (ReelWriter const & i, _reels) {
+		if (i.picture_reused()) {
+			periods.push_back (i.period());
+		}
+	}
+	return periods;
+}
+
 /** @param frame Frame index within the whole DCP.
  *  @return true if we can fake-write this frame.
  */
@@ -660,12 +831,17 @@ Writer::can_fake_write (Frame frame) const
 		return false;
 	}
 
+	ReelWriter const & reel = _reels[video_reel(frame)];
+
+	if (reel.picture_reused()) {
+		/* Nothing is being written to this reel's picture asset */
+		return true;
+	}
+
 	/* We have to do a proper write of the first frame so that we can set up the JPEG2000
 	   parameters in the asset writer.
 	*/
 
-	ReelWriter const & reel = _reels[video_reel(frame)];
-
 	/* Make frame relative to the start of the reel */
 	frame -= reel.start ();
 	return (frame != 0 && frame < reel.first_nonexistant_frame());
@@ -718,26 +894,6 @@ Writer::write (list<shared_ptr<Font> > fonts)
 	}
 }
 
-bool
-operator< (QueueItem const & a, QueueItem const & b)
-{
-	if (a.reel != b.reel) {
-		return a.reel < b.reel;
-	}
-
-	if (a.frame != b.frame) {
-		return a.frame < b.frame;
-	}
-
-	return static_cast<int> (a.eyes) < static_cast<int> (b.eyes);
-}
-
-bool
-operator== (QueueItem const & a, QueueItem const & b)
-{
-	return a.reel == b.reel && a.frame == b.frame && a.eyes == b.eyes;
-}
-
 void
 Writer::set_encoder_threads (int threads)
 {
@@ -765,13 +921,47 @@ Writer::video_reel (int frame) const
 	return i;
 }
 
+/** Calculate the digest of a reel's picture asset; called in our digest thread */
+void
+Writer::calculate_picture_digest (size_t reel)
+try
+{
+	_reels[reel].calculate_picture_digest (boost::bind (&Writer::picture_digest_progress, this, _1));
+}
+catch (boost::thread_interrupted &)
+{
+	/* We are being destroyed */
+}
+catch (...)
+{
+	store_current ();
+}
+
+void
+Writer::picture_digest_progress (float progress)
+{
+	boost::this_thread::interruption_point ();
+
+	{
+		boost::mutex::scoped_lock lm (_digest_progresses_mutex);
+		if (!_report_digest_progress) {
+			/* We are still encoding, and the job's progress is about that */
+			return;
+		}
+	}
+
+	shared_ptr<Job> job = _job.lock ();
+	if (job) {
+		set_digest_progress (job.get(), progress);
+	}
+}
+
 void
 Writer::set_digest_progress (Job* job, float progress)
 {
-	/* I believe this is thread-safe */
+	boost::mutex::scoped_lock lm (_digest_progresses_mutex);
 	_digest_progresses[boost::this_thread::get_id()] = progress;
 
-	boost::mutex::scoped_lock lm (_digest_progresses_mutex);
 	float min_progress = FLT_MAX;
 	for (map<boost::thread::id, float>::const_iterator i = _digest_progresses.begin(); i != _digest_progresses.end(); ++i) {
 		min_progress = min (min_progress, i->second);
@@ -26,10 +26,12 @@
 #include "player_text.h"
 #include "exception_store.h"
 #include "dcp_text_track.h"
+#include "writer_queue.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/asio.hpp>
 #include <list>
 
 namespace dcp {
@@ -42,42 +44,7 @@ class Job;
 class Font;
 class ReferencedReelAsset;
 class ReelWriter;
-
-struct QueueItem
-{
-public:
-	QueueItem ()
-		: size (0)
-		, reel (0)
-		, frame (0)
-		, eyes (EYES_BOTH)
-	{}
-
-	enum Type {
-		/** a normal frame with some JPEG200 data */
-		FULL,
-		/** a frame whose data already exists in the MXF,
-		    and we fake-write it; i.e. we update the writer's
-		    state but we use the data that is already on disk.
-		*/
-		FAKE,
-		REPEAT,
-	} type;
-
-	/** encoded data for FULL */
-	boost::optional<dcp::Data> encoded;
-	/** size of data for FAKE */
-	int size;
-	/** reel index */
-	size_t reel;
-	/** frame index within the reel */
-	int frame;
-	/** eyes for FULL, FAKE and REPEAT */
-	Eyes eyes;
-};
-
-bool operator< (QueueItem const & a, QueueItem const & b);
-bool operator== (QueueItem const & a, QueueItem const & b);
+class FrameSpill;
 
 /** @class Writer
  *  @brief Class to manage writing JPEG2000 and audio data to assets on disk.
@@ -99,6 +66,7 @@ public:
 	void start ();
 
 	bool can_fake_write (Frame) const;
+	std::list<DCPTimePeriod> reused_picture_periods () const;
 
 	void write (dcp::Data, Frame, Eyes);
 	void fake_write (Frame, Eyes);
@@ -112,11 +80,26 @@ public:
 
 	void set_encoder_threads (int threads);
 
+	int64_t memory_used () const;
+
+	/** @return maximum number of bytes of encoded frames to hold in memory, if there is one */
+	boost::optional<int64_t> memory_limit () const {
+		return _memory_limit;
+	}
+
 private:
 	void thread ();
-	void terminate_thread (bool);
-	bool have_sequenced_image_at_queue_head ();
+	void terminate_threads (bool);
+	void write_reel (size_t reel_index, boost::mutex::scoped_lock& lock);
+	bool have_sequenced_image (size_t reel_index) const;
+	boost::optional<size_t> sequenced_reel () const;
+	bool can_write () const;
+	bool too_much_in_memory () const;
+	int64_t held_in_memory () const;
+	void prefetch_spilled_frames (size_t reel);
 	size_t video_reel (int frame) const;
+	void calculate_picture_digest (size_t reel);
+	void picture_digest_progress (float progress);
 	void set_digest_progress (Job* job, float progress);
 	void write_cover_sheet ();
 
@@ -128,14 +111,12 @@ private:
 	std::vector<ReelWriter>::iterator _subtitle_reel;
 	std::map<DCPTextTrack, std::vector<ReelWriter>::iterator> _caption_reels;
 
-	/** our thread, or 0 */
-	boost::thread* _thread;
-	/** true if our thread should finish */
+	/** our threads, which write the picture assets */
+	std::vector<boost::thread*> _threads;
+	/** true if our threads should finish */
 	bool _finish;
 	/** queue of things to write to disk */
-	std::list<QueueItem> _queue;
-	/** number of FULL frames whose JPEG200 data is currently held in RAM */
-	int _queued_full_in_memory;
+	WriterQueue _queue;
 	/** mutex for thread state */
 	mutable boost::mutex _state_mutex;
 	/** condition to manage thread wakeups when we have nothing to do  */
@@ -147,6 +128,10 @@ private:
 	 */
 	int _maximum_frames_in_memory;
 	unsigned int _maximum_queue_size;
+	/** maximum number of bytes of encoded frames to hold in memory, used instead
+	 *  of _maximum_frames_in_memory if it is set.
+	 */
+	boost::optional<int64_t> _memory_limit;
 
 	/** number of FULL written frames */
 	int _full_written;
@@ -157,9 +142,22 @@ private:
 	    due to the limit of frames to be held in memory.
 	*/
 	int _pushed_to_disk;
+	/** where frames are pushed to disk */
+	boost::shared_ptr<FrameSpill> _spill;
+	/** true for each reel that a thread is currently writing */
+	std::vector<bool> _reel_busy;
+	/** number of true entries in _reel_busy */
+	int _busy_reels;
+
+	/** service and thread to calculate digests of picture assets as soon as they are finished */
+	boost::asio::io_service _digest_service;
+	boost::shared_ptr<boost::asio::io_service::work> _digest_work;
+	boost::thread_group _digest_pool;
 
 	boost::mutex _digest_progresses_mutex;
 	std::map<boost::thread::id, float> _digest_progresses;
+	/** true if digest progress should be reported to our job; protected by _digest_progresses_mutex */
+	bool _report_digest_progress;
 
 	std::list<ReferencedReelAsset> _reel_assets;
 
@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/writer_queue.cc
+ *  @brief QueueItem and WriterQueue classes.
+ */
+
+#include "writer_queue.h"
+#include "dcpomatic_assert.h"
+#include <functional>
+#include <limits>
+
+bool
+operator< (QueueItem const & a, QueueItem const & b)
+{
+	if (a.reel != b.reel) {
+		return a.reel < b.reel;
+	}
+
+	if (a.frame != b.frame) {
+		return a.frame < b.frame;
+	}
+
+	return static_cast<int> (a.eyes) < static_cast<int> (b.eyes);
+}
+
+bool
+operator== (QueueItem const & a, QueueItem const & b)
+{
+	return a.reel == b.reel && a.frame == b.frame && a.eyes == b.eyes;
+}
+
+bool
+WriterQueue::IteratorOrder::operator() (Iterator const & a, Iterator const & b) const
+{
+	if (*a < *b) {
+		return true;
+	} else if (*b < *a) {
+		return false;
+	}
+
+	return std::less<QueueItem const *> () (&(*a), &(*b));
+}
+
+WriterQueue::WriterQueue ()
+	: _in_memory_bytes (0)
+{
+
+}
+
+void
+WriterQueue::push (QueueItem const & item)
+{
+	/* Frames mostly arrive in something close to the right order, so a hint of
+	   the end of the queue makes most insertions cheap.
+	*/
+	Iterator i = _items.insert (_items.end(), item);
+	if (item.type == QueueItem::FULL && item.encoded) {
+		_in_memory.insert (i);
+		_in_memory_bytes += item.encoded->size ();
+	}
+}
+
+QueueItem const &
+WriterQueue::front () const
+{
+	DCPOMATIC_ASSERT (!_items.empty());
+	return *_items.begin();
+}
+
+/** @return first item for a given reel, or end() if there are no items for that reel */
+WriterQueue::const_iterator
+WriterQueue::first (size_t reel) const
+{
+	QueueItem k;
+	k.reel = reel;
+	k.frame = std::numeric_limits<int>::min ();
+	const_iterator i = _items.lower_bound (k);
+	if (i == _items.end() || i->reel != reel) {
+		return _items.end ();
+	}
+	return i;
+}
+
+/** Remove the first item from the queue and return it */
+QueueItem
+WriterQueue::pop_front ()
+{
+	DCPOMATIC_ASSERT (!_items.empty());
+	return pop (_items.begin());
+}
+
+/** Remove an item from the queue and return it */
+QueueItem
+WriterQueue::pop (const_iterator i)
+{
+	QueueItem item = *i;
+	if (_in_memory.erase (i)) {
+		_in_memory_bytes -= item.encoded->size ();
+	}
+	_items.erase (i);
+	return item;
+}
+
+/** @return the last FULL item (in (reel, frame, eyes) order) whose data is in memory;
+ *  there must be at least one.  The iterator remains valid until the item is removed
+ *  with pop_front() or pushed_to_disk(), whatever is added in the mean time.
+ */
+WriterQueue::const_iterator
+WriterQueue::last_full_in_memory () const
+{
+	DCPOMATIC_ASSERT (!_in_memory.empty());
+	return *_in_memory.rbegin();
+}
+
+/** Note that the data for an item which was in memory has been written to disk,
+ *  so that the item no longer holds its data.
+ *  @param i Item, from last_full_in_memory().
+ */
+void
+WriterQueue::pushed_to_disk (const_iterator i)
+{
+	/* Set elements are const, so replace the item with one which has no data */
+	QueueItem item = *i;
+	item.encoded.reset ();
+
+	Iterator j = _items.find (item);
+	while (j != _items.end() && &(*j) != &(*i)) {
+		++j;
+	}
+	DCPOMATIC_ASSERT (j != _items.end());
+
+	_in_memory.erase (j);
+	_in_memory_bytes -= j->encoded->size ();
+	Iterator hint = j;
+	++hint;
+	_items.erase (j);
+	_items.insert (hint, item);
+}
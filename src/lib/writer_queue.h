@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_WRITER_QUEUE_H
+#define DCPOMATIC_WRITER_QUEUE_H
+
+/** @file  src/lib/writer_queue.h
+ *  @brief QueueItem and WriterQueue classes.
+ */
+
+#include "types.h"
+#include <dcp/data.h>
+#include <boost/optional.hpp>
+#include <set>
+
+struct QueueItem
+{
+public:
+	QueueItem ()
+		: size (0)
+		, reel (0)
+		, frame (0)
+		, eyes (EYES_BOTH)
+	{}
+
+	enum Type {
+		/** a normal frame with some JPEG200 data */
+		FULL,
+		/** a frame whose data already exists in the MXF,
+		    and we fake-write it; i.e. we update the writer's
+		    state but we use the data that is already on disk.
+		*/
+		FAKE,
+		REPEAT,
+	} type;
+
+	/** encoded data for FULL */
+	boost::optional<dcp::Data> encoded;
+	/** size of data for FAKE */
+	int size;
+	/** reel index */
+	size_t reel;
+	/** frame index within the reel */
+	int frame;
+	/** eyes for FULL, FAKE and REPEAT */
+	Eyes eyes;
+};
+
+bool operator< (QueueItem const & a, QueueItem const & b);
+bool operator== (QueueItem const & a, QueueItem const & b);
+
+/** @class WriterQueue
+ *  @brief The Writer's queue of frames waiting to be written, kept in (reel, frame, eyes) order.
+ *
+ *  Items can be added in any order in O(log n) time (or close to O(1) if they arrive
+ *  nearly in order), the first item is always available in O(1) and FULL items whose
+ *  data is held in memory are indexed so that the last one can be found at once when
+ *  something must be pushed to disk.  The first item for any particular reel can
+ *  be found in O(log n).
+ *
+ *  This class is not thread-safe.
+ */
+class WriterQueue
+{
+public:
+	typedef std::multiset<QueueItem>::const_iterator const_iterator;
+
+	WriterQueue ();
+
+	void push (QueueItem const & item);
+	QueueItem pop_front ();
+	QueueItem pop (const_iterator i);
+
+	/** @return first item in (reel, frame, eyes) order; the queue must not be empty */
+	QueueItem const & front () const;
+
+	const_iterator first (size_t reel) const;
+
+	bool empty () const {
+		return _items.empty ();
+	}
+
+	size_t size () const {
+		return _items.size ();
+	}
+
+	/** @return number of FULL items whose data is held in memory */
+	int full_in_memory () const {
+		return _in_memory.size ();
+	}
+
+	/** @return total size of the data of FULL items which is held in memory */
+	int64_t full_in_memory_bytes () const {
+		return _in_memory_bytes;
+	}
+
+	const_iterator last_full_in_memory () const;
+	void pushed_to_disk (const_iterator i);
+
+	const_iterator begin () const {
+		return _items.begin ();
+	}
+
+	const_iterator end () const {
+		return _items.end ();
+	}
+
+private:
+	typedef std::multiset<QueueItem>::iterator Iterator;
+
+	/** Order iterators by the items that they point to, and then by address
+	 *  so that items with the same (reel, frame, eyes) can coexist.
+	 */
+	struct IteratorOrder
+	{
+		bool operator() (Iterator const & a, Iterator const & b) const;
+	};
+
+	std::multiset<QueueItem> _items;
+	/** iterators into _items of FULL items whose data is in memory */
+	std::set<Iterator, IteratorOrder> _in_memory;
+	int64_t _in_memory_bytes;
+};
+
+#endif
@@ -0,0 +1,394 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/xyz_converter.cc
+ *  @brief XYZConverter class.
+ */
+
+#include "xyz_converter.h"
+#include "dcpomatic_assert.h"
+#include "compose.hpp"
+#include <dcp/colour_conversion.h>
+#include <dcp/transfer_function.h>
+#include <dcp/openjpeg_image.h>
+#include <dcp/rgb_xyz.h>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <cmath>
+
+/* Use the SIMD implementations when we can compile them for particular
+   targets and choose between them at run time; the rest of DCP-o-matic
+   is only built for baseline x86.
+*/
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define DCPOMATIC_XYZ_SIMD
+#include <immintrin.h>
+#endif
+
+#include "i18n.h"
+
+using std::list;
+using std::pair;
+using std::make_pair;
+using std::max;
+using std::min;
+using boost::shared_ptr;
+using boost::optional;
+
+/** Converters for the last few colour conversions that we were asked about */
+static list<pair<dcp::ColourConversion, shared_ptr<const XYZConverter> > > converter_cache;
+static boost::mutex converter_cache_mutex;
+static int const converter_cache_size = 4;
+
+XYZConverter::XYZConverter (dcp::ColourConversion const & conversion)
+	: _lut_in (4096)
+	, _lut_out (65536)
+{
+	double const * lut_in = conversion.in()->lut (12, false);
+	std::copy (lut_in, lut_in + 4096, _lut_in.begin ());
+
+	double const * lut_out = conversion.out()->lut (16, true);
+	for (int i = 0; i < 65536; ++i) {
+		_lut_out[i] = lrint (lut_out[i] * 4095);
+	}
+
+	dcp::combined_rgb_to_xyz (conversion, _matrix);
+}
+
+/** @return a converter for a conversion, re-using one that we made before if possible */
+shared_ptr<const XYZConverter>
+XYZConverter::get (dcp::ColourConversion const & conversion)
+{
+	boost::mutex::scoped_lock lm (converter_cache_mutex);
+
+	for (list<pair<dcp::ColourConversion, shared_ptr<const XYZConverter> > >::iterator i = converter_cache.begin(); i != converter_cache.end(); ++i) {
+		/* Only an exact match will give exactly the same results */
+		if (i->first.about_equal (conversion, 0)) {
+			pair<dcp::ColourConversion, shared_ptr<const XYZConverter> > hit = *i;
+			converter_cache.erase (i);
+			converter_cache.push_front (hit);
+			return hit.second;
+		}
+	}
+
+	/* Making the tables takes a little while, but not long enough to be worth releasing the lock */
+	shared_ptr<const XYZConverter> c (new XYZConverter (conversion));
+	converter_cache.push_front (make_pair (conversion, c));
+	while (static_cast<int> (converter_cache.size()) > converter_cache_size) {
+		converter_cache.pop_back ();
+	}
+
+	return c;
+}
+
+bool
+XYZConverter::supported (Implementation implementation)
+{
+	switch (implementation) {
+	case IMPLEMENTATION_SCALAR:
+		return true;
+#ifdef DCPOMATIC_XYZ_SIMD
+	case IMPLEMENTATION_SSE41:
+		__builtin_cpu_init ();
+		return __builtin_cpu_supports ("sse4.1");
+	case IMPLEMENTATION_AVX2:
+		__builtin_cpu_init ();
+		return __builtin_cpu_supports ("avx2");
+#else
+	default:
+		return false;
+#endif
+	}
+
+	return false;
+}
+
+XYZConverter::Implementation
+XYZConverter::best_implementation ()
+{
+	static Implementation const best =
+		supported (IMPLEMENTATION_AVX2) ? IMPLEMENTATION_AVX2 :
+		(supported (IMPLEMENTATION_SSE41) ? IMPLEMENTATION_SSE41 : IMPLEMENTATION_SCALAR);
+
+	return best;
+}
+
+/** Convert an image using the best implementation for this CPU.
+ *  @param rgb RGB48LE image data.
+ *  @param size Size of the image in pixels.
+ *  @param stride Stride of the image data in bytes.
+ *  @param note Handler to be told if any values were clamped.
+ */
+shared_ptr<dcp::OpenJPEGImage>
+XYZConverter::convert (uint8_t const * rgb, dcp::Size size, int stride, optional<dcp::NoteHandler> note) const
+{
+	return convert (rgb, size, stride, note, best_implementation ());
+}
+
+/** Convert an image using a particular implementation, which must be supported by this CPU */
+shared_ptr<dcp::OpenJPEGImage>
+XYZConverter::convert (uint8_t const * rgb, dcp::Size size, int stride, optional<dcp::NoteHandler> note, Implementation implementation) const
+{
+	shared_ptr<dcp::OpenJPEGImage> xyz (new dcp::OpenJPEGImage (size));
+	note_clamped (convert_lines (rgb, size, stride, xyz->data(0), xyz->data(1), xyz->data(2), implementation), note);
+	return xyz;
+}
+
+/** Convert some lines of an image into XYZ planes which have been allocated by the caller,
+ *  using the best implementation for this CPU.
+ *  @param rgb RGB48LE image data.
+ *  @param size Size of the area to convert in pixels.
+ *  @param stride Stride of the image data in bytes.
+ *  @param x X plane to write to, with one int per pixel and no padding.
+ *  @param y Y plane to write to.
+ *  @param z Z plane to write to.
+ *  @return number of pixels which had to be clamped; see note_clamped().
+ */
+int
+XYZConverter::convert_lines (uint8_t const * rgb, dcp::Size size, int stride, int* x, int* y, int* z) const
+{
+	return convert_lines (rgb, size, stride, x, y, z, best_implementation ());
+}
+
+int
+XYZConverter::convert_lines (uint8_t const * rgb, dcp::Size size, int stride, int* xyz_x, int* xyz_y, int* xyz_z, Implementation implementation) const
+{
+	DCPOMATIC_ASSERT (supported (implementation));
+
+	int clamped = 0;
+	for (int y = 0; y < size.height; ++y) {
+		uint16_t const * p = reinterpret_cast<uint16_t const *> (rgb + y * stride);
+		switch (implementation) {
+		case IMPLEMENTATION_SCALAR:
+			clamped += convert_scalar (p, size.width, xyz_x, xyz_y, xyz_z);
+			break;
+		case IMPLEMENTATION_SSE41:
+			clamped += convert_sse41 (p, size.width, xyz_x, xyz_y, xyz_z);
+			break;
+		case IMPLEMENTATION_AVX2:
+			clamped += convert_avx2 (p, size.width, xyz_x, xyz_y, xyz_z);
+			break;
+		}
+		xyz_x += size.width;
+		xyz_y += size.width;
+		xyz_z += size.width;
+	}
+
+	return clamped;
+}
+
+/** Tell a note handler, in the same way as dcp::rgb_to_xyz, that some pixels were clamped */
+void
+XYZConverter::note_clamped (int clamped, optional<dcp::NoteHandler> note)
+{
+	if (clamped && note) {
+		note.get() (dcp::DCP_NOTE, String::compose ("%1 XYZ value(s) clamped", clamped));
+	}
+}
+
+/** Convert some pixels one at a time.
+ *  @return number of pixels which had to be clamped.
+ */
+int
+XYZConverter::convert_scalar (uint16_t const * p, int pixels, int* xyz_x, int* xyz_y, int* xyz_z) const
+{
+	double const * lut_in = &_lut_in[0];
+	int32_t const * lut_out = &_lut_out[0];
+	double const * m = _matrix;
+
+	int clamped = 0;
+	for (int i = 0; i < pixels; ++i) {
+		/* In gamma LUT (converting 16-bit to 12-bit) */
+		double const r = lut_in[*p++ >> 4];
+		double const g = lut_in[*p++ >> 4];
+		double const b = lut_in[*p++ >> 4];
+
+		/* RGB to XYZ, Bradford transform and DCI companding */
+		double x = r * m[0] + g * m[1] + b * m[2];
+		double y = r * m[3] + g * m[4] + b * m[5];
+		double z = r * m[6] + g * m[7] + b * m[8];
+
+		if (x < 0 || y < 0 || z < 0 || x > 65535 || y > 65535 || z > 65535) {
+			++clamped;
+		}
+
+		x = min (65535.0, max (0.0, x));
+		y = min (65535.0, max (0.0, y));
+		z = min (65535.0, max (0.0, z));
+
+		/* Out gamma LUT, which is already scaled to 12 bits */
+		*xyz_x++ = lut_out[lrint (x)];
+		*xyz_y++ = lut_out[lrint (y)];
+		*xyz_z++ = lut_out[lrint (z)];
+	}
+
+	return clamped;
+}
+
+#ifdef DCPOMATIC_XYZ_SIMD
+
+/* The SIMD versions must not use fused multiply-adds, as these round differently;
+   none of their targets enable FMA so the compiler cannot introduce them.
+   Conversion of doubles to integers uses the current rounding mode, as lrint does.
+*/
+
+__attribute__((target("sse4.1")))
+int
+XYZConverter::convert_sse41 (uint16_t const * p, int pixels, int* xyz_x, int* xyz_y, int* xyz_z) const
+{
+	double const * lut_in = &_lut_in[0];
+	int32_t const * lut_out = &_lut_out[0];
+
+	__m128d const m0 = _mm_set1_pd (_matrix[0]);
+	__m128d const m1 = _mm_set1_pd (_matrix[1]);
+	__m128d const m2 = _mm_set1_pd (_matrix[2]);
+	__m128d const m3 = _mm_set1_pd (_matrix[3]);
+	__m128d const m4 = _mm_set1_pd (_matrix[4]);
+	__m128d const m5 = _mm_set1_pd (_matrix[5]);
+	__m128d const m6 = _mm_set1_pd (_matrix[6]);
+	__m128d const m7 = _mm_set1_pd (_matrix[7]);
+	__m128d const m8 = _mm_set1_pd (_matrix[8]);
+	__m128d const zero = _mm_setzero_pd ();
+	__m128d const top = _mm_set1_pd (65535);
+
+	int clamped = 0;
+	int const vector_pixels = pixels & ~1;
+	for (int i = 0; i < vector_pixels; i += 2) {
+		__m128d const r = _mm_set_pd (lut_in[p[3] >> 4], lut_in[p[0] >> 4]);
+		__m128d const g = _mm_set_pd (lut_in[p[4] >> 4], lut_in[p[1] >> 4]);
+		__m128d const b = _mm_set_pd (lut_in[p[5] >> 4], lut_in[p[2] >> 4]);
+		p += 6;
+
+		__m128d x = _mm_add_pd (_mm_add_pd (_mm_mul_pd (r, m0), _mm_mul_pd (g, m1)), _mm_mul_pd (b, m2));
+		__m128d y = _mm_add_pd (_mm_add_pd (_mm_mul_pd (r, m3), _mm_mul_pd (g, m4)), _mm_mul_pd (b, m5));
+		__m128d z = _mm_add_pd (_mm_add_pd (_mm_mul_pd (r, m6), _mm_mul_pd (g, m7)), _mm_mul_pd (b, m8));
+
+		__m128d const out = _mm_or_pd (
+			_mm_or_pd (_mm_or_pd (_mm_cmplt_pd (x, zero), _mm_cmpgt_pd (x, top)), _mm_or_pd (_mm_cmplt_pd (y, zero), _mm_cmpgt_pd (y, top))),
+			_mm_or_pd (_mm_cmplt_pd (z, zero), _mm_cmpgt_pd (z, top))
+			);
+		clamped += __builtin_popcount (_mm_movemask_pd (out));
+
+		x = _mm_min_pd (_mm_max_pd (x, zero), top);
+		y = _mm_min_pd (_mm_max_pd (y, zero), top);
+		z = _mm_min_pd (_mm_max_pd (z, zero), top);
+
+		__m128i const xi = _mm_cvtpd_epi32 (x);
+		__m128i const yi = _mm_cvtpd_epi32 (y);
+		__m128i const zi = _mm_cvtpd_epi32 (z);
+
+		xyz_x[0] = lut_out[_mm_extract_epi32 (xi, 0)];
+		xyz_x[1] = lut_out[_mm_extract_epi32 (xi, 1)];
+		xyz_y[0] = lut_out[_mm_extract_epi32 (yi, 0)];
+		xyz_y[1] = lut_out[_mm_extract_epi32 (yi, 1)];
+		xyz_z[0] = lut_out[_mm_extract_epi32 (zi, 0)];
+		xyz_z[1] = lut_out[_mm_extract_epi32 (zi, 1)];
+		xyz_x += 2;
+		xyz_y += 2;
+		xyz_z += 2;
+	}
+
+	return clamped + convert_scalar (p, pixels - vector_pixels, xyz_x, xyz_y, xyz_z);
+}
+
+__attribute__((target("avx2")))
+int
+XYZConverter::convert_avx2 (uint16_t const * p, int pixels, int* xyz_x, int* xyz_y, int* xyz_z) const
+{
+	double const * lut_in = &_lut_in[0];
+	int const * lut_out = reinterpret_cast<int const *> (&_lut_out[0]);
+
+	__m256d const m0 = _mm256_set1_pd (_matrix[0]);
+	__m256d const m1 = _mm256_set1_pd (_matrix[1]);
+	__m256d const m2 = _mm256_set1_pd (_matrix[2]);
+	__m256d const m3 = _mm256_set1_pd (_matrix[3]);
+	__m256d const m4 = _mm256_set1_pd (_matrix[4]);
+	__m256d const m5 = _mm256_set1_pd (_matrix[5]);
+	__m256d const m6 = _mm256_set1_pd (_matrix[6]);
+	__m256d const m7 = _mm256_set1_pd (_matrix[7]);
+	__m256d const m8 = _mm256_set1_pd (_matrix[8]);
+	__m256d const zero = _mm256_setzero_pd ();
+	__m256d const top = _mm256_set1_pd (65535);
+	__m256d const all = _mm256_castsi256_pd (_mm256_set1_epi64x (-1));
+
+	int clamped = 0;
+	int const vector_pixels = pixels & ~3;
+	for (int i = 0; i < vector_pixels; i += 4) {
+		/* 4 pixels of interleaved RGB make 12 16-bit values, which we split into
+		   one vector of 12-bit LUT indices for each channel.
+		*/
+		__m128i const ri = _mm_set_epi32 (p[9] >> 4, p[6] >> 4, p[3] >> 4, p[0] >> 4);
+		__m128i const gi = _mm_set_epi32 (p[10] >> 4, p[7] >> 4, p[4] >> 4, p[1] >> 4);
+		__m128i const bi = _mm_set_epi32 (p[11] >> 4, p[8] >> 4, p[5] >> 4, p[2] >> 4);
+		p += 12;
+
+		__m256d const r = _mm256_mask_i32gather_pd (zero, lut_in, ri, all, 8);
+		__m256d const g = _mm256_mask_i32gather_pd (zero, lut_in, gi, all, 8);
+		__m256d const b = _mm256_mask_i32gather_pd (zero, lut_in, bi, all, 8);
+
+		__m256d x = _mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (r, m0), _mm256_mul_pd (g, m1)), _mm256_mul_pd (b, m2));
+		__m256d y = _mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (r, m3), _mm256_mul_pd (g, m4)), _mm256_mul_pd (b, m5));
+		__m256d z = _mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (r, m6), _mm256_mul_pd (g, m7)), _mm256_mul_pd (b, m8));
+
+		__m256d const out = _mm256_or_pd (
+			_mm256_or_pd (
+				_mm256_or_pd (_mm256_cmp_pd (x, zero, _CMP_LT_OQ), _mm256_cmp_pd (x, top, _CMP_GT_OQ)),
+				_mm256_or_pd (_mm256_cmp_pd (y, zero, _CMP_LT_OQ), _mm256_cmp_pd (y, top, _CMP_GT_OQ))
+				),
+			_mm256_or_pd (_mm256_cmp_pd (z, zero, _CMP_LT_OQ), _mm256_cmp_pd (z, top, _CMP_GT_OQ))
+			);
+		clamped += __builtin_popcount (_mm256_movemask_pd (out));
+
+		x = _mm256_min_pd (_mm256_max_pd (x, zero), top);
+		y = _mm256_min_pd (_mm256_max_pd (y, zero), top);
+		z = _mm256_min_pd (_mm256_max_pd (z, zero), top);
+
+		__m128i const xo = _mm_i32gather_epi32 (lut_out, _mm256_cvtpd_epi32 (x), 4);
+		__m128i const yo = _mm_i32gather_epi32 (lut_out, _mm256_cvtpd_epi32 (y), 4);
+		__m128i const zo = _mm_i32gather_epi32 (lut_out, _mm256_cvtpd_epi32 (z), 4);
+
+		_mm_storeu_si128 (reinterpret_cast<__m128i*> (xyz_x), xo);
+		_mm_storeu_si128 (reinterpret_cast<__m128i*> (xyz_y), yo);
+		_mm_storeu_si128 (reinterpret_cast<__m128i*> (xyz_z), zo);
+		xyz_x += 4;
+		xyz_y += 4;
+		xyz_z += 4;
+	}
+
+	return clamped + convert_scalar (p, pixels - vector_pixels, xyz_x, xyz_y, xyz_z);
+}
+
+#else
+
+int
+XYZConverter::convert_sse41 (uint16_t const *, int, int *, int *, int *) const
+{
+	DCPOMATIC_ASSERT (false);
+	return 0;
+}
+
+int
+XYZConverter::convert_avx2 (uint16_t const *, int, int *, int *, int *) const
+{
+	DCPOMATIC_ASSERT (false);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DCPOMATIC_XYZ_CONVERTER_H
+#define DCPOMATIC_XYZ_CONVERTER_H
+
+/** @file  src/lib/xyz_converter.h
+ *  @brief XYZConverter class.
+ */
+
+#include <dcp/types.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <vector>
+
+namespace dcp {
+	class ColourConversion;
+	class OpenJPEGImage;
+}
+
+/** @class XYZConverter
+ *  @brief Conversion of 48-bit RGB images to 12-bit XYZ, giving the same results as dcp::rgb_to_xyz.
+ *
+ *  The input LUT, matrix and output LUT for a ColourConversion are worked out once
+ *  when the converter is made; the output LUT is stored already scaled and rounded
+ *  to 12 bits.  On x86 CPUs with SSE4.1 or AVX2 several pixels are converted at once.
+ *  The arithmetic is done in the same order as libdcp's, with no fused multiply-adds,
+ *  so the results are bit-exact whichever implementation is used.
+ *
+ *  A converter does not change once it has been made, so it can be used by many threads at once.
+ */
+class XYZConverter : public boost::noncopyable
+{
+public:
+	explicit XYZConverter (dcp::ColourConversion const & conversion);
+
+	enum Implementation {
+		IMPLEMENTATION_SCALAR,
+		IMPLEMENTATION_SSE41,
+		IMPLEMENTATION_AVX2
+	};
+
+	boost::shared_ptr<dcp::OpenJPEGImage> convert (
+		uint8_t const * rgb, dcp::Size size, int stride, boost::optional<dcp::NoteHandler> note = boost::optional<dcp::NoteHandler>()
+		) const;
+
+	boost::shared_ptr<dcp::OpenJPEGImage> convert (
+		uint8_t const * rgb, dcp::Size size, int stride, boost::optional<dcp::NoteHandler> note, Implementation implementation
+		) const;
+
+	int convert_lines (uint8_t const * rgb, dcp::Size size, int stride, int* x, int* y, int* z) const;
+	int convert_lines (uint8_t const * rgb, dcp::Size size, int stride, int* x, int* y, int* z, Implementation implementation) const;
+
+	static void note_clamped (int clamped, boost::optional<dcp::NoteHandler> note);
+
+	static Implementation best_implementation ();
+	static bool supported (Implementation implementation);
+	static boost::shared_ptr<const XYZConverter> get (dcp::ColourConversion const & conversion);
+
+private:
+	int convert_scalar (uint16_t const * rgb, int pixels, int* x, int* y, int* z) const;
+	int convert_sse41 (uint16_t const * rgb, int pixels, int* x, int* y, int* z) const;
+	int convert_avx2 (uint16_t const * rgb, int pixels, int* x, int* y, int* z) const;
+
+	/** 12-bit input LUT */
+	std::vector<double> _lut_in;
+	/** product of the RGB to XYZ matrix, the Bradford transform and the DCI companding, scaled to 16 bits, from dcp::combined_rgb_to_xyz */
+	double _matrix[9];
+	/** 16-bit output LUT, scaled to 12-bit integers */
+	std::vector<int32_t> _lut_out;
+};
+
+#endif
@@ -39,6 +39,8 @@
 #include <getopt.h>
 #include <iostream>
 #include <iomanip>
+#include <climits>
+#include <cstdlib>
 
 using std::string;
 using std::cerr;
@@ -68,6 +70,7 @@ help (string n)
 	     << "  -d, --dcp-path       echo DCP's path to stdout on successful completion (implies -n)\n"
 	     << "  -c, --config <dir>   directory containing config.xml and cinemas.xml\n"
 	     << "      --dump           just dump a summary of the film's settings; don't encode\n"
+	     << "      --writer-memory <MB> maximum amount of encoded data to hold in memory before spilling to disk\n"
 	     << "\n"
 	     << "<FILM> is the film directory.\n";
 }
@@ -198,6 +201,7 @@ main (int argc, char* argv[])
 	bool list_servers_ = false;
 	bool dcp_path = false;
 	optional<boost::filesystem::path> config;
+	optional<int> writer_memory;
 
 	int option_index = 0;
 	while (true) {
@@ -216,10 +220,11 @@ main (int argc, char* argv[])
 			{ "config", required_argument, 0, 'c' },
 			/* Just using A, B, C ... from here on */
 			{ "dump", no_argument, 0, 'A' },
+			{ "writer-memory", required_argument, 0, 'B' },
 			{ 0, 0, 0, 0 }
 		};
 
-		int c = getopt_long (argc, argv, "vhfnrt:j:kAs:ldc:", long_options, &option_index);
+		int c = getopt_long (argc, argv, "vhfnrt:j:kAB:s:ldc:", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -253,6 +258,18 @@ main (int argc, char* argv[])
 		case 'A':
 			dump = true;
 			break;
+		case 'B':
+		{
+			/* A limit of 0 would make every frame go to disk, so don't accept that or anything else odd */
+			char* end = 0;
+			long const mb = strtol (optarg, &end, 10);
+			if (end == optarg || *end != '\0' || mb <= 0 || mb > INT_MAX) {
+				cerr << argv[0] << ": --writer-memory must be a positive whole number of megabytes\n";
+				exit (EXIT_FAILURE);
+			}
+			writer_memory = mb;
+			break;
+		}
 		case 's':
 			servers = optarg;
 			break;
@@ -318,6 +335,10 @@ main (int argc, char* argv[])
 		Config::instance()->set_master_encoding_threads (threads.get ());
 	}
 
+	if (writer_memory) {
+		Config::instance()->set_writer_memory_limit (int64_t (writer_memory.get ()) * 1024 * 1024);
+	}
+
 	shared_ptr<Film> film;
 	try {
 		film.reset (new Film (film_dir));
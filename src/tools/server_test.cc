@@ -30,16 +30,23 @@
 #include "lib/video_decoder.h"
 #include "lib/player.h"
 #include "lib/player_video.h"
+#include "lib/image.h"
 #include "lib/encode_server_description.h"
+#include "lib/encode_server_connection.h"
 #include <getopt.h>
 #include <iostream>
 #include <iomanip>
 #include <exception>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/foreach.hpp>
 
 using std::cout;
 using std::cerr;
 using std::string;
 using std::pair;
+using std::list;
+using std::setprecision;
+using std::fixed;
 using boost::shared_ptr;
 using boost::optional;
 using boost::bind;
@@ -47,7 +54,10 @@ using dcp::Data;
 
 static shared_ptr<Film> film;
 static EncodeServerDescription* server;
+static EncodeServerConnection* connection;
 static int frame_count = 0;
+/** total time spent waiting for remote encodes */
+static boost::posix_time::time_duration remote_time;
 
 void
 process_video (shared_ptr<PlayerVideo> pvf)
@@ -65,7 +75,13 @@ process_video (shared_ptr<PlayerVideo> pvf)
 
 	string remote_error;
 	try {
-		remote_encoded = remote->encode_remotely (*server);
+		boost::posix_time::ptime const start = boost::posix_time::microsec_clock::universal_time ();
+		if (connection) {
+			remote_encoded = connection->encode (remote);
+		} else {
+			remote_encoded = remote->encode_remotely (*server);
+		}
+		remote_time += boost::posix_time::microsec_clock::universal_time() - start;
 	} catch (NetworkError& e) {
 		remote_error = e.what ();
 	}
@@ -95,7 +111,15 @@ process_video (shared_ptr<PlayerVideo> pvf)
 static void
 help (string n)
 {
-	cerr << "Syntax: " << n << " [--help] --film <film> --server <host>\n";
+	cerr << "Syntax: " << n << " [--help] [--codec <codec>] [--single-frame] --film <film> --server <host>\n";
+	cerr << "  --codec         transport codec to send images with: None";
+	BOOST_FOREACH (TransportCodec i, Image::supported_transport_codecs()) {
+		if (i != TRANSPORT_CODEC_NONE) {
+			cerr << ", " << transport_codec_to_string (i);
+		}
+	}
+	cerr << " (default is the best available)\n";
+	cerr << "  --single-frame  open a new connection for each frame, as older servers need\n";
 	exit (EXIT_FAILURE);
 }
 
@@ -104,17 +128,21 @@ main (int argc, char* argv[])
 {
 	boost::filesystem::path film_dir;
 	string server_host;
+	optional<TransportCodec> codec;
+	bool single_frame = false;
 
 	while (true) {
 		static struct option long_options[] = {
 			{ "help", no_argument, 0, 'h'},
 			{ "server", required_argument, 0, 's'},
 			{ "film", required_argument, 0, 'f'},
+			{ "codec", required_argument, 0, 'c'},
+			{ "single-frame", no_argument, 0, 'S'},
 			{ 0, 0, 0, 0 }
 		};
 
 		int option_index = 0;
-		int c = getopt_long (argc, argv, "hs:f:", long_options, &option_index);
+		int c = getopt_long (argc, argv, "hs:f:c:S", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -130,6 +158,16 @@ main (int argc, char* argv[])
 		case 'f':
 			film_dir = optarg;
 			break;
+		case 'c':
+			codec = string_to_transport_codec (optarg);
+			if (!codec) {
+				cerr << "Unknown codec " << optarg << "\n";
+				exit (EXIT_FAILURE);
+			}
+			break;
+		case 'S':
+			single_frame = true;
+			break;
 		}
 	}
 
@@ -142,12 +180,33 @@ main (int argc, char* argv[])
 
 	try {
 		server = new EncodeServerDescription (server_host, 1, SERVER_LINK_VERSION);
+		list<TransportCodec> codecs = Image::supported_transport_codecs ();
+		if (codec) {
+			codecs.clear ();
+			codecs.push_back (*codec);
+		}
+		server->set_transport_codecs (codecs);
+
+		if (!single_frame) {
+			connection = new EncodeServerConnection (*server);
+		}
+
 		film.reset (new Film (film_dir));
 		film->read_metadata ();
 
 		shared_ptr<Player> player (new Player (film, film->playlist ()));
 		player->Video.connect (bind (&process_video, _1));
 		while (!player->pass ()) {}
+
+		if (frame_count > 0) {
+			double const seconds = remote_time.total_microseconds() / 1e6;
+			cout << fixed << setprecision (2) << frame_count << " frames; ";
+			if (connection) {
+				cout << (connection->bytes_sent() / 1e6) << "MB sent ("
+				     << (connection->bytes_sent() / 1e6 / frame_count) << "MB per frame); ";
+			}
+			cout << (seconds > 0 ? frame_count / seconds : 0) << " frames per second remotely.\n";
+		}
 	} catch (std::exception& e) {
 		cerr << "Error: " << e.what() << "\n";
 	}
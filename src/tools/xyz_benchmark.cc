@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/tools/xyz_benchmark.cc
+ *  @brief Time XYZConverter's implementations, and libdcp, converting some 2K frames from RGB to XYZ.
+ */
+
+#include "lib/xyz_converter.h"
+#include "lib/colour_conversion.h"
+#include <dcp/rgb_xyz.h>
+#include <dcp/openjpeg_image.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <getopt.h>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+using std::cout;
+using std::cerr;
+using std::string;
+using std::vector;
+using boost::shared_ptr;
+using boost::optional;
+
+static void
+help (string n)
+{
+	cerr << "Syntax: " << n << " [--help] [--frames <count>]\n";
+	cerr << "  --frames  number of frames to convert with each implementation (default 8)\n";
+}
+
+static void
+report (string name, boost::posix_time::time_duration taken, int frames)
+{
+	cout << name << ": " << (taken.total_microseconds() / (frames * 1000.0)) << "ms per frame\n";
+}
+
+int
+main (int argc, char* argv[])
+{
+	int frames = 8;
+
+	while (true) {
+		static struct option long_options[] = {
+			{ "help", no_argument, 0, 'h'},
+			{ "frames", required_argument, 0, 'f'},
+			{ 0, 0, 0, 0 }
+		};
+
+		int option_index = 0;
+		int c = getopt_long (argc, argv, "hf:", long_options, &option_index);
+
+		if (c == -1) {
+			break;
+		}
+
+		switch (c) {
+		case 'h':
+			help (argv[0]);
+			exit (EXIT_SUCCESS);
+		case 'f':
+			frames = atoi (optarg);
+			if (frames <= 0) {
+				help (argv[0]);
+				exit (EXIT_FAILURE);
+			}
+			break;
+		default:
+			help (argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+
+	dcp::Size const size (1998, 1080);
+	int const stride = size.width * 6;
+	vector<uint16_t> rgb (size.height * stride / 2);
+	srand (42);
+	for (size_t i = 0; i < rgb.size(); ++i) {
+		rgb[i] = rand() & 0xffff;
+	}
+	uint8_t const * data = reinterpret_cast<uint8_t const *> (&rgb[0]);
+	ColourConversion const conversion (dcp::ColourConversion::srgb_to_xyz ());
+
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time ();
+	for (int i = 0; i < frames; ++i) {
+		dcp::rgb_to_xyz (data, size, stride, conversion, optional<dcp::NoteHandler>());
+	}
+	report ("libdcp", boost::posix_time::microsec_clock::universal_time() - start, frames);
+
+	shared_ptr<const XYZConverter> converter = XYZConverter::get (conversion);
+
+	XYZConverter::Implementation const implementations[] = {
+		XYZConverter::IMPLEMENTATION_SCALAR,
+		XYZConverter::IMPLEMENTATION_SSE41,
+		XYZConverter::IMPLEMENTATION_AVX2
+	};
+
+	char const * names[] = {
+		"XYZConverter scalar",
+		"XYZConverter SSE4.1",
+		"XYZConverter AVX2"
+	};
+
+	for (int j = 0; j < 3; ++j) {
+		if (!XYZConverter::supported (implementations[j])) {
+			cout << names[j] << ": not supported on this CPU\n";
+			continue;
+		}
+
+		start = boost::posix_time::microsec_clock::universal_time ();
+		for (int i = 0; i < frames; ++i) {
+			converter->convert (data, size, stride, optional<dcp::NoteHandler>(), implementations[j]);
+		}
+		report (names[j], boost::posix_time::microsec_clock::universal_time() - start, frames);
+	}
+
+	return 0;
+}
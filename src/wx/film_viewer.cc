@@ -41,6 +41,7 @@
 #include "lib/video_decoder.h"
 #include "lib/timer.h"
 #include "lib/butler.h"
+#include "lib/seek_cache.h"
 #include "lib/log.h"
 #include "lib/config.h"
 #include "lib/compose.hpp"
@@ -50,6 +51,7 @@ extern "C" {
 #include <libavutil/pixfmt.h>
 }
 #include <dcp/exceptions.h>
+#include <dcp/raw_convert.h>
 #include <wx/tglbtn.h>
 #include <iostream>
 #include <iomanip>
@@ -68,6 +70,7 @@ using boost::dynamic_pointer_cast;
 using boost::weak_ptr;
 using boost::optional;
 using dcp::Size;
+using dcp::raw_convert;
 
 static
 int
@@ -83,6 +86,7 @@ FilmViewer::FilmViewer (wxWindow* p)
 	, _audio_channels (0)
 	, _audio_block_size (1024)
 	, _playing (false)
+	, _seek_cache (new SeekCache ())
 	, _latency_history_count (0)
 	, _dropped (0)
 	, _closed_captions_dialog (new ClosedCaptionsDialog(p, this))
@@ -130,6 +134,7 @@ FilmViewer::set_film (shared_ptr<Film> film)
 
 	_frame.reset ();
 	_closed_captions_dialog->clear ();
+	_seek_cache->clear ();
 
 	if (!_film) {
 		_player.reset ();
@@ -217,6 +222,9 @@ FilmViewer::recreate_butler ()
 		_butler->disable_audio ();
 	}
 
+	_butler->set_seek_cache (_seek_cache);
+	update_seek_cache ();
+
 	_closed_captions_dialog->set_butler (_butler);
 
 	if (was_running) {
@@ -224,6 +232,32 @@ FilmViewer::recreate_butler ()
 	}
 }
 
+/** Tell our seek cache about everything that affects the frames that our player is now making */
+void
+FilmViewer::update_seek_cache ()
+{
+	if (!_film) {
+		return;
+	}
+
+	string id = _film->video_identifier()
+		+ "_" + raw_convert<string>(_out_size.width)
+		+ "_" + raw_convert<string>(_out_size.height);
+
+	if (_dcp_decode_reduction) {
+		id += "_" + raw_convert<string>(*_dcp_decode_reduction);
+	}
+
+	/* We always burn in open subtitles, so the film's identifier won't be enough if some are not set to burn */
+	BOOST_FOREACH (shared_ptr<Content> i, _film->content()) {
+		if (!i->text.empty()) {
+			id += "_" + i->identifier();
+		}
+	}
+
+	_seek_cache->set_identifier (id, _film->video_frame_rate());
+}
+
 void
 FilmViewer::refresh_panel ()
 {
@@ -524,6 +558,11 @@ FilmViewer::stop ()
 void
 FilmViewer::player_change (ChangeType type, int property, bool frequent)
 {
+	if (type != CHANGE_TYPE_PENDING) {
+		/* Our butler stopped using the seek cache when this change became pending */
+		update_seek_cache ();
+	}
+
 	if (type != CHANGE_TYPE_DONE || frequent) {
 		return;
 	}
@@ -35,6 +35,7 @@ class RGBPlusAlphaImage;
 class PlayerVideo;
 class Player;
 class Butler;
+class SeekCache;
 class ClosedCaptionsDialog;
 
 /** @class FilmViewer
@@ -115,6 +116,7 @@ private:
 	void film_change (ChangeType, Film::Property);
 	void content_change (ChangeType, int property);
 	void recreate_butler ();
+	void update_seek_cache ();
 	void config_changed (Config::Property);
 	bool maybe_draw_background_image (wxPaintDC& dc);
 
@@ -150,6 +152,8 @@ private:
 	unsigned int _audio_block_size;
 	bool _playing;
 	boost::shared_ptr<Butler> _butler;
+	/** Frames that we have recently seen, so that scrubbing back and forth doesn't mean decoding them again */
+	boost::shared_ptr<SeekCache> _seek_cache;
 
 	std::list<Frame> _latency_history;
 	/** Mutex to protect _latency_history */
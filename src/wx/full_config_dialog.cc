@@ -1368,6 +1368,7 @@ public:
 		, _allow_any_dcp_frame_rate (0)
 		, _allow_any_container (0)
 		, _only_servers_encode (0)
+		, _fused_video_pipeline (0)
 		, _log_general (0)
 		, _log_warning (0)
 		, _log_error (0)
@@ -1423,6 +1424,10 @@ private:
 		table->Add (_only_servers_encode, 1, wxEXPAND | wxALL);
 		table->AddSpacer (0);
 
+		_fused_video_pipeline = new CheckBox (_panel, _("Prepare video for encoding in a single pass"));
+		table->Add (_fused_video_pipeline, 1, wxEXPAND | wxALL);
+		table->AddSpacer (0);
+
 		{
 			add_label_to_sizer (table, _panel, _("Maximum number of frames to store per thread"), true);
 			wxBoxSizer* s = new wxBoxSizer (wxHORIZONTAL);
@@ -1493,6 +1498,7 @@ private:
 		_allow_any_dcp_frame_rate->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::allow_any_dcp_frame_rate_changed, this));
 		_allow_any_container->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::allow_any_container_changed, this));
 		_only_servers_encode->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::only_servers_encode_changed, this));
+		_fused_video_pipeline->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::fused_video_pipeline_changed, this));
 		_frames_in_memory_multiplier->Bind (wxEVT_SPINCTRL, boost::bind(&AdvancedPage::frames_in_memory_multiplier_changed, this));
 		_dcp_metadata_filename_format->Changed.connect (boost::bind (&AdvancedPage::dcp_metadata_filename_format_changed, this));
 		_dcp_asset_filename_format->Changed.connect (boost::bind (&AdvancedPage::dcp_asset_filename_format_changed, this));
@@ -1516,6 +1522,7 @@ private:
 		checked_set (_allow_any_dcp_frame_rate, config->allow_any_dcp_frame_rate ());
 		checked_set (_allow_any_container, config->allow_any_container ());
 		checked_set (_only_servers_encode, config->only_servers_encode ());
+		checked_set (_fused_video_pipeline, config->fused_video_pipeline ());
 		checked_set (_log_general, config->log_types() & LogEntry::TYPE_GENERAL);
 		checked_set (_log_warning, config->log_types() & LogEntry::TYPE_WARNING);
 		checked_set (_log_error, config->log_types() & LogEntry::TYPE_ERROR);
@@ -1554,6 +1561,11 @@ private:
 		Config::instance()->set_only_servers_encode (_only_servers_encode->GetValue ());
 	}
 
+	void fused_video_pipeline_changed ()
+	{
+		Config::instance()->set_fused_video_pipeline (_fused_video_pipeline->GetValue ());
+	}
+
 	void dcp_metadata_filename_format_changed ()
 	{
 		Config::instance()->set_dcp_metadata_filename_format (_dcp_metadata_filename_format->get ());
@@ -1603,6 +1615,7 @@ private:
 	wxCheckBox* _allow_any_dcp_frame_rate;
 	wxCheckBox* _allow_any_container;
 	wxCheckBox* _only_servers_encode;
+	wxCheckBox* _fused_video_pipeline;
 	NameFormatEditor* _dcp_metadata_filename_format;
 	NameFormatEditor* _dcp_asset_filename_format;
 	wxCheckBox* _log_general;
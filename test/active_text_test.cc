@@ -0,0 +1,134 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/active_text_test.cc
+ *  @brief Test ActiveText.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/active_text.h"
+#include "lib/string_text_file_content.h"
+#include "lib/text_content.h"
+#include <boost/test/unit_test.hpp>
+
+using std::list;
+using std::vector;
+using boost::shared_ptr;
+using boost::weak_ptr;
+
+/** @return A PlayerText that we can recognise by its marker */
+static PlayerText
+marked (double marker)
+{
+	PlayerText t;
+	t.bitmap.push_back (BitmapText (shared_ptr<Image>(), dcpomatic::Rect<double> (marker, 0, 0, 0)));
+	return t;
+}
+
+static vector<double>
+markers (list<PlayerText> texts)
+{
+	vector<double> m;
+	for (list<PlayerText>::const_iterator i = texts.begin(); i != texts.end(); ++i) {
+		BOOST_REQUIRE_EQUAL (i->bitmap.size(), 1U);
+		m.push_back (i->bitmap.front().rectangle.x);
+	}
+	return m;
+}
+
+static shared_ptr<TextContent>
+burnt_text (shared_ptr<StringTextFileContent> content)
+{
+	shared_ptr<TextContent> text = content->only_text ();
+	text->set_use (true);
+	text->set_burn (true);
+	return text;
+}
+
+/** Texts come back grouped by content, and in the order that they were added for each content,
+ *  whatever their times; this is the order in which they are stacked when burnt in.
+ */
+BOOST_AUTO_TEST_CASE (active_text_test1)
+{
+	shared_ptr<StringTextFileContent> content_a (new StringTextFileContent("test/data/subrip.srt"));
+	shared_ptr<StringTextFileContent> content_b (new StringTextFileContent("test/data/subrip2.srt"));
+	shared_ptr<TextContent> a = burnt_text (content_a);
+	shared_ptr<TextContent> b = burnt_text (content_b);
+
+	ActiveText active;
+	active.add_from (b, marked(1), DCPTime::from_seconds(2));
+	active.add_to (b, DCPTime::from_seconds(10));
+	active.add_from (a, marked(2), DCPTime::from_seconds(1));
+	active.add_to (a, DCPTime::from_seconds(10));
+	active.add_from (b, marked(3), DCPTime::from_seconds(0));
+	active.add_to (b, DCPTime::from_seconds(10));
+
+	vector<double> expected;
+	if (weak_ptr<const TextContent>(a) < weak_ptr<const TextContent>(b)) {
+		expected.push_back (2);
+		expected.push_back (1);
+		expected.push_back (3);
+	} else {
+		expected.push_back (1);
+		expected.push_back (3);
+		expected.push_back (2);
+	}
+
+	vector<double> const got = markers (active.get_burnt(DCPTimePeriod(DCPTime::from_seconds(3), DCPTime::from_seconds(4)), false));
+	BOOST_CHECK_EQUAL_COLLECTIONS (got.begin(), got.end(), expected.begin(), expected.end());
+}
+
+/** Long texts, and texts which have not been given a to time, are still found long after they start;
+ *  short ones which have finished are not.
+ */
+BOOST_AUTO_TEST_CASE (active_text_test2)
+{
+	shared_ptr<StringTextFileContent> content_a (new StringTextFileContent("test/data/subrip.srt"));
+	shared_ptr<StringTextFileContent> content_b (new StringTextFileContent("test/data/subrip2.srt"));
+	shared_ptr<TextContent> a = burnt_text (content_a);
+	shared_ptr<TextContent> b = burnt_text (content_b);
+
+	ActiveText active;
+	active.add_from (a, marked(1), DCPTime::from_seconds(0));
+	active.add_to (a, DCPTime::from_seconds(100));
+	active.add_from (a, marked(2), DCPTime::from_seconds(1));
+	active.add_to (a, DCPTime::from_seconds(2));
+	active.add_from (b, marked(3), DCPTime::from_seconds(3));
+
+	DCPTimePeriod const early (DCPTime::from_seconds(1), DCPTime::from_seconds(2));
+	vector<double> got = markers (active.get_burnt(early, false));
+	BOOST_REQUIRE_EQUAL (got.size(), 2U);
+	BOOST_CHECK_EQUAL (got[0], 1);
+	BOOST_CHECK_EQUAL (got[1], 2);
+
+	DCPTimePeriod const late (DCPTime::from_seconds(50), DCPTime::from_seconds(51));
+	got = markers (active.get_burnt(late, false));
+	BOOST_REQUIRE_EQUAL (got.size(), 2U);
+	BOOST_CHECK ((got[0] == 1 && got[1] == 3) || (got[0] == 3 && got[1] == 1));
+
+	active.clear_before (DCPTime::from_seconds(50));
+	got = markers (active.get_burnt(late, false));
+	BOOST_CHECK_EQUAL (got.size(), 2U);
+
+	/* Texts from content that is not set to burn are not returned unless we ask for them */
+	b->set_burn (false);
+	BOOST_CHECK_EQUAL (active.get_burnt(late, false).size(), 1U);
+	BOOST_CHECK_EQUAL (active.get_burnt(late, true).size(), 2U);
+}
@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/black_fill_test.cc
+ *  @brief Check the black frames that are written to fill gaps in a DCP.
+ *  @ingroup specific
+ */
+
+#include "lib/film.h"
+#include "lib/content_factory.h"
+#include "lib/content.h"
+#include "lib/video_content.h"
+#include "lib/image.h"
+#include "lib/raw_image_proxy.h"
+#include "lib/player_video.h"
+#include "lib/dcp_video.h"
+#include "lib/colour_conversion.h"
+#include "test.h"
+#include <dcp/dcp.h>
+#include <dcp/cpl.h>
+#include <dcp/reel.h>
+#include <dcp/reel_mono_picture_asset.h>
+#include <dcp/mono_picture_asset.h>
+#include <dcp/mono_picture_asset_reader.h>
+#include <dcp/mono_picture_frame.h>
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+using std::list;
+using boost::shared_ptr;
+using boost::dynamic_pointer_cast;
+using boost::optional;
+
+/** Black frames that fill gaps are encoded once by the encoder threads, then repeated or
+ *  written again from a copy.  Check that every one of them in the DCP is the same as a
+ *  black frame encoded in the normal way.
+ */
+BOOST_AUTO_TEST_CASE (black_fill_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("black_fill_test");
+	film->set_reel_type (REELTYPE_BY_VIDEO_CONTENT);
+
+	shared_ptr<Content> first = content_factory("test/data/flat_red.png").front();
+	shared_ptr<Content> second = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (first);
+	film->examine_and_add_content (second);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	/* Black, red, black, red; a reel each, so that black frames start two reels and can't
+	   always be repeats of the frame before.
+	*/
+	first->video->set_length (24);
+	first->set_position (film, DCPTime::from_seconds(1));
+	second->video->set_length (24);
+	second->set_position (film, DCPTime::from_seconds(3));
+
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	dcp::Size const size = film->frame_size ();
+	shared_ptr<Image> black_image (new Image (AV_PIX_FMT_RGB24, size, true));
+	black_image->make_black ();
+	shared_ptr<PlayerVideo> black (
+		new PlayerVideo (
+			shared_ptr<ImageProxy> (new RawImageProxy (black_image)),
+			Crop (),
+			optional<double> (),
+			size,
+			size,
+			EYES_BOTH,
+			PART_WHOLE,
+			PresetColourConversion::all().front().conversion,
+			boost::weak_ptr<Content>(),
+			optional<Frame>()
+			)
+		);
+	dcp::Data const reference = DCPVideo(black, 0, film->video_frame_rate(), film->j2k_bandwidth(), film->resolution()).encode_locally();
+
+	dcp::DCP dcp (film->dir (film->dcp_name ()));
+	dcp.read ();
+	BOOST_REQUIRE_EQUAL (dcp.cpls().size(), 1U);
+	list<shared_ptr<dcp::Reel> > reels = dcp.cpls().front()->reels ();
+	BOOST_REQUIRE_EQUAL (reels.size(), 4U);
+
+	int reel = 0;
+	for (list<shared_ptr<dcp::Reel> >::const_iterator i = reels.begin(); i != reels.end(); ++i, ++reel) {
+		if (reel % 2) {
+			/* Red */
+			continue;
+		}
+
+		shared_ptr<dcp::ReelMonoPictureAsset> picture = dynamic_pointer_cast<dcp::ReelMonoPictureAsset> ((*i)->main_picture());
+		BOOST_REQUIRE (picture);
+		shared_ptr<dcp::MonoPictureAssetReader> reader = picture->mono_asset()->start_read ();
+		for (int64_t j = 0; j < picture->intrinsic_duration(); ++j) {
+			shared_ptr<const dcp::MonoPictureFrame> frame = reader->get_frame (j);
+			BOOST_REQUIRE_EQUAL (frame->j2k_size(), reference.size());
+			BOOST_CHECK_MESSAGE (
+				memcmp (frame->j2k_data(), reference.data().get(), reference.size()) == 0,
+				"black frame " << j << " of reel " << reel << " differs"
+				);
+		}
+	}
+}
@@ -35,8 +35,11 @@
 #include "lib/raw_image_proxy.h"
 #include "lib/j2k_image_proxy.h"
 #include "lib/encode_server_description.h"
+#include "lib/encode_server_connection.h"
 #include "lib/file_log.h"
 #include "lib/dcpomatic_log.h"
+#include "lib/dcpomatic_socket.h"
+#include "lib/binary_metadata.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
 
@@ -57,6 +60,18 @@ do_remote_encode (shared_ptr<DCPVideo> frame, EncodeServerDescription descriptio
 	BOOST_CHECK_EQUAL (memcmp (locally_encoded.data().get(), remotely_encoded.data().get(), locally_encoded.size()), 0);
 }
 
+void
+do_persistent_remote_encode (shared_ptr<DCPVideo> frame, shared_ptr<EncodeServerConnection> connection, Data locally_encoded)
+{
+	for (int i = 0; i < 4; ++i) {
+		Data remotely_encoded;
+		BOOST_REQUIRE_NO_THROW (remotely_encoded = connection->encode (frame));
+
+		BOOST_REQUIRE_EQUAL (locally_encoded.size(), remotely_encoded.size());
+		BOOST_CHECK_EQUAL (memcmp (locally_encoded.data().get(), remotely_encoded.data().get(), locally_encoded.size()), 0);
+	}
+}
+
 BOOST_AUTO_TEST_CASE (client_server_test_rgb)
 {
 	shared_ptr<Image> image (new Image (AV_PIX_FMT_RGB24, dcp::Size (1998, 1080), true));
@@ -125,6 +140,8 @@ BOOST_AUTO_TEST_CASE (client_server_test_rgb)
 
 	/* "localhost" rather than "127.0.0.1" here fails on docker; go figure */
 	EncodeServerDescription description ("127.0.0.1", 1, SERVER_LINK_VERSION);
+	/* Send the images compressed, if we can */
+	description.set_transport_codecs (Image::supported_transport_codecs ());
 
 	list<thread*> threads;
 	for (int i = 0; i < 8; ++i) {
@@ -324,3 +341,150 @@ BOOST_AUTO_TEST_CASE (client_server_test_j2k)
 	delete server_thread;
 	delete server;
 }
+
+/** Check that several threads can share one persistent connection to a server */
+BOOST_AUTO_TEST_CASE (client_server_test_persistent)
+{
+	shared_ptr<Image> image (new Image (AV_PIX_FMT_YUV420P, dcp::Size (1998, 1080), true));
+
+	for (int i = 0; i < image->planes(); ++i) {
+		uint8_t* p = image->data()[i];
+		for (int j = 0; j < image->line_size()[i]; ++j) {
+			*p++ = j % 256;
+		}
+	}
+
+	dcpomatic_log.reset (new FileLog("build/test/client_server_test_persistent.log"));
+
+	list<shared_ptr<DCPVideo> > frames;
+	list<Data> locally_encoded;
+	for (int i = 0; i < 4; ++i) {
+		shared_ptr<PlayerVideo> pvf (
+			new PlayerVideo (
+				shared_ptr<ImageProxy> (new RawImageProxy (image)),
+				Crop (),
+				optional<double> (),
+				dcp::Size (1998, 1080),
+				dcp::Size (1998, 1080),
+				EYES_BOTH,
+				PART_WHOLE,
+				ColourConversion(),
+				weak_ptr<Content>(),
+				optional<Frame>()
+				)
+			);
+
+		/* Use a different bandwidth for each frame so that they encode differently */
+		frames.push_back (shared_ptr<DCPVideo> (new DCPVideo (pvf, i, 24, 100000000 + i * 50000000, RESOLUTION_2K)));
+		locally_encoded.push_back (frames.back()->encode_locally ());
+	}
+
+	EncodeServer* server = new EncodeServer (true, 2);
+
+	thread* server_thread = new thread (boost::bind (&EncodeServer::run, server));
+
+	/* Let the server get itself ready */
+	dcpomatic_sleep (1);
+
+	/* "localhost" rather than "127.0.0.1" here fails on docker; go figure */
+	EncodeServerDescription description ("127.0.0.1", 2, SERVER_LINK_VERSION);
+	BOOST_REQUIRE (description.persistent_connection ());
+	shared_ptr<EncodeServerConnection> connection (new EncodeServerConnection (description, 1200));
+
+	list<thread*> threads;
+	list<Data>::const_iterator j = locally_encoded.begin ();
+	for (list<shared_ptr<DCPVideo> >::const_iterator i = frames.begin(); i != frames.end(); ++i) {
+		threads.push_back (new thread (boost::bind (do_persistent_remote_encode, *i, connection, *j)));
+		++j;
+	}
+
+	for (list<thread*>::iterator i = threads.begin(); i != threads.end(); ++i) {
+		(*i)->join ();
+	}
+
+	for (list<thread*>::iterator i = threads.begin(); i != threads.end(); ++i) {
+		delete *i;
+	}
+
+	connection.reset ();
+
+	server->stop ();
+	server_thread->join ();
+	delete server_thread;
+	delete server;
+}
+
+/** Send a frame as a binary request over a real socket and read it back as the server would */
+static shared_ptr<DCPVideo>
+binary_round_trip (shared_ptr<DCPVideo> frame, EncodeServerDescription description)
+{
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::acceptor acceptor (io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+	shared_ptr<Socket> out (new Socket);
+	out->connect (acceptor.local_endpoint());
+	shared_ptr<Socket> in (new Socket);
+	acceptor.accept (in->socket());
+
+	/* The image is small enough to fit in the socket's buffers, so we can write it all before reading */
+	frame->send_request (out, description);
+
+	uint32_t const length = in->read_uint32 ();
+	std::vector<uint8_t> metadata (length);
+	in->read (&metadata[0], length);
+
+	BinaryReader reader (&metadata[0], length);
+	BOOST_REQUIRE_EQUAL (reader.read_uint32(), static_cast<uint32_t>(ENCODING_REQUEST_MAGIC));
+	BOOST_REQUIRE_EQUAL (reader.read_uint32(), static_cast<uint32_t>(ENCODING_REQUEST_VERSION));
+	shared_ptr<DCPVideo> received (new DCPVideo (reader, in));
+
+	BOOST_CHECK_EQUAL (in->bytes_read(), out->bytes_written());
+	return received;
+}
+
+/** Check that a DCPVideo and its PlayerVideo come through the binary request format unchanged,
+ *  with and without compression of the image.
+ */
+BOOST_AUTO_TEST_CASE (client_server_test_binary_request)
+{
+	shared_ptr<Image> image (new Image (AV_PIX_FMT_RGB24, dcp::Size (64, 48), true));
+	uint8_t* p = image->data()[0];
+	for (int y = 0; y < 48; ++y) {
+		for (int x = 0; x < 64 * 3; ++x) {
+			p[x] = (x + y) % 256;
+		}
+		p += image->stride()[0];
+	}
+
+	shared_ptr<Image> sub_image (new Image (AV_PIX_FMT_BGRA, dcp::Size (16, 8), true));
+	sub_image->make_transparent ();
+
+	shared_ptr<PlayerVideo> pvf (
+		new PlayerVideo (
+			shared_ptr<ImageProxy> (new RawImageProxy (image)),
+			Crop (2, 4, 6, 8),
+			optional<double> (0.5),
+			dcp::Size (40, 30),
+			dcp::Size (48, 30),
+			EYES_LEFT,
+			PART_WHOLE,
+			PresetColourConversion::all().front().conversion,
+			weak_ptr<Content>(),
+			optional<Frame>()
+			)
+		);
+
+	pvf->set_text (PositionImage (sub_image, Position<int> (5, 6)));
+
+	shared_ptr<DCPVideo> frame (new DCPVideo (pvf, 42, 25, 150000000, RESOLUTION_4K));
+
+	EncodeServerDescription description ("127.0.0.1", 1, SERVER_LINK_VERSION);
+	shared_ptr<DCPVideo> received = binary_round_trip (frame, description);
+	BOOST_CHECK_EQUAL (received->index(), 42);
+	BOOST_CHECK_EQUAL (received->eyes(), EYES_LEFT);
+	BOOST_CHECK (received->same (frame));
+
+	description.set_transport_codecs (Image::supported_transport_codecs ());
+	received = binary_round_trip (frame, description);
+	BOOST_CHECK (received->same (frame));
+}
@@ -25,6 +25,8 @@
 
 #include "lib/colour_conversion.h"
 #include "lib/film.h"
+#include "lib/binary_metadata.h"
+#include "lib/exceptions.h"
 #include <dcp/gamma_transfer_function.h>
 #include <libxml++/libxml++.h>
 #include <boost/test/unit_test.hpp>
@@ -114,3 +116,25 @@ BOOST_AUTO_TEST_CASE (colour_conversion_test4)
 		BOOST_CHECK (ColourConversion::from_xml (in, Film::current_state_version).get () == i.conversion);
 	}
 }
+
+/** Test a round trip via the binary representation used for encode server requests */
+BOOST_AUTO_TEST_CASE (colour_conversion_test5)
+{
+	BOOST_FOREACH (PresetColourConversion const & i, PresetColourConversion::all ()) {
+		BinaryWriter writer;
+		i.conversion.as_binary (writer);
+		BinaryReader reader (writer.data(), writer.size());
+		BOOST_CHECK (ColourConversion (reader) == i.conversion);
+	}
+
+	ColourConversion adjusted (dcp::ColourConversion::rec709_to_xyz ());
+	adjusted.set_adjusted_white (dcp::Chromaticity (0.31, 0.32));
+	BinaryWriter writer;
+	adjusted.as_binary (writer);
+	BinaryReader reader (writer.data(), writer.size());
+	BOOST_CHECK (ColourConversion (reader) == adjusted);
+
+	/* Running off the end of the data must throw rather than read garbage */
+	BinaryReader truncated (writer.data(), writer.size() - 1);
+	BOOST_CHECK_THROW (ColourConversion c (truncated), NetworkError);
+}
@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/data_pool_test.cc
+ *  @brief Test DataPool.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/data_pool.h"
+#include <boost/test/unit_test.hpp>
+
+/** Memory from destroyed Data is given to the next request that it is big enough for */
+BOOST_AUTO_TEST_CASE (data_pool_test1)
+{
+	DataPool* pool = DataPool::instance ();
+	pool->clear ();
+
+	uint8_t* a_data = 0;
+	{
+		dcp::Data a = pool->get (100000);
+		BOOST_CHECK_EQUAL (a.size(), 100000);
+		a_data = a.data().get();
+		/* A copy keeps the memory in use */
+		dcp::Data b = a;
+	}
+
+	BOOST_CHECK (pool->idle() >= 100000);
+
+	/* Too big for a's memory */
+	dcp::Data c = pool->get (1000000);
+	BOOST_CHECK (c.data().get() != a_data);
+
+	/* Small enough */
+	dcp::Data d = pool->get (99000);
+	BOOST_CHECK (d.data().get() == a_data);
+	BOOST_CHECK_EQUAL (d.size(), 99000);
+	BOOST_CHECK_EQUAL (pool->idle(), 0U);
+
+	pool->clear ();
+}
+
+/** The pool frees the memory that was returned longest ago when it is over its limit */
+BOOST_AUTO_TEST_CASE (data_pool_test2)
+{
+	DataPool* pool = DataPool::instance ();
+	pool->clear ();
+	size_t const old_limit = pool->idle_limit ();
+	pool->set_idle_limit (150 * 1024);
+
+	uint8_t* b_data = 0;
+	{
+		dcp::Data a = pool->get (64 * 1024);
+		dcp::Data b = pool->get (64 * 1024);
+		dcp::Data c = pool->get (64 * 1024);
+		b_data = b.data().get();
+		a = dcp::Data ();
+		b = dcp::Data ();
+		c = dcp::Data ();
+	}
+
+	/* a's memory has gone */
+	BOOST_CHECK_EQUAL (pool->idle(), 128 * 1024U);
+	/* c's memory is the most recently returned so it is used first; then b's */
+	dcp::Data d = pool->get (1000);
+	dcp::Data e = pool->get (1000);
+	BOOST_CHECK (e.data().get() == b_data);
+
+	pool->set_idle_limit (old_limit);
+	pool->clear ();
+}
@@ -32,7 +32,9 @@
 #include <dcp/cpl.h>
 #include <dcp/reel.h>
 #include <dcp/reel_picture_asset.h>
+#include <dcp/mono_picture_asset.h>
 #include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
 
 using std::list;
 using std::string;
@@ -100,3 +102,38 @@ BOOST_AUTO_TEST_CASE (digest_test)
 	++i;
 	BOOST_REQUIRE (i == reels.end ());
 }
+
+/** Check that the picture digests worked out by the Writer's background digest thread, while
+ *  the DCP is still being written, match those computed afresh from the finished MXFs.
+ */
+BOOST_AUTO_TEST_CASE (digest_test2)
+{
+	shared_ptr<Film> film = new_test_film2 ("digest_test2");
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TST"));
+	shared_ptr<ImageContent> r (new ImageContent("test/data/flat_red.png"));
+	shared_ptr<ImageContent> g (new ImageContent("test/data/flat_green.png"));
+	shared_ptr<ImageContent> b (new ImageContent("test/data/flat_blue.png"));
+	film->examine_and_add_content (r);
+	film->examine_and_add_content (g);
+	film->examine_and_add_content (b);
+	film->set_reel_type (REELTYPE_BY_VIDEO_CONTENT);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	Config::instance()->set_master_encoding_threads (4);
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+	Config::instance()->set_master_encoding_threads (1);
+
+	dcp::DCP dcp (film->dir (film->dcp_name ()));
+	dcp.read ();
+	BOOST_REQUIRE_EQUAL (dcp.cpls().size(), 1);
+	list<shared_ptr<dcp::Reel> > reels = dcp.cpls().front()->reels ();
+	BOOST_REQUIRE_EQUAL (reels.size(), 3);
+
+	BOOST_FOREACH (shared_ptr<dcp::Reel> i, reels) {
+		BOOST_REQUIRE (i->main_picture()->hash());
+		BOOST_REQUIRE (i->main_picture()->asset()->file());
+		dcp::MonoPictureAsset fresh (i->main_picture()->asset()->file().get());
+		BOOST_CHECK_EQUAL (i->main_picture()->hash().get(), fresh.hash());
+	}
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/encode_server_statistics_test.cc
+ *  @brief Test EncodeServerStatistics.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/encode_server_statistics.h"
+#include <boost/test/unit_test.hpp>
+
+using boost::optional;
+
+static void
+encode (EncodeServerStatistics& stats, optional<double> latency)
+{
+	stats.acquire ();
+	stats.add (latency);
+	stats.release ();
+}
+
+/** The limit rises while frames come back quickly, and falls when they slow down */
+BOOST_AUTO_TEST_CASE (encode_server_statistics_test1)
+{
+	EncodeServerStatistics stats (4);
+	BOOST_CHECK_EQUAL (stats.limit(), 4);
+	BOOST_CHECK_EQUAL (stats.maximum(), 8);
+
+	for (int i = 0; i < 64; ++i) {
+		encode (stats, 1.0);
+	}
+	BOOST_CHECK_EQUAL (stats.limit(), 8);
+	BOOST_CHECK_CLOSE (stats.latency(), 1.0, 0.01);
+
+	/* Judged against the recent fastest, these are slow */
+	for (int i = 0; i < 16; ++i) {
+		encode (stats, 4.0);
+	}
+	BOOST_CHECK (stats.limit() < 8);
+	BOOST_CHECK_EQUAL (stats.in_flight(), 0);
+}
+
+/** Failures halve the limit, but never take it below 1 */
+BOOST_AUTO_TEST_CASE (encode_server_statistics_test2)
+{
+	EncodeServerStatistics stats (4);
+	encode (stats, optional<double> ());
+	BOOST_CHECK_EQUAL (stats.limit(), 2);
+	encode (stats, optional<double> ());
+	encode (stats, optional<double> ());
+	BOOST_CHECK_EQUAL (stats.limit(), 1);
+	BOOST_CHECK_EQUAL (stats.latency(), 0);
+}
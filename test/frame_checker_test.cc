@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/frame_checker_test.cc
+ *  @brief Test FrameChecker.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/frame_checker.h"
+#include "lib/digester.h"
+#include "lib/cross.h"
+#include <dcp/data.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <cstdio>
+#include <cstring>
+
+using std::vector;
+using boost::optional;
+
+static void
+progress (float p, float, float* last)
+{
+	BOOST_CHECK (p >= *last);
+	*last = p;
+}
+
+/** Write some frames, with gaps between them, and check them */
+BOOST_AUTO_TEST_CASE (frame_checker_test)
+{
+	boost::filesystem::path const path = "build/test/frame_checker_test.mxf";
+
+	FILE* f = fopen_boost (path, "wb");
+	BOOST_REQUIRE (f);
+	vector<dcp::FrameInfo> frames;
+	int64_t offset = 0;
+	for (int i = 0; i < 200; ++i) {
+		/* Some frames are bigger than a block */
+		dcp::Data data ((i % 100) == 0 ? 40 * 1024 * 1024 : 100000 + i * 1000);
+		for (int j = 0; j < data.size(); ++j) {
+			data.data()[j] = (i * 7 + j) & 0xff;
+		}
+		uint8_t gap[20];
+		memset (gap, 0, sizeof (gap));
+		fwrite (gap, sizeof (gap), 1, f);
+		offset += sizeof (gap);
+		fwrite (data.data().get(), data.size(), 1, f);
+		Digester digester;
+		digester.add (data.data().get(), data.size());
+		frames.push_back (dcp::FrameInfo (offset, data.size(), digester.get()));
+		offset += data.size();
+	}
+	fclose (f);
+
+	{
+		FrameChecker checker (path);
+		BOOST_CHECK (checker.check (frames[0]));
+		BOOST_CHECK (checker.check (frames[199]));
+		float last = 0;
+		BOOST_CHECK (!checker.first_bad (frames, boost::bind (&progress, _1, _2, &last)));
+		BOOST_CHECK_CLOSE (last, 1, 1e-3);
+	}
+
+	/* Corrupt a frame */
+	f = fopen_boost (path, "r+b");
+	BOOST_REQUIRE (f);
+	dcpomatic_fseek (f, frames[123].offset + 50, SEEK_SET);
+	uint8_t const bad = 42;
+	fwrite (&bad, 1, 1, f);
+	fclose (f);
+
+	{
+		FrameChecker checker (path);
+		BOOST_CHECK (!checker.check (frames[123]));
+		optional<size_t> first = checker.first_bad (frames, boost::function<void (float, float)> ());
+		BOOST_REQUIRE (first);
+		BOOST_CHECK_EQUAL (*first, 123);
+	}
+
+	/* Cut the file short in the middle of a frame */
+	boost::filesystem::resize_file (path, frames[180].offset + 10);
+
+	{
+		FrameChecker checker (path);
+		BOOST_CHECK (!checker.check (frames[180]));
+		vector<dcp::FrameInfo> last (frames.begin() + 124, frames.end());
+		optional<size_t> first = checker.first_bad (last, boost::function<void (float, float)> ());
+		BOOST_REQUIRE (first);
+		BOOST_CHECK_EQUAL (*first, 180 - 124);
+	}
+}
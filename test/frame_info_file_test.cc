@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/frame_info_file_test.cc
+ *  @brief Test FrameInfoFile.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/frame_info_file.h"
+#include "lib/cross.h"
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+
+static bool
+equal (dcp::FrameInfo a, dcp::FrameInfo b)
+{
+	return a.offset == b.offset && a.size == b.size && a.hash == b.hash;
+}
+
+/** Write records beyond the size that the file was opened with, and check that they
+ *  are still there when the file is opened again.
+ */
+BOOST_AUTO_TEST_CASE (frame_info_file_test1)
+{
+	boost::filesystem::path const path = "build/test/frame_info_file_test1";
+	boost::filesystem::remove (path);
+
+	dcp::FrameInfo info1 (0, 4096, "0123456789abcdef0123456789abcdef");
+	dcp::FrameInfo info2 (4096, 99157123, "ffeeddccbbaa99887766554433221100");
+
+	{
+		FrameInfoFile file (path, 8);
+		BOOST_CHECK_EQUAL (file.last_written(), -1);
+		file.write (0, info1);
+		file.write (10000, info2);
+		BOOST_CHECK (equal(file.read(0), info1));
+		BOOST_CHECK (equal(file.read(10000), info2));
+		BOOST_CHECK_EQUAL (file.read(5).size, 0);
+		BOOST_CHECK_EQUAL (file.last_written(), 10000);
+	}
+
+	FrameInfoFile file (path, 8);
+	BOOST_CHECK (equal(file.read(0), info1));
+	BOOST_CHECK (equal(file.read(10000), info2));
+	BOOST_CHECK_EQUAL (file.read(1000000).size, 0);
+	BOOST_CHECK_EQUAL (file.last_written(), 10000);
+}
+
+/** Check that a file in the old format is converted */
+BOOST_AUTO_TEST_CASE (frame_info_file_test2)
+{
+	boost::filesystem::path const path = "build/test/frame_info_file_test2";
+
+	FILE* f = fopen_boost (path, "wb");
+	BOOST_REQUIRE (f);
+	for (int i = 0; i < 3; ++i) {
+		int64_t const offset = i * 1000;
+		int64_t const size = 1000;
+		fwrite (&offset, sizeof (offset), 1, f);
+		fwrite (&size, sizeof (size), 1, f);
+		fwrite ("00112233445566778899aabbccddeeff", 32, 1, f);
+	}
+	fclose (f);
+
+	FrameInfoFile file (path, 3);
+	BOOST_CHECK_EQUAL (file.last_written(), 2);
+	for (int i = 0; i < 3; ++i) {
+		BOOST_CHECK (equal(file.read(i), dcp::FrameInfo(i * 1000, 1000, "00112233445566778899aabbccddeeff")));
+	}
+}
@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/frame_spill_test.cc
+ *  @brief Test FrameSpill.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/frame_spill.h"
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+static QueueItem
+frame (int index)
+{
+	QueueItem i;
+	i.type = QueueItem::FULL;
+	i.reel = index / 10;
+	i.frame = index % 10;
+	i.eyes = EYES_BOTH;
+	return i;
+}
+
+static dcp::Data
+data (int index)
+{
+	dcp::Data d (1000 + index * 37);
+	for (int i = 0; i < d.size(); ++i) {
+		d.data()[i] = (i + index) & 0xff;
+	}
+	return d;
+}
+
+static void
+check (dcp::Data const & d, int index)
+{
+	BOOST_REQUIRE_EQUAL (d.size(), 1000 + index * 37);
+	for (int i = 0; i < d.size(); ++i) {
+		BOOST_REQUIRE_EQUAL (d.data()[i], (i + index) & 0xff);
+	}
+}
+
+/** Frames come back from the spill as they went in, whether or not they were prefetched,
+ *  and the file is removed afterwards.
+ */
+BOOST_AUTO_TEST_CASE (frame_spill_test)
+{
+	boost::filesystem::path const path = "build/test/frame_spill_test.spill";
+	boost::filesystem::remove (path);
+
+	{
+		/* A small limit so that we sometimes have to wait */
+		FrameSpill spill (path, 4096);
+		for (int i = 0; i < 40; ++i) {
+			spill.wait_for_space ();
+			spill.put (frame(i), data(i));
+		}
+
+		for (int i = 39; i >= 30; --i) {
+			spill.prefetch (frame(i));
+		}
+
+		for (int i = 0; i < 40; ++i) {
+			check (spill.get(frame(i)), i);
+		}
+
+		BOOST_CHECK_EQUAL (spill.memory_used(), 0);
+
+		/* We can't tell how many frames had gone by the time that get() was
+		   called, so this is only the most that could have been written.
+		*/
+		int64_t total = 0;
+		for (int i = 0; i < 40; ++i) {
+			total += data(i).size();
+		}
+		BOOST_CHECK (spill.bytes_written() <= total);
+		BOOST_CHECK (boost::filesystem::exists (path));
+	}
+
+	BOOST_CHECK (!boost::filesystem::exists (path));
+}
+
+/** Frames can be taken back with get() before they have been written, including while
+ *  the spill's thread is busy writing an earlier batch, without upsetting that thread
+ *  or leaving their bytes counted as waiting to be written.
+ */
+BOOST_AUTO_TEST_CASE (frame_spill_get_before_write_test)
+{
+	boost::filesystem::path const path = "build/test/frame_spill_get_before_write_test.spill";
+	boost::filesystem::remove (path);
+
+	{
+		FrameSpill spill (path, 4096);
+
+		for (int i = 0; i < 4; ++i) {
+			/* A large frame to keep the thread busy writing... */
+			QueueItem big = frame (100 + i);
+			dcp::Data big_data (64 * 1024 * 1024);
+			memset (big_data.data().get(), i, big_data.size());
+			spill.put (big, big_data);
+
+			/* ...while we put some more and take them straight back */
+			for (int j = 0; j < 10; ++j) {
+				spill.put (frame(i * 10 + j), data(i * 10 + j));
+				check (spill.get(frame(i * 10 + j)), i * 10 + j);
+			}
+
+			dcp::Data back = spill.get (big);
+			BOOST_REQUIRE_EQUAL (back.size(), big_data.size());
+			BOOST_CHECK (memcmp (back.data().get(), big_data.data().get(), back.size()) == 0);
+
+			/* Nothing is left waiting to be written, so this must not block or throw */
+			spill.wait_for_space ();
+		}
+
+		BOOST_CHECK_EQUAL (spill.memory_used(), 0);
+	}
+
+	BOOST_CHECK (!boost::filesystem::exists (path));
+}
@@ -0,0 +1,102 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/image_pool_test.cc
+ *  @brief Test ImagePool.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/image.h"
+#include "lib/image_pool.h"
+#include <boost/test/unit_test.hpp>
+
+using boost::shared_ptr;
+
+/** Memory from a destroyed Image is given to the next Image of the same format and size */
+BOOST_AUTO_TEST_CASE (image_pool_test1)
+{
+	ImagePool* pool = ImagePool::instance ();
+	pool->clear ();
+	ImagePool::Statistics const before = pool->statistics ();
+
+	shared_ptr<Image> a (new Image (AV_PIX_FMT_RGB48LE, dcp::Size (640, 480), true));
+	uint8_t* const a_data = a->data()[0];
+	BOOST_CHECK_EQUAL (pool->statistics().misses, before.misses + 1);
+	BOOST_CHECK_EQUAL (pool->statistics().in_use, before.in_use + a->memory_used() + 640 * 6 + 32);
+
+	a.reset ();
+	BOOST_CHECK (pool->statistics().idle > 0);
+
+	/* Different size: new memory */
+	shared_ptr<Image> b (new Image (AV_PIX_FMT_RGB48LE, dcp::Size (640, 482), true));
+	BOOST_CHECK_EQUAL (pool->statistics().misses, before.misses + 2);
+	/* Different alignment: new memory */
+	shared_ptr<Image> c (new Image (AV_PIX_FMT_RGB48LE, dcp::Size (640, 480), false));
+	BOOST_CHECK_EQUAL (pool->statistics().misses, before.misses + 3);
+
+	/* Same format and size: a's memory */
+	shared_ptr<Image> d (new Image (AV_PIX_FMT_RGB48LE, dcp::Size (640, 480), true));
+	BOOST_CHECK_EQUAL (pool->statistics().hits, before.hits + 1);
+	BOOST_CHECK (d->data()[0] == a_data);
+	BOOST_CHECK_EQUAL (d->stride()[0], 640 * 6);
+	BOOST_CHECK_EQUAL (d->line_size()[0], 640 * 6);
+
+	b.reset ();
+	c.reset ();
+	d.reset ();
+	BOOST_CHECK_EQUAL (pool->statistics().in_use, before.in_use);
+
+	pool->clear ();
+	BOOST_CHECK_EQUAL (pool->statistics().idle, 0U);
+}
+
+/** The pool frees the memory that was returned longest ago when it is over its limit */
+BOOST_AUTO_TEST_CASE (image_pool_test2)
+{
+	ImagePool* pool = ImagePool::instance ();
+	pool->clear ();
+	size_t const old_limit = pool->idle_limit ();
+
+	shared_ptr<Image> a (new Image (AV_PIX_FMT_RGB24, dcp::Size (256, 256), true));
+	shared_ptr<Image> b (new Image (AV_PIX_FMT_RGB24, dcp::Size (256, 257), true));
+	shared_ptr<Image> c (new Image (AV_PIX_FMT_RGB24, dcp::Size (256, 258), true));
+
+	/* Room for two of them */
+	pool->set_idle_limit (a->memory_used() * 2 + c->memory_used());
+
+	a.reset ();
+	b.reset ();
+	c.reset ();
+
+	uint64_t const hits = pool->statistics().hits;
+	shared_ptr<Image> d (new Image (AV_PIX_FMT_RGB24, dcp::Size (256, 256), true));
+	BOOST_CHECK_EQUAL (pool->statistics().hits, hits);
+	shared_ptr<Image> e (new Image (AV_PIX_FMT_RGB24, dcp::Size (256, 258), true));
+	BOOST_CHECK_EQUAL (pool->statistics().hits, hits + 1);
+
+	/* With a limit of 0 nothing is kept */
+	pool->set_idle_limit (0);
+	BOOST_CHECK_EQUAL (pool->statistics().idle, 0U);
+	d.reset ();
+	BOOST_CHECK_EQUAL (pool->statistics().idle, 0U);
+
+	pool->set_idle_limit (old_limit);
+	pool->clear ();
+}
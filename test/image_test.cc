@@ -26,7 +26,13 @@
 
 #include "lib/image.h"
 #include "lib/ffmpeg_image_proxy.h"
+#include "lib/xyz_converter.h"
+#include "lib/colour_conversion.h"
 #include "test.h"
+#include <dcp/openjpeg_image.h>
+#include <dcp/colour_conversion.h>
+#include <dcp/transfer_function.h>
+#include <dcp/rgb_xyz.h>
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
@@ -34,6 +40,7 @@ using std::string;
 using std::list;
 using std::cout;
 using boost::shared_ptr;
+using boost::optional;
 
 BOOST_AUTO_TEST_CASE (aligned_image_test)
 {
@@ -188,6 +195,120 @@ BOOST_AUTO_TEST_CASE (alpha_blend_test)
 	alpha_blend_test_one (AV_PIX_FMT_YUV422P10LE, "yuv422p10le");
 }
 
+/** The blend that Image::alpha_blend should do for each sample */
+template <class T>
+static void
+blend_reference (T& t, int o, uint8_t a)
+{
+	float const alpha = float (a) / 255;
+	t = o * alpha + t * (1 - alpha);
+}
+
+/** Check Image::alpha_blend with packed formats against a simple implementation of the same thing,
+ *  using an overlay with transparent, opaque and partially transparent parts which overlaps
+ *  the edges of the image.
+ */
+static void
+alpha_blend_test2_one (AVPixelFormat format, AVPixelFormat overlay_format, Position<int> position)
+{
+	shared_ptr<Image> image (new Image (format, dcp::Size(203, 117), false));
+	for (int y = 0; y < image->size().height; ++y) {
+		uint8_t* p = image->data()[0] + y * image->stride()[0];
+		for (int x = 0; x < image->line_size()[0]; ++x) {
+			*p++ = (x * 7 + y * 3) & 0xff;
+		}
+	}
+
+	shared_ptr<Image> overlay (new Image (overlay_format, dcp::Size(97, 61), false));
+	overlay->make_transparent ();
+	for (int y = 4; y < overlay->size().height; ++y) {
+		uint8_t* p = overlay->data()[0] + y * overlay->stride()[0];
+		for (int x = 9; x < (y % 13) + 70; ++x) {
+			p[x * 4 + 0] = x + y;
+			p[x * 4 + 1] = x * 2;
+			p[x * 4 + 2] = y * 5;
+			p[x * 4 + 3] = (x % 3) ? 255 : (x * y);
+		}
+	}
+
+	shared_ptr<Image> ref (new Image (*image.get()));
+
+	int const blue = overlay_format == AV_PIX_FMT_BGRA ? 0 : 2;
+	int const red = overlay_format == AV_PIX_FMT_BGRA ? 2 : 0;
+	dcp::ColourConversion conv = dcp::ColourConversion::srgb_to_xyz();
+	double matrix[9];
+	dcp::combined_rgb_to_xyz (conv, matrix);
+	double const * lut_in = conv.in()->lut (8, false);
+	double const * lut_out = conv.out()->lut (16, true);
+
+	int const start_tx = std::max (0, position.x);
+	int const start_ty = std::max (0, position.y);
+	for (int ty = start_ty, oy = start_ty - position.y; ty < ref->size().height && oy < overlay->size().height; ++ty, ++oy) {
+		for (int tx = start_tx, i = 0; tx < ref->size().width && (tx - position.x) < overlay->size().width; ++tx, ++i) {
+			/* Image::alpha_blend reads the overlay from the start of each line */
+			uint8_t const * op = overlay->data()[0] + oy * overlay->stride()[0] + i * 4;
+			uint8_t* tp = ref->data()[0] + ty * ref->stride()[0];
+			switch (format) {
+			case AV_PIX_FMT_RGB24:
+				tp += tx * 3;
+				blend_reference (tp[0], op[red], op[3]);
+				blend_reference (tp[1], op[1], op[3]);
+				blend_reference (tp[2], op[blue], op[3]);
+				break;
+			case AV_PIX_FMT_BGRA:
+			case AV_PIX_FMT_RGBA:
+				tp += tx * 4;
+				blend_reference (tp[0], format == AV_PIX_FMT_BGRA ? op[blue] : op[red], op[3]);
+				blend_reference (tp[1], op[1], op[3]);
+				blend_reference (tp[2], format == AV_PIX_FMT_BGRA ? op[red] : op[blue], op[3]);
+				blend_reference (tp[3], op[3], op[3]);
+				break;
+			case AV_PIX_FMT_RGB48LE:
+				tp += tx * 6;
+				blend_reference (tp[1], op[red], op[3]);
+				blend_reference (tp[3], op[1], op[3]);
+				blend_reference (tp[5], op[blue], op[3]);
+				break;
+			case AV_PIX_FMT_XYZ12LE:
+			{
+				uint16_t* xyz = reinterpret_cast<uint16_t*> (tp + tx * 6);
+				double const r = lut_in[op[red]];
+				double const g = lut_in[op[1]];
+				double const b = lut_in[op[blue]];
+				for (int c = 0; c < 3; ++c) {
+					double const v = std::max (0.0, std::min (65535.0, r * matrix[c * 3] + g * matrix[c * 3 + 1] + b * matrix[c * 3 + 2]));
+					blend_reference (xyz[c], lrint(lut_out[lrint(v)] * 65535), op[3]);
+				}
+				break;
+			}
+			default:
+				BOOST_REQUIRE (false);
+			}
+		}
+	}
+
+	image->alpha_blend (overlay, position);
+
+	for (int y = 0; y < image->size().height; ++y) {
+		uint8_t const * p = image->data()[0] + y * image->stride()[0];
+		uint8_t const * q = ref->data()[0] + y * ref->stride()[0];
+		BOOST_REQUIRE_MESSAGE (memcmp (p, q, image->line_size()[0]) == 0, "line " << y << " differs");
+	}
+}
+
+BOOST_AUTO_TEST_CASE (alpha_blend_test2)
+{
+	AVPixelFormat const formats[] = {
+		AV_PIX_FMT_RGB24, AV_PIX_FMT_BGRA, AV_PIX_FMT_RGBA, AV_PIX_FMT_RGB48LE, AV_PIX_FMT_XYZ12LE
+	};
+
+	for (size_t i = 0; i < sizeof(formats) / sizeof(AVPixelFormat); ++i) {
+		alpha_blend_test2_one (formats[i], AV_PIX_FMT_BGRA, Position<int>(13, 17));
+		alpha_blend_test2_one (formats[i], AV_PIX_FMT_RGBA, Position<int>(-5, -9));
+		alpha_blend_test2_one (formats[i], AV_PIX_FMT_BGRA, Position<int>(150, 90));
+	}
+}
+
 /** Test merge (list<PositionImage>) with a single image */
 BOOST_AUTO_TEST_CASE (merge_test1)
 {
@@ -367,3 +488,51 @@ BOOST_AUTO_TEST_CASE (fade_test)
 	fade_test_format_red   (AV_PIX_FMT_RGB48LE,   0.5, "rgb48le_50");
 	fade_test_format_red   (AV_PIX_FMT_RGB48LE,   1,   "rgb48le_100");
 }
+
+/** Check that Image::crop_scale_window_xyz gives the same results as crop_scale_window, alpha_blend,
+ *  fade and conversion to XYZ done one after the other.
+ */
+static void
+crop_scale_window_xyz_test_one (AVPixelFormat format, Crop crop, dcp::Size inter_size, dcp::Size out_size, Position<int> text_position, optional<float> fade)
+{
+	shared_ptr<FFmpegImageProxy> proxy(new FFmpegImageProxy("test/data/player_seek_test_0.png"));
+	shared_ptr<Image> in = proxy->image().first->convert_pixel_format(dcp::YUV_TO_RGB_REC709, format, true, false);
+
+	shared_ptr<Image> text (new Image(AV_PIX_FMT_BGRA, dcp::Size(317, 93), true));
+	for (int y = 0; y < text->size().height; ++y) {
+		uint8_t* p = text->data()[0] + y * text->stride()[0];
+		for (int x = 0; x < text->size().width; ++x) {
+			*p++ = x;
+			*p++ = y;
+			*p++ = x + y;
+			*p++ = (x * 3 + y) & 0xff;
+		}
+	}
+
+	ColourConversion const conversion (dcp::ColourConversion::rec709_to_xyz());
+	shared_ptr<const XYZConverter> converter = XYZConverter::get (conversion);
+
+	shared_ptr<Image> rgb = in->crop_scale_window (crop, inter_size, out_size, dcp::YUV_TO_RGB_REC709, AV_PIX_FMT_RGB48LE, true, false);
+	rgb->alpha_blend (text, text_position);
+	if (fade) {
+		rgb->fade (fade.get());
+	}
+	shared_ptr<dcp::OpenJPEGImage> ref = converter->convert (rgb->data()[0], rgb->size(), rgb->stride()[0]);
+
+	shared_ptr<dcp::OpenJPEGImage> check = in->crop_scale_window_xyz (
+		crop, inter_size, out_size, dcp::YUV_TO_RGB_REC709, false, text, text_position, fade, *converter, optional<dcp::NoteHandler>()
+		);
+
+	for (int c = 0; c < 3; ++c) {
+		BOOST_REQUIRE (std::equal(ref->data(c), ref->data(c) + out_size.width * out_size.height, check->data(c)));
+	}
+}
+
+BOOST_AUTO_TEST_CASE (crop_scale_window_xyz_test)
+{
+	crop_scale_window_xyz_test_one (AV_PIX_FMT_RGB24, Crop(), dcp::Size(1998, 1080), dcp::Size(1998, 1080), Position<int>(50, 60), optional<float>());
+	crop_scale_window_xyz_test_one (AV_PIX_FMT_YUV420P, Crop(), dcp::Size(1998, 836), dcp::Size(1998, 1080), Position<int>(-20, 100), 0.5);
+	crop_scale_window_xyz_test_one (AV_PIX_FMT_RGB24, Crop(512, 0, 0, 0), dcp::Size(1486, 1080), dcp::Size(1998, 1080), Position<int>(1800, 1000), 0.25);
+	crop_scale_window_xyz_test_one (AV_PIX_FMT_YUV422P10, Crop(10, 20, 30, 40), dcp::Size(1440, 800), dcp::Size(2048, 858), Position<int>(0, 0), optional<float>());
+	crop_scale_window_xyz_test_one (AV_PIX_FMT_RGB48LE, Crop(100, 0, 7, 9), dcp::Size(1340, 1064), dcp::Size(1998, 1080), Position<int>(300, -40), 0.75);
+}
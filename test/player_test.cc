@@ -29,6 +29,7 @@
 #include "lib/ratio.h"
 #include "lib/audio_buffers.h"
 #include "lib/player.h"
+#include "lib/player_video.h"
 #include "lib/video_content.h"
 #include "lib/image_content.h"
 #include "lib/string_text_file_content.h"
@@ -46,6 +47,7 @@
 using std::cout;
 using std::list;
 using std::pair;
+using std::string;
 using boost::shared_ptr;
 using boost::bind;
 using boost::optional;
@@ -398,3 +400,193 @@ BOOST_AUTO_TEST_CASE (player_silence_at_end_crash)
 	film2->make_dcp ();
 	BOOST_REQUIRE (!wait_for_jobs());
 }
+
+static void
+record_video (list<string>* out, shared_ptr<PlayerVideo>, DCPTime time)
+{
+	out->push_back (String::compose("V %1", time.get()));
+}
+
+static void
+record_audio (list<string>* out, shared_ptr<AudioBuffers> audio, DCPTime time)
+{
+	out->push_back (String::compose("A %1 %2", time.get(), audio->frames()));
+}
+
+static void
+record_text (list<string>* out, PlayerText, TextType type, optional<DCPTextTrack>, DCPTimePeriod period)
+{
+	out->push_back (String::compose("T %1 %2 %3", static_cast<int>(type), period.from.get(), period.to.get()));
+}
+
+static list<string>
+player_output (shared_ptr<Film> film, bool decode_ahead)
+{
+	shared_ptr<Player> player (new Player(film, film->playlist()));
+	if (decode_ahead) {
+		player->set_decode_ahead ();
+	}
+
+	list<string> out;
+	player->Video.connect (bind (&record_video, &out, _1, _2));
+	player->Audio.connect (bind (&record_audio, &out, _1, _2));
+	player->Text.connect (bind (&record_text, &out, _1, _2, _3, _4));
+
+	for (int i = 0; i < 48; ++i) {
+		player->pass ();
+	}
+	player->seek (DCPTime::from_seconds(1), true);
+	while (!player->pass ()) {}
+
+	return out;
+}
+
+/** Check that decoding ahead on other threads doesn't change what the player emits */
+BOOST_AUTO_TEST_CASE (player_decode_ahead_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("player_decode_ahead_test");
+	film->set_audio_channels (6);
+
+	shared_ptr<Content> video = content_factory("test/data/test.mp4").front();
+	film->examine_and_add_content (video);
+	shared_ptr<Content> audio = content_factory("test/data/white.wav").front();
+	film->examine_and_add_content (audio);
+	shared_ptr<Content> text = content_factory("test/data/subrip.srt").front();
+	film->examine_and_add_content (text);
+	BOOST_REQUIRE (!wait_for_jobs());
+	text->only_text()->set_use (true);
+
+	list<string> A = player_output (film, false);
+	list<string> B = player_output (film, true);
+	BOOST_CHECK (!A.empty());
+	BOOST_CHECK (A == B);
+}
+
+static void
+record_black (list<shared_ptr<PlayerVideo> >* out, shared_ptr<PlayerVideo> video)
+{
+	if (video->black()) {
+		out->push_back (video);
+	}
+}
+
+static void
+record_silence (list<shared_ptr<AudioBuffers> >* out, shared_ptr<AudioBuffers> audio)
+{
+	out->push_back (audio);
+}
+
+/** Check that the player re-uses its black image and silent buffers when filling gaps */
+BOOST_AUTO_TEST_CASE (player_shared_fill_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("player_shared_fill_test");
+	film->set_audio_channels (6);
+
+	shared_ptr<Content> content = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (content);
+	BOOST_REQUIRE (!wait_for_jobs());
+	content->video->set_length (24);
+	content->set_position (film, DCPTime::from_seconds(2));
+
+	shared_ptr<Player> player (new Player(film, film->playlist()));
+	list<shared_ptr<PlayerVideo> > black;
+	list<shared_ptr<AudioBuffers> > silence;
+	player->Video.connect (bind (&record_black, &black, _1));
+	player->Audio.connect (bind (&record_silence, &silence, _1));
+	while (!player->pass ()) {}
+
+	BOOST_REQUIRE_EQUAL (black.size(), 48U);
+	for (list<shared_ptr<PlayerVideo> >::const_iterator i = ++black.begin(); i != black.end(); ++i) {
+		/* Each frame is its own PlayerVideo (as texts may be burnt into it) but they share their image */
+		BOOST_CHECK (*i != black.front());
+		BOOST_CHECK ((*i)->same(black.front()));
+	}
+
+	BOOST_REQUIRE (silence.size() > 2);
+	BOOST_CHECK (silence.front() == *(++silence.begin()));
+}
+
+struct FirstOutput
+{
+	FirstOutput ()
+		: video_black (false)
+	{}
+
+	optional<DCPTime> video_time;
+	bool video_black;
+	optional<DCPTime> audio_time;
+	shared_ptr<AudioBuffers> audio;
+};
+
+static void
+record_first_video (FirstOutput* out, shared_ptr<PlayerVideo> video, DCPTime time)
+{
+	if (!out->video_time) {
+		out->video_time = time;
+		out->video_black = video->black ();
+	}
+}
+
+static void
+record_first_audio (FirstOutput* out, shared_ptr<AudioBuffers> audio, DCPTime time)
+{
+	if (!out->audio_time) {
+		out->audio_time = time;
+		out->audio = audio;
+	}
+}
+
+static FirstOutput
+player_first_output (shared_ptr<Film> film, bool decode_ahead)
+{
+	shared_ptr<Player> player (new Player(film, film->playlist()));
+	if (decode_ahead) {
+		player->set_decode_ahead ();
+	}
+
+	FirstOutput out;
+	player->Video.connect (bind (&record_first_video, &out, _1, _2));
+	player->Audio.connect (bind (&record_first_audio, &out, _1, _2));
+	while (!out.video_time || !out.audio_time) {
+		BOOST_REQUIRE (!player->pass ());
+	}
+	return out;
+}
+
+/** Check that nothing that a decoder emits straight away is lost when decoding ahead */
+BOOST_AUTO_TEST_CASE (player_decode_ahead_first_output_test)
+{
+	shared_ptr<Film> film = new_test_film2 ("player_decode_ahead_first_output_test");
+	film->set_audio_channels (6);
+
+	shared_ptr<Content> video = content_factory("test/data/flat_red.png").front();
+	film->examine_and_add_content (video);
+	shared_ptr<Content> audio = content_factory("test/data/white.wav").front();
+	film->examine_and_add_content (audio);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	FirstOutput A = player_first_output (film, false);
+	FirstOutput B = player_first_output (film, true);
+
+	/* The first frame is the content's, not black fill standing in for a lost one */
+	BOOST_REQUIRE (B.video_time);
+	BOOST_CHECK (*B.video_time == DCPTime());
+	BOOST_CHECK (!B.video_black);
+
+	/* and the first audio samples are the content's, not silence */
+	BOOST_REQUIRE (A.audio);
+	BOOST_REQUIRE (B.audio);
+	BOOST_CHECK (*B.audio_time == DCPTime());
+	BOOST_REQUIRE_EQUAL (A.audio->frames(), B.audio->frames());
+	BOOST_REQUIRE_EQUAL (A.audio->channels(), B.audio->channels());
+	bool silent = true;
+	for (int i = 0; i < A.audio->channels(); ++i) {
+		for (int j = 0; j < A.audio->frames(); ++j) {
+			BOOST_REQUIRE_EQUAL (A.audio->data(i)[j], B.audio->data(i)[j]);
+			if (B.audio->data(i)[j] != 0) {
+				silent = false;
+			}
+		}
+	}
+	BOOST_CHECK (!silent);
+}
@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/reel_reuse_test.cc
+ *  @brief Check that complete picture assets are re-used when a DCP is made again.
+ *  @ingroup specific
+ */
+
+#include "lib/film.h"
+#include "lib/image_content.h"
+#include "lib/dcp_content_type.h"
+#include "lib/video_content.h"
+#include "test.h"
+#include <dcp/dcp.h>
+#include <dcp/cpl.h>
+#include <dcp/reel.h>
+#include <dcp/reel_picture_asset.h>
+#include <dcp/mono_picture_asset.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+using std::list;
+using std::string;
+using std::vector;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_CASE (reel_reuse_test)
+{
+	shared_ptr<Film> film = new_test_film ("reel_reuse_test");
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TST"));
+	film->set_name ("reel_reuse_test");
+	shared_ptr<ImageContent> r (new ImageContent("test/data/flat_red.png"));
+	shared_ptr<ImageContent> g (new ImageContent("test/data/flat_green.png"));
+	film->examine_and_add_content (r);
+	film->examine_and_add_content (g);
+	film->set_reel_type (REELTYPE_BY_VIDEO_CONTENT);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	list<DCPTimePeriod> reels = film->reels ();
+	BOOST_REQUIRE_EQUAL (reels.size(), 2U);
+
+	vector<string> ids;
+	BOOST_FOREACH (DCPTimePeriod i, reels) {
+		BOOST_CHECK (boost::filesystem::exists(film->picture_digest_file(i)));
+		dcp::MonoPictureAsset asset (film->internal_video_asset_dir() / film->internal_video_asset_filename(i));
+		ids.push_back (asset.id());
+	}
+
+	/* Changing the name doesn't change the video, so the same assets should be used again */
+	film->set_name ("reel_reuse_test2");
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	dcp::DCP dcp (film->dir (film->dcp_name ()));
+	dcp.read ();
+	BOOST_REQUIRE_EQUAL (dcp.cpls().size(), 1U);
+	list<shared_ptr<dcp::Reel> > dcp_reels = dcp.cpls().front()->reels ();
+	BOOST_REQUIRE_EQUAL (dcp_reels.size(), 2U);
+
+	list<shared_ptr<dcp::Reel> >::const_iterator i = dcp_reels.begin ();
+	for (size_t j = 0; j < ids.size(); ++j) {
+		BOOST_REQUIRE ((*i)->main_picture());
+		BOOST_CHECK_EQUAL ((*i)->main_picture()->asset()->id(), ids[j]);
+		/* The digest that we saved should be the one in the CPL */
+		BOOST_REQUIRE ((*i)->main_picture()->hash());
+		BOOST_CHECK_EQUAL ((*i)->main_picture()->hash().get(), (*i)->main_picture()->asset()->hash());
+		++i;
+	}
+}
+
+/** Check that changing the content in one reel does not stop the others' assets being re-used */
+BOOST_AUTO_TEST_CASE (reel_reuse_test2)
+{
+	shared_ptr<Film> film = new_test_film ("reel_reuse_test2");
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TST"));
+	film->set_name ("reel_reuse_test2");
+	shared_ptr<ImageContent> r (new ImageContent("test/data/flat_red.png"));
+	shared_ptr<ImageContent> g (new ImageContent("test/data/flat_green.png"));
+	film->examine_and_add_content (r);
+	film->examine_and_add_content (g);
+	film->set_reel_type (REELTYPE_BY_VIDEO_CONTENT);
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	list<DCPTimePeriod> reels = film->reels ();
+	BOOST_REQUIRE_EQUAL (reels.size(), 2U);
+
+	string const first_id = dcp::MonoPictureAsset(film->internal_video_asset_dir() / film->internal_video_asset_filename(reels.front())).id();
+	boost::filesystem::path const second_asset = film->internal_video_asset_dir() / film->internal_video_asset_filename(reels.back());
+	string const second_id = dcp::MonoPictureAsset(second_asset).id();
+
+	/* Change the video in the second reel only */
+	g->video->set_left_crop (8);
+	BOOST_CHECK (film->internal_video_asset_dir() / film->internal_video_asset_filename(reels.back()) != second_asset);
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	dcp::DCP dcp (film->dir (film->dcp_name ()));
+	dcp.read ();
+	BOOST_REQUIRE_EQUAL (dcp.cpls().size(), 1U);
+	list<shared_ptr<dcp::Reel> > dcp_reels = dcp.cpls().front()->reels ();
+	BOOST_REQUIRE_EQUAL (dcp_reels.size(), 2U);
+	BOOST_REQUIRE (dcp_reels.front()->main_picture());
+	BOOST_REQUIRE (dcp_reels.back()->main_picture());
+	BOOST_CHECK_EQUAL (dcp_reels.front()->main_picture()->asset()->id(), first_id);
+	BOOST_CHECK (dcp_reels.back()->main_picture()->asset()->id() != second_id);
+}
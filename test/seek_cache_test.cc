@@ -0,0 +1,127 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/seek_cache_test.cc
+ *  @brief Test SeekCache.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/seek_cache.h"
+#include "lib/player_video.h"
+#include "lib/raw_image_proxy.h"
+#include "lib/image.h"
+#include "lib/colour_conversion.h"
+#include <boost/test/unit_test.hpp>
+
+using std::list;
+using std::pair;
+using boost::shared_ptr;
+using boost::optional;
+
+static shared_ptr<PlayerVideo>
+frame (Eyes eyes = EYES_BOTH)
+{
+	shared_ptr<Image> image (new Image(AV_PIX_FMT_RGB24, dcp::Size(64, 64), true));
+	image->make_black ();
+	return shared_ptr<PlayerVideo> (
+		new PlayerVideo (
+			shared_ptr<const ImageProxy>(new RawImageProxy(image)),
+			Crop(),
+			optional<double>(),
+			dcp::Size(64, 64),
+			dcp::Size(64, 64),
+			eyes,
+			PART_WHOLE,
+			PresetColourConversion::all().front().conversion,
+			boost::weak_ptr<Content>(),
+			optional<Frame>()
+			)
+		);
+}
+
+static DCPTime
+at (int f)
+{
+	return DCPTime::from_frames (f, 24);
+}
+
+/** Frames are only stored and returned for the current identifier, and the least recently used go first */
+BOOST_AUTO_TEST_CASE (seek_cache_test1)
+{
+	SeekCache cache;
+
+	/* No identifier yet, so nothing is kept */
+	cache.put (frame(), at(0));
+	BOOST_CHECK_EQUAL (cache.size(), 0);
+
+	cache.set_identifier ("A", 24);
+	for (int i = 0; i < SeekCache::maximum_frames + 10; ++i) {
+		cache.put (frame(), at(i));
+	}
+	BOOST_CHECK_EQUAL (cache.size(), SeekCache::maximum_frames);
+	BOOST_CHECK (cache.get(at(5)).empty());
+
+	list<pair<shared_ptr<PlayerVideo>, DCPTime> > f = cache.get (at(20));
+	BOOST_REQUIRE_EQUAL (f.size(), 1U);
+	BOOST_CHECK (f.front().second == at(20));
+
+	/* A seek to between frames gives the next one */
+	f = cache.get (at(20) + DCPTime(1));
+	BOOST_REQUIRE_EQUAL (f.size(), 1U);
+	BOOST_CHECK (f.front().second == at(21));
+
+	/* at(20) was just used, so it survives when at(10) does not */
+	cache.put (frame(), at(100));
+	BOOST_CHECK_EQUAL (cache.get(at(20)).size(), 1U);
+	BOOST_CHECK (cache.get(at(10)).empty());
+
+	cache.set_identifier ("B", 24);
+	BOOST_CHECK (cache.get(at(20)).empty());
+	cache.invalidate ();
+	cache.put (frame(), at(20));
+	BOOST_CHECK (cache.get(at(20)).empty());
+	cache.set_identifier ("A", 24);
+	BOOST_CHECK_EQUAL (cache.get(at(20)).size(), 1U);
+}
+
+/** 3D frames are only returned once we have both eyes */
+BOOST_AUTO_TEST_CASE (seek_cache_test2)
+{
+	SeekCache cache;
+	cache.set_identifier ("A", 24);
+
+	cache.put (frame(EYES_LEFT), at(4));
+	BOOST_CHECK (cache.get(at(4)).empty());
+	cache.put (frame(EYES_RIGHT), at(4));
+	BOOST_CHECK_EQUAL (cache.get(at(4)).size(), 2U);
+}
+
+/** prefetch_from() asks for the frames before a seek unless we already have them */
+BOOST_AUTO_TEST_CASE (seek_cache_test3)
+{
+	SeekCache cache;
+	cache.set_identifier ("A", 24);
+
+	BOOST_CHECK (cache.prefetch_from(at(100)) == at(100 - SeekCache::prefetch_behind));
+	BOOST_CHECK (cache.prefetch_from(at(3)) == DCPTime());
+
+	cache.put (frame(), at(99));
+	BOOST_CHECK (cache.prefetch_from(at(100)) == at(100));
+}
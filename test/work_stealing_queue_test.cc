@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/work_stealing_queue_test.cc
+ *  @brief Test WorkStealingQueue.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/work_stealing_queue.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <set>
+
+using std::list;
+using std::set;
+
+/** Items pushed with no workers are taken by the first worker to arrive */
+BOOST_AUTO_TEST_CASE (work_stealing_queue_test1)
+{
+	WorkStealingQueue<int> queue;
+	queue.push (1);
+	queue.push (2);
+	BOOST_CHECK_EQUAL (queue.size(), 2U);
+
+	int const w = queue.add_worker ();
+	BOOST_CHECK_EQUAL (queue.pop(w), 1);
+	BOOST_CHECK_EQUAL (queue.pop(w), 2);
+	BOOST_CHECK (queue.empty());
+}
+
+/** A worker steals from another when its own deque is empty, and items from
+ *  a removed worker are not lost.
+ */
+BOOST_AUTO_TEST_CASE (work_stealing_queue_test2)
+{
+	WorkStealingQueue<int> queue;
+	int const a = queue.add_worker ();
+	int const b = queue.add_worker ();
+
+	for (int i = 0; i < 4; ++i) {
+		queue.push (i);
+	}
+
+	/* a's deque has 0 and 2; b's has 1 and 3 */
+	BOOST_CHECK_EQUAL (queue.pop(a), 0);
+	BOOST_CHECK_EQUAL (queue.pop(a), 2);
+	/* now a steals from b */
+	BOOST_CHECK_EQUAL (queue.pop(a), 1);
+
+	queue.push_front (b, 42);
+	queue.remove_worker (b);
+	BOOST_CHECK_EQUAL (queue.workers(), 1);
+
+	set<int> rest;
+	rest.insert (queue.pop(a));
+	rest.insert (queue.pop(a));
+	BOOST_CHECK (rest.find(3) != rest.end());
+	BOOST_CHECK (rest.find(42) != rest.end());
+	BOOST_CHECK (queue.empty());
+}
+
+static void
+consume (WorkStealingQueue<int>* queue, int worker, boost::mutex* mutex, set<int>* seen)
+{
+	try {
+		while (true) {
+			int const i = queue->pop (worker);
+			boost::mutex::scoped_lock lm (*mutex);
+			seen->insert (i);
+		}
+	} catch (boost::thread_interrupted &) {
+
+	}
+}
+
+/** Many producers and consumers; every item must be taken exactly once */
+BOOST_AUTO_TEST_CASE (work_stealing_queue_test3)
+{
+	WorkStealingQueue<int> queue;
+	boost::mutex mutex;
+	set<int> seen;
+
+	boost::thread_group group;
+	for (int i = 0; i < 8; ++i) {
+		group.create_thread (boost::bind (&consume, &queue, queue.add_worker(), &mutex, &seen));
+	}
+
+	int const N = 10000;
+	for (int i = 0; i < N; ++i) {
+		queue.wait_for_space (17);
+		queue.push (i);
+	}
+
+	while (!queue.empty()) {
+		queue.wait_for_space (1);
+	}
+
+	group.interrupt_all ();
+	group.join_all ();
+
+	BOOST_CHECK (queue.take_all().empty());
+	BOOST_CHECK_EQUAL (seen.size(), size_t(N));
+}
@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/write_behind_test.cc
+ *  @brief Check that writing MXFs with write-behind gives the same results as writing without.
+ *  @ingroup specific
+ */
+
+#include "lib/film.h"
+#include "lib/config.h"
+#include "lib/content_factory.h"
+#include "lib/content.h"
+#include "test.h"
+#include <dcp/dcp.h>
+#include <dcp/cpl.h>
+#include <dcp/reel.h>
+#include <dcp/reel_mono_picture_asset.h>
+#include <dcp/reel_sound_asset.h>
+#include <dcp/mono_picture_asset.h>
+#include <dcp/mono_picture_asset_reader.h>
+#include <dcp/mono_picture_frame.h>
+#include <dcp/sound_asset.h>
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+
+using std::list;
+using std::string;
+using boost::shared_ptr;
+using boost::dynamic_pointer_cast;
+
+static shared_ptr<Film>
+make (string name, bool write_behind)
+{
+	bool const old = Config::instance()->write_behind ();
+	Config::instance()->set_write_behind (write_behind);
+
+	shared_ptr<Film> film = new_test_film2 (name);
+	film->set_reel_type (REELTYPE_BY_VIDEO_CONTENT);
+	film->examine_and_add_content (content_factory("test/data/flat_red.png").front());
+	film->examine_and_add_content (content_factory("test/data/flat_green.png").front());
+	film->examine_and_add_content (content_factory("test/data/staircase.wav").front());
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs());
+
+	Config::instance()->set_write_behind (old);
+	return film;
+}
+
+static list<shared_ptr<dcp::Reel> >
+reels (shared_ptr<Film> film)
+{
+	dcp::DCP dcp (film->dir (film->dcp_name ()));
+	dcp.read ();
+	BOOST_REQUIRE_EQUAL (dcp.cpls().size(), 1U);
+	return dcp.cpls().front()->reels ();
+}
+
+/** The MXF headers contain fresh UUIDs and timestamps on every encode so the files from two
+ *  encodes can never be byte-for-byte the same; instead, check that they are the same size and
+ *  that every picture and sound frame in them is identical.
+ */
+BOOST_AUTO_TEST_CASE (write_behind_test)
+{
+	list<shared_ptr<dcp::Reel> > without = reels (make ("write_behind_test_without", false));
+	list<shared_ptr<dcp::Reel> > with = reels (make ("write_behind_test_with", true));
+	BOOST_REQUIRE_EQUAL (without.size(), 2U);
+	BOOST_REQUIRE_EQUAL (with.size(), without.size());
+
+	list<shared_ptr<dcp::Reel> >::const_iterator i = without.begin ();
+	list<shared_ptr<dcp::Reel> >::const_iterator j = with.begin ();
+	for (; i != without.end(); ++i, ++j) {
+		shared_ptr<dcp::ReelMonoPictureAsset> ref_picture = dynamic_pointer_cast<dcp::ReelMonoPictureAsset> ((*i)->main_picture());
+		shared_ptr<dcp::ReelMonoPictureAsset> check_picture = dynamic_pointer_cast<dcp::ReelMonoPictureAsset> ((*j)->main_picture());
+		BOOST_REQUIRE (ref_picture);
+		BOOST_REQUIRE (check_picture);
+		BOOST_REQUIRE_EQUAL (ref_picture->intrinsic_duration(), check_picture->intrinsic_duration());
+		BOOST_CHECK_EQUAL (
+			boost::filesystem::file_size (ref_picture->asset()->file().get()),
+			boost::filesystem::file_size (check_picture->asset()->file().get())
+			);
+
+		shared_ptr<dcp::MonoPictureAssetReader> ref_reader = ref_picture->mono_asset()->start_read ();
+		shared_ptr<dcp::MonoPictureAssetReader> check_reader = check_picture->mono_asset()->start_read ();
+		for (int64_t k = 0; k < ref_picture->intrinsic_duration(); ++k) {
+			shared_ptr<const dcp::MonoPictureFrame> ref_frame = ref_reader->get_frame (k);
+			shared_ptr<const dcp::MonoPictureFrame> check_frame = check_reader->get_frame (k);
+			BOOST_REQUIRE_EQUAL (ref_frame->j2k_size(), check_frame->j2k_size());
+			BOOST_CHECK_MESSAGE (
+				memcmp (ref_frame->j2k_data(), check_frame->j2k_data(), ref_frame->j2k_size()) == 0,
+				"picture frame " << k << " differs"
+				);
+		}
+
+		BOOST_REQUIRE ((*i)->main_sound());
+		BOOST_REQUIRE ((*j)->main_sound());
+		BOOST_CHECK_EQUAL (
+			boost::filesystem::file_size ((*i)->main_sound()->asset()->file().get()),
+			boost::filesystem::file_size ((*j)->main_sound()->asset()->file().get())
+			);
+		check_mxf_audio_file ((*i)->main_sound()->asset()->file().get(), (*j)->main_sound()->asset()->file().get());
+	}
+}
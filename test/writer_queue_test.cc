@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/writer_queue_test.cc
+ *  @brief Test WriterQueue.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/writer_queue.h"
+#include <boost/test/unit_test.hpp>
+
+static QueueItem
+item (QueueItem::Type type, size_t reel, int frame, Eyes eyes)
+{
+	QueueItem i;
+	i.type = type;
+	i.reel = reel;
+	i.frame = frame;
+	i.eyes = eyes;
+	if (type == QueueItem::FULL) {
+		i.encoded = dcp::Data (64);
+	}
+	return i;
+}
+
+/** Items come out in (reel, frame, eyes) order whatever order they went in */
+BOOST_AUTO_TEST_CASE (writer_queue_test1)
+{
+	WriterQueue queue;
+	queue.push (item(QueueItem::FULL, 1, 0, EYES_LEFT));
+	queue.push (item(QueueItem::FAKE, 0, 5, EYES_RIGHT));
+	queue.push (item(QueueItem::REPEAT, 0, 5, EYES_LEFT));
+	queue.push (item(QueueItem::FULL, 0, 2, EYES_RIGHT));
+	queue.push (item(QueueItem::FULL, 0, 2, EYES_LEFT));
+	BOOST_CHECK_EQUAL (queue.size(), 5U);
+	BOOST_CHECK_EQUAL (queue.full_in_memory(), 3);
+	BOOST_CHECK_EQUAL (queue.full_in_memory_bytes(), 3 * 64);
+
+	BOOST_CHECK (queue.front() == item(QueueItem::FULL, 0, 2, EYES_LEFT));
+	BOOST_CHECK (queue.pop_front() == item(QueueItem::FULL, 0, 2, EYES_LEFT));
+	BOOST_CHECK (queue.pop_front() == item(QueueItem::FULL, 0, 2, EYES_RIGHT));
+	BOOST_CHECK_EQUAL (queue.full_in_memory(), 1);
+	BOOST_CHECK_EQUAL (queue.full_in_memory_bytes(), 64);
+	BOOST_CHECK (queue.pop_front() == item(QueueItem::REPEAT, 0, 5, EYES_LEFT));
+	BOOST_CHECK (queue.pop_front() == item(QueueItem::FAKE, 0, 5, EYES_RIGHT));
+	QueueItem last = queue.pop_front ();
+	BOOST_CHECK (last == item(QueueItem::FULL, 1, 0, EYES_LEFT));
+	BOOST_CHECK (last.encoded);
+	BOOST_CHECK (queue.empty());
+	BOOST_CHECK_EQUAL (queue.full_in_memory(), 0);
+	BOOST_CHECK_EQUAL (queue.full_in_memory_bytes(), 0);
+}
+
+/** The last FULL item in memory is the one to push to disk, and after that it stays in the queue without its data */
+BOOST_AUTO_TEST_CASE (writer_queue_test2)
+{
+	WriterQueue queue;
+	for (int i = 0; i < 16; ++i) {
+		queue.push (item(QueueItem::FULL, 0, (i * 7) % 16, EYES_BOTH));
+	}
+	queue.push (item(QueueItem::FAKE, 0, 16, EYES_BOTH));
+
+	for (int i = 15; i >= 10; --i) {
+		WriterQueue::const_iterator j = queue.last_full_in_memory ();
+		BOOST_CHECK_EQUAL (j->frame, i);
+		/* Things added while an item is being pushed to disk must not upset it */
+		queue.push (item(QueueItem::REPEAT, 0, 100 + i, EYES_BOTH));
+		queue.pushed_to_disk (j);
+	}
+
+	BOOST_CHECK_EQUAL (queue.size(), 23U);
+	BOOST_CHECK_EQUAL (queue.full_in_memory(), 10);
+	BOOST_CHECK_EQUAL (queue.full_in_memory_bytes(), 10 * 64);
+	BOOST_CHECK_EQUAL (queue.last_full_in_memory()->frame, 9);
+
+	for (int i = 0; i < 16; ++i) {
+		QueueItem const j = queue.pop_front ();
+		BOOST_CHECK_EQUAL (j.frame, i);
+		BOOST_CHECK_EQUAL (static_cast<bool> (j.encoded), i < 10);
+	}
+	BOOST_CHECK (queue.pop_front().type == QueueItem::FAKE);
+	BOOST_CHECK_EQUAL (queue.full_in_memory(), 0);
+	BOOST_CHECK_EQUAL (queue.front().frame, 110);
+}
+
+/** Each reel's part of the queue can be found and taken from independently */
+BOOST_AUTO_TEST_CASE (writer_queue_test3)
+{
+	WriterQueue queue;
+	queue.push (item(QueueItem::FULL, 2, 4, EYES_BOTH));
+	queue.push (item(QueueItem::FULL, 0, 7, EYES_BOTH));
+	queue.push (item(QueueItem::FULL, 2, 3, EYES_BOTH));
+	queue.push (item(QueueItem::FULL, 0, 6, EYES_BOTH));
+
+	BOOST_CHECK (queue.first(1) == queue.end());
+	BOOST_CHECK (queue.first(3) == queue.end());
+	BOOST_REQUIRE (queue.first(2) != queue.end());
+	BOOST_CHECK_EQUAL (queue.first(2)->frame, 3);
+
+	BOOST_CHECK (queue.pop(queue.first(2)) == item(QueueItem::FULL, 2, 3, EYES_BOTH));
+	BOOST_CHECK_EQUAL (queue.full_in_memory(), 3);
+	BOOST_CHECK_EQUAL (queue.first(2)->frame, 4);
+	BOOST_CHECK_EQUAL (queue.first(0)->frame, 6);
+	BOOST_CHECK (queue.front() == item(QueueItem::FULL, 0, 6, EYES_BOTH));
+}
@@ -0,0 +1,94 @@
+/*
+    Copyright (C) 2020 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/xyz_converter_test.cc
+ *  @brief Test XYZConverter against libdcp's RGB to XYZ conversion.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/xyz_converter.h"
+#include "lib/colour_conversion.h"
+#include <dcp/rgb_xyz.h>
+#include <dcp/openjpeg_image.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <vector>
+#include <cstdlib>
+
+using std::vector;
+using boost::shared_ptr;
+
+static int const implementations = 3;
+
+static vector<uint16_t>
+random_rgb48 (dcp::Size size, int stride)
+{
+	vector<uint16_t> rgb (size.height * stride / 2);
+	srand (42);
+	for (size_t i = 0; i < rgb.size(); ++i) {
+		rgb[i] = rand() & 0xffff;
+	}
+	return rgb;
+}
+
+static void
+count_notes (int* notes, dcp::NoteType, std::string)
+{
+	++(*notes);
+}
+
+/** Every implementation of XYZConverter that this CPU supports should give exactly the same
+ *  results as dcp::rgb_to_xyz, for all our preset conversions.  The width is chosen so that
+ *  the SIMD implementations also have some pixels left over at the end of each line.
+ */
+BOOST_AUTO_TEST_CASE (xyz_converter_test1)
+{
+	dcp::Size const size (211, 37);
+	/* Some padding at the end of each line, like an Image */
+	int const stride = size.width * 6 + 26;
+	vector<uint16_t> rgb = random_rgb48 (size, stride);
+	uint8_t const * data = reinterpret_cast<uint8_t const *> (&rgb[0]);
+
+	BOOST_FOREACH (PresetColourConversion const & i, PresetColourConversion::all()) {
+		int libdcp_notes = 0;
+		shared_ptr<dcp::OpenJPEGImage> ref = dcp::rgb_to_xyz (data, size, stride, i.conversion, dcp::NoteHandler (boost::bind (&count_notes, &libdcp_notes, _1, _2)));
+
+		for (int j = 0; j < implementations; ++j) {
+			XYZConverter::Implementation const imp = static_cast<XYZConverter::Implementation> (j);
+			if (!XYZConverter::supported (imp)) {
+				continue;
+			}
+
+			int notes = 0;
+			shared_ptr<dcp::OpenJPEGImage> check = XYZConverter::get(i.conversion)->convert (
+				data, size, stride, dcp::NoteHandler (boost::bind (&count_notes, &notes, _1, _2)), imp
+				);
+
+			BOOST_CHECK_EQUAL (notes, libdcp_notes);
+			for (int c = 0; c < 3; ++c) {
+				BOOST_REQUIRE_MESSAGE (
+					std::equal (ref->data(c), ref->data(c) + size.width * size.height, check->data(c)),
+					"implementation " << j << " differs from libdcp in component " << c << " for " << i.id
+					);
+			}
+		}
+	}
+}